@@ -0,0 +1,557 @@
+/* bench.c - cpkg 性能测试（make bench）
+ *
+ * 在临时工作目录中生成合成的包源码树，重复测量构建、安装、卸载与索引查找的耗时，
+ * 输出各项的中位数与分位数，并把结果写成 JSON；给出基线文件时逐项比较中位数。
+ *
+ * 用法: cpkg-bench [-n 次数] [-s 规模] [-o 结果.json] [-b 基线.json] [-t 阈值%] [-w 目录] [-k] [-v]
+ *   -n  每项重复次数（默认 10）
+ *   -s  合成数据的规模倍数（默认 1）
+ *   -o  结果文件（默认 bench.json）
+ *   -b  与基线结果比较，任一项中位数变慢超过阈值时返回 1
+ *   -t  回归阈值，百分比（默认 10）
+ *   -w  工作目录（默认在 /tmp 下新建，结束后删除）
+ *   -k  保留工作目录
+ *   -v  显示被测函数的输出
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/cpkg.h"
+#include "../include/index.h"
+#include "../include/repo.h"
+
+#define BENCH_MAX_RESULTS  32
+#define BENCH_NAME_LEN     64
+#define BENCH_PATH_LEN     (MAX_PATH_LEN * 4)   // 工作目录之下的路径
+
+typedef struct {
+    char name[BENCH_NAME_LEN];
+    double *samples;    // 毫秒
+    int count;
+} Bench_Result;
+
+typedef struct {
+    Bench_Result results[BENCH_MAX_RESULTS];
+    int nresults;
+    int runs;
+    int verbose;
+    int saved_stdout;
+} Bench;
+
+/* 合成的包源码树 */
+typedef struct {
+    const char *name;       // 包名（目录名为 bench-<name>）
+    int headers;            // 头文件数量
+    int header_size;        // 每个头文件的字节数
+    int depth;              // 头文件所在目录的层数
+    int libs;               // 库文件数量
+    size_t lib_size;        // 每个库文件的字节数
+} Tree_Spec;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static Bench_Result *result_get(Bench *b, const char *name)
+{
+    for (int i = 0; i < b->nresults; i++)
+        if (strcmp(b->results[i].name, name) == 0)
+            return &b->results[i];
+    if (b->nresults == BENCH_MAX_RESULTS)
+        return NULL;
+    Bench_Result *r = &b->results[b->nresults];
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->samples = calloc((size_t)b->runs, sizeof(double));
+    if (!r->samples)
+        return NULL;
+    b->nresults++;
+    return r;
+}
+
+static void record(Bench *b, const char *name, double ms)
+{
+    Bench_Result *r = result_get(b, name);
+    if (r && r->count < b->runs)
+        r->samples[r->count++] = ms;
+}
+
+/* 被测函数的输出（进度信息）不计入终端，避免刷屏；耗时仍包含格式化与写入 */
+static void quiet_begin(Bench *b)
+{
+    if (b->verbose)
+        return;
+    fflush(stdout);
+    b->saved_stdout = dup(STDOUT_FILENO);
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+    }
+}
+
+static void quiet_end(Bench *b)
+{
+    if (b->verbose || b->saved_stdout < 0)
+        return;
+    fflush(stdout);
+    dup2(b->saved_stdout, STDOUT_FILENO);
+    close(b->saved_stdout);
+    b->saved_stdout = -1;
+}
+
+/* ---- 合成数据 ---- */
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static int write_file(const char *path, const void *data, size_t len)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+        return -1;
+    size_t n = fwrite(data, 1, len, fp);
+    return (fclose(fp) == 0 && n == len) ? 0 : -1;
+}
+
+/**
+ * @brief 生成一个包源码树：头文件分布在 depth 层目录中，库文件为不可压缩的随机数据
+ * @param dir 包目录（包含 CPKG/control）
+ */
+static int make_tree(const char *dir, const Tree_Spec *t, int scale)
+{
+    char path[BENCH_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s/", dir, META_DIR_NAME);
+    if (mkdir_p(path, 0755) != 0)
+        return -1;
+
+    // 头文件：第 i 个放在 inc/d0/d1/.../d(i % depth) 下，文件名唯一（构建时复制到同一目录）
+    char *text = malloc((size_t)t->header_size + 1);
+    if (!text)
+        return -1;
+    for (int i = 0; i < t->header_size; i++)
+        text[i] = (char)('a' + (rng_next() % 26));
+    int headers = t->headers * scale;
+    for (int i = 0; i < headers; i++) {
+        int level = t->depth > 0 ? i % t->depth : 0;
+        int off = snprintf(path, sizeof(path), "%s/inc", dir);
+        for (int d = 0; d <= level && off < (int)sizeof(path) - 32; d++)
+            off += snprintf(path + off, sizeof(path) - (size_t)off, "/d%d", d);
+        snprintf(path + off, sizeof(path) - (size_t)off, "/");
+        if (mkdir_p(path, 0755) != 0) {
+            free(text);
+            return -1;
+        }
+        snprintf(path + off, sizeof(path) - (size_t)off, "/h%05d.h", i);
+        if (write_file(path, text, (size_t)t->header_size) != 0) {
+            free(text);
+            return -1;
+        }
+    }
+    free(text);
+
+    size_t lib_size = t->lib_size * (size_t)scale;
+    if (t->libs > 0) {
+        uint64_t *data = malloc(lib_size + sizeof(uint64_t));
+        if (!data)
+            return -1;
+        snprintf(path, sizeof(path), "%s/lib/", dir);
+        mkdir_p(path, 0755);
+        for (int i = 0; i < t->libs; i++) {
+            for (size_t w = 0; w < lib_size / sizeof(uint64_t) + 1; w++)
+                data[w] = rng_next();
+            snprintf(path, sizeof(path), "%s/lib/lib%s%d.a", dir, t->name, i);
+            if (write_file(path, data, lib_size) != 0) {
+                free(data);
+                return -1;
+            }
+        }
+        free(data);
+    }
+
+    FILE *fp;
+    snprintf(path, sizeof(path), "%s/%s/control", dir, META_DIR_NAME);
+    if ((fp = fopen(path, "w")) == NULL)
+        return -1;
+    fprintf(fp, "packet: bench-%s\nversion: 1.0\ndescription: synthetic benchmark package\n"
+                "author: bench\nlicense: MIT\n", t->name);
+    fprintf(fp, "include: %s\n", headers > 0 ? "\"inc/**/*.h\"" : "{}");
+    fprintf(fp, "lib: %s\n", t->libs > 0 ? "\"lib/*.a\"" : "{}");
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+/* 生成 count 条记录的索引文本 */
+static char *make_index(int count, size_t *len)
+{
+    size_t cap = (size_t)count * 200 + 1;
+    char *data = malloc(cap);
+    if (!data)
+        return NULL;
+    size_t off = 0;
+    for (int i = 0; i < count; i++) {
+        char hash[SHA256_HEX_LEN + 1];
+        for (int k = 0; k < SHA256_HEX_LEN; k++)
+            hash[k] = "0123456789abcdef"[rng_next() & 15];
+        hash[SHA256_HEX_LEN] = '\0';
+        off += (size_t)snprintf(data + off, cap - off, "pkg%06d|1.%d.%d|pool/pkg%06d.cpk|%s|libc (>= 1.0)|%d\n",
+                                i, i % 7, i % 13, i, hash, 1000 + i);
+    }
+    *len = off;
+    return data;
+}
+
+/* ---- 各项测量 ---- */
+
+/* make_build_package 会询问是否继续，每次构建前把标准输入换成写有 "y" 的文件 */
+static int answer_yes(const char *work)
+{
+    char path[BENCH_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/answer", work);
+    if (write_file(path, "y\n", 2) != 0)
+        return -1;
+    return freopen(path, "r", stdin) ? 0 : -1;
+}
+
+static int bench_tree(Bench *b, const char *work, const Tree_Spec *t)
+{
+    char dir[BENCH_PATH_LEN], pkg[BENCH_PATH_LEN * 2], name[BENCH_NAME_LEN], label[BENCH_NAME_LEN * 2];
+    snprintf(dir, sizeof(dir), "%s/bench-%s", work, t->name);
+    snprintf(pkg, sizeof(pkg), "%s/bench-%s-1.0.cpk", dir, t->name);
+    snprintf(name, sizeof(name), "bench-%s", t->name);
+
+    if (answer_yes(work) != 0 || chdir(dir) != 0)
+        return -1;
+    quiet_begin(b);
+    double t0 = now_ms();
+    int ret = make_build_package(".");
+    double t1 = now_ms();
+    quiet_end(b);
+    if (chdir(work) != 0 || ret != 0) {
+        fprintf(stderr, "cpkg-bench: build of %s failed\n", name);
+        return -1;
+    }
+    snprintf(label, sizeof(label), "build/%s", t->name);
+    record(b, label, t1 - t0);
+
+    quiet_begin(b);
+    t0 = now_ms();
+    ret = install_package(pkg);
+    t1 = now_ms();
+    quiet_end(b);
+    if (ret != 0) {
+        fprintf(stderr, "cpkg-bench: install of %s failed\n", name);
+        return -1;
+    }
+    snprintf(label, sizeof(label), "install/%s", t->name);
+    record(b, label, t1 - t0);
+
+    quiet_begin(b);
+    t0 = now_ms();
+    ret = remove_package(name);
+    t1 = now_ms();
+    quiet_end(b);
+    if (ret != 0) {
+        fprintf(stderr, "cpkg-bench: remove of %s failed\n", name);
+        return -1;
+    }
+    snprintf(label, sizeof(label), "remove/%s", t->name);
+    record(b, label, t1 - t0);
+    return 0;
+}
+
+static int bench_index(Bench *b, const char *data, size_t len, int count)
+{
+    Repo_Index idx;
+    double t0 = now_ms();
+    if (index_parse(data, len, &idx) != 0)
+        return -1;
+    double t1 = now_ms();
+    record(b, "index/parse", t1 - t0);
+
+    // 按伪随机顺序查找每个包名
+    char key[32];
+    size_t found = 0;
+    uint64_t step = 7919;
+    t0 = now_ms();
+    for (int i = 0; i < count; i++) {
+        snprintf(key, sizeof(key), "pkg%06d", (int)(((uint64_t)i * step) % (uint64_t)count));
+        found += index_find(&idx, key) != NULL;
+    }
+    t1 = now_ms();
+    index_free(&idx);
+    if (found != (size_t)count)
+        return -1;
+    record(b, "index/find", t1 - t0);
+
+    // 端到端搜索：读取缓存的索引并逐条匹配
+    quiet_begin(b);
+    t0 = now_ms();
+    int ret = repo_search("pkg0042");
+    t1 = now_ms();
+    quiet_end(b);
+    if (ret != 0)
+        return -1;
+    record(b, "search", t1 - t0);
+    return 0;
+}
+
+/* ---- 统计与输出 ---- */
+
+typedef struct {
+    double min, median, p90, p99, max, mean;
+} Bench_Stats;
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* 线性插值的分位数 */
+static double percentile(const double *sorted, int n, double q)
+{
+    if (n == 1)
+        return sorted[0];
+    double pos = q * (n - 1);
+    int lo = (int)pos;
+    if (lo >= n - 1)
+        return sorted[n - 1];
+    return sorted[lo] + (sorted[lo + 1] - sorted[lo]) * (pos - lo);
+}
+
+static void compute_stats(Bench_Result *r, Bench_Stats *s)
+{
+    memset(s, 0, sizeof(*s));
+    if (r->count == 0)
+        return;
+    qsort(r->samples, (size_t)r->count, sizeof(double), cmp_double);
+    double sum = 0;
+    for (int i = 0; i < r->count; i++)
+        sum += r->samples[i];
+    s->min = r->samples[0];
+    s->max = r->samples[r->count - 1];
+    s->median = percentile(r->samples, r->count, 0.5);
+    s->p90 = percentile(r->samples, r->count, 0.9);
+    s->p99 = percentile(r->samples, r->count, 0.99);
+    s->mean = sum / r->count;
+}
+
+static int write_json(Bench *b, const Bench_Stats *stats, const char *path, int scale)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+    fprintf(fp, "{\n  \"runs\": %d,\n  \"scale\": %d,\n  \"unit\": \"ms\",\n  \"results\": [\n", b->runs, scale);
+    for (int i = 0; i < b->nresults; i++) {
+        const Bench_Stats *s = &stats[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"samples\": %d, \"min\": %.3f, \"median\": %.3f, "
+                    "\"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f, \"mean\": %.3f}%s\n",
+                b->results[i].name, b->results[i].count, s->min, s->median, s->p90, s->p99,
+                s->max, s->mean, i + 1 < b->nresults ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+/* 在基线 JSON（本程序的输出格式）中查找某项的中位数 */
+static int baseline_median(const char *json, const char *name, double *out)
+{
+    char key[BENCH_NAME_LEN + 16];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    const char *p = strstr(json, key);
+    if (!p)
+        return -1;
+    const char *end = strchr(p, '}');
+    const char *m = strstr(p, "\"median\":");
+    if (!m || (end && m > end))
+        return -1;
+    *out = strtod(m + 9, NULL);
+    return 0;
+}
+
+static char *read_all(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return NULL;
+    struct stat st;
+    char *data = NULL;
+    if (fstat(fileno(fp), &st) == 0 && (data = malloc((size_t)st.st_size + 1)) != NULL)
+        data[fread(data, 1, (size_t)st.st_size, fp)] = '\0';
+    fclose(fp);
+    return data;
+}
+
+/* 与基线比较，返回变慢超过阈值的项数 */
+static int compare_baseline(Bench *b, const Bench_Stats *stats, const char *path, double threshold)
+{
+    char *json = read_all(path);
+    if (!json) {
+        fprintf(stderr, "cpkg-bench: cannot read baseline %s\n", path);
+        return -1;
+    }
+    int regressions = 0;
+    printf("\n%-20s %12s %12s %9s\n", "benchmark", "baseline", "current", "change");
+    for (int i = 0; i < b->nresults; i++) {
+        double base;
+        if (baseline_median(json, b->results[i].name, &base) != 0) {
+            printf("%-20s %12s %12.3f %9s\n", b->results[i].name, "-", stats[i].median, "new");
+            continue;
+        }
+        double change = base > 0 ? (stats[i].median - base) / base * 100.0 : 0.0;
+        int slower = change > threshold;
+        regressions += slower;
+        printf("%-20s %12.3f %12.3f %+8.1f%%%s\n", b->results[i].name, base, stats[i].median,
+               change, slower ? "  REGRESSION" : "");
+    }
+    free(json);
+    return regressions;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: cpkg-bench [-n runs] [-s scale] [-o out.json] [-b baseline.json] "
+                    "[-t threshold%%] [-w workdir] [-k] [-v]\n");
+}
+
+int main(int argc, char **argv)
+{
+    Bench b;
+    memset(&b, 0, sizeof(b));
+    b.runs = 10;
+    b.saved_stdout = -1;
+    int scale = 1, keep = 0, opt;
+    double threshold = 10.0;
+    const char *out = "bench.json", *baseline = NULL, *work_arg = NULL;
+    while ((opt = getopt(argc, argv, "n:s:o:b:t:w:kvh")) != -1) {
+        switch (opt) {
+        case 'n': b.runs = atoi(optarg); break;
+        case 's': scale = atoi(optarg); break;
+        case 'o': out = optarg; break;
+        case 'b': baseline = optarg; break;
+        case 't': threshold = atof(optarg); break;
+        case 'w': work_arg = optarg; break;
+        case 'k': keep = 1; break;
+        case 'v': b.verbose = 1; break;
+        default: usage(); return 2;
+        }
+    }
+    if (b.runs < 1 || scale < 1) {
+        usage();
+        return 2;
+    }
+
+    // 结果与基线路径相对于启动目录
+    char start[MAX_PATH_LEN], out_path[MAX_PATH_LEN * 2], base_path[MAX_PATH_LEN * 2];
+    if (!getcwd(start, sizeof(start)))
+        return 1;
+    snprintf(out_path, sizeof(out_path), "%s%s%s", out[0] == '/' ? "" : start, out[0] == '/' ? "" : "/", out);
+    if (baseline)
+        snprintf(base_path, sizeof(base_path), "%s%s%s", baseline[0] == '/' ? "" : start,
+                 baseline[0] == '/' ? "" : "/", baseline);
+
+    char work[MAX_PATH_LEN];
+    if (work_arg) {
+        if (mkdir_p(work_arg, 0755) != 0 && errno != EEXIST)
+            return 1;
+        if (!realpath(work_arg, work))
+            return 1;
+    } else {
+        snprintf(work, sizeof(work), "/tmp/cpkg-bench-XXXXXX");
+        if (!mkdtemp(work)) {
+            perror("cpkg-bench: mkdtemp");
+            return 1;
+        }
+    }
+    if (chdir(work) != 0)
+        return 1;
+
+    // 所有状态（cpkg-work、索引缓存）都落在工作目录中
+    char index_url[MAX_PATH_LEN * 2];
+    snprintf(index_url, sizeof(index_url), "file://%s/index.txt", work);
+    setenv("CPKG_INDEX_URL", index_url, 1);
+    setenv("CPKG_ALLOW_USER_INSTALL", "1", 1);
+
+    const Tree_Spec trees[] = {
+        { "headers", 2000, 128, 4, 0, 0 },              // 大量小头文件
+        { "libs", 4, 256, 1, 3, 8u << 20 },             // 少量大库文件
+        { "deep", 256, 512, 32, 1, 64u << 10 },         // 很深的目录
+    };
+    const int ntrees = (int)(sizeof(trees) / sizeof(trees[0]));
+    int index_count = 10000 * scale;
+
+    printf("cpkg-bench: generating synthetic trees in %s\n", work);
+    int ret = 0;
+    for (int i = 0; ret == 0 && i < ntrees; i++) {
+        char dir[MAX_PATH_LEN + BENCH_NAME_LEN];
+        snprintf(dir, sizeof(dir), "%s/bench-%s", work, trees[i].name);
+        ret = make_tree(dir, &trees[i], scale);
+    }
+    size_t index_len = 0;
+    char *index_data = ret == 0 ? make_index(index_count, &index_len) : NULL;
+    if (!index_data || write_file("index.txt", index_data, index_len) != 0)
+        ret = -1;
+    if (ret != 0)
+        fprintf(stderr, "cpkg-bench: failed to generate test data\n");
+
+    for (int r = 0; ret == 0 && r < b.runs; r++) {
+        printf("cpkg-bench: run %d/%d\n", r + 1, b.runs);
+        fflush(stdout);
+        for (int i = 0; ret == 0 && i < ntrees; i++)
+            ret = bench_tree(&b, work, &trees[i]);
+        if (ret == 0 && bench_index(&b, index_data, index_len, index_count) != 0) {
+            fprintf(stderr, "cpkg-bench: index benchmark failed\n");
+            ret = -1;
+        }
+    }
+    free(index_data);
+
+    int status = ret == 0 ? 0 : 1;
+    if (ret == 0) {
+        Bench_Stats stats[BENCH_MAX_RESULTS];
+        printf("\n%-20s %10s %10s %10s %10s %10s\n", "benchmark (ms)", "min", "median", "p90", "p99", "max");
+        for (int i = 0; i < b.nresults; i++) {
+            compute_stats(&b.results[i], &stats[i]);
+            printf("%-20s %10.3f %10.3f %10.3f %10.3f %10.3f\n", b.results[i].name, stats[i].min,
+                   stats[i].median, stats[i].p90, stats[i].p99, stats[i].max);
+        }
+        if (write_json(&b, stats, out_path, scale) != 0) {
+            fprintf(stderr, "cpkg-bench: cannot write %s\n", out_path);
+            status = 1;
+        } else {
+            printf("\ncpkg-bench: results written to %s\n", out_path);
+        }
+        if (baseline) {
+            int regressions = compare_baseline(&b, stats, base_path, threshold);
+            if (regressions != 0) {
+                if (regressions > 0)
+                    printf("cpkg-bench: %d benchmark(s) slower than baseline by more than %.1f%%\n",
+                           regressions, threshold);
+                status = 1;
+            }
+        }
+    }
+
+    for (int i = 0; i < b.nresults; i++)
+        free(b.results[i].samples);
+    if (chdir(start) != 0 || keep || work_arg)
+        printf("cpkg-bench: work directory kept: %s\n", work);
+    else
+        rm_rf(work);
+    return status;
+}
@@ -0,0 +1,33 @@
+/* cpkgd.c - cpkg 常驻进程（make cpkgd）
+ *
+ * 在内存中保留索引、网络连接池与镜像评分，通过 unix socket 为 cpkg 执行
+ * --search、--fetch 与 --repo-install（协议见 include/daemon.h）。前台运行，
+ * 收到 SIGINT/SIGTERM 后等待排队的操作完成再退出。
+ *
+ * 用法: cpkgd [-s socket]
+ *   -s  socket 路径（默认见 daemon_socket_path）
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include "../include/daemon.h"
+
+int main(int argc, char *argv[])
+{
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path) + 1];
+    daemon_socket_path(path, sizeof(path));
+    const char *socket_path = path;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:h")) != -1) {
+        switch (opt) {
+        case 's':
+            socket_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-s socket]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    return daemon_serve(socket_path);
+}
@@ -0,0 +1,27 @@
+/* batch.h - 批量操作（--batch FILE）
+ *
+ * 操作列表每行一个操作，可跟多个包名，# 开始注释：
+ *   install NAME...    从远程仓库安装（含依赖）
+ *   remove NAME...     卸载
+ *   fetch NAME...      下载到当前目录的 NAME.cpk
+ * 整个列表先解析、去重并校验（包名存在于索引、要卸载的包已安装、同一个包不能
+ * 既安装又卸载），任一问题都不执行任何操作。校验之前取得所有要安装、卸载的包
+ * （含安装计划引入的依赖）的包锁，一直持有到写完历史记录。之后只加载一次索引，
+ * 按下载、安装、卸载的顺序各用一次调用执行；某一阶段失败时跳过之后的阶段，
+ * 已提交的修改不回滚（批量操作不是事务）。
+ * 结束时打印每个操作的结果，并把整批操作作为一条记录追加到 cpkg-work/history。
+ */
+#ifndef BATCH_H
+#define BATCH_H
+
+#define BATCH_HISTORY_FILE "history"   // 工作目录下的批量操作记录
+
+/**
+ * @brief 执行操作列表
+ * @param path 操作列表文件，"-" 为标准输入
+ * @param jobs 并发数（0 使用默认值）
+ * @return 0 全部成功，1 列表无效或校验失败（未执行任何操作），2 有操作失败或被跳过
+ */
+int batch_run(const char *path, int jobs);
+
+#endif /* BATCH_H */
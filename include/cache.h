@@ -0,0 +1,47 @@
+/* cache.h - 以 SHA256 为键的本地包缓存
+ *
+ * 下载过的 .cpk 保存为 cpkg-work/cache/<sha256>.cpk，内容与键一一对应，
+ * 因此同一哈希的包再次下载或安装时可以完全离线完成。
+ *   - 写入先落到同目录下的临时文件，完成后 rename 原子发布，多个进程并发写入安全
+ *   - 命中时更新 mtime，超出 CPKG_CACHE_MAX 时按 mtime 从旧到新淘汰（LRU）
+ *   - 命中/未命中次数记录在 cpkg-work/cache/stats 中（flock 保护）
+ */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+
+#define CACHE_DIR           "cache"     // 缓存目录（位于工作目录下）
+#define CACHE_STATS_FILE    "stats"     // 统计计数文件
+#define CACHE_TMP_PREFIX    ".tmp-"     // 未发布的临时文件前缀
+#define CACHE_DEFAULT_MAX   (2LL * 1024 * 1024 * 1024)  // 默认容量上限 2 GiB
+#define CACHE_TMP_STALE_SEC (24 * 60 * 60)  // 超过此时间的临时文件视为残留并清理
+
+/* 缓存是否启用（CPKG_CACHE_MAX=0 时禁用） */
+int cache_enabled(void);
+
+/* 查找缓存条目，命中时把路径写入 out 并刷新 mtime，返回 0；未命中返回 1 */
+int cache_lookup(const char *sha256, char *out, size_t len);
+
+/* 从缓存复制到 dest（边复制边校验哈希，条目损坏时删除），成功返回 0 */
+int cache_fetch(const char *sha256, const char *dest_path);
+
+/* 把已校验的文件加入缓存（临时文件 + rename），成功返回 0 */
+int cache_store_file(const char *sha256, const char *src_path);
+
+/* 删除缓存条目 */
+void cache_remove(const char *sha256);
+
+/* 流式写入：下载数据同时写入缓存，commit 时 ok 为真才发布 */
+typedef struct Cache_Writer Cache_Writer;
+Cache_Writer *cache_writer_begin(const char *sha256);
+void cache_writer_write(Cache_Writer *w, const void *data, size_t len);
+int cache_writer_commit(Cache_Writer *w, int ok);
+
+/* 按 CPKG_CACHE_MAX 淘汰最久未使用的条目 */
+void cache_evict(void);
+
+/* 打印缓存统计（--cache-stats） */
+int cache_print_stats(void);
+
+#endif /* CACHE_H */
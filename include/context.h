@@ -0,0 +1,55 @@
+/* context.h - 当前操作的上下文：输出、进度、工作目录与持久化策略
+ *
+ * CLI 使用默认上下文：输出写到标准输出，工作目录为 ./cpkg-work，需要确认时读标准输入。
+ * libcpkg 在每次调用期间为当前线程设置句柄自己的上下文；run_parallel 的工作线程
+ * 与解压线程继承创建者的上下文，同一操作的输出与进度都交给同一个句柄。
+ * 每个句柄使用自己的连接池：libcurl 不支持在并发的 multi 句柄之间共享连接缓存。
+ * 镜像评分保存在工作目录中，因此镜像列表也按句柄分开。
+ */
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stdint.h>
+
+struct net_ctx;
+struct Mirror_State;
+
+/* level 为 help.h 中的级别字符串，普通文本为 NULL；text 不含前缀 */
+typedef void (*Cpk_Output_Fn)(void *user, const char *level, const char *text);
+/* phase 为 "download"、"extract"、"install"、"build" 或 "remove"；total 未知时为 0 */
+typedef void (*Cpk_Progress_Fn)(void *user, const char *phase, const char *name, uint64_t done, uint64_t total);
+
+typedef struct {
+    const char *work_dir;       // 工作目录（NULL 为 WORK_DIR_NAME）
+    Cpk_Output_Fn output;       // NULL 时写到标准输出
+    void *output_user;
+    Cpk_Progress_Fn progress;   // 可为 NULL
+    void *progress_user;
+    int assume_yes;             // 需要确认时直接继续，不读标准输入
+    struct net_ctx *net;        // 连接池（NULL 为进程共享的默认连接池）
+    struct Mirror_State *mirrors; // 镜像列表与评分（NULL 为进程共享的默认列表）
+    int durability;             // Durability_Mode（0 使用 CPKG_DURABILITY，见 durability.h）
+} Cpk_Context;
+
+/* 当前线程的上下文（未设置时为默认上下文） */
+const Cpk_Context *cpk_context(void);
+
+/* 设置当前线程的上下文（NULL 恢复默认），ctx 须在使用期间保持有效 */
+void cpk_context_set(const Cpk_Context *ctx);
+
+/* 当前上下文的工作目录 */
+const char *cpk_work_dir(void);
+
+/* 带级别前缀的输出（cpk_printf 的实现） */
+void cpk_log(const char *level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/* 不带前缀的普通输出 */
+void cpk_text(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/* 报告进度（没有进度回调时不做任何事） */
+void cpk_progress(const char *phase, const char *name, uint64_t done, uint64_t total);
+
+/* 当前上下文是否需要进度（用于跳过只为进度准备数据的开销） */
+int cpk_progress_wanted(void);
+
+#endif /* CONTEXT_H */
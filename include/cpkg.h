@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <sys/types.h>
 
@@ -34,26 +35,38 @@
 #define META_DIR_NAME       "CPKG"       // 元数据文件名
 #define WORK_DIR_NAME       "cpkg-work"  // 工作目录名
 #define INSTALL_DIR         "installed"  // 安装目录名
+#define DOWNLOAD_DIR        "downloads"  // 远程安装的下载目录名（保存未完成的 .part）
+#define STAGING_DIR         "staging"    // 解压暂存目录名（校验通过后提交到安装目录）
+#define STATUS_DIR          "status"     // 已安装包记录目录名（每个包一个文件）
 
 // ====== 包管理相关 ======
-#define CPKG_MAGIC          "CPKG"       // CPK 文件魔数
+#define CPKG_MAGIC          "CPKG"       // CPK 文件魔数（第 1 版头部）
+#define CPKG_MAGIC_V2       "CPK2"       // 第 2 版头部（增加依赖与保留区）
 #define CPKG_MAGIC_LEN      4            // 魔数长度
+#define CPKG_DEPENDS_LEN    1024         // 头部中依赖列表的长度
+#define CPKG_RESERVED_LEN   512          // 头部保留区长度（供后续扩展，写入时清零）
 #define CPKG_INSTALL_PREFIX "/usr/local" // 包安装前缀
 #define CPKG_LIB_PATH       "/usr/local/lib/cpkg_packages"  // 包库安装路径
 
+typedef struct Control_Chunk Control_Chunk; // 控制信息的内存块（见 read_control_info.c）
+
+/* 控制信息：结构体、所有字符串与列表都分配在 arena 中，由 control_info_free 一次释放 */
 typedef struct {
-    char name[MAX_PATH_LEN]; // 包名
-    char version[MAX_PATH_LEN]; // 版本号
-    char description[MAX_PATH_LEN]; // 描述
-    char homepage[MAX_PATH_LEN]; // 主页
-    char author[MAX_PATH_LEN]; // 作者
-    char license[MAX_PATH_LEN]; // 许可证
-    char include_install_path[MAX_PATH_LEN]; // 安装路径
-    char lib_install_path[MAX_PATH_LEN]; // 构建路径
-    char **include_files; // 头文件列表
-    char **lib_files; // 库文件列表
+    const char *name; // 包名
+    const char *version; // 版本号
+    const char *description; // 描述
+    const char *homepage; // 主页
+    const char *author; // 作者
+    const char *license; // 许可证
+    const char *include_install_path; // 安装路径
+    const char *lib_install_path; // 构建路径
+    const char **include_files; // 头文件列表
+    const char **lib_files; // 库文件列表
     int include_file_count; // 头文件数量
     int lib_file_count; // 库文件数量
+    const char **depends; // 依赖列表（每项形如 "name (>= 1.0)"）
+    int depends_count; // 依赖数量
+    Control_Chunk *arena; // 内存块链表
 } Control_Info;
 
 typedef struct {
@@ -67,8 +80,17 @@ typedef struct {
     char license[128];                  // 许可证
     char include_install_path[INSTALL_PATH_LEN];  // 头文件安装路径
     char lib_install_path[INSTALL_PATH_LEN];      // 库文件安装路径
+    // ---- 以下字段仅存在于第 2 版头部（魔数 CPK2） ----
+    char depends[CPKG_DEPENDS_LEN];     // 依赖列表（逗号分隔）
+    char tree_hash[SHA256_HEX_LEN + 1]; // 载荷的 Merkle 根（见 merkle.h，空串表示未提供）
+    char reserved[CPKG_RESERVED_LEN - SHA256_HEX_LEN - 1];  // 保留区
 } CPK_Header;
 
+#define CPK_HEADER_V1_SIZE  offsetof(CPK_Header, depends)  // 第 1 版头部大小
+#define CPK_HEADER_V2_SIZE  sizeof(CPK_Header)             // 第 2 版头部大小
+
+size_t cpk_header_size(const char *magic); // 根据魔数确定头部大小，未知魔数返回 0
+
 int check_sudo_privileges(void); // 检查是否有root权限
 int tf_choose(const char *msg); // 选择yes或no
 int mkdir_p(const char *path, mode_t mode); // 创建目录
@@ -79,11 +101,28 @@ char *archive_create_tgz(const char *src_dir, size_t *out_len); // 创建tar.gz
 CPK_Header *make_Header(Control_Info *ctrl_info); // 创建CPK头文件
 char *sha256_mem(const unsigned char *data, size_t len); // 计算哈希值
 Control_Info *read_control_info(FILE *fp); // 读取控制文件
+Control_Info *read_control_file(const char *path); // 读取控制文件（mmap 后解析）
+Control_Info *parse_control_info(const char *data, size_t len, const char *source); // 解析内存中的控制文件内容
+void control_info_free(Control_Info *info); // 释放控制信息（包括其中所有字符串与列表）
 void printf_control_info(Control_Info *ctrl_info); // 打印控制信息
 off_t get_file_size(const char *path); // 获取文件大小
 
+/* 流式安装：边接收数据边校验与解压，校验全部通过后才提交 */
+typedef struct Install_Stream Install_Stream;
+Install_Stream *install_stream_begin(const char *expected_sha256); // 开始（expected_sha256 可为 NULL）
+int install_stream_expect_tree(Install_Stream *s, const unsigned char *leaves, size_t count); // 写入前设置期望的叶子列表（count 个摘要，见 merkle.h），逐块校验
+int install_stream_write(Install_Stream *s, const void *data, size_t len); // 写入数据，失败返回 -1
+int install_stream_finish(Install_Stream *s, int transfer_ok); // 结束并提交，成功返回 0
+int install_stream_verify(Install_Stream *s, int transfer_ok); // 结束写入并校验（解压结果留在 staging），成功返回 0
+int install_stream_commit(Install_Stream *s); // 提交已校验的 staging 并记录安装状态，释放 s，成功返回 0
+void install_stream_abort(Install_Stream *s); // 丢弃 staging 并释放 s
+const CPK_Header *install_stream_header(const Install_Stream *s); // 已解析的头部（未收到完整头部时为 NULL）
+int install_stream_load_file(Install_Stream *s, const char *pkg_path); // 把本地包文件读入流，读取成功返回 1
+
 int install_package(const char *pkg_path);
+int install_package_file(const char *pkg_path, const char *expected_sha256); // 安装本地包并校验整个文件的哈希（可为 NULL）
 int remove_package(const char *pkg_name);
+int remove_package_held(const char *pkg_name); // 调用方已持有该包的包锁
 int make_build_package(const char *package_path_dir);
 
 #endif // CPKG_H
\ No newline at end of file
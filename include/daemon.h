@@ -0,0 +1,75 @@
+/* daemon.h - 常驻进程 cpkgd 及其 unix socket 协议
+ *
+ * cpkgd 在内存中保留解析好的索引（超过 CPKGD_INDEX_TTL 秒后刷新）、网络连接池
+ * 与镜像评分，cpkg 发现它在运行时把 --search、--fetch、--repo-install 交给它执行，
+ * 省去每次启动时初始化 libcurl/OpenSSL 与下载、解析索引的开销。
+ *
+ * 每条消息由固定的 12 字节头部和负载组成（整数为本机字节序，只用于本机通信）：
+ *   magic(4) version(1) op(1) count(2) len(4)
+ * 请求负载为 count 个以 '\0' 结尾的字符串参数；应答依次为若干 OUTPUT/ENTRIES
+ * 帧和一个 DONE 帧。
+ *   SEARCH   query                         应答 ENTRIES（每条记录 name、version、url）
+ *   FETCH    cwd jobs name...              在 cwd 中下载为 name.cpk，输出以 OUTPUT 帧转发
+ *   INSTALL  cwd jobs name...              在 cwd 的工作目录中安装
+ *   RELOAD                                 下次请求时重新获取索引
+ * 查询并发执行；FETCH/INSTALL 等修改状态的请求进入队列，由一个线程依次执行。
+ * 请求按 cpkgd 自己的环境执行，客户端设置了 CPKG_INDEX_URL 等变量时不使用 cpkgd。
+ * 已安装状态不缓存：每个请求可能来自不同的工作目录，且其他进程也会修改它。
+ */
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DAEMON_MAGIC        0x444b5043u   // "CPKD"
+#define DAEMON_VERSION      1
+#define DAEMON_MAX_PAYLOAD  (1u << 20)    // 单帧负载上限
+#define DAEMON_SOCKET_ENV   "CPKG_DAEMON_SOCKET"
+#define DAEMON_DISABLE_ENV  "CPKG_NO_DAEMON"  // 设为 1 时 cpkg 不连接 cpkgd
+#define DAEMON_TTL_ENV      "CPKGD_INDEX_TTL"
+#define DAEMON_DEFAULT_TTL  60                // 索引刷新间隔（秒）
+
+/* 请求 */
+enum {
+    DAEMON_PING = 1,
+    DAEMON_SEARCH,
+    DAEMON_FETCH,
+    DAEMON_INSTALL,
+    DAEMON_RELOAD,
+};
+
+/* 应答 */
+enum {
+    DAEMON_OUTPUT = 0x81,   // 负载为原样输出到标准输出的文本
+    DAEMON_ENTRIES,         // 负载为 count 个字符串，每 3 个为一条搜索结果
+    DAEMON_DONE,            // 负载为 int32 结果（0 成功）
+};
+
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t op;
+    uint16_t count;
+    uint32_t len;
+} Daemon_Header;
+
+/**
+ * @brief socket 路径：$CPKG_DAEMON_SOCKET，否则 $XDG_RUNTIME_DIR/cpkgd.sock，
+ *        否则 /tmp/cpkgd-<uid>.sock
+ */
+void daemon_socket_path(char *out, size_t len);
+
+/**
+ * @brief 把请求交给正在运行的 cpkgd，并把应答输出到标准输出
+ * @return -1 表示没有可用的 cpkgd（调用方应在本地执行），否则为操作结果
+ */
+int daemon_request(uint8_t op, const char **args, uint16_t count);
+
+/**
+ * @brief 在 socket_path 上提供服务（前台运行，直到收到 SIGINT/SIGTERM）
+ * @return 0 正常退出，非 0 表示无法监听
+ */
+int daemon_serve(const char *socket_path);
+
+#endif /* DAEMON_H */
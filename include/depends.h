@@ -0,0 +1,64 @@
+/* depends.h - 依赖声明解析、依赖闭包计算与安装分层
+ *
+ * 依赖列表为逗号分隔的若干项，每项形如：
+ *   name
+ *   name (>= 1.0)      或   name >= 1.0
+ * 支持的关系：<< <= = >= >>（以及 < > == 作为 << >> = 的别名），版本比较见 version.h。
+ */
+#ifndef DEPENDS_H
+#define DEPENDS_H
+
+#include <stddef.h>
+#include "index.h"
+
+typedef enum {
+    DEP_ANY = 0,  // 无版本要求
+    DEP_LT,       // <<
+    DEP_LE,       // <=
+    DEP_EQ,       // =
+    DEP_GE,       // >=
+    DEP_GT,       // >>
+} Dep_Op;
+
+typedef struct {
+    char name[256];
+    Dep_Op op;
+    char version[64];
+} Dep_Spec;
+
+/* 解析依赖列表，*out 由调用方 free；格式错误返回非0 */
+int dep_parse_list(const char *list, Dep_Spec **out, size_t *count);
+
+/* 版本是否满足依赖要求 */
+int dep_satisfied(const Dep_Spec *dep, const char *version);
+
+/* 格式化为 "name (>= 1.0)" */
+void dep_format(const Dep_Spec *dep, char *out, size_t len);
+
+/* 安装计划中的一项 */
+typedef struct {
+    const Index_Entry *entry;
+    int level;            // 所在层（0 表示不依赖计划中的其他包）
+    int requested;        // 是否为用户直接指定的包
+    size_t *deps;         // 依赖的计划项下标
+    size_t dep_count;
+} Plan_Item;
+
+typedef struct {
+    Plan_Item *items;     // 按层排序，同层内保持解析顺序
+    size_t count;
+    int levels;           // 层数
+} Install_Plan;
+
+/**
+ * @brief 计算安装闭包并分层
+ * @note 已安装且满足版本要求的依赖不加入计划；
+ *       缺失依赖、版本冲突或依赖环都视为错误
+ * @return 0 成功，非0 失败（已打印原因）
+ */
+int dep_resolve(const Repo_Index *index, const char **names, size_t count, Install_Plan *plan);
+
+/* 释放安装计划 */
+void dep_plan_free(Install_Plan *plan);
+
+#endif /* DEPENDS_H */
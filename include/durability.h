@@ -0,0 +1,62 @@
+/* durability.h - 安装的持久化策略（--durability / CPKG_DURABILITY）
+ *
+ *   none    不主动同步，断电后刚安装的文件可能被截断
+ *   batch   （默认）提交前对 staging 所在文件系统调用一次 syncfs，数据落盘后才把
+ *           文件移动到安装目录；写完安装记录后再调用一次，使提交本身落盘
+ *   strict  解压时每个文件与目录写完即 fsync（交给同步线程池，解压不等待），
+ *           提交后 fsync 安装目录，安装记录先 fsync 再替换
+ * 两种同步模式下 "Package installed successfully" 都在数据与记录落盘之后输出。
+ */
+#ifndef DURABILITY_H
+#define DURABILITY_H
+
+#include <stdio.h>
+
+#define DURABILITY_ENV          "CPKG_DURABILITY"
+#define DURABILITY_SYNC_THREADS 8       // strict 模式的同步线程数
+#define DURABILITY_QUEUE_LEN    256     // 等待同步的文件上限（限制同时打开的描述符）
+
+typedef enum {
+    DURABILITY_DEFAULT = 0,     // 未指定：CPKG_DURABILITY，否则 batch
+    DURABILITY_NONE,
+    DURABILITY_BATCH,
+    DURABILITY_STRICT,
+} Durability_Mode;
+
+/* 解析模式名，无效时返回 -1 */
+int durability_parse(const char *name);
+
+const char *durability_name(Durability_Mode mode);
+
+/* 当前操作的模式：上下文中的设置（cpkg --durability、cpkg_set_durability）优先，其次环境变量 */
+Durability_Mode durability_mode(void);
+
+/* 同步 path 所在的文件系统（内核不支持 syncfs 时退回 sync） */
+int durability_syncfs(const char *path);
+
+/* strict 模式下 fsync 已写入的文件流（替换前调用），其他模式不做任何事 */
+int durability_sync_file(FILE *fp);
+
+/* strict 模式下 fsync 目录（使其中的创建与重命名落盘），其他模式不做任何事 */
+int durability_sync_dir(const char *dir);
+
+/* 同步线程池：提交的描述符由线程 fsync 后关闭 */
+typedef struct Sync_Pool Sync_Pool;
+
+/* 创建线程池，失败返回 NULL */
+Sync_Pool *sync_pool_new(int threads);
+
+/**
+ * @brief 提交描述符（取得所有权），队列满时等待
+ * @note pool 为 NULL 时在调用线程中同步执行
+ * @return 同步执行失败时返回 -1，否则 0（失败在 sync_pool_finish 中报告）
+ */
+int sync_pool_submit(Sync_Pool *pool, int fd);
+
+/**
+ * @brief 等待所有提交的描述符完成并释放线程池
+ * @return 0 全部成功，-1 有失败（errno 为第一个错误）
+ */
+int sync_pool_finish(Sync_Pool *pool);
+
+#endif /* DURABILITY_H */
@@ -0,0 +1,42 @@
+/* fileglob.h - 一次遍历匹配多个文件名模式
+ *
+ * 控制文件的 include/lib 中的所有模式一起编译，按各模式的字面目录前缀确定要遍历的
+ * 目录，每个目录只读取一次（getdents64 批量读取），遍历时同时匹配全部模式。
+ *   *  ?  [...]   匹配单个路径分量内的字符（不匹配开头的 '.'）
+ *   **           匹配零个或多个目录（不进入以 '.' 开头的目录）
+ *   !pattern     排除匹配的文件；同一组内后出现的模式优先
+ *   ~  ~user     开头的主目录展开（与 glob 的 GLOB_TILDE 相同）
+ * 只返回非目录项，不进入指向目录的符号链接。不含通配符的模式原样保留（文件不存在时
+ * 由调用者报错）。每组结果排序并去重。
+ */
+#ifndef FILEGLOB_H
+#define FILEGLOB_H
+
+#include <stddef.h>
+
+#define FILEGLOB_MAX_GROUPS  4    // 结果组数（例如 include 与 lib）
+#define FILEGLOB_MAX_DEPTH   63   // 单个模式中通配部分的最大分量数
+
+typedef struct File_Glob File_Glob;
+
+File_Glob *fileglob_new(void);
+
+/**
+ * @brief 添加一个模式
+ * @param group 结果组（0 .. FILEGLOB_MAX_GROUPS-1）
+ * @return 0 成功，-1 模式无效、~user 的主目录未知或内存不足
+ */
+int fileglob_add(File_Glob *g, int group, const char *pattern);
+
+/* 遍历并匹配所有模式，成功返回 0 */
+int fileglob_run(File_Glob *g);
+
+/* 某组的结果（按字节序排序，fileglob_free 之前有效） */
+const char *const *fileglob_results(const File_Glob *g, int group, size_t *count);
+
+void fileglob_free(File_Glob *g);
+
+/* 模式中是否含有通配符或排除前缀 */
+int fileglob_is_pattern(const char *pattern);
+
+#endif /* FILEGLOB_H */
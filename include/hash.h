@@ -0,0 +1,52 @@
+/* hash.h - SHA-256 计算与十六进制编解码
+ *
+ * 基于 OpenSSL EVP 接口，由库根据 CPU 选择 SHA-NI / ARMv8 等加速实现；
+ * 摘要算法对象只获取一次，各上下文共用。
+ */
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <openssl/evp.h>
+
+#define HASH_DIGEST_LEN     32               // SHA-256 摘要字节数
+#define HASH_HEX_LEN        64               // 十六进制摘要长度
+#define HASH_IO_BLOCK       (1024 * 1024)    // 读文件计算哈希时的块大小
+
+typedef EVP_MD_CTX Hash_Ctx;
+
+/* 创建 SHA-256 上下文，失败返回 NULL */
+Hash_Ctx *hash_new(void);
+
+/* 重新开始计算 */
+int hash_reset(Hash_Ctx *h);
+
+/* 追加数据，成功返回 0 */
+int hash_update(Hash_Ctx *h, const void *data, size_t len);
+
+/* 结束计算并输出摘要（out 至少 HASH_DIGEST_LEN 字节），成功返回 0 */
+int hash_final(Hash_Ctx *h, unsigned char *out);
+
+/* 结束计算并输出十六进制摘要（out 至少 HASH_HEX_LEN + 1 字节），成功返回 0 */
+int hash_final_hex(Hash_Ctx *h, char *out);
+
+/* 释放上下文（可为 NULL） */
+void hash_free(Hash_Ctx *h);
+
+/* 计算内存数据的摘要，成功返回 0 */
+int hash_mem(const void *data, size_t len, unsigned char *out);
+int hash_mem_hex(const void *data, size_t len, char *out);
+
+/* 从 offset 开始读取文件描述符直到结尾，追加到 h（不结束计算），成功返回 0 */
+int hash_fd_update(Hash_Ctx *h, int fd, off_t offset);
+
+/* 从 offset 开始读取文件描述符直到结尾并计算摘要，成功返回 0 */
+int hash_fd_hex(int fd, off_t offset, char *out);
+
+/* 十六进制编码，out 至少 len * 2 + 1 字节 */
+void hex_encode(const unsigned char *in, size_t len, char *out);
+
+/* 解码恰好 len * 2 个十六进制字符（大小写均可），成功返回 0 */
+int hex_decode(const char *in, unsigned char *out, size_t len);
+
+#endif /* HASH_H */
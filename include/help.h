@@ -18,6 +18,8 @@
 #ifndef HELP_H
 #define HELP_H
 
+#include "context.h"
+
 // 帮助信息字符串声明
 extern const char *help_message; // 帮助信息字符串
 
@@ -44,12 +46,8 @@ extern const char *help_message; // 帮助信息字符串
 #endif
 
 
-// 彩色打印宏
-// 正确的 cpk_printf 宏定义
-#define cpk_printf(level, format, ...) \
-    do { \
-        printf("%s %s " format, CPKG_NAME, level, ##__VA_ARGS__); \
-    } while (0)
+// 彩色打印宏：经由当前上下文输出（默认写到标准输出，见 context.h）
+#define cpk_printf(level, format, ...) cpk_log(level, format, ##__VA_ARGS__)
 
 /**
  * @brief 夹带私货，赞美帝皇
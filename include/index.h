@@ -0,0 +1,63 @@
+/* index.h - 远程索引的解析、本地缓存与增量更新
+ *
+ * 索引格式（每行一条记录）: name|version|url|sha256[|depends[|size[|tree]]]
+ *   depends 为可选的依赖列表（语法见 depends.h），缺省表示无依赖
+ *   size    为可选的包文件大小（字节），用于显示下载量
+ *   tree    为可选的整个包文件的 Merkle 根（见 merkle.h），提供时服务器在
+ *           url + ".tree" 放置叶子列表，下载时逐块校验
+ *
+ * 服务器端约定（以 CPKG_INDEX_URL 去掉 .gz/.zst 后缀后的地址为 BASE）:
+ *   BASE            完整索引，可提供 BASE.gz / BASE.zst 压缩版本
+ *   BASE.seq        当前索引序列号（十进制整数）
+ *   BASE.diff.<n>   把序列号 n-1 的索引变为 n 的增量文件，
+ *                   每行为 "+name|version|url|sha256"（新增或替换）或 "-name"（删除）
+ *
+ * 配置了多个镜像时（见 mirror.h）按评分依次尝试，各镜像共用同一份本地缓存。
+ */
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stddef.h>
+
+#define INDEX_CACHE_DIR     "index"      // 索引缓存目录（位于工作目录下）
+#define INDEX_CACHE_FILE    "index.txt"  // 缓存的完整索引
+#define INDEX_CACHE_SEQ     "seq"        // 缓存的序列号及来源
+#define INDEX_MAX_DIFFS     64           // 超过此数量的增量直接全量获取
+#define INDEX_FIELDS        7            // 每条记录的字段数（多余字段忽略）
+
+typedef struct {
+    char *line;     // 本条记录的存储（字段以 '\0' 分隔）
+    char *name;     // 包名
+    char *version;  // 版本号
+    char *url;      // 下载地址
+    char *sha256;   // 哈希值（可能为空串）
+    char *depends;  // 依赖列表（可能为空串）
+    char *size;     // 包文件大小（十进制字节数，可能为空串）
+    char *tree;     // 包文件的 Merkle 根（可能为空串）
+} Index_Entry;
+
+typedef struct {
+    Index_Entry *entries; // 按 name 排序，name 唯一
+    size_t count;
+    size_t capacity;
+} Repo_Index;
+
+/* 解析索引文本（重复的包名保留第一条） */
+int index_parse(const char *data, size_t len, Repo_Index *out);
+
+/* 释放索引 */
+void index_free(Repo_Index *idx);
+
+/* 按包名二分查找，未找到返回 NULL */
+const Index_Entry *index_find(const Repo_Index *idx, const char *name);
+
+/* 应用一个增量文件 */
+int index_apply_diff(Repo_Index *idx, const char *diff, size_t len);
+
+/* 序列化为索引文本，调用方负责 free */
+char *index_serialize(const Repo_Index *idx, size_t *out_len);
+
+/* 获取索引：优先使用本地缓存 + 增量，出现缺口时回退为全量（支持 gzip/zstd） */
+int repo_load_index(Repo_Index *out);
+
+#endif /* INDEX_H */
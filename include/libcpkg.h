@@ -0,0 +1,120 @@
+/* libcpkg.h - 可嵌入的 cpkg 库接口
+ *
+ * 每个 cpkg_handle 拥有自己的工作目录、日志与进度回调，库本身不向标准输出打印，
+ * 也不读取标准输入。不同句柄可以在不同线程中同时使用；同一句柄的调用应由
+ * 调用方串行化。回调在执行操作的线程或库内部的工作线程中调用，同一句柄的
+ * 回调不会并发执行。
+ *
+ * 链接：-lcpkg（另需 -larchive -lcurl -lcrypto -lpthread），或直接使用 libcpkg.a。
+ */
+#ifndef LIBCPKG_H
+#define LIBCPKG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define CPKG_API __attribute__((visibility("default")))
+#else
+#define CPKG_API
+#endif
+
+typedef struct cpkg_handle cpkg_handle;
+
+/* 结果码 */
+typedef enum {
+    CPKG_OK = 0,
+    CPKG_E_INVALID,     // 参数无效
+    CPKG_E_NOMEM,       // 内存不足
+    CPKG_E_INDEX,       // 无法获取或解析远程索引
+    CPKG_E_NOT_FOUND,   // 索引中没有该包
+    CPKG_E_DOWNLOAD,    // 下载或校验失败
+    CPKG_E_DEPENDS,     // 依赖缺失、冲突或成环
+    CPKG_E_FAILED,      // 安装、删除或构建失败（详见 cpkg_last_error）
+} cpkg_status;
+
+/* 日志级别（CPKG_LOG_TEXT 为不带级别的普通输出，例如安装计划） */
+typedef enum {
+    CPKG_LOG_TEXT = 0,
+    CPKG_LOG_DEBUG,
+    CPKG_LOG_INFO,
+    CPKG_LOG_SUCCESS,
+    CPKG_LOG_WARNING,
+    CPKG_LOG_ERROR,
+} cpkg_log_level;
+
+/* 持久化策略（与 cpkg --durability 相同） */
+typedef enum {
+    CPKG_DURABILITY_DEFAULT = 0,    // $CPKG_DURABILITY，否则 batch
+    CPKG_DURABILITY_NONE,           // 不主动同步
+    CPKG_DURABILITY_BATCH,          // 每个包提交前后各一次 syncfs
+    CPKG_DURABILITY_STRICT,         // 每个文件 fsync
+} cpkg_durability;
+
+typedef void (*cpkg_log_fn)(void *user, cpkg_log_level level, const char *message);
+
+/**
+ * phase 为 "download"、"extract"、"install"、"build" 或 "remove"，
+ * name 为包名、文件名或下载地址的最后一段；total 未知时为 0
+ */
+typedef void (*cpkg_progress_fn)(void *user, const char *phase, const char *name,
+                                 uint64_t done, uint64_t total);
+
+/* 搜索结果回调 */
+typedef void (*cpkg_search_fn)(void *user, const char *name, const char *version, const char *url);
+
+/**
+ * @brief 创建句柄
+ * @param root 状态根目录，工作目录为 root/cpkg-work；NULL 为当前目录
+ * @return 句柄，内存不足时为 NULL
+ */
+CPKG_API cpkg_handle *cpkg_open(const char *root);
+
+CPKG_API void cpkg_close(cpkg_handle *h);
+
+/* 设置日志回调（默认丢弃日志；错误信息总能通过 cpkg_last_error 取得）。
+ * 日志与进度回调可以在操作进行中从其他线程更换，之后的回调使用新的设置 */
+CPKG_API void cpkg_set_log(cpkg_handle *h, cpkg_log_fn fn, void *user);
+
+CPKG_API void cpkg_set_progress(cpkg_handle *h, cpkg_progress_fn fn, void *user);
+
+/* 以下设置只能在两次操作之间调用 */
+
+/* 设置下载与解压的并发数（0 为默认值） */
+CPKG_API void cpkg_set_jobs(cpkg_handle *h, int jobs);
+
+/* 设置安装的持久化策略 */
+CPKG_API void cpkg_set_durability(cpkg_handle *h, cpkg_durability mode);
+
+/* 安装本地包文件 */
+CPKG_API cpkg_status cpkg_install_file(cpkg_handle *h, const char *path);
+
+/* 从远程仓库安装多个包及其依赖 */
+CPKG_API cpkg_status cpkg_install(cpkg_handle *h, const char **names, size_t count);
+
+/* 删除已安装的包 */
+CPKG_API cpkg_status cpkg_remove(cpkg_handle *h, const char *name);
+
+/* 构建包目录（不询问确认），在目录中生成 name-version.cpk */
+CPKG_API cpkg_status cpkg_build(cpkg_handle *h, const char *package_dir);
+
+/* 从远程仓库下载多个包到 dests 指定的文件 */
+CPKG_API cpkg_status cpkg_fetch(cpkg_handle *h, const char **names, const char **dests, size_t count);
+
+/* 在远程索引中搜索，任一字段包含 query 的记录交给 fn */
+CPKG_API cpkg_status cpkg_search(cpkg_handle *h, const char *query, cpkg_search_fn fn, void *user);
+
+/* 该句柄最近一次失败时的错误信息（没有时为空串），在下一次调用前有效 */
+CPKG_API const char *cpkg_last_error(const cpkg_handle *h);
+
+CPKG_API const char *cpkg_strerror(cpkg_status status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCPKG_H */
@@ -0,0 +1,44 @@
+/* lock.h - 工作目录的进程间读写锁
+ *
+ * 锁文件位于 cpkg-work/lock/，使用 flock（锁属于打开的文件描述，同一进程的
+ * 不同线程分别加锁时同样互斥，进程退出时由内核自动释放）：
+ *   state        查询（--verify）持有共享锁；提交安装与卸载持有排他锁，
+ *                查询不会看到提交到一半的状态，提交本身很短
+ *   NAME.lock    单个包的排他锁，从下载/解压一直持有到提交完成，
+ *                同一个包不会被两个进程同时安装或卸载，不相关的包互不影响
+ * 多个包的锁按包名顺序获取，包锁总在 state 之前获取，不会死锁。
+ * 等待有上限（CPKG_LOCK_TIMEOUT 秒），等待超过 1 秒时打印持有者（pid、命令行与模式）。
+ */
+#ifndef LOCK_H
+#define LOCK_H
+
+#include <stddef.h>
+
+#define LOCK_DIR             "lock"              // 工作目录下的锁文件目录
+#define LOCK_STATE           "state"             // 全局状态锁
+#define LOCK_TIMEOUT_ENV     "CPKG_LOCK_TIMEOUT"
+#define LOCK_DEFAULT_TIMEOUT 60                  // 默认最长等待（秒）
+#define LOCK_NOTICE_MS       1000                // 等待多久后打印持有者
+#define LOCK_NONE            (-2)                // 无法创建锁文件时的只读查询（不加锁继续）
+
+/**
+ * @brief 获取全局状态锁
+ * @param exclusive 非0 为排他锁（提交），0 为共享锁（查询）
+ * @return 锁的文件描述符；-1 表示超时或无法加锁（已打印原因）；
+ *         共享模式下无法创建锁文件时返回 LOCK_NONE
+ */
+int lock_state(int exclusive);
+
+/**
+ * @brief 按包名顺序获取多个包的排他锁（重复的包名只加一次）
+ * @param fds 输出，count 个，与 names 一一对应（重复项为 -1），用 lock_release_all 释放
+ * @return 0 成功，-1 失败（已获取的锁已释放）
+ */
+int lock_packages(const char **names, size_t count, int *fds);
+
+/* 释放锁（fd 小于 0 时不做任何事） */
+void lock_release(int fd);
+
+void lock_release_all(int *fds, size_t count);
+
+#endif /* LOCK_H */
@@ -0,0 +1,60 @@
+/* manifest.h - 已安装文件清单
+ *
+ * 安装时为每个包记录其文件（cpkg-work/manifest/<name>），每行一条：
+ *   <type> <sha256> <size> <mtime 秒>.<纳秒> <path>
+ * type 为 f（普通文件）或 l（符号链接，哈希为链接目标），path 相对于安装目录，
+ * 位于行尾以便包含空格。--verify 据此检查被修改、缺失或多出的文件。
+ */
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stddef.h>
+#include "hash.h"
+
+#define MANIFEST_DIR        "manifest"     // 文件清单目录（位于工作目录下）
+#define MANIFEST_SMALL_FILE (64 * 1024)    // 不超过此大小的文件一次读入栈上缓冲区
+
+typedef struct {
+    const char *path;        // 相对安装目录的路径
+    char type;               // 'f' 或 'l'
+    char sha256[HASH_HEX_LEN + 1];
+    long long size;
+    long long mtime_sec;
+    long mtime_nsec;
+} Manifest_Entry;
+
+typedef struct {
+    Manifest_Entry *entries; // 按 path 排序
+    size_t count;
+    char *data;              // path 的存储
+} Manifest;
+
+/* 遍历目录，只记录类型、大小与修改时间（sha256 为空串），成功返回 0 */
+int manifest_list(const char *root, Manifest *out);
+
+/**
+ * @brief 遍历目录并计算其中所有文件的摘要
+ * @param root 目录（路径相对于它记录）
+ * @param threads 哈希线程数（<=0 使用 CPU 核数）
+ * @return 0 成功，非0 失败
+ */
+int manifest_build(const char *root, int threads, Manifest *out);
+
+/* 写入（覆盖）包的文件清单，成功返回 0 */
+int manifest_write(const char *name, const Manifest *m);
+
+/* 读取包的文件清单：0 成功，1 没有清单，-1 格式错误或内存不足 */
+int manifest_read(const char *name, Manifest *out);
+
+/* 删除包的文件清单 */
+int manifest_remove(const char *name);
+
+void manifest_free(Manifest *m);
+
+/* 按 path 二分查找，未找到返回 NULL */
+const Manifest_Entry *manifest_find(const Manifest *m, const char *path);
+
+/* 计算文件摘要（type 为 'l' 时为链接目标的摘要），成功返回 0 */
+int manifest_hash_file(const char *path, char type, char *out);
+
+#endif /* MANIFEST_H */
@@ -0,0 +1,67 @@
+/* merkle.h - 分块 SHA-256 的 Merkle 树哈希
+ *
+ * 数据按 MERKLE_LEAF_SIZE 切分为叶子（最后一块可以较短，空数据视为一个空叶子）：
+ *   leaf = SHA256(0x00 || chunk)
+ *   node = SHA256(0x01 || left || right)，每层落单的最后一个节点直接进入上一层
+ * 叶子彼此独立，因此可以多核并行计算；拿到叶子列表后，下载中的每个块
+ * 到达即可单独校验，不必等到最后一个字节。
+ *
+ * 叶子列表文件（包文件地址加 MERKLE_SUFFIX）：每行一个叶子哈希（十六进制）。
+ */
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "hash.h"
+
+#define MERKLE_LEAF_SIZE    (1024 * 1024)  // 叶子大小
+#define MERKLE_UNIT_LEAVES  16             // 并行计算时每个任务负责的叶子数
+#define MERKLE_SUFFIX       ".tree"        // 叶子列表文件后缀
+
+typedef unsigned char Merkle_Digest[HASH_DIGEST_LEN];
+
+/* 增量计算（数据按顺序到达），同时保存全部叶子哈希 */
+typedef struct {
+    Hash_Ctx *leaf;                 // 当前叶子
+    size_t leaf_fill;               // 当前叶子已有的字节数
+    Merkle_Digest *leaves;
+    size_t count, capacity;
+    const Merkle_Digest *expected;  // 期望的叶子列表（可为 NULL），每个叶子完成时比较
+    size_t expected_count;
+    long bad_leaf;                  // 第一个不匹配的叶子（-1 表示无）
+} Merkle_Builder;
+
+/* 初始化；expected 非 NULL 时逐叶校验 */
+int merkle_init(Merkle_Builder *b, const Merkle_Digest *expected, size_t expected_count);
+
+/* 追加数据，叶子校验失败时返回 -1 */
+int merkle_update(Merkle_Builder *b, const void *data, size_t len);
+
+/* 结束计算并输出根（十六进制），叶子数与期望不符也视为失败；成功返回 0 */
+int merkle_final(Merkle_Builder *b, char *root_hex);
+
+/* 从已完成的叶子继续计算（续传时恢复保存的叶子哈希），须在 merkle_init 之后、追加数据之前调用 */
+int merkle_restore(Merkle_Builder *b, const Merkle_Digest *leaves, size_t count);
+
+void merkle_free(Merkle_Builder *b);
+
+/* 由叶子列表计算根 */
+int merkle_root(const Merkle_Digest *leaves, size_t count, Merkle_Digest root);
+
+/* 文件中 [offset, offset + length) 对应的叶子数 */
+size_t merkle_leaf_count(off_t length);
+
+/* 计算文件中从 offset 开始的第 first 到 first + count - 1 个叶子 */
+int merkle_hash_leaves(int fd, off_t offset, off_t length, size_t first, size_t count, Merkle_Digest *out);
+
+/* 并行计算文件从 offset 到结尾部分的根（threads <= 0 使用 CPU 核数） */
+int merkle_root_fd(int fd, off_t offset, int threads, char *root_hex);
+
+/* 解析叶子列表文件，*out 由调用方 free；格式错误返回非0 */
+int merkle_parse_leaves(const char *text, size_t len, Merkle_Digest **out, size_t *count);
+
+/* 写出叶子列表文件，成功返回 0 */
+int merkle_write_leaves(const char *path, const Merkle_Digest *leaves, size_t count);
+
+#endif /* MERKLE_H */
@@ -0,0 +1,60 @@
+/* mirror.h - 多镜像支持：并行测速排序、评分持久化与故障切换
+ *
+ * 镜像列表来自 CPKG_MIRRORS（以逗号或空白分隔的镜像根地址），索引位于
+ * <镜像根地址>/<索引文件名>，索引文件名取 CPKG_INDEX_URL 的最后一段（默认 index.txt）。
+ * 未设置 CPKG_MIRRORS 时 CPKG_INDEX_URL 所在目录就是唯一的镜像。
+ *
+ * 索引中的下载地址可以是相对路径（相对镜像根地址），也可以是以某个镜像根地址开头的
+ * 绝对地址，两种情况下都会按评分依次尝试所有镜像上的同一文件。
+ */
+#ifndef MIRROR_H
+#define MIRROR_H
+
+#include <stddef.h>
+#include "network.h"
+
+#define MIRROR_MAX              16          // 最多支持的镜像数
+#define MIRROR_STATE_FILE       "mirrors"   // 评分持久化文件（位于工作目录下）
+#define MIRROR_DEFAULT_INDEX    "index.txt" // 默认索引文件名
+#define MIRROR_PROBE_TTL        (60 * 60)   // 评分有效期（秒），过期后重新测速
+#define MIRROR_PROBE_BYTES      (64 * 1024) // 测速时下载的字节数
+#define MIRROR_PROBE_TIMEOUT_MS 3000        // 单个镜像测速的超时时间
+#define MIRROR_SCORE_BYTES      (1024.0 * 1024.0)  // 评分 = 下载这么多字节的预计耗时
+#define MIRROR_DEAD_SCORE       1e9         // 不可用镜像的评分（排在最后，仍作为最后的选择）
+
+typedef struct {
+    char base[NET_URL_MAX];   // 镜像根地址（不含结尾的 '/'）
+    double latency_ms;        // 首字节延迟
+    double bytes_per_sec;     // 吞吐
+    double score_ms;          // 预计下载 MIRROR_SCORE_BYTES 的耗时，越小越好
+    int failures;             // 连续失败次数
+    long probed_at;           // 上次测速时间（Unix 时间戳）
+} Mirror;
+
+typedef struct {
+    Mirror mirrors[MIRROR_MAX]; // 按评分从好到差排序
+    size_t count;
+    char index_name[256];       // 索引文件名（相对镜像根地址）
+    char key[NET_URL_MAX];      // 仓库标识（配置中第一个镜像上的索引地址），用于索引缓存
+} Mirror_List;
+
+/* 镜像列表与评分的状态，每个 libcpkg 句柄一个（见 Cpk_Context.mirrors） */
+typedef struct Mirror_State Mirror_State;
+
+Mirror_State *mirror_state_new(void);
+void mirror_state_free(Mirror_State *state);
+
+/* 当前上下文的镜像列表（首次调用时读取配置、必要时并行测速并排序），
+ * 上下文没有自己的状态时使用进程共享的列表 */
+const Mirror_List *mirror_default(void);
+
+/* 拼出第 i 个镜像上的索引地址，地址过长时返回 -1 */
+int mirror_index_url(const Mirror_List *list, size_t i, char *out, size_t len);
+
+/* 把索引中的下载地址展开为各镜像上的候选地址（按评分排序），返回候选数 */
+size_t mirror_candidates(const Mirror_List *list, const char *url, char (*out)[NET_URL_MAX], size_t max);
+
+/* 记录镜像失败（下次运行时重新测速） */
+void mirror_mark_failed(const char *base);
+
+#endif /* MIRROR_H */
@@ -6,10 +6,78 @@
 
 #include <stddef.h>
 
-/* 下载 URL 到内存，调用方负责 free(*out_data) */
+#define NET_MAX_IDLE_HANDLES 8  // 网络上下文中缓存的空闲 easy 句柄数量上限
+#define NET_DEFAULT_PARALLEL 8  // 并行下载的默认并发数
+#define NET_DEFAULT_PER_HOST 4  // 每个主机的默认并发上限
+#define NET_MAX_ATTEMPTS     4  // 单个下载的最大尝试次数（失败后从断点续传）
+#define NET_MAX_SEGMENTS     16 // 分段下载的最大分段数
+#define NET_URL_MAX          2048
+#define NET_CHECKPOINT_BYTES (4LL * 1024 * 1024)       // 每下载多少字节保存一次续传点
+#define NET_SEGMENT_MIN_SIZE (64LL * 1024 * 1024)      // 小于此大小的文件不分段
+#define NET_CONNECT_TIMEOUT  5     // 连接超时（秒），可用 CPKG_CONNECT_TIMEOUT 覆盖
+#define NET_LOW_SPEED_LIMIT  1024  // 低速阈值（字节/秒）
+#define NET_LOW_SPEED_TIME   10    // 低于阈值持续多少秒视为停滞（秒），可用 CPKG_LOW_SPEED_TIME 覆盖
+#define NET_PART_SUFFIX      ".part"       // 未完成下载的数据文件后缀
+#define NET_META_SUFFIX      ".part.meta"  // 续传元数据（校验器、偏移）
+
+/* 网络上下文：持有可复用的 easy 句柄以及共享的 DNS / TLS 会话 / 连接缓存 */
+typedef struct net_ctx net_ctx;
+
+/* 创建网络上下文，失败返回 NULL */
+net_ctx *net_ctx_new(void);
+
+/* 释放网络上下文及其持有的所有句柄 */
+void net_ctx_free(net_ctx *ctx);
+
+/* 当前上下文（见 context.h）的连接池，未设置时为进程级默认上下文（首次调用时创建，进程退出时释放） */
+net_ctx *net_default(void);
+
+/* 使用指定上下文下载 URL 到内存，调用方负责 free(*out_data) */
+int net_download_to_memory(net_ctx *ctx, const char *url, char **out_data, size_t *out_len);
+
+/* 使用指定上下文下载 URL 到本地文件，覆盖已存在文件 */
+int net_download_to_file(net_ctx *ctx, const char *url, const char *dest_path);
+
+/* 并行下载任务 */
+typedef struct net_job {
+    const char *url;         // 下载地址
+    const char *dest_path;   // 目标文件（覆盖）；设置 sink 时忽略
+    const char *const *alt_urls; // 备用地址（其他镜像上的同一文件），失败时依次切换，可为 NULL
+    size_t alt_count;
+    const char *sha256;      // 期望的 SHA256（至少 64 个十六进制字符），NULL 表示不校验
+    const char *tree_root;   // 期望的 Merkle 根（见 merkle.h），非 NULL 时代替 sha256 校验：顺序下载边下载边计算叶子
+                             // （续传时不必重读已完成的叶子），分段下载完成后多核计算
+    int (*sink)(void *user, const void *data, size_t len); // 非 NULL 时数据交给 sink（返回 0 表示成功），不写文件、不计算哈希、不续传
+    void *sink_user;
+    void (*on_done)(struct net_job *job); // 非 NULL 时在任务得到最终结果后立即调用（在 net_download_many 的线程中）
+    int status;              // 输出：0 成功，1 打开文件失败，2 下载失败，3 哈希不匹配
+    char actual_sha256[65];  // 输出：边下载边计算得到的 SHA256（按 tree_root 校验时为 Merkle 根）
+} net_job;
+
+/* 使用 curl multi 并行执行下载任务（HTTP/2 多路复用、每主机并发上限），返回失败任务数
+ * 数据先写入 <dest>.part，失败时保存续传点，之后以 Range + If-Range 继续下载；
+ * 设置了备用地址时每次失败切换到下一个地址 */
+int net_download_many(net_ctx *ctx, net_job *jobs, size_t count, int max_parallel, int max_per_host);
+
+/* 并行探测任务：下载地址的前 max_bytes 字节，测量首字节延迟与吞吐 */
+typedef struct {
+    const char *url;
+    int ok;                  // 输出：探测是否成功
+    double latency_ms;       // 输出：从发起请求到收到首字节的时间
+    double bytes_per_sec;    // 输出：首字节之后的下载速度
+} net_probe;
+
+/* 并行执行探测（每个探测最长 timeout_ms），返回成功的探测数 */
+int net_probe_many(net_ctx *ctx, net_probe *probes, size_t count, long max_bytes, long timeout_ms);
+
+/* 将单个大文件拆分为多个 Range 分段并行下载（服务器不支持 Range 或文件较小时退回普通下载）
+ * 完成后返回 0，否则返回非0（进度保存在 .part.meta 中，可再次调用继续） */
+int net_download_segmented(net_ctx *ctx, net_job *job, int segments);
+
+/* 下载 URL 到内存，调用方负责 free(*out_data)（使用默认上下文） */
 int repo_download_to_memory(const char *url, char **out_data, size_t *out_len);
 
-/* 下载 URL 到本地文件，覆盖已存在文件 */
+/* 下载 URL 到本地文件，覆盖已存在文件（使用默认上下文） */
 int repo_download_to_file(const char *url, const char *dest_path);
 
 #endif /* NETWORK_H */
@@ -20,6 +20,19 @@
 
 #include <getopt.h>
 
+/* 只有长选项形式的参数取值（避开单字符选项的取值范围） */
+enum {
+    OPT_CACHE_STATS = 256,  // --cache-stats
+    OPT_UPGRADE,            // --upgrade
+    OPT_VERIFY_PACKAGES,    // --verify-packages
+    OPT_ALL,                // --all
+    OPT_FAST,               // --fast
+    OPT_TIMINGS,            // --timings[=json|text]
+    OPT_TRACE,              // --trace=FILE
+    OPT_BATCH,              // --batch FILE
+    OPT_DURABILITY,         // --durability=none|batch|strict
+};
+
 extern struct option long_options[];
 
 #endif
\ No newline at end of file
@@ -3,6 +3,9 @@
 #ifndef REPO_H
 #define REPO_H
 
+#include <stddef.h>
+#include "index.h"
+
 /* 在远程索引中搜索关键字并打印匹配结果 */
 int repo_search(const char *query);
 
@@ -12,4 +15,23 @@ int repo_fetch_package_by_name(const char *name, const char *dest_path);
 /* 下载并直接安装包（下载到临时并调用 install_package） */
 int repo_install_by_name(const char *name);
 
+/* 并行下载多个包（jobs 为并发数，0 使用默认值），任一失败返回非0 */
+int repo_fetch_packages(const char **names, const char **dest_paths, size_t count, int jobs);
+
+/* 同 repo_fetch_packages，使用调用方已加载的索引 */
+int repo_fetch_from_index(const Repo_Index *index, const char **names, const char **dest_paths, size_t count, int jobs);
+
+/* 安装多个包及其依赖：并行下载、解压与校验，按依赖层次依次提交 */
+int repo_install_packages(const char **names, size_t count, int jobs);
+
+/* 同 repo_install_packages，使用调用方已加载的索引 */
+int repo_install_from_index(const Repo_Index *index, const char **names, size_t count, int jobs);
+
+/* 同 repo_install_from_index，held 中的包锁已由调用方持有（不再加锁，也不释放） */
+int repo_install_held(const Repo_Index *index, const char **names, size_t count, int jobs,
+                      const char **held, size_t held_count);
+
+/* 把已安装的包（names 为空时为全部）升级到索引中的较新版本，先打印计划再并行执行 */
+int repo_upgrade_packages(const char **names, size_t count, int jobs);
+
 #endif /* REPO_H */
@@ -0,0 +1,30 @@
+/* status.h - 已安装包的状态记录
+ *
+ * 每个已安装的包在 cpkg-work/status/<name> 中有一条记录（key: value 文本），
+ * 包括版本与依赖，供依赖解析和升级判断使用。
+ */
+#ifndef STATUS_H
+#define STATUS_H
+
+#include "cpkg.h"
+
+typedef struct {
+    char name[256];
+    char version[64];
+    char depends[CPKG_DEPENDS_LEN];
+    long installed_at;        // 安装时间（Unix 时间戳）
+} Installed_Pkg;
+
+/* 根据包头部写入（覆盖）安装记录，成功返回 0 */
+int status_write(const CPK_Header *header);
+
+/* 读取安装记录，已安装返回 0，未安装返回 1 */
+int status_read(const char *name, Installed_Pkg *out);
+
+/* 读取全部安装记录（按包名排序），*out 由调用方 free；没有记录时 *count 为 0 */
+int status_list(Installed_Pkg **out, size_t *count);
+
+/* 删除安装记录 */
+int status_remove(const char *name);
+
+#endif /* STATUS_H */
@@ -0,0 +1,78 @@
+/* timing.h - 阶段耗时与计数器（--timings）
+ *
+ * 各阶段用单调时钟计时，记录次数、总耗时与最长一次；计数器记录读写字节数、
+ * 创建的文件数等。多个线程可同时记录（原子累加）。程序退出时输出汇总
+ * （--timings=json 为 JSON，否则为文本表格，均写到标准错误）。
+ * 未启用时每个埋点只是对一个全局标志的判断。
+ */
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+
+/* 阶段：X(枚举名, 输出名) */
+#define TIMING_PHASES(X) \
+    X(INSTALL,  "install")   /* install_package 整体 */ \
+    X(BUILD,    "build")     /* make_build_package 整体 */ \
+    X(FETCH,    "fetch")     /* 下载包到本地文件 */ \
+    X(NETWORK,  "network")   /* 网络传输 */ \
+    X(HASH,     "hash")      /* SHA-256 与 Merkle 计算 */ \
+    X(EXTRACT,  "extract")   /* 解压（含写入文件） */ \
+    X(COMMIT,   "commit")    /* 记录清单并提交到安装目录 */ \
+    X(COPY,     "copy")      /* 构建时复制源文件 */ \
+    X(COMPRESS, "compress")  /* 构建时压缩 */ \
+    X(WRITE,    "write")     /* 写出包文件 */
+
+/* 计数器：X(枚举名, 输出名) */
+#define TIMING_COUNTERS(X) \
+    X(BYTES_READ,    "bytes_read")     /* 从本地文件读取 */ \
+    X(BYTES_WRITTEN, "bytes_written")  /* 写入本地文件 */ \
+    X(NET_BYTES,     "net_bytes")      /* 从网络接收 */ \
+    X(FILES_CREATED, "files_created") \
+    X(ALLOCATIONS,   "allocations")    /* malloc/calloc/realloc 调用次数 */
+
+typedef enum {
+#define TIMING_ENUM(id, name) TIMING_##id,
+    TIMING_PHASES(TIMING_ENUM)
+    TIMING_PHASE_COUNT
+} Timing_Phase;
+
+typedef enum {
+    TIMING_COUNTERS(TIMING_ENUM)
+    TIMING_COUNTER_COUNT
+#undef TIMING_ENUM
+} Timing_Counter;
+
+extern int timing_enabled;
+
+uint64_t timing_now_ns(void);
+void timing_record(Timing_Phase phase, uint64_t start_ns);
+void timing_count(Timing_Counter counter, uint64_t n);
+
+/* 阶段开始，返回开始时间（未启用时为 0） */
+static inline uint64_t timing_begin(void)
+{
+    return timing_enabled ? timing_now_ns() : 0;
+}
+
+/* 阶段结束（start 为 timing_begin 的返回值） */
+static inline void timing_end(Timing_Phase phase, uint64_t start)
+{
+    if (start)
+        timing_record(phase, start);
+}
+
+static inline void timing_add(Timing_Counter counter, uint64_t n)
+{
+    if (timing_enabled)
+        timing_count(counter, n);
+}
+
+/**
+ * @brief 启用统计，退出时输出汇总
+ * @param format "json"、"text" 或 NULL（文本）
+ * @return 0 成功，-1 格式无效
+ */
+int timing_enable(const char *format);
+
+#endif /* TIMING_H */
@@ -0,0 +1,66 @@
+/* trace.h - Chrome/Perfetto trace_event 记录（--trace=FILE）
+ *
+ * 每个线程写自己的环形缓冲区（单写者，无锁），满了覆盖最早的事件；
+ * 程序退出时把所有缓冲区写成 trace_event JSON，可在 chrome://tracing
+ * 或 ui.perfetto.dev 中查看各线程的重叠与等待。
+ * 未启用时每个埋点只是对一个全局标志的判断。
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* 事件类别：X(枚举名, 输出名) */
+#define TRACE_CATEGORIES(X) \
+    X(PACKAGE,  "package")   /* 安装/构建/解压/提交单个包 */ \
+    X(FILE,     "file")      /* 解压或复制单个文件 */ \
+    X(DOWNLOAD, "download")  /* 单个下载任务（异步事件，可在同一线程上重叠） */ \
+    X(COMPRESS, "compress")  /* 压缩单个条目 */
+
+typedef enum {
+#define TRACE_ENUM(id, name) TRACE_##id,
+    TRACE_CATEGORIES(TRACE_ENUM)
+#undef TRACE_ENUM
+    TRACE_CATEGORY_COUNT
+} Trace_Category;
+
+extern int trace_enabled;
+
+/**
+ * @brief 记录一个事件
+ * @param ph   trace_event 的 ph：'B'/'E' 为同步区间，'b'/'e' 为按 id 配对的异步区间
+ * @param name 事件名（过长时保留结尾部分），可为 NULL
+ */
+void trace_record(char ph, Trace_Category cat, const char *name, uint64_t id);
+
+static inline void trace_begin(Trace_Category cat, const char *name)
+{
+    if (trace_enabled)
+        trace_record('B', cat, name, 0);
+}
+
+static inline void trace_end(Trace_Category cat)
+{
+    if (trace_enabled)
+        trace_record('E', cat, NULL, 0);
+}
+
+static inline void trace_async_begin(Trace_Category cat, const char *name, uint64_t id)
+{
+    if (trace_enabled)
+        trace_record('b', cat, name, id);
+}
+
+static inline void trace_async_end(Trace_Category cat, const char *name, uint64_t id)
+{
+    if (trace_enabled)
+        trace_record('e', cat, name, id);
+}
+
+/**
+ * @brief 启用记录，退出时写入 path
+ * @return 0 成功，-1 无法创建文件
+ */
+int trace_open(const char *path);
+
+#endif /* TRACE_H */
@@ -0,0 +1,60 @@
+/* uring_writer.h - 解压时的 io_uring 后台写入
+ *
+ * 小文件的数据整个缓存后，以一组链接的 SQE 提交：openat2（直接打开到固定文件槽）
+ * -> write -> close，由内核异步执行，解压线程不等待每个文件的 open/write/close，
+ * 继续解压下一个条目。同时在途的文件数与字节数有上限，达到上限时才等待完成。
+ * 某个文件失败（例如父目录尚不存在、同名条目已存在、短写）时调用 redo 回调同步重写。
+ * 不同文件的链之间没有先后顺序，同一路径的文件在前一个完成后才提交。
+ * 直接使用 io_uring 系统调用，不依赖 liburing；内核不支持或被禁用时 uring_writer_new
+ * 返回 NULL，调用方改用同步写入。内核工作线程与解压线程并行才有收益，因此默认只在
+ * 多于一个 CPU 时使用；CPKG_IO_URING=1 总是使用，=0 总是不用。
+ */
+#ifndef URING_WRITER_H
+#define URING_WRITER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define URING_ENV          "CPKG_IO_URING"       // 1 总是使用，0 不使用，未设置时按 CPU 数决定
+#define URING_MAX_FILE     (1024 * 1024)         // 大于此大小的文件同步写入
+#define URING_MAX_BYTES    (32 * 1024 * 1024)    // 在途数据上限
+#define URING_SLOTS        64                    // 在途文件上限（固定文件槽数）
+#define URING_SUBMIT_BATCH 24                    // 积累多少个 SQE 后提交一次
+
+typedef struct Uring_Writer Uring_Writer;
+
+/* 异步写入失败时同步重写整个文件，返回 0 成功 */
+typedef int (*Uring_Redo_Fn)(void *ctx, const char *path, mode_t mode, const char *buf, size_t len);
+
+/**
+ * @brief 创建写入器
+ * @param dir_fd 目标目录，path 相对于它
+ * @return NULL 表示 io_uring 不可用
+ */
+Uring_Writer *uring_writer_new(int dir_fd, Uring_Redo_Fn redo, void *redo_ctx);
+
+/**
+ * @brief 提交一个新文件（O_CREAT|O_EXCL，权限为 mode，受 umask 影响；
+ *        路径中不允许符号链接，也不能离开 dir_fd，否则交给 redo）
+ * @param buf 文件内容（malloc 分配），返回 0 时所有权转给写入器
+ * @return 0 已提交，1 写入器已不可用（调用方同步写入），-1 内存不足
+ */
+int uring_writer_file(Uring_Writer *w, const char *path, mode_t mode, char *buf, size_t len);
+
+/**
+ * @brief 等待同一路径上已提交的文件完成（包括失败后的同步重写），
+ *        调用方在同步创建或替换该路径之前调用，使包中靠后的条目总是胜出
+ * @return 0 成功，-1 无法再与内核通信
+ */
+int uring_writer_wait_path(Uring_Writer *w, const char *path);
+
+/**
+ * @brief 等待所有已提交的文件完成（包括失败后的同步重写）
+ * @return 0 成功，-1 有文件最终写入失败
+ */
+int uring_writer_drain(Uring_Writer *w);
+
+/* 等待完成并释放 */
+void uring_writer_free(Uring_Writer *w);
+
+#endif /* URING_WRITER_H */
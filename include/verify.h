@@ -0,0 +1,29 @@
+/* verify.h - 包文件与已安装文件的完整性校验
+ */
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stddef.h>
+
+/**
+ * @brief 并行校验目录中所有 .cpk 文件（负载哈希与包头记录的哈希比较，
+ *        包头带 Merkle 根时按叶子分组拆分任务）
+ * @param dir 目录
+ * @param jobs 线程数（0 使用 CPU 核数）
+ * @return 0 全部通过，1 有包校验失败，2 无法读取目录
+ */
+int verify_packages_dir(const char *dir, int jobs);
+
+#define VERIFY_MIN_THREADS  8   // 检查已安装文件时的默认最少线程数（小文件以 I/O 延迟为主）
+
+/**
+ * @brief 按安装时记录的文件清单检查已安装的包
+ * @param names 包名（count 为 0 表示全部已安装的包）
+ * @param fast 非0 时只比较大小与修改时间，不读取文件内容
+ * @param jobs 线程数（0 使用默认值）
+ * @note 报告被修改、缺失的文件以及包目录中清单之外的文件
+ * @return 0 全部通过，1 发现问题，2 包未安装或无法读取记录
+ */
+int verify_installed(const char **names, size_t count, int fast, int jobs);
+
+#endif /* VERIFY_H */
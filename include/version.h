@@ -0,0 +1,16 @@
+/* version.h - 版本号比较
+ *
+ * 采用 dpkg 的比较规则：[epoch:]upstream[-revision]
+ *   - epoch 为整数，缺省为 0，优先比较
+ *   - upstream / revision 按 "非数字段按字符、数字段按数值" 交替比较，
+ *     字母排在非字母符号之前，'~' 排在一切字符（包括空串）之前
+ * 另外兼容 semver 的预发布写法：'-' 之后以字母开头的部分（如 1.0.0-rc.1）
+ * 视为预发布标记，排在对应正式版之前；以数字开头的仍按 dpkg revision 处理。
+ */
+#ifndef VERSION_H
+#define VERSION_H
+
+/* 比较两个版本号，a < b 返回负数，相等返回 0，a > b 返回正数 */
+int version_compare(const char *a, const char *b);
+
+#endif /* VERSION_H */
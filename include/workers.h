@@ -0,0 +1,21 @@
+/* workers.h - 简单的并行任务执行
+ *
+ * 固定数量的线程从共享计数器领取任务下标，适合彼此独立、耗时相近的任务
+ * （例如并行解压、并行校验）。
+ */
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stddef.h>
+
+/**
+ * @brief 并行执行 fn(ctx, 0) ... fn(ctx, count - 1)
+ * @param threads 线程数（<=0 时使用 CPU 核数），不超过 count
+ * @note 线程创建失败时剩余任务在调用线程中执行；所有任务完成后才返回
+ */
+void run_parallel(size_t count, int threads, void (*fn)(void *ctx, size_t i), void *ctx);
+
+/* 可用的 CPU 核数（至少为 1） */
+int worker_cpu_count(void);
+
+#endif /* WORKERS_H */
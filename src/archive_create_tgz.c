@@ -9,6 +9,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include "../include/cpkg.h"
+#include "../include/trace.h"
 
 /**
  * @brief nftw 遍历回调：将单个文件/目录添加到归档中
@@ -119,38 +120,33 @@ static int add_entry(const char *fpath, const struct stat *sb,
     }
 
     /* 写入头部 */
-    int r = archive_write_header(ctx->archive, entry);
-    if (r != ARCHIVE_OK) {
-        archive_entry_free(entry);
-        free(entry_path);
-        return -1;
-    }
+    trace_begin(TRACE_COMPRESS, entry_path);
+    int ret = 0;
+    if (archive_write_header(ctx->archive, entry) != ARCHIVE_OK)
+        ret = -1;
 
     /* 如果是普通文件，写入数据 */
-    if (S_ISREG(sb->st_mode)) {
+    if (ret == 0 && S_ISREG(sb->st_mode)) {
         int fd = open(fpath, O_RDONLY);
-        if (fd < 0) {
-            archive_entry_free(entry);
-            free(entry_path);
-            return -1;
-        }
+        if (fd < 0)
+            ret = -1;
         char buf[FILE_BUFFER_SIZE];
         ssize_t bytes_read;
-        while ((bytes_read = read(fd, buf, sizeof(buf))) > 0) {
+        while (fd >= 0 && (bytes_read = read(fd, buf, sizeof(buf))) > 0) {
             ssize_t written = archive_write_data(ctx->archive, buf, bytes_read);
             if (written != bytes_read) {
-                close(fd);
-                archive_entry_free(entry);
-                free(entry_path);
-                return -1;
+                ret = -1;
+                break;
             }
         }
-        close(fd);
+        if (fd >= 0)
+            close(fd);
     }
+    trace_end(TRACE_COMPRESS);
 
     archive_entry_free(entry);
     free(entry_path);
-    return 0;
+    return ret;
 }
 
 /**
@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/batch.h"
+#include "../include/cpkg.h"
+#include "../include/help.h"
+#include "../include/index.h"
+#include "../include/repo.h"
+#include "../include/status.h"
+#include "../include/depends.h"
+#include "../include/lock.h"
+
+/* 操作类型，按执行顺序排列 */
+typedef enum {
+    BATCH_FETCH,
+    BATCH_INSTALL,
+    BATCH_REMOVE,
+} Batch_Kind;
+
+typedef enum {
+    RESULT_PENDING,
+    RESULT_OK,
+    RESULT_FAILED,
+    RESULT_SKIPPED,
+} Batch_Result;
+
+typedef struct {
+    Batch_Kind kind;
+    char *name;
+    int line;               // 首次出现的行号
+    Batch_Result result;
+    struct stat before;     // fetch：执行前的目标文件（用于判断是否已更新）
+    int existed;
+} Batch_Op;
+
+typedef struct {
+    Batch_Op *ops;
+    size_t count;
+    size_t capacity;
+} Batch_List;
+
+typedef struct {
+    const char **names;     // 安装、卸载的包与安装计划引入的依赖（不重复）
+    int *fds;
+    size_t count;
+    size_t capacity;
+} Batch_Locks;
+
+static const char *const kind_names[] = { "fetch", "install", "remove" };
+static const char *const result_names[] = { "pending", "ok", "failed", "skipped" };
+
+/* 包名不能包含路径分隔符，也不能是 . 或 ..（会用作工作目录下的路径） */
+static int valid_name(const char *name)
+{
+    return name[0] && name[0] != '.' && strchr(name, '/') == NULL;
+}
+
+static int add_op(Batch_List *list, Batch_Kind kind, const char *name, int line)
+{
+    if (list->count == list->capacity) {
+        size_t cap = list->capacity ? list->capacity * 2 : 32;
+        Batch_Op *ops = realloc(list->ops, cap * sizeof(Batch_Op));
+        if (!ops)
+            return -1;
+        list->ops = ops;
+        list->capacity = cap;
+    }
+    Batch_Op *op = &list->ops[list->count];
+    memset(op, 0, sizeof(*op));
+    op->kind = kind;
+    op->line = line;
+    if (!(op->name = strdup(name)))
+        return -1;
+    list->count++;
+    return 0;
+}
+
+static void free_list(Batch_List *list)
+{
+    for (size_t i = 0; i < list->count; i++)
+        free(list->ops[i].name);
+    free(list->ops);
+}
+
+/**
+ * @brief 读取操作列表
+ * @return 0 成功，1 语法错误（已打印位置）
+ */
+static int parse_ops(FILE *fp, const char *path, Batch_List *list)
+{
+    char *line = NULL;
+    size_t cap = 0;
+    int lineno = 0, ret = 0;
+    while (getline(&line, &cap, fp) != -1) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        char *save = NULL;
+        char *verb = strtok_r(line, " \t\r\n", &save);
+        if (!verb)
+            continue;
+        Batch_Kind kind;
+        if (strcmp(verb, "install") == 0)
+            kind = BATCH_INSTALL;
+        else if (strcmp(verb, "remove") == 0)
+            kind = BATCH_REMOVE;
+        else if (strcmp(verb, "fetch") == 0)
+            kind = BATCH_FETCH;
+        else {
+            cpk_printf(ERROR, "%s:%d: unknown operation '%s'\n", path, lineno, verb);
+            ret = 1;
+            continue;
+        }
+        int names = 0;
+        for (char *name; (name = strtok_r(NULL, " \t\r\n", &save)) != NULL; names++) {
+            if (!valid_name(name)) {
+                cpk_printf(ERROR, "%s:%d: invalid package name '%s'\n", path, lineno, name);
+                ret = 1;
+            } else if (add_op(list, kind, name, lineno) != 0) {
+                cpk_printf(ERROR, "Memory allocation failed.\n");
+                free(line);
+                return 1;
+            }
+        }
+        if (names == 0) {
+            cpk_printf(ERROR, "%s:%d: '%s' requires at least one package name\n", path, lineno, verb);
+            ret = 1;
+        }
+    }
+    free(line);
+    return ret;
+}
+
+/* 按（类型，包名，行号）排序：同类操作相邻，重复项排在首次出现之后 */
+static int cmp_op(const void *a, const void *b)
+{
+    const Batch_Op *x = a, *y = b;
+    if (x->kind != y->kind)
+        return (int)x->kind - (int)y->kind;
+    int c = strcmp(x->name, y->name);
+    return c ? c : x->line - y->line;
+}
+
+/* 去掉重复的操作（保留首次出现的） */
+static void dedup_ops(Batch_List *list)
+{
+    qsort(list->ops, list->count, sizeof(Batch_Op), cmp_op);
+    size_t n = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        Batch_Op *op = &list->ops[i];
+        if (n > 0 && list->ops[n - 1].kind == op->kind && strcmp(list->ops[n - 1].name, op->name) == 0) {
+            cpk_printf(INFO, "Line %d: duplicate %s %s ignored (first on line %d)\n",
+                       op->line, kind_names[op->kind], op->name, list->ops[n - 1].line);
+            free(op->name);
+            continue;
+        }
+        list->ops[n++] = *op;
+    }
+    list->count = n;
+}
+
+/* 把包加入锁集合（已存在时忽略），name 须在整批执行期间有效 */
+static int lock_add(Batch_Locks *locks, const char *name)
+{
+    for (size_t i = 0; i < locks->count; i++)
+        if (strcmp(locks->names[i], name) == 0)
+            return 0;
+    if (locks->count == locks->capacity) {
+        size_t cap = locks->capacity ? locks->capacity * 2 : 32;
+        const char **names = realloc(locks->names, cap * sizeof(char *));
+        if (names)
+            locks->names = names;
+        int *fds = realloc(locks->fds, cap * sizeof(int));
+        if (fds)
+            locks->fds = fds;
+        if (!names || !fds)
+            return -1;
+        locks->capacity = cap;
+    }
+    locks->names[locks->count] = name;
+    locks->fds[locks->count++] = -1;
+    return 0;
+}
+
+static const Batch_Op *find_op(const Batch_List *list, Batch_Kind kind, const char *name)
+{
+    for (size_t i = 0; i < list->count; i++)
+        if (list->ops[i].kind == kind && strcmp(list->ops[i].name, name) == 0)
+            return &list->ops[i];
+    return NULL;
+}
+
+static int is_installed(const char *name)
+{
+    char path[MAX_PATH_LEN];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s/%s", cpk_work_dir(), INSTALL_DIR, name);
+    return stat(path, &st) == 0;
+}
+
+/* 收集某一类操作的包名，返回数量（op_list 可为 NULL） */
+static size_t collect(Batch_List *list, Batch_Kind kind, const char **names, Batch_Op **op_list)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->ops[i].kind != kind)
+            continue;
+        names[n] = list->ops[i].name;
+        if (op_list)
+            op_list[n] = &list->ops[i];
+        n++;
+    }
+    return n;
+}
+
+/* depends 中被本批卸载的包，返回冲突数（已打印） */
+static int check_required(const Batch_List *list, const char *owner, const char *depends)
+{
+    Dep_Spec *deps = NULL;
+    size_t n = 0;
+    if (!depends[0] || dep_parse_list(depends, &deps, &n) != 0)
+        return 0;
+    int conflicts = 0;
+    for (size_t i = 0; i < n; i++) {
+        const Batch_Op *op = find_op(list, BATCH_REMOVE, deps[i].name);
+        if (op) {
+            cpk_printf(ERROR, "Line %d: cannot remove %s, it is required by %s\n", op->line, op->name, owner);
+            conflicts++;
+        }
+    }
+    free(deps);
+    return conflicts;
+}
+
+/**
+ * @brief 执行前检查整个列表
+ * @note 安装的依赖在此解析一次，依赖问题与卸载后留下的包缺少依赖都在执行前报告
+ * @param index 已加载的索引（没有 fetch/install 时为 NULL）
+ * @param locks 调用方已持有其中的包锁；安装计划中不在其中的包会被加入（未加锁）
+ * @return 0 可以执行，1 有问题（已打印全部问题）
+ */
+static int validate_ops(Batch_List *list, const Repo_Index *index, const char **names, Batch_Locks *locks)
+{
+    int ret = 0, removes = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        const Batch_Op *op = &list->ops[i];
+        switch (op->kind) {
+        case BATCH_FETCH:
+        case BATCH_INSTALL:
+            if (!index_find(index, op->name)) {
+                cpk_printf(ERROR, "Line %d: package not found in index: %s\n", op->line, op->name);
+                ret = 1;
+            }
+            break;
+        case BATCH_REMOVE:
+            removes++;
+            if (find_op(list, BATCH_INSTALL, op->name)) {
+                cpk_printf(ERROR, "Line %d: %s is both installed and removed in this batch\n", op->line, op->name);
+                ret = 1;
+            } else if (!is_installed(op->name)) {
+                cpk_printf(ERROR, "Line %d: package '%s' is not installed\n", op->line, op->name);
+                ret = 1;
+            }
+            break;
+        }
+    }
+    if (ret != 0)
+        return ret;
+
+    // 要安装的包（含新引入的依赖）
+    Install_Plan plan = { 0 };
+    size_t n = collect(list, BATCH_INSTALL, names, NULL);
+    if (n > 0 && dep_resolve(index, names, n, &plan) != 0)
+        return 1;
+    for (size_t i = 0; i < plan.count && ret == 0; i++) {
+        if (lock_add(locks, plan.items[i].entry->name) != 0) {
+            cpk_printf(ERROR, "Memory allocation failed.\n");
+            ret = 1;
+        }
+    }
+    if (removes > 0) {
+        for (size_t i = 0; i < plan.count; i++)
+            if (check_required(list, plan.items[i].entry->name, plan.items[i].entry->depends) > 0)
+                ret = 1;
+        // 保留下来的已安装包（将被重新安装的以索引中的依赖为准，已在上面检查）
+        Installed_Pkg *pkgs = NULL;
+        size_t count = 0;
+        if (status_list(&pkgs, &count) == 0) {
+            for (size_t i = 0; i < count; i++) {
+                if (find_op(list, BATCH_REMOVE, pkgs[i].name) || find_op(list, BATCH_INSTALL, pkgs[i].name))
+                    continue;
+                if (check_required(list, pkgs[i].name, pkgs[i].depends) > 0)
+                    ret = 1;
+            }
+        }
+        free(pkgs);
+    }
+    if (n > 0)
+        dep_plan_free(&plan);
+    return ret;
+}
+
+/* 下载阶段：一次并行下载；整体失败时按目标文件是否被替换判断各包的结果 */
+static int run_fetch(Batch_List *list, const Repo_Index *index, int jobs,
+                     const char **names, Batch_Op **ops)
+{
+    size_t n = collect(list, BATCH_FETCH, names, ops);
+    if (n == 0)
+        return 0;
+    char (*dests)[MAX_PATH_LEN] = calloc(n, sizeof(*dests));
+    const char **dest_ptrs = calloc(n, sizeof(char *));
+    if (!dests || !dest_ptrs) {
+        free(dests);
+        free(dest_ptrs);
+        cpk_printf(ERROR, "Memory allocation failed.\n");
+        for (size_t i = 0; i < n; i++)
+            ops[i]->result = RESULT_FAILED;
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        snprintf(dests[i], MAX_PATH_LEN, "%s.cpk", names[i]);
+        dest_ptrs[i] = dests[i];
+        ops[i]->existed = stat(dests[i], &ops[i]->before) == 0;
+    }
+    int r = repo_fetch_from_index(index, names, dest_ptrs, n, jobs);
+    for (size_t i = 0; i < n; i++) {
+        struct stat st;
+        // 下载与缓存复制都通过 rename 发布，成功时目标文件一定是新的 inode
+        int replaced = stat(dests[i], &st) == 0 &&
+                       (!ops[i]->existed || st.st_ino != ops[i]->before.st_ino ||
+                        st.st_mtime != ops[i]->before.st_mtime);
+        ops[i]->result = (r == 0 || replaced) ? RESULT_OK : RESULT_FAILED;
+    }
+    free(dests);
+    free(dest_ptrs);
+    return r != 0;
+}
+
+/* 安装阶段：所有包一起解析依赖、并行下载与解压；整体失败时按安装记录判断各包的结果 */
+static int run_install(Batch_List *list, const Repo_Index *index, int jobs,
+                       const char **names, Batch_Op **ops, const Batch_Locks *locks)
+{
+    size_t n = collect(list, BATCH_INSTALL, names, ops);
+    if (n == 0)
+        return 0;
+    int r = repo_install_held(index, names, n, jobs, locks->names, locks->count);
+    for (size_t i = 0; i < n; i++) {
+        Installed_Pkg pkg;
+        const Index_Entry *entry = index_find(index, names[i]);
+        int done = status_read(names[i], &pkg) == 0 && strcmp(pkg.version, entry->version) == 0;
+        ops[i]->result = (r == 0 || done) ? RESULT_OK : RESULT_FAILED;
+    }
+    return r != 0;
+}
+
+/* 卸载阶段：包锁已由 batch_run 持有 */
+static int run_remove(Batch_List *list)
+{
+    int failed = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        Batch_Op *op = &list->ops[i];
+        if (op->kind != BATCH_REMOVE)
+            continue;
+        op->result = remove_package_held(op->name) == 0 ? RESULT_OK : RESULT_FAILED;
+        failed |= op->result != RESULT_OK;
+    }
+    return failed;
+}
+
+/* 把整批操作作为一条记录追加到历史文件（一次 write，多个进程的记录不会交错） */
+static void write_history(const Batch_List *list, int failed)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *mem = open_memstream(&buf, &len);
+    if (!mem)
+        return;
+    fprintf(mem, "batch %ld %s %zu\n", (long)time(NULL), failed ? "failed" : "ok", list->count);
+    for (size_t i = 0; i < list->count; i++) {
+        const Batch_Op *op = &list->ops[i];
+        fprintf(mem, "  %s %s %s\n", kind_names[op->kind], op->name, result_names[op->result]);
+    }
+    if (fclose(mem) != 0) {
+        free(buf);
+        return;
+    }
+    char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s", cpk_work_dir(), BATCH_HISTORY_FILE);
+    if (mkdir_p(cpk_work_dir(), 0755) != 0 && errno != EEXIST) {
+        free(buf);
+        return;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0 || write(fd, buf, len) != (ssize_t)len)
+        cpk_printf(WARNING, "Failed to write batch record to %s\n", path);
+    if (fd >= 0)
+        close(fd);
+    free(buf);
+}
+
+static void print_report(const Batch_List *list)
+{
+    size_t counts[4] = { 0 };
+    cpk_printf(INFO, "Batch result:\n");
+    for (size_t i = 0; i < list->count; i++) {
+        const Batch_Op *op = &list->ops[i];
+        counts[op->result]++;
+        cpk_text("  %-8s %-32s %s\n", kind_names[op->kind], op->name, result_names[op->result]);
+    }
+    cpk_text("%zu ok, %zu failed, %zu skipped\n", counts[RESULT_OK], counts[RESULT_FAILED], counts[RESULT_SKIPPED]);
+}
+
+int batch_run(const char *path, int jobs)
+{
+    FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!fp) {
+        cpk_printf(ERROR, "Cannot open batch file: %s\n", path);
+        return 1;
+    }
+    Batch_List list = { 0 };
+    int r = parse_ops(fp, strcmp(path, "-") == 0 ? "<stdin>" : path, &list);
+    if (fp != stdin)
+        fclose(fp);
+    if (r == 0 && list.count == 0) {
+        cpk_printf(ERROR, "Batch file contains no operations\n");
+        r = 1;
+    }
+    if (r != 0) {
+        free_list(&list);
+        return 1;
+    }
+    dedup_ops(&list);
+
+    // 共享的状态只加载一次：所有 fetch/install 使用同一份索引
+    Repo_Index index = { 0 };
+    int need_index = 0;
+    for (size_t i = 0; i < list.count && !need_index; i++)
+        need_index = list.ops[i].kind != BATCH_REMOVE;
+    if (need_index && repo_load_index(&index) != 0) {
+        cpk_printf(ERROR, "Failed to load repository index\n");
+        free_list(&list);
+        return 1;
+    }
+    const char **names = calloc(list.count, sizeof(char *));
+    Batch_Op **ops = calloc(list.count, sizeof(Batch_Op *));
+    Batch_Locks locks = { 0 };
+    r = !names || !ops;
+    for (size_t i = 0; i < list.count && r == 0; i++)
+        if (list.ops[i].kind != BATCH_FETCH)
+            r = lock_add(&locks, list.ops[i].name) != 0;
+    // 校验之前取得所有要修改的包的锁，一直持有到写完历史记录，
+    // 校验时看到的状态在执行期间不会被其他进程改变
+    while (r == 0) {
+        size_t held = locks.count;
+        if (lock_packages(locks.names, held, locks.fds) != 0) {
+            r = 1;
+            break;
+        }
+        r = validate_ops(&list, need_index ? &index : NULL, names, &locks);
+        if (r != 0 || locks.count == held)
+            break;
+        // 安装计划引入了其他包：全部释放后按包名顺序重新加锁，再检查一次
+        lock_release_all(locks.fds, held);
+    }
+    if (r != 0) {
+        cpk_printf(ERROR, "Batch rejected, no changes were made\n");
+        lock_release_all(locks.fds, locks.count);
+        free(locks.names);
+        free(locks.fds);
+        free(names);
+        free(ops);
+        if (need_index)
+            index_free(&index);
+        free_list(&list);
+        return 1;
+    }
+
+    // 按阶段执行，某一阶段失败时不再继续修改状态（例如新包没装好就不卸载旧包）
+    int failed = run_fetch(&list, &index, jobs, names, ops);
+    if (!failed)
+        failed = run_install(&list, &index, jobs, names, ops, &locks);
+    if (!failed)
+        failed = run_remove(&list);
+    for (size_t i = 0; i < list.count; i++)
+        if (list.ops[i].result == RESULT_PENDING)
+            list.ops[i].result = RESULT_SKIPPED;
+
+    print_report(&list);
+    write_history(&list, failed);
+    lock_release_all(locks.fds, locks.count);
+    free(locks.names);
+    free(locks.fds);
+    free(names);
+    free(ops);
+    if (need_index)
+        index_free(&index);
+    free_list(&list);
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "../include/cache.h"
+#include "../include/hash.h"
+#include "../include/cpkg.h"
+#include "../include/help.h"
+
+/* 缓存文件路径长度：目录 + 64 位哈希 + 后缀 */
+#define CACHE_PATH_LEN (MAX_PATH_LEN + 128)
+
+struct Cache_Writer {
+    int fd;
+    int failed;
+    char sha256[SHA256_HEX_LEN + 1];
+    char tmp[CACHE_PATH_LEN];
+};
+
+/* 解析 CPKG_CACHE_MAX（支持 K/M/G 后缀），未设置时返回默认值 */
+static long long cache_max_bytes(void)
+{
+    const char *env = getenv("CPKG_CACHE_MAX");
+    if (!env || !*env)
+        return CACHE_DEFAULT_MAX;
+    char *end;
+    long long v = strtoll(env, &end, 10);
+    if (v < 0)
+        return 0;
+    switch (*end) {
+    case 'k': case 'K': v *= 1024LL; break;
+    case 'm': case 'M': v *= 1024LL * 1024; break;
+    case 'g': case 'G': v *= 1024LL * 1024 * 1024; break;
+    default: break;
+    }
+    return v;
+}
+
+int cache_enabled(void)
+{
+    return cache_max_bytes() > 0;
+}
+
+/* 哈希必须是 64 个十六进制字符，避免拼出任意路径 */
+static int valid_hash(const char *sha256)
+{
+    if (!sha256)
+        return 0;
+    for (int i = 0; i < SHA256_HEX_LEN; i++) {
+        char c = sha256[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')))
+            return 0;
+    }
+    return 1;
+}
+
+static int cache_dir_ready(void)
+{
+    char dir[MAX_PATH_LEN];
+    snprintf(dir, sizeof(dir), "%s/%s", cpk_work_dir(), CACHE_DIR);
+    if (mkdir_p(dir, 0755) != 0 && errno != EEXIST) {
+        cpk_printf(WARNING, "Failed to create cache directory: %s\n", dir);
+        return -1;
+    }
+    return 0;
+}
+
+static void entry_path(const char *sha256, char *out, size_t len)
+{
+    snprintf(out, len, "%s/%s/%.64s.cpk", cpk_work_dir(), CACHE_DIR, sha256);
+}
+
+/* 在 flock 保护下累加统计计数（hits / misses / bytes_saved） */
+static void stats_add(long long hits, long long misses, long long saved)
+{
+    if (cache_dir_ready() != 0)
+        return;
+    char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s/%s", cpk_work_dir(), CACHE_DIR, CACHE_STATS_FILE);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return;
+    if (flock(fd, LOCK_EX) == 0) {
+        char buf[256] = {0};
+        long long h = 0, m = 0, s = 0;
+        if (pread(fd, buf, sizeof(buf) - 1, 0) > 0)
+            sscanf(buf, "hits %lld\nmisses %lld\nbytes_saved %lld", &h, &m, &s);
+        int n = snprintf(buf, sizeof(buf), "hits %lld\nmisses %lld\nbytes_saved %lld\n",
+                         h + hits, m + misses, s + saved);
+        if (ftruncate(fd, 0) == 0 && pwrite(fd, buf, n, 0) != n)
+            cpk_printf(WARNING, "Failed to update cache stats\n");
+        flock(fd, LOCK_UN);
+    }
+    close(fd);
+}
+
+int cache_lookup(const char *sha256, char *out, size_t len)
+{
+    if (!cache_enabled() || !valid_hash(sha256))
+        return 1;
+    entry_path(sha256, out, len);
+    struct stat st;
+    if (stat(out, &st) != 0 || !S_ISREG(st.st_mode)) {
+        stats_add(0, 1, 0);
+        return 1;
+    }
+    // 刷新 mtime 作为 LRU 的访问时间
+    utimensat(AT_FDCWD, out, NULL, 0);
+    stats_add(1, 0, st.st_size);
+    return 0;
+}
+
+void cache_remove(const char *sha256)
+{
+    if (!valid_hash(sha256))
+        return;
+    char path[CACHE_PATH_LEN];
+    entry_path(sha256, path, sizeof(path));
+    unlink(path);
+}
+
+/* 在缓存目录中创建临时文件（与最终文件同一文件系统，保证 rename 原子） */
+static int open_tmp(char *tmp, size_t len)
+{
+    if (cache_dir_ready() != 0)
+        return -1;
+    snprintf(tmp, len, "%s/%s/%sXXXXXX", cpk_work_dir(), CACHE_DIR, CACHE_TMP_PREFIX);
+    return mkstemp(tmp);
+}
+
+/* 落盘并原子发布临时文件 */
+static int publish_tmp(int fd, const char *tmp, const char *sha256)
+{
+    char path[CACHE_PATH_LEN];
+    entry_path(sha256, path, sizeof(path));
+    if (fchmod(fd, 0644) != 0 || fsync(fd) != 0) {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int cache_fetch(const char *sha256, const char *dest_path)
+{
+    char path[CACHE_PATH_LEN];
+    if (cache_lookup(sha256, path, sizeof(path)) != 0)
+        return 1;
+
+    FILE *in = fopen(path, "rb");
+    if (!in)
+        return 1;
+    // 先写入 dest 的临时文件，校验通过后再 rename，避免留下不完整的包
+    char tmp[MAX_PATH_LEN + 16];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", dest_path);
+    FILE *out = fopen(tmp, "wb");
+    if (!out) {
+        fclose(in);
+        return 1;
+    }
+    Hash_Ctx *ctx = hash_new();
+    char *buf = malloc(HASH_IO_BLOCK);
+    int ok = (buf != NULL && ctx != NULL);
+    size_t n;
+    while (ok && (n = fread(buf, 1, HASH_IO_BLOCK, in)) > 0) {
+        hash_update(ctx, buf, n);
+        if (fwrite(buf, 1, n, out) != n)
+            ok = 0;
+    }
+    if (ferror(in))
+        ok = 0;
+    free(buf);
+    fclose(in);
+    if (fclose(out) != 0)
+        ok = 0;
+
+    char hex[SHA256_HEX_LEN + 1] = "";
+    if (ctx && hash_final_hex(ctx, hex) != 0)
+        ok = 0;
+    hash_free(ctx);
+    if (ok && strncasecmp(hex, sha256, SHA256_HEX_LEN) != 0) {
+        cpk_printf(WARNING, "Cache entry %.64s is corrupt, removing\n", sha256);
+        cache_remove(sha256);
+        ok = 0;
+    }
+    if (!ok || rename(tmp, dest_path) != 0) {
+        unlink(tmp);
+        return 1;
+    }
+    return 0;
+}
+
+int cache_store_file(const char *sha256, const char *src_path)
+{
+    if (!cache_enabled() || !valid_hash(sha256))
+        return 1;
+    char tmp[CACHE_PATH_LEN];
+    int fd = open_tmp(tmp, sizeof(tmp));
+    if (fd < 0)
+        return 1;
+    FILE *in = fopen(src_path, "rb");
+    if (!in) {
+        close(fd);
+        unlink(tmp);
+        return 1;
+    }
+    char *buf = malloc(HASH_IO_BLOCK);
+    int ok = (buf != NULL);
+    size_t n;
+    while (ok && (n = fread(buf, 1, HASH_IO_BLOCK, in)) > 0) {
+        if (write(fd, buf, n) != (ssize_t)n)
+            ok = 0;
+    }
+    if (ferror(in))
+        ok = 0;
+    free(buf);
+    fclose(in);
+    if (!ok) {
+        close(fd);
+        unlink(tmp);
+        return 1;
+    }
+    return publish_tmp(fd, tmp, sha256) == 0 ? 0 : 1;
+}
+
+Cache_Writer *cache_writer_begin(const char *sha256)
+{
+    if (!cache_enabled() || !valid_hash(sha256))
+        return NULL;
+    Cache_Writer *w = calloc(1, sizeof(Cache_Writer));
+    if (!w)
+        return NULL;
+    memcpy(w->sha256, sha256, SHA256_HEX_LEN);
+    w->fd = open_tmp(w->tmp, sizeof(w->tmp));
+    if (w->fd < 0) {
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+void cache_writer_write(Cache_Writer *w, const void *data, size_t len)
+{
+    // 写缓存失败不影响安装，只是不发布
+    if (!w || w->failed)
+        return;
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(w->fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            w->failed = 1;
+            return;
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+int cache_writer_commit(Cache_Writer *w, int ok)
+{
+    if (!w)
+        return 1;
+    int ret = 1;
+    if (ok && !w->failed) {
+        ret = publish_tmp(w->fd, w->tmp, w->sha256) == 0 ? 0 : 1;
+    } else {
+        close(w->fd);
+        unlink(w->tmp);
+    }
+    free(w);
+    return ret;
+}
+
+typedef struct {
+    char name[SHA256_HEX_LEN + 8];
+    off_t size;
+    time_t mtime;
+} Cache_Entry;
+
+static int cmp_mtime(const void *a, const void *b)
+{
+    const Cache_Entry *x = a, *y = b;
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+/* 扫描缓存目录，返回条目数组（调用方 free），同时清理残留的临时文件 */
+static Cache_Entry *scan_entries(size_t *count, long long *total)
+{
+    *count = 0;
+    *total = 0;
+    char dir_path[MAX_PATH_LEN];
+    snprintf(dir_path, sizeof(dir_path), "%s/%s", cpk_work_dir(), CACHE_DIR);
+    DIR *dir = opendir(dir_path);
+    if (!dir)
+        return NULL;
+    int dfd = dirfd(dir);
+    time_t now = time(NULL);
+    Cache_Entry *list = NULL;
+    size_t cap = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        struct stat st;
+        if (fstatat(dfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        if (strncmp(de->d_name, CACHE_TMP_PREFIX, strlen(CACHE_TMP_PREFIX)) == 0) {
+            if (now - st.st_mtime > CACHE_TMP_STALE_SEC)
+                unlinkat(dfd, de->d_name, 0);
+            continue;
+        }
+        size_t len = strlen(de->d_name);
+        if (len != SHA256_HEX_LEN + 4 || strcmp(de->d_name + SHA256_HEX_LEN, ".cpk") != 0)
+            continue;
+        if (*count == cap) {
+            size_t ncap = cap ? cap * 2 : 64;
+            Cache_Entry *tmp = realloc(list, ncap * sizeof(Cache_Entry));
+            if (!tmp)
+                break;
+            list = tmp;
+            cap = ncap;
+        }
+        Cache_Entry *e = &list[(*count)++];
+        memcpy(e->name, de->d_name, len + 1);
+        e->size = st.st_size;
+        e->mtime = st.st_mtime;
+        *total += st.st_size;
+    }
+    closedir(dir);
+    return list;
+}
+
+void cache_evict(void)
+{
+    long long max = cache_max_bytes();
+    if (max <= 0)
+        return;
+    size_t count;
+    long long total;
+    Cache_Entry *list = scan_entries(&count, &total);
+    if (!list || total <= max) {
+        free(list);
+        return;
+    }
+    qsort(list, count, sizeof(Cache_Entry), cmp_mtime);
+    char path[CACHE_PATH_LEN];
+    for (size_t i = 0; i < count && total > max; i++) {
+        snprintf(path, sizeof(path), "%s/%s/%s", cpk_work_dir(), CACHE_DIR, list[i].name);
+        if (unlink(path) == 0) {
+            total -= list[i].size;
+            cpk_printf(DEBUG, "Evicted cache entry %s\n", list[i].name);
+        }
+    }
+    free(list);
+}
+
+int cache_print_stats(void)
+{
+    size_t count;
+    long long total;
+    Cache_Entry *list = scan_entries(&count, &total);
+    free(list);
+
+    long long hits = 0, misses = 0, saved = 0;
+    char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s/%s", cpk_work_dir(), CACHE_DIR, CACHE_STATS_FILE);
+    FILE *fp = fopen(path, "r");
+    if (fp) {
+        if (fscanf(fp, "hits %lld\nmisses %lld\nbytes_saved %lld", &hits, &misses, &saved) != 3)
+            hits = misses = saved = 0;
+        fclose(fp);
+    }
+    long long max = cache_max_bytes();
+    cpk_text("Cache directory: %s/%s\n", cpk_work_dir(), CACHE_DIR);
+    cpk_text("Entries:         %zu\n", count);
+    cpk_text("Size:            %.1f MiB\n", total / (1024.0 * 1024.0));
+    if (max > 0)
+        cpk_text("Limit:           %.1f MiB (%.1f%% used)\n", max / (1024.0 * 1024.0), 100.0 * total / max);
+    else
+        cpk_text("Limit:           disabled (CPKG_CACHE_MAX=0)\n");
+    cpk_text("Hits:            %lld\n", hits);
+    cpk_text("Misses:          %lld\n", misses);
+    if (hits + misses > 0)
+        cpk_text("Hit rate:        %.1f%%\n", 100.0 * hits / (hits + misses));
+    cpk_text("Bytes saved:     %.1f MiB\n", saved / (1024.0 * 1024.0));
+    return 0;
+}
@@ -0,0 +1,74 @@
+#define _GNU_SOURCE   // vasprintf
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "../include/context.h"
+#include "../include/cpkg.h"
+#include "../include/help.h"
+
+static const Cpk_Context default_context = { WORK_DIR_NAME, NULL, NULL, NULL, NULL, 0, NULL, NULL, 0 };
+static __thread const Cpk_Context *current;
+
+const Cpk_Context *cpk_context(void)
+{
+    return current ? current : &default_context;
+}
+
+void cpk_context_set(const Cpk_Context *ctx)
+{
+    current = ctx;
+}
+
+const char *cpk_work_dir(void)
+{
+    const Cpk_Context *ctx = cpk_context();
+    return ctx->work_dir ? ctx->work_dir : WORK_DIR_NAME;
+}
+
+static void emit(const char *level, const char *format, va_list ap)
+{
+    const Cpk_Context *ctx = cpk_context();
+    if (ctx->output) {
+        char *text = NULL;
+        if (vasprintf(&text, format, ap) >= 0) {
+            ctx->output(ctx->output_user, level, text);
+            free(text);
+        }
+        return;
+    }
+    // 前缀与内容一起输出，多个线程的行不会交错
+    flockfile(stdout);
+    if (level)
+        printf("%s %s ", CPKG_NAME, level);
+    vprintf(format, ap);
+    funlockfile(stdout);
+}
+
+void cpk_log(const char *level, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    emit(level, format, ap);
+    va_end(ap);
+}
+
+void cpk_text(const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    emit(NULL, format, ap);
+    va_end(ap);
+}
+
+void cpk_progress(const char *phase, const char *name, uint64_t done, uint64_t total)
+{
+    const Cpk_Context *ctx = cpk_context();
+    if (ctx->progress)
+        ctx->progress(ctx->progress_user, phase, name, done, total);
+}
+
+int cpk_progress_wanted(void)
+{
+    return cpk_context()->progress != NULL;
+}
@@ -4,8 +4,65 @@
 #include <unistd.h>
 #include "../include/cpkg.h"
 #include "../include/help.h"
+#include "../include/merkle.h"
+#include "../include/timing.h"
+#include "../include/trace.h"
+
+static int build_package(const char *package_path_dir);
+
+typedef struct {
+    const char *path;
+    const char *base;   // 复制到包中后的文件名
+} Build_File;
+
+static int cmp_base(const void *a, const void *b)
+{
+    return strcmp(((const Build_File *)a)->base, ((const Build_File *)b)->base);
+}
+
+/**
+ * @brief 文件按文件名复制到同一个目录，不同目录下的同名文件会互相覆盖，视为错误
+ * @param dir 包中的目标目录（用于报错）
+ * @return 0 没有冲突，1 有冲突或内存不足
+ */
+static int check_basenames(const char **files, int count, const char *dir)
+{
+    if (count < 2)
+        return 0;
+    Build_File *list = malloc((size_t)count * sizeof(Build_File));
+    if (!list) {
+        cpk_printf(ERROR, "Memory allocation failed.\n");
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        const char *slash = strrchr(files[i], '/');
+        list[i].path = files[i];
+        list[i].base = slash ? slash + 1 : files[i];
+    }
+    qsort(list, (size_t)count, sizeof(Build_File), cmp_base);
+    int ret = 0;
+    for (int i = 1; i < count; i++) {
+        if (strcmp(list[i].base, list[i - 1].base) == 0 && strcmp(list[i].path, list[i - 1].path) != 0) {
+            cpk_printf(ERROR, "Both %s and %s would be packaged as %s/%s\n",
+                       list[i - 1].path, list[i].path, dir, list[i].base);
+            ret = 1;
+        }
+    }
+    free(list);
+    return ret;
+}
 
 int make_build_package(const char *package_path_dir)
+{
+    uint64_t t_build = timing_begin();
+    trace_begin(TRACE_PACKAGE, package_path_dir);
+    int ret = build_package(package_path_dir);
+    trace_end(TRACE_PACKAGE);
+    timing_end(TIMING_BUILD, t_build);
+    return ret;
+}
+
+static int build_package(const char *package_path_dir)
 {
     // 复制路径并去掉末尾的 '/'
     char *package_path = strdup(package_path_dir);
@@ -17,8 +74,8 @@ int make_build_package(const char *package_path_dir)
     if (len > 0 && package_path[len - 1] == '/')
         package_path[len - 1] = '\0';
 
-    printf("the path is \"%s\"\n", package_path);
-    printf("Is finding control file...\n");
+    cpk_text("the path is \"%s\"\n", package_path);
+    cpk_text("Is finding control file...\n");
 
     // 拼接 control 文件路径
     char *ctrl_file_path = NULL;
@@ -27,69 +84,73 @@ int make_build_package(const char *package_path_dir)
         free(package_path);
         return 1;
     }
-    FILE *ctrl_file = fopen(ctrl_file_path, "r");
-    if (!ctrl_file) {
-        printf("control file not found.\n");
+    if (access(ctrl_file_path, R_OK) != 0) {
+        cpk_text("control file not found.\n");
         free(ctrl_file_path);
         free(package_path);
         return 1;
     }
 
-    Control_Info *ctrl_info = read_control_info(ctrl_file);
+    Control_Info *ctrl_info = read_control_file(ctrl_file_path);
     if (!ctrl_info) {
         cpk_printf(ERROR, "Error: read control file failed.\n");
-        fclose(ctrl_file);
         free(ctrl_file_path);
         free(package_path);
         return 1;
     }
-    fclose(ctrl_file);
 
-    printf("OK, I find the control file.\n");
-    printf("and look at the info, it is true?\n\n");
+    cpk_text("OK, I find the control file.\n");
+    cpk_text("and look at the info, it is true?\n\n");
 
     char cwd[1024];
     if (!getcwd(cwd, sizeof(cwd))) {
         cpk_printf(ERROR, "Error: get current working directory failed.\n");
         free(ctrl_file_path);
         free(package_path);
-        free(ctrl_info);   // 需要实现此函数，或手动释放
+        control_info_free(ctrl_info);
         return 1;
     }
     printf_control_info(ctrl_info);
+    const char *base_dir = package_path[0] == '/' ? "" : cwd;  // 绝对路径不再拼接当前目录
 
     if (tf_choose("If you want to build the package, please enter 'y', or enter 'n' to stop build the package.")) {
-        printf("OK, I will stop build the package.\n");
+        cpk_text("OK, I will stop build the package.\n");
         free(ctrl_file_path);
         free(package_path);
-        free(ctrl_info);
+        control_info_free(ctrl_info);
         return 0;
     }
 
-    printf("Is Building the package...\n");
+    cpk_text("Is Building the package...\n");
 
     // 动态构建 build_path
     char *build_path = NULL;
-    if (asprintf(&build_path, "%s/%s/%s", cwd, package_path, ctrl_info->name) == -1) {
+    if (asprintf(&build_path, "%s/%s/%s", base_dir, package_path, ctrl_info->name) == -1) {
         cpk_printf(ERROR, "Memory allocation failed.\n");
         free(ctrl_file_path);
         free(package_path);
-        free(ctrl_info);
+        control_info_free(ctrl_info);
         return 1;
     }
-    printf("build path is \"%s\"\n", build_path);
+    cpk_text("build path is \"%s\"\n", build_path);
 
     if (mkdir_p(build_path, 0755)) {
         cpk_printf(ERROR, "Error: create build path failed.\n");
         free(build_path);
         free(ctrl_file_path);
         free(package_path);
-        free(ctrl_info);
+        control_info_free(ctrl_info);
         return 1;
     }
 
+    // 不同目录下的同名文件（例如 "**" 匹配到的）不能静默覆盖
+    if (check_basenames(ctrl_info->include_files, ctrl_info->include_file_count, "include") ||
+        check_basenames(ctrl_info->lib_files, ctrl_info->lib_file_count, "lib"))
+        goto error;
+
     // 拷贝头文件
-    printf("Is copying include files...\n");
+    uint64_t t_phase = timing_begin();
+    cpk_text("Is copying include files...\n");
     for (int i = 0; i < ctrl_info->include_file_count; i++) {
         char *dst_dir = NULL;
         if (asprintf(&dst_dir, "%s/include/", build_path) == -1) {
@@ -110,7 +171,7 @@ int make_build_package(const char *package_path_dir)
     }
 
     // 拷贝库文件
-    printf("Is copying lib files...\n");
+    cpk_text("Is copying lib files...\n");
     for (int i = 0; i < ctrl_info->lib_file_count; i++) {
         char *dst_dir = NULL;
         if (asprintf(&dst_dir, "%s/lib/", build_path) == -1) {
@@ -130,28 +191,33 @@ int make_build_package(const char *package_path_dir)
         free(dst_dir);
     }
 
+    timing_end(TIMING_COPY, t_phase);
+
     // 压缩
-    printf("Is compressing the package...\n");
+    cpk_text("Is compressing the package...\n");
     size_t tgz_malloc_size = 0;
+    t_phase = timing_begin();
     char *tgz_malloc_file = archive_create_tgz(build_path, &tgz_malloc_size);
+    timing_end(TIMING_COMPRESS, t_phase);
     if (!tgz_malloc_file) {
         cpk_printf(ERROR, "Error: create tgz file failed.\n");
         goto error;
     }
-    printf("OK, I compress the package.\n");
+    cpk_text("OK, I compress the package.\n");
 
     // 创建头部
-    printf("Is making header file...\n");
+    cpk_text("Is making header file...\n");
     CPK_Header *header = make_Header(ctrl_info);
     if (!header) {
         cpk_printf(ERROR, "Error: make header failed.\n");
         free(tgz_malloc_file);
         goto error;
     }
-    printf("OK, I make the header file.\n");
+    cpk_text("OK, I make the header file.\n");
 
     // 计算哈希
-    printf("Is calculating hash value...\n");
+    cpk_text("Is calculating hash value...\n");
+    t_phase = timing_begin();
     char *hash = sha256_mem((const unsigned char *)tgz_malloc_file, tgz_malloc_size); // 强制转换
     if (!hash) {
         cpk_printf(ERROR, "Error: calculate hash failed.\n");
@@ -170,10 +236,25 @@ int make_build_package(const char *package_path_dir)
     strncpy(header->hash, hash, sizeof(header->hash) - 1);
     header->hash[sizeof(header->hash) - 1] = '\0';
 
+    // 载荷的 Merkle 根，供多核校验与按块校验使用
+    Merkle_Builder tree;
+    if (merkle_init(&tree, NULL, 0) != 0 ||
+        merkle_update(&tree, tgz_malloc_file, tgz_malloc_size) != 0 ||
+        merkle_final(&tree, header->tree_hash) != 0) {
+        cpk_printf(ERROR, "Error: calculate tree hash failed.\n");
+        merkle_free(&tree);
+        free(hash);
+        free(header);
+        free(tgz_malloc_file);
+        goto error;
+    }
+    merkle_free(&tree);
+    timing_end(TIMING_HASH, t_phase);
+
     // 写入 .cpk 文件
-    printf("Is writing header file...\n");
+    cpk_text("Is writing header file...\n");
     char *header_file_path = NULL;
-    if (asprintf(&header_file_path, "%s/%s/%s-%s.cpk", cwd, package_path,
+    if (asprintf(&header_file_path, "%s/%s/%s-%s.cpk", base_dir, package_path,
                  ctrl_info->name, ctrl_info->version) == -1) {
         cpk_printf(ERROR, "Memory allocation failed.\n");
         free(hash);
@@ -181,6 +262,7 @@ int make_build_package(const char *package_path_dir)
         free(tgz_malloc_file);
         goto error;
     }
+    t_phase = timing_begin();
     FILE *header_file = fopen(header_file_path, "wb");
     if (!header_file) {
         cpk_printf(ERROR, "Error: create header file failed.\n");
@@ -209,9 +291,32 @@ int make_build_package(const char *package_path_dir)
         goto error;
     }
     fclose(header_file);
-    printf("OK, I build the package.\n");
-    printf("The package is saved in \"%s\"\n", header_file_path);
-    printf("The hash value is \"%s\"\n", hash);
+    timing_add(TIMING_FILES_CREATED, 1);
+    timing_add(TIMING_BYTES_WRITTEN, sizeof(CPK_Header) + tgz_malloc_size);
+    timing_end(TIMING_WRITE, t_phase);
+
+    // 整个包文件的叶子列表（<包文件>.tree），与索引中的 tree 字段配合用于下载时逐块校验
+    char file_tree[SHA256_HEX_LEN + 1] = "";
+    char *tree_path = NULL;
+    t_phase = timing_begin();
+    if (merkle_init(&tree, NULL, 0) != 0 ||
+        merkle_update(&tree, header, sizeof(CPK_Header)) != 0 ||
+        merkle_update(&tree, tgz_malloc_file, tgz_malloc_size) != 0 ||
+        merkle_final(&tree, file_tree) != 0 ||
+        asprintf(&tree_path, "%s%s", header_file_path, MERKLE_SUFFIX) == -1 ||
+        merkle_write_leaves(tree_path, tree.leaves, tree.count) != 0)
+        file_tree[0] = '\0';
+    merkle_free(&tree);
+    timing_end(TIMING_HASH, t_phase);
+    if (!file_tree[0])
+        cpk_printf(WARNING, "Failed to write the tree file, the package can only be verified as a whole\n");
+
+    cpk_text("OK, I build the package.\n");
+    cpk_text("The package is saved in \"%s\"\n", header_file_path);
+    cpk_text("The hash value is \"%s\"\n", hash);
+    if (file_tree[0])
+        cpk_text("The tree hash is \"%s\" (%s)\n", file_tree, tree_path);
+    free(tree_path);
 
     // 清理临时构建目录
     if (rm_rf(build_path))
@@ -225,8 +330,9 @@ int make_build_package(const char *package_path_dir)
     free(build_path);
     free(ctrl_file_path);
     free(package_path);
-    free(ctrl_info);   // 请确保实现了此函数
-    printf("Build package done.\n");
+    cpk_progress("build", ctrl_info->name, 1, 1);
+    control_info_free(ctrl_info);
+    cpk_text("Build package done.\n");
     return 0;
 
 error:
@@ -237,7 +343,6 @@ error:
     }
     free(ctrl_file_path);
     free(package_path);
-    if (ctrl_info)
-        free(ctrl_info);
+    control_info_free(ctrl_info);
     return 1;
 }
\ No newline at end of file
@@ -24,6 +24,11 @@
 #include <dirent.h>
 #include "../include/cpkg.h"
 #include "../include/help.h"
+#include "../include/status.h"
+#include "../include/manifest.h"
+#include "../include/lock.h"
+
+static int remove_locked(const char *pkg_name);
 
 /**
  * @brief 移除已安装的软件包
@@ -37,15 +42,42 @@ int remove_package(const char *pkg_name)
         return 1;
     }
 
-    // 检查权限
-    if (check_sudo_privileges() != 0) {
-        cpk_printf(ERROR, "This operation requires sudo privileges.\n");
+    // 先取包锁再取状态锁（与安装的加锁顺序一致）
+    int pkg_lock, state_lock = -1;
+    if (lock_packages(&pkg_name, 1, &pkg_lock) != 0)
         return 1;
-    }
+    int ret = 1;
+    if ((state_lock = lock_state(1)) >= 0)
+        ret = remove_locked(pkg_name);
+    lock_release(state_lock);
+    lock_release(pkg_lock);
+    if (ret == 0)
+        cpk_progress("remove", pkg_name, 1, 1);
+    return ret;
+}
 
+/**
+ * @brief 移除已安装的软件包，调用方已持有该包的包锁
+ * @param pkg_name 软件包名称
+ * @return 0 表示成功，非0表示失败
+ */
+int remove_package_held(const char *pkg_name)
+{
+    int ret = 1, state_lock = lock_state(1);
+    if (state_lock >= 0)
+        ret = remove_locked(pkg_name);
+    lock_release(state_lock);
+    if (ret == 0)
+        cpk_progress("remove", pkg_name, 1, 1);
+    return ret;
+}
+
+/* 持有锁时删除包目录与记录 */
+static int remove_locked(const char *pkg_name)
+{
     // 从工作目录查找已安装的包
     char pkg_install_path[MAX_PATH_LEN];
-    snprintf(pkg_install_path, MAX_PATH_LEN, "%s/%s/%s", WORK_DIR_NAME, INSTALL_DIR, pkg_name);
+    snprintf(pkg_install_path, MAX_PATH_LEN, "%s/%s/%s", cpk_work_dir(), INSTALL_DIR, pkg_name);
 
     // 检查包是否存在
     struct stat st;
@@ -63,12 +95,14 @@ int remove_package(const char *pkg_name)
     }
 
     // 列出移除前的内容（可选，用于调试）
-    printf("Verifying removal...\n");
+    cpk_text("Verifying removal...\n");
     if (stat(pkg_install_path, &st) == 0) {
         cpk_printf(WARNING, "Package directory still exists after removal attempt.\n");
         return 1;
     }
 
-    printf("Package '%s' removed successfully.\n", pkg_name);
+    status_remove(pkg_name);
+    manifest_remove(pkg_name);
+    cpk_text("Package '%s' removed successfully.\n", pkg_name);
     return 0;
 }
\ No newline at end of file
@@ -13,10 +13,11 @@
 #include <dirent.h>
 #include <archive.h>
 #include <archive_entry.h>
-#define OPENSSL_SUPPRESS_DEPRECATED
-#include <openssl/sha.h>
 #include "../include/cpkg.h"
-#include "../include/help.h"  // 假设 cpk_printf 在此定义
+#include "../include/help.h"
+#include "../include/hash.h"  // 假设 cpk_printf 在此定义
+#include "../include/timing.h"
+#include "../include/trace.h"
 
 /**
  * @brief 检查root权限
@@ -38,7 +39,9 @@ int check_sudo_privileges(void)
  */
 int tf_choose(const char *msg)
 {
-    printf("%s (Y/n) ", msg);
+    if (cpk_context()->assume_yes)
+        return 0;
+    cpk_text("%s (Y/n) ", msg);
     int ch = 0;
     while ((ch = getchar()) == '\n' || ch == EOF) continue;
     if (ch == 'y' || ch == 'Y') 
@@ -140,10 +143,15 @@ int cp_file(const char *src_file, const char *dst_dir)
 
     char buffer[FILE_BUFFER_SIZE];
     size_t n;
+    timing_add(TIMING_FILES_CREATED, 1);
+    trace_begin(TRACE_FILE, dst_path);
     while ((n = fread(buffer, 1, sizeof(buffer), src_fp)) > 0) {
-        if (fwrite(buffer, 1, n, dst_fp) != n) goto cleanup;
+        if (fwrite(buffer, 1, n, dst_fp) != n) break;
+        timing_add(TIMING_BYTES_READ, n);
+        timing_add(TIMING_BYTES_WRITTEN, n);
     }
-    if (ferror(src_fp)) goto cleanup;
+    trace_end(TRACE_FILE);
+    if (n > 0 || ferror(src_fp)) goto cleanup;
 
     ret = 0;
 
@@ -203,16 +211,16 @@ CPK_Header *make_Header(Control_Info *ctrl_info)
     if (!header) return NULL;
     memset(header, 0, sizeof(CPK_Header));
 
-    memcpy(header->magic, "CPKG", 4);
+    memcpy(header->magic, CPKG_MAGIC_V2, CPKG_MAGIC_LEN);
 
     // 临时哈希值
     strncpy(header->hash, "0", sizeof(header->hash) - 1);
     header->hash[sizeof(header->hash) - 1] = '\0';
 
-    // 安全复制：使用 strnlen 限制读取长度
+    // 安全复制：按目标字段长度截断
 #define SAFE_COPY(dest, src) \
     do { \
-        size_t src_len = strnlen(src, sizeof(src) - 1); \
+        size_t src_len = strnlen(src, sizeof(dest) - 1); \
         memcpy(dest, src, src_len); \
         dest[src_len] = '\0'; \
     } while (0)
@@ -227,6 +235,21 @@ CPK_Header *make_Header(Control_Info *ctrl_info)
     SAFE_COPY(header->lib_install_path, ctrl_info->lib_install_path);
 
 #undef SAFE_COPY
+
+    // 依赖以 ", " 连接写入头部，超出长度视为错误
+    size_t off = 0;
+    for (int i = 0; i < ctrl_info->depends_count; i++)
+    {
+        int n = snprintf(header->depends + off, sizeof(header->depends) - off, "%s%s",
+                         i ? ", " : "", ctrl_info->depends[i]);
+        if (n < 0 || (size_t)n >= sizeof(header->depends) - off)
+        {
+            cpk_printf(ERROR, "Dependency list too long (max %d bytes)\n", CPKG_DEPENDS_LEN - 1);
+            free(header);
+            return NULL;
+        }
+        off += n;
+    }
     return header;
 }
 
@@ -240,23 +263,29 @@ char *sha256_mem(const unsigned char *data, size_t len)
 {
     if (!data || len == 0) return NULL;
 
-    SHA256_CTX ctx;
-    if (!SHA256_Init(&ctx)) return NULL;
-    if (!SHA256_Update(&ctx, data, len)) return NULL;
-
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    if (!SHA256_Final(hash, &ctx)) return NULL;
-
-    char *hash_str = malloc(SHA256_DIGEST_LENGTH * 2 + 1);
+    char *hash_str = malloc(HASH_HEX_LEN + 1);
     if (!hash_str) return NULL;
-
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++)
-        sprintf(hash_str + i * 2, "%02x", hash[i]);
-    hash_str[SHA256_DIGEST_LENGTH * 2] = '\0';
-
+    if (hash_mem_hex(data, len, hash_str) != 0) {
+        free(hash_str);
+        return NULL;
+    }
     return hash_str;
 }
 
+/**
+ * @brief 根据魔数确定包头大小
+ * @param magic 文件开头的 CPKG_MAGIC_LEN 个字节
+ * @return 头部大小，未知魔数返回 0
+ */
+size_t cpk_header_size(const char *magic)
+{
+    if (memcmp(magic, CPKG_MAGIC, CPKG_MAGIC_LEN) == 0)
+        return CPK_HEADER_V1_SIZE;
+    if (memcmp(magic, CPKG_MAGIC_V2, CPKG_MAGIC_LEN) == 0)
+        return CPK_HEADER_V2_SIZE;
+    return 0;
+}
+
 /**
  * @brief 打印控制信息
  * @note 打印 Control_Info 结构体中的内容
@@ -264,19 +293,22 @@ char *sha256_mem(const unsigned char *data, size_t len)
  */
 void printf_control_info(Control_Info *ctrl_info)
 {
-    printf("package name: %s\n", ctrl_info->name);
-    printf("version: %s\n", ctrl_info->version);
-    printf("description: %s\n", ctrl_info->description);
-    printf("homepage: %s\n", ctrl_info->homepage);
-    printf("author: %s\n", ctrl_info->author);
-    printf("license: %s\n", ctrl_info->license);
-    printf("include_install_path: %s\n", ctrl_info->include_install_path);
-    printf("lib_install_path: %s\n", ctrl_info->lib_install_path);
-    printf("include_files:\n");
+    cpk_text("package name: %s\n", ctrl_info->name);
+    cpk_text("version: %s\n", ctrl_info->version);
+    cpk_text("description: %s\n", ctrl_info->description);
+    cpk_text("homepage: %s\n", ctrl_info->homepage);
+    cpk_text("author: %s\n", ctrl_info->author);
+    cpk_text("license: %s\n", ctrl_info->license);
+    cpk_text("include_install_path: %s\n", ctrl_info->include_install_path);
+    cpk_text("lib_install_path: %s\n", ctrl_info->lib_install_path);
+    cpk_text("include_files:\n");
     for (int i = 0; i < ctrl_info->include_file_count; i++)
-        printf("  %s\n", ctrl_info->include_files[i]);
-    printf("lib_files:\n");
+        cpk_text("  %s\n", ctrl_info->include_files[i]);
+    cpk_text("lib_files:\n");
     for (int i = 0; i < ctrl_info->lib_file_count; i++)
-        printf("  %s\n", ctrl_info->lib_files[i]);
-    printf("\n");
+        cpk_text("  %s\n", ctrl_info->lib_files[i]);
+    cpk_text("depends:\n");
+    for (int i = 0; i < ctrl_info->depends_count; i++)
+        cpk_text("  %s\n", ctrl_info->depends[i]);
+    cpk_text("\n");
 }
@@ -0,0 +1,587 @@
+#define _GNU_SOURCE   // accept4、pipe2、ppoll 与 struct ucred
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "../include/daemon.h"
+#include "../include/cpkg.h"
+#include "../include/help.h"
+#include "../include/index.h"
+#include "../include/repo.h"
+
+#define DAEMON_ENTRY_BATCH 256          // 每个 ENTRIES 帧最多包含的记录数
+#define DAEMON_OUTPUT_CHUNK 4096
+
+/* ---------- 帧的收发 ---------- */
+
+static int write_all(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = iovcnt };
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int send_frame(int fd, uint8_t op, uint16_t count, const void *payload, uint32_t len)
+{
+    Daemon_Header h = { DAEMON_MAGIC, DAEMON_VERSION, op, count, len };
+    struct iovec iov[2] = { { &h, sizeof(h) }, { (void *)payload, len } };
+    return write_all(fd, iov, len > 0 ? 2 : 1);
+}
+
+/* 读取一帧，*payload 以 '\0' 结尾，由调用方 free */
+static int recv_frame(int fd, Daemon_Header *h, char **payload)
+{
+    if (read_all(fd, h, sizeof(*h)) != 0)
+        return -1;
+    if (h->magic != DAEMON_MAGIC || h->version != DAEMON_VERSION || h->len > DAEMON_MAX_PAYLOAD)
+        return -1;
+    *payload = malloc(h->len + 1);
+    if (!*payload)
+        return -1;
+    if (read_all(fd, *payload, h->len) != 0) {
+        free(*payload);
+        return -1;
+    }
+    (*payload)[h->len] = '\0';
+    return 0;
+}
+
+/* 把负载拆分为 count 个字符串（指向 payload 内部），格式不符返回 NULL */
+static const char **unpack_args(char *payload, uint32_t len, uint16_t count)
+{
+    const char **args = calloc(count + 1, sizeof(char *));
+    if (!args)
+        return NULL;
+    uint32_t off = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        char *nul = off < len ? memchr(payload + off, '\0', len - off) : NULL;
+        if (!nul) {
+            free(args);
+            return NULL;
+        }
+        args[i] = payload + off;
+        off = (uint32_t)(nul - payload) + 1;
+    }
+    return args;
+}
+
+void daemon_socket_path(char *out, size_t len)
+{
+    const char *env = getenv(DAEMON_SOCKET_ENV);
+    const char *run = getenv("XDG_RUNTIME_DIR");
+    if (env && env[0])
+        snprintf(out, len, "%s", env);
+    else if (run && run[0])
+        snprintf(out, len, "%s/cpkgd.sock", run);
+    else
+        snprintf(out, len, "/tmp/cpkgd-%u.sock", (unsigned)getuid());
+}
+
+static int socket_address(const char *path, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path))
+        return -1;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/* ---------- 客户端 ---------- */
+
+int daemon_request(uint8_t op, const char **args, uint16_t count)
+{
+    const char *off = getenv(DAEMON_DISABLE_ENV);
+    if (off && strcmp(off, "1") == 0)
+        return -1;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path) + 1];
+    struct sockaddr_un addr;
+    daemon_socket_path(path, sizeof(path));
+    if (socket_address(path, &addr) != 0)
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    size_t len = 0;
+    for (uint16_t i = 0; i < count; i++)
+        len += strlen(args[i]) + 1;
+    char *payload = malloc(len ? len : 1);
+    if (!payload || len > DAEMON_MAX_PAYLOAD) {
+        free(payload);
+        close(fd);
+        return -1;
+    }
+    char *p = payload;
+    for (uint16_t i = 0; i < count; i++) {
+        size_t n = strlen(args[i]) + 1;
+        memcpy(p, args[i], n);
+        p += n;
+    }
+    int sent = send_frame(fd, op, count, payload, (uint32_t)len);
+    free(payload);
+    if (sent != 0) {
+        close(fd);
+        return -1;
+    }
+
+    // 还没收到任何应答就断开时视为 cpkgd 不可用，请求未被执行
+    int ret = -1, frames = 0;
+    Daemon_Header h;
+    char *data;
+    while (recv_frame(fd, &h, &data) == 0) {
+        frames++;
+        if (h.op == DAEMON_OUTPUT) {
+            fwrite(data, 1, h.len, stdout);
+        } else if (h.op == DAEMON_ENTRIES) {
+            const char **fields = unpack_args(data, h.len, h.count);
+            for (uint16_t i = 0; fields && i + 2 < h.count; i += 3)
+                printf("%s\t%s\t%s\n", fields[i], fields[i + 1], fields[i + 2]);
+            free(fields);
+        } else if (h.op == DAEMON_DONE && h.len == sizeof(int32_t)) {
+            int32_t status;
+            memcpy(&status, data, sizeof(status));
+            ret = status;
+            free(data);
+            break;
+        }
+        free(data);
+    }
+    close(fd);
+    if (ret == -1 && frames > 0) {
+        cpk_printf(ERROR, "Lost connection to cpkgd\n");
+        ret = 1;
+    }
+    return ret;
+}
+
+/* ---------- 服务端 ---------- */
+
+/* 修改状态的请求，由队列线程依次执行 */
+typedef struct Daemon_Job {
+    struct Daemon_Job *next;
+    uint8_t op;
+    const char **args;
+    uint16_t count;
+    int out_fd;                 // 输出管道的写入端，执行期间作为标准输出
+    int done;
+    int status;
+} Daemon_Job;
+
+static struct {
+    pthread_rwlock_t index_lock;
+    Repo_Index index;
+    int loaded;
+    time_t loaded_at;           // 0 表示下次使用前刷新
+    int ttl;
+    // 当前目录与标准输出是进程级的：执行队列任务与刷新索引时持有
+    pthread_mutex_t io_lock;
+    int home_fd;
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_cond;
+    Daemon_Job *head, *tail;
+    int busy;
+} server = {
+    .index_lock = PTHREAD_RWLOCK_INITIALIZER,
+    .io_lock = PTHREAD_MUTEX_INITIALIZER,
+    .queue_lock = PTHREAD_MUTEX_INITIALIZER,
+    .queue_cond = PTHREAD_COND_INITIALIZER,
+    .home_fd = -1,
+};
+
+static volatile sig_atomic_t stopping;
+
+/**
+ * @brief 取得索引的读锁，索引过期时先刷新
+ * @return 0 成功（调用方随后调用 release_index），-1 没有可用的索引
+ * @note 刷新失败时继续使用旧索引，ttl 秒后再试
+ */
+static int acquire_index(void)
+{
+    pthread_rwlock_rdlock(&server.index_lock);
+    if (server.loaded && time(NULL) - server.loaded_at < server.ttl)
+        return 0;
+    pthread_rwlock_unlock(&server.index_lock);
+
+    pthread_rwlock_wrlock(&server.index_lock);
+    if (!server.loaded || time(NULL) - server.loaded_at >= server.ttl) {
+        Repo_Index fresh;
+        pthread_mutex_lock(&server.io_lock);
+        int r = repo_load_index(&fresh);
+        pthread_mutex_unlock(&server.io_lock);
+        if (r == 0) {
+            if (server.loaded)
+                index_free(&server.index);
+            server.index = fresh;
+            server.loaded = 1;
+            cpk_printf(INFO, "Index loaded: %zu package(s)\n", fresh.count);
+        } else if (server.loaded) {
+            cpk_printf(WARNING, "Index refresh failed, keeping the previous index\n");
+        }
+        server.loaded_at = time(NULL);
+    }
+    pthread_rwlock_unlock(&server.index_lock);
+
+    pthread_rwlock_rdlock(&server.index_lock);
+    if (server.loaded)
+        return 0;
+    pthread_rwlock_unlock(&server.index_lock);
+    return -1;
+}
+
+static void release_index(void)
+{
+    pthread_rwlock_unlock(&server.index_lock);
+}
+
+static int send_text(int fd, const char *text)
+{
+    return send_frame(fd, DAEMON_OUTPUT, 0, text, (uint32_t)strlen(text));
+}
+
+/* 搜索：与 repo_search 相同的匹配规则，结果分批以 ENTRIES 帧返回 */
+static int serve_search(int fd, const char *query)
+{
+    if (acquire_index() != 0) {
+        send_text(fd, "cpkgd: failed to load index\n");
+        return 1;
+    }
+    size_t cap = 64 * 1024, len = 0;
+    char *buf = malloc(cap);
+    uint16_t n = 0;
+    int ret = buf ? 0 : 1;
+    for (size_t i = 0; ret == 0 && i < server.index.count; i++) {
+        const Index_Entry *e = &server.index.entries[i];
+        if (!strstr(e->name, query) && !strstr(e->version, query) &&
+            !strstr(e->url, query) && !strstr(e->sha256, query))
+            continue;
+        const char *fields[3] = { e->name, e->version, e->url };
+        size_t need = strlen(e->name) + strlen(e->version) + strlen(e->url) + 3;
+        if (n > 0 && (len + need > cap || n >= DAEMON_ENTRY_BATCH * 3)) {
+            ret = send_frame(fd, DAEMON_ENTRIES, n, buf, (uint32_t)len);
+            len = 0;
+            n = 0;
+        }
+        if (need > cap) {
+            char *t = realloc(buf, need);
+            if (!t) {
+                ret = 1;
+                break;
+            }
+            buf = t;
+            cap = need;
+        }
+        for (int k = 0; k < 3; k++) {
+            size_t l = strlen(fields[k]) + 1;
+            memcpy(buf + len, fields[k], l);
+            len += l;
+        }
+        n += 3;
+    }
+    if (ret == 0 && n > 0)
+        ret = send_frame(fd, DAEMON_ENTRIES, n, buf, (uint32_t)len);
+    release_index();
+    free(buf);
+    return ret != 0;
+}
+
+/* 在队列线程中执行：标准输出重定向到请求方的管道，当前目录切换为请求方的目录 */
+static int run_job(Daemon_Job *job)
+{
+    const char *cwd = job->args[0];
+    int jobs = atoi(job->args[1]);
+    const char **names = job->args + 2;
+    size_t count = job->count - 2;
+    int index_ok = acquire_index() == 0;
+
+    pthread_mutex_lock(&server.io_lock);
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(job->out_fd, STDOUT_FILENO);
+    close(job->out_fd);
+
+    int ret = 0;
+    if (!index_ok) {
+        cpk_printf(ERROR, "Failed to download index\n");
+        ret = 2;
+    } else if (chdir(cwd) != 0) {
+        cpk_printf(ERROR, "Cannot change directory to %s: %s\n", cwd, strerror(errno));
+        ret = 1;
+    } else if (job->op == DAEMON_FETCH) {
+        char (*dests)[MAX_PATH_LEN] = calloc(count, sizeof(*dests));
+        const char **dest_ptrs = calloc(count, sizeof(char *));
+        if (!dests || !dest_ptrs) {
+            ret = 2;
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                snprintf(dests[i], MAX_PATH_LEN, "%s.cpk", names[i]);
+                dest_ptrs[i] = dests[i];
+            }
+            ret = repo_fetch_from_index(&server.index, names, dest_ptrs, count, jobs);
+        }
+        free(dests);
+        free(dest_ptrs);
+    } else {
+        ret = repo_install_from_index(&server.index, names, count, jobs);
+    }
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    if (fchdir(server.home_fd) != 0)
+        cpk_printf(WARNING, "Cannot return to the daemon directory: %s\n", strerror(errno));
+    pthread_mutex_unlock(&server.io_lock);
+    if (index_ok)
+        release_index();
+    return ret;
+}
+
+static void *queue_worker(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&server.queue_lock);
+        while (!server.head)
+            pthread_cond_wait(&server.queue_cond, &server.queue_lock);
+        Daemon_Job *job = server.head;
+        server.head = job->next;
+        if (!server.head)
+            server.tail = NULL;
+        server.busy = 1;
+        pthread_mutex_unlock(&server.queue_lock);
+
+        int status = run_job(job);
+
+        pthread_mutex_lock(&server.queue_lock);
+        job->status = status;
+        job->done = 1;
+        server.busy = 0;
+        pthread_cond_broadcast(&server.queue_cond);
+        pthread_mutex_unlock(&server.queue_lock);
+    }
+    return NULL;
+}
+
+/* 把修改状态的请求排入队列，转发其输出直到执行结束 */
+static int serve_queued(int fd, uint8_t op, const char **args, uint16_t count)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        return 1;
+    Daemon_Job job = { .op = op, .args = args, .count = count, .out_fd = fds[1] };
+    pthread_mutex_lock(&server.queue_lock);
+    if (server.tail)
+        server.tail->next = &job;
+    else
+        server.head = &job;
+    server.tail = &job;
+    pthread_cond_broadcast(&server.queue_cond);
+    pthread_mutex_unlock(&server.queue_lock);
+
+    // 请求方断开后继续读空管道，任务照常执行完
+    char buf[DAEMON_OUTPUT_CHUNK];
+    int client_ok = 1;
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (client_ok && send_frame(fd, DAEMON_OUTPUT, 0, buf, (uint32_t)n) != 0)
+            client_ok = 0;
+    }
+    close(fds[0]);
+
+    pthread_mutex_lock(&server.queue_lock);
+    while (!job.done)
+        pthread_cond_wait(&server.queue_cond, &server.queue_lock);
+    pthread_mutex_unlock(&server.queue_lock);
+    return job.status;
+}
+
+static int handle_request(int fd, uint8_t op, const char **args, uint16_t count)
+{
+    switch (op) {
+    case DAEMON_PING:
+        return 0;
+    case DAEMON_RELOAD:
+        pthread_rwlock_wrlock(&server.index_lock);
+        server.loaded_at = 0;
+        pthread_rwlock_unlock(&server.index_lock);
+        return 0;
+    case DAEMON_SEARCH:
+        if (count == 1)
+            return serve_search(fd, args[0]);
+        break;
+    case DAEMON_FETCH:
+    case DAEMON_INSTALL:
+        if (count >= 3)
+            return serve_queued(fd, op, args, count);
+        break;
+    }
+    send_text(fd, "cpkgd: invalid request\n");
+    return 1;
+}
+
+static void *serve_client(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    // socket 文件只对本用户开放，这里再确认对方是本用户或 root
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 ||
+        (cred.uid != 0 && cred.uid != geteuid())) {
+        close(fd);
+        return NULL;
+    }
+    Daemon_Header h;
+    char *payload;
+    while (recv_frame(fd, &h, &payload) == 0) {
+        const char **args = unpack_args(payload, h.len, h.count);
+        int32_t status = args ? handle_request(fd, h.op, args, h.count) : 1;
+        free(args);
+        free(payload);
+        if (send_frame(fd, DAEMON_DONE, 0, &status, sizeof(status)) != 0)
+            break;
+    }
+    close(fd);
+    return NULL;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stopping = 1;
+}
+
+int daemon_serve(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    if (socket_address(socket_path, &addr) != 0) {
+        cpk_printf(ERROR, "Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    const char *ttl = getenv(DAEMON_TTL_ENV);
+    server.ttl = ttl && atoi(ttl) > 0 ? atoi(ttl) : DAEMON_DEFAULT_TTL;
+    server.home_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (server.home_fd < 0) {
+        cpk_printf(ERROR, "Cannot open the current directory: %s\n", strerror(errno));
+        return 1;
+    }
+    setvbuf(stdout, NULL, _IOLBF, 0);  // 转发给请求方的输出按行到达
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return 1;
+    // 已有 cpkgd 在监听时退出；否则删除残留的 socket 文件
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        cpk_printf(ERROR, "cpkgd is already running on %s\n", socket_path);
+        close(fd);
+        return 1;
+    }
+    close(fd);
+    unlink(socket_path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    mode_t old_mask = umask(077);
+    int bound = fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    umask(old_mask);
+    if (!bound || listen(fd, SOMAXCONN) != 0) {
+        cpk_printf(ERROR, "Cannot listen on %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+
+    // 信号只在主线程的 ppoll 中解除屏蔽，收到后退出监听
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    sigset_t block, prev;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &prev);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t tid;
+    if (pthread_create(&tid, &attr, queue_worker, NULL) != 0) {
+        cpk_printf(ERROR, "Failed to start the queue thread\n");
+        close(fd);
+        unlink(socket_path);
+        return 1;
+    }
+    cpk_printf(INFO, "cpkgd listening on %s\n", socket_path);
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    while (!stopping) {
+        if (ppoll(&pfd, 1, NULL, &prev) <= 0)
+            continue;
+        int c = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+        if (c < 0)
+            continue;
+        if (pthread_create(&tid, &attr, serve_client, (void *)(intptr_t)c) != 0)
+            close(c);
+    }
+    pthread_attr_destroy(&attr);
+    close(fd);
+    unlink(socket_path);
+
+    // 等待正在执行与排队的修改操作完成
+    pthread_mutex_lock(&server.queue_lock);
+    while (server.head || server.busy)
+        pthread_cond_wait(&server.queue_cond, &server.queue_lock);
+    pthread_mutex_unlock(&server.queue_lock);
+    cpk_printf(INFO, "cpkgd stopped\n");
+    return 0;
+}
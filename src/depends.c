@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "../include/depends.h"
+#include "../include/version.h"
+#include "../include/status.h"
+#include "../include/cpkg.h"
+#include "../include/help.h"
+
+/* 关系运算符表（较长的写法在前，保证最长匹配） */
+static const struct {
+    const char *text;
+    Dep_Op op;
+} dep_ops[] = {
+    { "<<", DEP_LT }, { "<=", DEP_LE }, { ">=", DEP_GE }, { ">>", DEP_GT },
+    { "==", DEP_EQ }, { "=", DEP_EQ }, { "<", DEP_LT }, { ">", DEP_GT },
+};
+
+static const char *op_text(Dep_Op op)
+{
+    switch (op) {
+    case DEP_LT: return "<<";
+    case DEP_LE: return "<=";
+    case DEP_EQ: return "=";
+    case DEP_GE: return ">=";
+    case DEP_GT: return ">>";
+    default: return "";
+    }
+}
+
+/* 解析单个依赖项 [s, e)，成功返回 0 */
+static int parse_item(const char *s, const char *e, Dep_Spec *out)
+{
+    memset(out, 0, sizeof(*out));
+    while (s < e && isspace((unsigned char)*s)) s++;
+    while (e > s && isspace((unsigned char)e[-1])) e--;
+    if (s == e)
+        return 1;  // 空项
+
+    const char *name_end = s;
+    while (name_end < e && !isspace((unsigned char)*name_end) && !strchr("(<>=", *name_end))
+        name_end++;
+    size_t nlen = name_end - s;
+    if (nlen == 0 || nlen >= sizeof(out->name))
+        return -1;
+    memcpy(out->name, s, nlen);
+
+    const char *p = name_end;
+    while (p < e && isspace((unsigned char)*p)) p++;
+    if (p == e)
+        return 0;
+    int paren = (*p == '(');
+    if (paren) {
+        if (e[-1] != ')')
+            return -1;
+        p++;
+        e--;
+        while (p < e && isspace((unsigned char)*p)) p++;
+    }
+    size_t i;
+    for (i = 0; i < sizeof(dep_ops) / sizeof(dep_ops[0]); i++) {
+        size_t olen = strlen(dep_ops[i].text);
+        if ((size_t)(e - p) >= olen && strncmp(p, dep_ops[i].text, olen) == 0) {
+            out->op = dep_ops[i].op;
+            p += olen;
+            break;
+        }
+    }
+    if (i == sizeof(dep_ops) / sizeof(dep_ops[0]))
+        return -1;
+    while (p < e && isspace((unsigned char)*p)) p++;
+    while (e > p && isspace((unsigned char)e[-1])) e--;
+    size_t vlen = e - p;
+    if (vlen == 0 || vlen >= sizeof(out->version))
+        return -1;
+    for (const char *c = p; c < e; c++)
+        if (isspace((unsigned char)*c))
+            return -1;
+    memcpy(out->version, p, vlen);
+    return 0;
+}
+
+int dep_parse_list(const char *list, Dep_Spec **out, size_t *count)
+{
+    *out = NULL;
+    *count = 0;
+    if (!list || !*list)
+        return 0;
+    size_t cap = 1;
+    for (const char *c = list; *c; c++)
+        if (*c == ',')
+            cap++;
+    Dep_Spec *specs = calloc(cap, sizeof(Dep_Spec));
+    if (!specs)
+        return -1;
+    const char *p = list;
+    while (1) {
+        const char *comma = strchr(p, ',');
+        const char *end = comma ? comma : p + strlen(p);
+        int r = parse_item(p, end, &specs[*count]);
+        if (r < 0) {
+            cpk_printf(ERROR, "Invalid dependency: %.*s\n", (int)(end - p), p);
+            free(specs);
+            *count = 0;
+            return -1;
+        }
+        if (r == 0)
+            (*count)++;
+        if (!comma)
+            break;
+        p = comma + 1;
+    }
+    *out = specs;
+    return 0;
+}
+
+int dep_satisfied(const Dep_Spec *dep, const char *version)
+{
+    if (dep->op == DEP_ANY)
+        return 1;
+    int c = version_compare(version, dep->version);
+    switch (dep->op) {
+    case DEP_LT: return c < 0;
+    case DEP_LE: return c <= 0;
+    case DEP_EQ: return c == 0;
+    case DEP_GE: return c >= 0;
+    case DEP_GT: return c > 0;
+    default: return 1;
+    }
+}
+
+void dep_format(const Dep_Spec *dep, char *out, size_t len)
+{
+    if (dep->op == DEP_ANY)
+        snprintf(out, len, "%s", dep->name);
+    else
+        snprintf(out, len, "%s (%s %s)", dep->name, op_text(dep->op), dep->version);
+}
+
+/* 解析过程中的状态 */
+typedef struct {
+    const Repo_Index *index;
+    Install_Plan *plan;
+    size_t capacity;
+    long *slot;       // 索引记录下标 -> 计划项下标（-1 表示不在计划中）
+    int *color;       // 分层时的 DFS 状态：0 未访问，1 访问中，2 完成
+} Resolver;
+
+/* 把索引记录加入计划（已存在时返回已有下标），失败返回 -1 */
+static long plan_add(Resolver *r, const Index_Entry *entry, int requested)
+{
+    size_t pos = entry - r->index->entries;
+    if (r->slot[pos] >= 0) {
+        r->plan->items[r->slot[pos]].requested |= requested;
+        return r->slot[pos];
+    }
+    Install_Plan *plan = r->plan;
+    if (plan->count == r->capacity) {
+        size_t ncap = r->capacity ? r->capacity * 2 : 16;
+        Plan_Item *t = realloc(plan->items, ncap * sizeof(Plan_Item));
+        if (!t)
+            return -1;
+        plan->items = t;
+        r->capacity = ncap;
+    }
+    Plan_Item *item = &plan->items[plan->count];
+    memset(item, 0, sizeof(*item));
+    item->entry = entry;
+    item->requested = requested;
+    r->slot[pos] = (long)plan->count;
+    return (long)plan->count++;
+}
+
+static int add_edge(Plan_Item *item, size_t dep)
+{
+    for (size_t i = 0; i < item->dep_count; i++)
+        if (item->deps[i] == dep)
+            return 0;
+    size_t *t = realloc(item->deps, (item->dep_count + 1) * sizeof(size_t));
+    if (!t)
+        return -1;
+    t[item->dep_count++] = dep;
+    item->deps = t;
+    return 0;
+}
+
+/* 展开第 i 项的依赖 */
+static int expand_item(Resolver *r, size_t i)
+{
+    const Index_Entry *entry = r->plan->items[i].entry;
+    Dep_Spec *specs;
+    size_t n;
+    if (dep_parse_list(entry->depends, &specs, &n) != 0) {
+        cpk_printf(ERROR, "Package %s has invalid dependencies\n", entry->name);
+        return -1;
+    }
+    int ret = 0;
+    for (size_t k = 0; k < n && ret == 0; k++) {
+        const Dep_Spec *dep = &specs[k];
+        char text[sizeof(dep->name) + sizeof(dep->version) + 8];
+        dep_format(dep, text, sizeof(text));
+        const Index_Entry *target = index_find(r->index, dep->name);
+        long in_plan = target ? r->slot[target - r->index->entries] : -1;
+        if (in_plan < 0) {
+            // 已安装且满足要求的依赖不重新安装
+            Installed_Pkg inst;
+            if (status_read(dep->name, &inst) == 0 && dep_satisfied(dep, inst.version))
+                continue;
+        }
+        if (!target) {
+            cpk_printf(ERROR, "Unresolvable dependency %s required by %s\n", text, entry->name);
+            ret = -1;
+        } else if (!dep_satisfied(dep, target->version)) {
+            cpk_printf(ERROR, "%s requires %s, but the index provides %s\n",
+                       entry->name, text, target->version);
+            ret = -1;
+        } else {
+            long d = plan_add(r, target, 0);
+            // plan_add 可能重新分配 items，重新取地址
+            if (d < 0 || add_edge(&r->plan->items[i], (size_t)d) != 0)
+                ret = -1;
+        }
+    }
+    free(specs);
+    return ret;
+}
+
+/* DFS 计算层号：level = 1 + max(依赖的层号)，遇到环时返回 -1 */
+static int compute_level(Resolver *r, size_t i)
+{
+    Plan_Item *item = &r->plan->items[i];
+    if (r->color[i] == 2)
+        return item->level;
+    if (r->color[i] == 1) {
+        cpk_printf(ERROR, "Dependency cycle involving %s\n", item->entry->name);
+        return -1;
+    }
+    r->color[i] = 1;
+    int level = 0;
+    for (size_t k = 0; k < item->dep_count; k++) {
+        int l = compute_level(r, item->deps[k]);
+        if (l < 0)
+            return -1;
+        if (l + 1 > level)
+            level = l + 1;
+    }
+    item->level = level;
+    r->color[i] = 2;
+    return level;
+}
+
+static int cmp_level(const void *a, const void *b, void *arg)
+{
+    const Plan_Item *items = arg;
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    if (items[x].level != items[y].level)
+        return items[x].level - items[y].level;
+    return (x > y) - (x < y);
+}
+
+/* 按层排序并重写依赖下标 */
+static int sort_by_level(Install_Plan *plan)
+{
+    size_t n = plan->count;
+    size_t *order = malloc(n * sizeof(size_t));
+    size_t *remap = malloc(n * sizeof(size_t));
+    Plan_Item *sorted = malloc(n * sizeof(Plan_Item));
+    if (!order || !remap || !sorted) {
+        free(order);
+        free(remap);
+        free(sorted);
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++)
+        order[i] = i;
+    qsort_r(order, n, sizeof(size_t), cmp_level, plan->items);
+    for (size_t i = 0; i < n; i++) {
+        remap[order[i]] = i;
+        sorted[i] = plan->items[order[i]];
+    }
+    for (size_t i = 0; i < n; i++)
+        for (size_t k = 0; k < sorted[i].dep_count; k++)
+            sorted[i].deps[k] = remap[sorted[i].deps[k]];
+    free(plan->items);
+    plan->items = sorted;
+    free(order);
+    free(remap);
+    return 0;
+}
+
+int dep_resolve(const Repo_Index *index, const char **names, size_t count, Install_Plan *plan)
+{
+    memset(plan, 0, sizeof(*plan));
+    Resolver r = { index, plan, 0, NULL, NULL };
+    r.slot = malloc((index->count ? index->count : 1) * sizeof(long));
+    if (!r.slot)
+        return 2;
+    for (size_t i = 0; i < index->count; i++)
+        r.slot[i] = -1;
+
+    int ret = 0;
+    for (size_t i = 0; i < count && ret == 0; i++) {
+        const Index_Entry *entry = index_find(index, names[i]);
+        if (!entry) {
+            cpk_printf(ERROR, "Package not found in index: %s\n", names[i]);
+            ret = 3;
+        } else if (plan_add(&r, entry, 1) < 0) {
+            ret = 2;
+        }
+    }
+    // 广度优先展开，plan->count 在展开过程中增长
+    for (size_t i = 0; i < plan->count && ret == 0; i++)
+        if (expand_item(&r, i) != 0)
+            ret = 5;
+
+    if (ret == 0) {
+        r.color = calloc(plan->count ? plan->count : 1, sizeof(int));
+        if (!r.color)
+            ret = 2;
+        for (size_t i = 0; i < plan->count && ret == 0; i++) {
+            int l = compute_level(&r, i);
+            if (l < 0)
+                ret = 5;
+            else if (l + 1 > plan->levels)
+                plan->levels = l + 1;
+        }
+    }
+    if (ret == 0 && sort_by_level(plan) != 0)
+        ret = 2;
+    free(r.slot);
+    free(r.color);
+    if (ret != 0)
+        dep_plan_free(plan);
+    return ret;
+}
+
+void dep_plan_free(Install_Plan *plan)
+{
+    if (!plan)
+        return;
+    for (size_t i = 0; i < plan->count; i++)
+        free(plan->items[i].deps);
+    free(plan->items);
+    memset(plan, 0, sizeof(*plan));
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../include/durability.h"
+#include "../include/context.h"
+
+static const char *const mode_names[] = { "default", "none", "batch", "strict" };
+
+int durability_parse(const char *name)
+{
+    for (int i = DURABILITY_NONE; i <= DURABILITY_STRICT; i++)
+        if (name && strcmp(name, mode_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+const char *durability_name(Durability_Mode mode)
+{
+    return mode >= DURABILITY_DEFAULT && mode <= DURABILITY_STRICT ? mode_names[mode] : "?";
+}
+
+Durability_Mode durability_mode(void)
+{
+    int mode = cpk_context()->durability;
+    if (mode == DURABILITY_DEFAULT) {
+        const char *env = getenv(DURABILITY_ENV);
+        mode = env && *env ? durability_parse(env) : -1;
+    }
+    return mode > DURABILITY_DEFAULT ? (Durability_Mode)mode : DURABILITY_BATCH;
+}
+
+int durability_syncfs(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    int ret = syncfs(fd);
+    if (ret != 0 && errno == ENOSYS) {
+        sync();
+        ret = 0;
+    }
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return ret;
+}
+
+int durability_sync_file(FILE *fp)
+{
+    if (durability_mode() != DURABILITY_STRICT)
+        return 0;
+    return fflush(fp) == 0 && fsync(fileno(fp)) == 0 ? 0 : -1;
+}
+
+int durability_sync_dir(const char *dir)
+{
+    if (durability_mode() != DURABILITY_STRICT)
+        return 0;
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    int ret = fsync(fd);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return ret;
+}
+
+struct Sync_Pool {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    int fds[DURABILITY_QUEUE_LEN];  // 环形队列
+    size_t head;
+    size_t count;
+    int closing;
+    int error;                      // 第一个失败的 errno
+    int threads;
+    pthread_t tid[];
+};
+
+/* fsync 后关闭，失败时返回 errno */
+static int sync_close(int fd)
+{
+    int err = fsync(fd) != 0 ? errno : 0;
+    if (close(fd) != 0 && err == 0)
+        err = errno;
+    return err;
+}
+
+static void *sync_worker(void *arg)
+{
+    Sync_Pool *p = (Sync_Pool *)arg;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->count == 0 && !p->closing)
+            pthread_cond_wait(&p->not_empty, &p->lock);
+        if (p->count == 0)
+            break;
+        int fd = p->fds[p->head];
+        p->head = (p->head + 1) % DURABILITY_QUEUE_LEN;
+        p->count--;
+        pthread_cond_signal(&p->not_full);
+        pthread_mutex_unlock(&p->lock);
+        int err = sync_close(fd);
+        pthread_mutex_lock(&p->lock);
+        if (err && !p->error)
+            p->error = err;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+Sync_Pool *sync_pool_new(int threads)
+{
+    if (threads <= 0)
+        threads = 1;
+    Sync_Pool *p = calloc(1, sizeof(Sync_Pool) + (size_t)threads * sizeof(pthread_t));
+    if (!p)
+        return NULL;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->not_empty, NULL);
+    pthread_cond_init(&p->not_full, NULL);
+    while (p->threads < threads && pthread_create(&p->tid[p->threads], NULL, sync_worker, p) == 0)
+        p->threads++;
+    if (p->threads == 0) {
+        pthread_cond_destroy(&p->not_full);
+        pthread_cond_destroy(&p->not_empty);
+        pthread_mutex_destroy(&p->lock);
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+int sync_pool_submit(Sync_Pool *p, int fd)
+{
+    if (!p) {
+        int err = sync_close(fd);
+        errno = err;
+        return err ? -1 : 0;
+    }
+    pthread_mutex_lock(&p->lock);
+    while (p->count == DURABILITY_QUEUE_LEN)
+        pthread_cond_wait(&p->not_full, &p->lock);
+    p->fds[(p->head + p->count) % DURABILITY_QUEUE_LEN] = fd;
+    p->count++;
+    pthread_cond_signal(&p->not_empty);
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
+
+int sync_pool_finish(Sync_Pool *p)
+{
+    if (!p)
+        return 0;
+    pthread_mutex_lock(&p->lock);
+    p->closing = 1;
+    pthread_cond_broadcast(&p->not_empty);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 0; i < p->threads; i++)
+        pthread_join(p->tid[i], NULL);
+    int err = p->error;
+    pthread_cond_destroy(&p->not_full);
+    pthread_cond_destroy(&p->not_empty);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+    errno = err;
+    return err ? -1 : 0;
+}
@@ -5,82 +5,845 @@
 #include <unistd.h>
 #include <limits.h>
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/openat2.h>
 #include "../include/cpkg.h"
+#include "../include/help.h"
+#include "../include/timing.h"
+#include "../include/trace.h"
+#include "../include/context.h"
+#include "../include/durability.h"
+#include "../include/uring_writer.h"
+
+/*
+ * 包中的条目几乎都是不带 ACL 与文件标志的普通文件、目录和符号链接，由快速路径
+ * 直接写入：相对目标目录的 *at 调用，文件创建时即带上权限（umask 不影响时不再
+ * fchmod），大文件先预分配，数据经 1 MiB 缓冲写出，时间用 futimens 在打开的
+ * 描述符上设置；目录与符号链接的权限和时间在所有条目写完后统一设置。
+ * 不超过 1 MiB 的文件读入内存后交给 io_uring 写入器（uring_writer.h），openat/write/close
+ * 在内核中异步完成，解压继续进行，权限与时间同样在最后设置；io_uring 不可用时同步写入。
+ * strict 持久化模式下文件写完、目录设置完后交给同步线程池 fsync，解压继续进行。
+ * 快速路径只在不经过符号链接、不离开目标目录的父目录中创建条目（openat2 的
+ * RESOLVE_BENEATH|RESOLVE_NO_SYMLINKS，内核不支持时逐级以 O_NOFOLLOW 打开），
+ * 父目录的描述符缓存到下一个目录不同的条目。
+ * 其余条目（设备、FIFO、带 ACL 或文件标志、目标已存在、路径经过符号链接等）交给
+ * archive_write_disk，同样不允许经过符号链接或 ".."。
+ */
+
+#define EXTRACT_BUFFER_SIZE   (1024 * 1024)  // 写缓冲大小
+#define EXTRACT_FALLOCATE_MIN (64 * 1024)    // 小文件一次写完，预分配没有收益
+
+/* 目录与符号链接延后设置的元数据 */
+typedef struct {
+    char *path;                 // 相对目标目录
+    mode_t mode;
+    int chmod;                  // 是否需要设置权限
+    int times;                  // 是否需要设置时间
+    int nofollow;               // 符号链接本身
+    int sync;                   // strict 模式下 fsync 的目录
+    struct timespec ts[2];
+} Fixup;
+
+typedef struct {
+    struct archive *a;
+    struct archive *ext;        // 慢速路径，首次需要时创建
+    const char *dest;
+    int dest_fd;
+    char *buf;
+    Sync_Pool *pool;            // strict 模式的同步线程池（创建失败时为 NULL，改为同步执行）
+    int strict;
+    Uring_Writer *uring;        // 小文件的异步写入（不可用时为 NULL）
+    int uring_tried;
+    int parent_fd;              // 上一个条目的父目录（O_PATH，-1 表示没有缓存）
+    char parent[MAX_PATH_LEN];
+    size_t parent_len;
+    char *slow_root;            // 慢速路径使用的目标目录（不含符号链接）
+    Fixup *fixups;
+    size_t fixup_count;
+    size_t fixup_capacity;
+} Extractor;
+
+static pthread_once_t umask_once = PTHREAD_ONCE_INIT;
+static int process_umask = -1;  // 未知时为 -1（总是显式设置权限）
+static int openat2_missing;     // 内核不支持 openat2，逐级打开目录
+
+/* 从 /proc/self/status 读取 umask（umask() 会修改进程状态，多线程中不能用来查询） */
+static void read_umask(void)
+{
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (!fp)
+        return;
+    char line[128];
+    unsigned int mask;
+    while (fgets(line, sizeof(line), fp))
+        if (sscanf(line, "Umask: %o", &mask) == 1) {
+            process_umask = (int)mask;
+            break;
+        }
+    fclose(fp);
+}
+
+/* 以 mode 创建后是否还要显式设置权限 */
+static int needs_chmod(mode_t mode)
+{
+    pthread_once(&umask_once, read_umask);
+    return process_umask < 0 || (mode & (mode_t)process_umask) != 0;
+}
+
+/* 条目路径只能指向目标目录之内 */
+static int safe_path(const char *path)
+{
+    if (!path || !path[0] || path[0] == '/')
+        return 0;
+    for (const char *p = path; *p; ) {
+        const char *end = strchr(p, '/');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len == 2 && p[0] == '.' && p[1] == '.')
+            return 0;
+        p += len;
+        while (*p == '/')
+            p++;
+    }
+    return 1;
+}
 
 /**
- * 从已打开的 FILE* 流中解压剩余数据到目标目录
- * @param fp     已打开的文件流（当前位置为压缩数据开始处）
- * @param dest   目标目录（必须存在）
+ * @brief 符号链接的目标只能指向目标目录之内：不能是绝对路径，".." 只能出现在开头，
+ *        且不超过链接所在目录的层数（中间的 ".." 可能借助其他链接离开目标目录）
+ * @param path 链接本身的路径（已通过 safe_path）
+ */
+static int safe_link_target(const char *path, const char *target)
+{
+    if (!target || !target[0] || target[0] == '/')
+        return 0;
+    int depth = -1;  // 链接所在目录的层数（不计链接本身）
+    for (const char *p = path; *p; ) {
+        size_t len = strcspn(p, "/");
+        if (len > 0 && !(len == 1 && p[0] == '.'))
+            depth++;
+        p += len + strspn(p + len, "/");
+    }
+    int named = 0;
+    for (const char *p = target; *p; ) {
+        size_t len = strcspn(p, "/");
+        if (len == 2 && p[0] == '.' && p[1] == '.') {
+            if (named || --depth < 0)
+                return 0;
+        } else if (len > 0 && !(len == 1 && p[0] == '.')) {
+            named = 1;
+        }
+        p += len + strspn(p + len, "/");
+    }
+    return 1;
+}
+
+/* 条目的访问与修改时间（没有访问时间时与修改时间相同） */
+static void entry_times(struct archive_entry *entry, struct timespec ts[2])
+{
+    ts[1].tv_sec = archive_entry_mtime(entry);
+    ts[1].tv_nsec = archive_entry_mtime_nsec(entry);
+    if (archive_entry_atime_is_set(entry)) {
+        ts[0].tv_sec = archive_entry_atime(entry);
+        ts[0].tv_nsec = archive_entry_atime_nsec(entry);
+    } else {
+        ts[0] = ts[1];
+    }
+}
+
+/* 记录延后的元数据，entry 为 NULL 时不设置时间 */
+static int add_fixup(Extractor *x, const char *path, mode_t mode, int chmod_needed,
+                     struct archive_entry *entry, int nofollow)
+{
+    int times = entry && archive_entry_mtime_is_set(entry);
+    int sync = x->strict && !nofollow;
+    if (!chmod_needed && !times && !sync)
+        return 0;
+    if (x->fixup_count == x->fixup_capacity) {
+        size_t cap = x->fixup_capacity ? x->fixup_capacity * 2 : 64;
+        Fixup *f = realloc(x->fixups, cap * sizeof(Fixup));
+        if (!f)
+            return -1;
+        x->fixups = f;
+        x->fixup_capacity = cap;
+    }
+    Fixup *f = &x->fixups[x->fixup_count];
+    if (!(f->path = strdup(path)))
+        return -1;
+    f->mode = mode;
+    f->chmod = chmod_needed;
+    f->times = times;
+    f->nofollow = nofollow;
+    f->sync = sync;
+    if (times)
+        entry_times(entry, f->ts);
+    x->fixup_count++;
+    return 0;
+}
+
+/* 路径经过符号链接或非目录（或离开了目标目录）：改走慢速路径 */
+static int diverted(int err)
+{
+    return err == ELOOP || err == ENOTDIR || err == EXDEV;
+}
+
+/* 把 path 的父目录复制到 dir（没有父目录时为空串），返回最后一个分量 */
+static const char *split_path(const char *path, char *dir, size_t size)
+{
+    const char *slash = strrchr(path, '/');
+    size_t len = slash ? (size_t)(slash - path) : 0;
+    if (len >= size)
+        len = size - 1;
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+    return slash ? slash + 1 : path;
+}
+
+/* 逐级以 O_NOFOLLOW 打开目录，create 时创建缺失的目录（记录下来，strict 模式需要 fsync） */
+static int walk_dir(Extractor *x, const char *dir, int create)
+{
+    char tmp[MAX_PATH_LEN];
+    snprintf(tmp, sizeof(tmp), "%s", dir);
+    int fd = x->dest_fd;
+    for (char *p = tmp; *p; ) {
+        char *end = strchr(p, '/');
+        if (end)
+            *end = '\0';
+        if (*p) {
+            int flags = O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+            int next = openat(fd, p, flags);
+            if (next < 0 && errno == ENOENT && create) {
+                if (mkdirat(fd, p, 0755) == 0) {
+                    if (add_fixup(x, tmp, 0, 0, NULL, 0) != 0)
+                        next = -1;
+                    else
+                        next = openat(fd, p, flags);
+                } else if (errno == EEXIST) {
+                    next = openat(fd, p, flags);
+                }
+            }
+            int saved = errno;
+            if (fd != x->dest_fd)
+                close(fd);
+            errno = saved;
+            if (next < 0)
+                return -1;
+            fd = next;
+        }
+        if (!end)
+            break;
+        *end = '/';
+        p = end + 1;
+    }
+    return fd == x->dest_fd ? openat(x->dest_fd, ".", O_PATH | O_DIRECTORY | O_CLOEXEC) : fd;
+}
+
+/**
+ * @brief 打开目标目录中的目录 dir，路径中不允许符号链接，也不能离开目标目录
+ * @param create 创建缺失的各级目录（父目录通常先于子项出现，只在缺失时创建）
+ * @return O_PATH 描述符，失败返回 -1（见 diverted）
+ */
+static int open_dir(Extractor *x, const char *dir, int create)
+{
+    if (!__atomic_load_n(&openat2_missing, __ATOMIC_RELAXED)) {
+        struct open_how how;
+        memset(&how, 0, sizeof(how));
+        how.flags = O_PATH | O_DIRECTORY | O_CLOEXEC;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_SYMLINKS;
+        int fd = (int)syscall(SYS_openat2, x->dest_fd, dir, &how, sizeof(how));
+        if (fd >= 0)
+            return fd;
+        if (errno == ENOSYS)
+            __atomic_store_n(&openat2_missing, 1, __ATOMIC_RELAXED);
+        else if (errno != EAGAIN && !(errno == ENOENT && create))
+            return -1;
+    }
+    return walk_dir(x, dir, create);
+}
+
+/* 丢弃缓存的父目录（慢速路径可能替换了目录） */
+static void forget_parent(Extractor *x)
+{
+    if (x->parent_fd >= 0)
+        close(x->parent_fd);
+    x->parent_fd = -1;
+    x->parent_len = 0;
+}
+
+/**
+ * @brief 取得 path 的父目录（缺失时创建）与最后一个路径分量
+ * @return 描述符（由 x 缓存，调用方不关闭），失败返回 -1（见 diverted）
+ */
+static int parent_fd(Extractor *x, const char *path, const char **base)
+{
+    char dir[MAX_PATH_LEN];
+    *base = split_path(path, dir, sizeof(dir));
+    size_t len = strlen(dir);
+    if (len == 0)
+        return x->dest_fd;
+    if (x->parent_fd >= 0 && len == x->parent_len && memcmp(dir, x->parent, len) == 0)
+        return x->parent_fd;
+    int fd = open_dir(x, dir, 1);
+    if (fd < 0)
+        return -1;
+    forget_parent(x);
+    x->parent_fd = fd;
+    memcpy(x->parent, dir, len + 1);
+    x->parent_len = len;
+    return fd;
+}
+
+/* 丢弃 path 的延后元数据（条目被慢速路径替换，由 archive_write_disk 设置） */
+static void drop_fixups(Extractor *x, const char *path)
+{
+    for (size_t i = 0; i < x->fixup_count; i++)
+        if (x->fixups[i].path && strcmp(x->fixups[i].path, path) == 0) {
+            free(x->fixups[i].path);
+            x->fixups[i].path = NULL;
+        }
+}
+
+/* 设置延后的元数据（倒序：子项都已写完，目录的修改时间不会再被改变） */
+static int apply_fixups(Extractor *x)
+{
+    int ret = 0;
+    for (size_t i = x->fixup_count; i-- > 0; ) {
+        Fixup *f = &x->fixups[i];
+        if (!f->path)
+            continue;  // 已丢弃
+        if (f->chmod && fchmodat(x->dest_fd, f->path, f->mode, 0) != 0)
+            ret = -1;
+        if (f->times && utimensat(x->dest_fd, f->path, f->ts, f->nofollow ? AT_SYMLINK_NOFOLLOW : 0) != 0)
+            ret = -1;
+        if (f->sync) {
+            int fd = openat(x->dest_fd, f->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0 || sync_pool_submit(x->pool, fd) != 0)
+                ret = -1;
+        }
+        free(f->path);
+    }
+    x->fixup_count = 0;
+    return ret;
+}
+
+static int write_all(int fd, const char *data, size_t len, int64_t offset)
+{
+    while (len > 0) {
+        ssize_t n = pwrite(fd, data, len, offset);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+        offset += n;
+        timing_add(TIMING_BYTES_WRITTEN, (uint64_t)n);
+    }
+    return 0;
+}
+
+/**
+ * @brief 把当前条目的数据写入 fd：相邻的小数据块合并到写缓冲，
+ *        大块直接写出，稀疏文件的空洞按偏移跳过
+ * @return 数据的结束位置，失败返回 -1
+ */
+static int64_t copy_data(Extractor *x, int fd)
+{
+    const void *block;
+    size_t size;
+    la_int64_t offset;
+    size_t used = 0;
+    int64_t buf_start = 0, end = 0;
+    int r;
+    while ((r = archive_read_data_block(x->a, &block, &size, &offset)) == ARCHIVE_OK) {
+        if (offset + (int64_t)size > end)
+            end = offset + (int64_t)size;
+        if (used > 0 && offset != buf_start + (int64_t)used) {
+            if (write_all(fd, x->buf, used, buf_start) != 0)
+                return -1;
+            used = 0;
+        }
+        if (used == 0 && size >= EXTRACT_BUFFER_SIZE) {
+            if (write_all(fd, block, size, offset) != 0)
+                return -1;
+            continue;
+        }
+        if (used == 0)
+            buf_start = offset;
+        while (size > 0) {
+            size_t n = EXTRACT_BUFFER_SIZE - used < size ? EXTRACT_BUFFER_SIZE - used : size;
+            memcpy(x->buf + used, block, n);
+            used += n;
+            block = (const char *)block + n;
+            size -= n;
+            if (used == EXTRACT_BUFFER_SIZE) {
+                if (write_all(fd, x->buf, used, buf_start) != 0)
+                    return -1;
+                buf_start += (int64_t)used;
+                used = 0;
+            }
+        }
+    }
+    if (r != ARCHIVE_EOF) {
+        cpk_printf(ERROR, "archive_read_data_block failed: %s\n", archive_error_string(x->a));
+        return -1;
+    }
+    if (used > 0 && write_all(fd, x->buf, used, buf_start) != 0)
+        return -1;
+    return end;
+}
+
+/**
+ * @brief 准备慢速路径：目标目录取已打开的 dest_fd 的绝对路径（内核给出的路径不含符号链接，
+ *        SECURE_SYMLINKS 检查路径的每一级），不依赖当前目录（cpkgd 在其他线程中切换目录）
  * @return 0 成功，-1 失败
  */
-int extract_archive(FILE *fp, const char *dest) {
-    struct archive *a = archive_read_new();
-    struct archive *ext = archive_write_disk_new();
+static int prepare_slow(Extractor *x)
+{
+    if (x->ext)
+        return 0;
+    char proc[64], real[PATH_MAX];
+    snprintf(proc, sizeof(proc), "/proc/self/fd/%d", x->dest_fd);
+    ssize_t n = readlink(proc, real, sizeof(real) - 1);
+    if (n <= 0 || real[0] != '/') {
+        if (n >= 0)
+            errno = ENOENT;
+        return -1;
+    }
+    real[n] = '\0';
+    free(x->slow_root);
+    x->slow_root = strdup(real);
+    x->ext = x->slow_root ? archive_write_disk_new() : NULL;
+    if (!x->ext)
+        return -1;
+    // 保留权限、时间等；不经过符号链接，不接受 ".."；
+    // 目标目录是绝对路径，因此不检查绝对路径（条目名已由 safe_path 拒绝）
+    int options = ARCHIVE_EXTRACT_TIME | ARCHIVE_EXTRACT_PERM |
+                  ARCHIVE_EXTRACT_ACL | ARCHIVE_EXTRACT_FFLAGS |
+                  ARCHIVE_EXTRACT_SECURE_SYMLINKS | ARCHIVE_EXTRACT_SECURE_NODOTDOT;
+    archive_write_disk_set_options(x->ext, options);
+    return 0;
+}
+
+/* 慢速路径：交给 archive_write_disk（支持所有条目类型、ACL 与文件标志，并替换已存在的目标） */
+static int write_slow(Extractor *x, struct archive_entry *entry, const char *path)
+{
+    if (prepare_slow(x) != 0) {
+        cpk_printf(ERROR, "Cannot prepare extraction into %s: %s\n", x->dest, strerror(errno));
+        return -1;
+    }
+    // 条目可能替换缓存的父目录，或替换之前记录了延后元数据的条目（元数据由 archive_write_disk 设置）
+    forget_parent(x);
+    drop_fixups(x, path);
+    char full_path[INSTALL_PATH_LEN];
+    snprintf(full_path, sizeof(full_path), "%s/%s", x->slow_root, path);
+    archive_entry_set_pathname(entry, full_path);
+    const char *hardlink = archive_entry_hardlink(entry);
+    if (hardlink) {
+        if (!safe_path(hardlink)) {
+            cpk_printf(ERROR, "Refusing to extract unsafe link: %s\n", hardlink);
+            return -1;
+        }
+        char link_path[INSTALL_PATH_LEN];
+        snprintf(link_path, sizeof(link_path), "%s/%s", x->slow_root, hardlink);
+        archive_entry_set_hardlink(entry, link_path);
+    }
+    if (archive_write_header(x->ext, entry) != ARCHIVE_OK) {
+        cpk_printf(ERROR, "archive_write_header failed: %s\n", archive_error_string(x->ext));
+        return -1;
+    }
+    if (archive_entry_filetype(entry) == AE_IFREG)
+        timing_add(TIMING_FILES_CREATED, 1);
+    if (archive_entry_size(entry) > 0) {
+        const void *block;
+        size_t size;
+        la_int64_t offset;
+        int r;
+        while ((r = archive_read_data_block(x->a, &block, &size, &offset)) == ARCHIVE_OK) {
+            if (archive_write_data_block(x->ext, block, size, offset) != ARCHIVE_OK) {
+                cpk_printf(ERROR, "archive_write_data_block failed: %s\n", archive_error_string(x->ext));
+                return -1;
+            }
+            timing_add(TIMING_BYTES_WRITTEN, (uint64_t)size);
+        }
+        if (r != ARCHIVE_EOF) {
+            cpk_printf(ERROR, "archive_read_data_block failed: %s\n", archive_error_string(x->a));
+            return -1;
+        }
+    }
+    if (archive_write_finish_entry(x->ext) != ARCHIVE_OK) {
+        cpk_printf(ERROR, "archive_write_finish_entry failed: %s\n", archive_error_string(x->ext));
+        return -1;
+    }
+    int type = archive_entry_filetype(entry);
+    if (x->strict && (type == AE_IFREG || type == AE_IFDIR)) {
+        int fd = open(full_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0 || sync_pool_submit(x->pool, fd) != 0) {
+            cpk_printf(ERROR, "Failed to sync %s: %s\n", full_path, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* 慢速路径写入已读入内存的文件（异步写入的文件无法在快速路径中重写时），时间仍在最后设置 */
+static int write_slow_buffer(Extractor *x, const char *path, mode_t mode, const char *buf, size_t len)
+{
+    if (prepare_slow(x) != 0) {
+        cpk_printf(ERROR, "Cannot prepare extraction into %s: %s\n", x->dest, strerror(errno));
+        return -1;
+    }
+    forget_parent(x);
+    char full_path[INSTALL_PATH_LEN];
+    snprintf(full_path, sizeof(full_path), "%s/%s", x->slow_root, path);
+    struct archive_entry *entry = archive_entry_new();
+    if (!entry)
+        return -1;
+    archive_entry_set_pathname(entry, full_path);
+    archive_entry_set_filetype(entry, AE_IFREG);
+    archive_entry_set_perm(entry, mode);
+    archive_entry_set_size(entry, (la_int64_t)len);
+    int ret = archive_write_header(x->ext, entry) == ARCHIVE_OK &&
+              (len == 0 || archive_write_data(x->ext, buf, len) == (la_ssize_t)len) &&
+              archive_write_finish_entry(x->ext) == ARCHIVE_OK ? 0 : -1;
+    if (ret == 0)
+        timing_add(TIMING_BYTES_WRITTEN, len);
+    else
+        cpk_printf(ERROR, "Failed to write %s: %s\n", full_path, archive_error_string(x->ext));
+    archive_entry_free(entry);
+    return ret;
+}
+
+/* io_uring 写入失败（或写入器不可用）时同步写入整个文件，同名文件先删除；
+ * 路径经过符号链接、同名的是目录等情况交给慢速路径 */
+static int rewrite_file(void *ctx, const char *path, mode_t mode, const char *buf, size_t len)
+{
+    Extractor *x = (Extractor *)ctx;
+    const char *base;
+    int dir_fd = parent_fd(x, path, &base);
+    int fd = -1;
+    if (dir_fd >= 0) {
+        int flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW;
+        fd = openat(dir_fd, base, flags, mode);
+        if (fd < 0 && errno == EEXIST && unlinkat(dir_fd, base, 0) == 0)
+            fd = openat(dir_fd, base, flags, mode);
+    }
+    if (fd < 0 && (diverted(errno) || errno == EISDIR))
+        return write_slow_buffer(x, path, mode, buf, len);
+    int ret = fd >= 0 && write_all(fd, buf, len, 0) == 0 ? 0 : -1;
+    if (fd >= 0 && close(fd) != 0)
+        ret = -1;
+    if (ret != 0)
+        cpk_printf(ERROR, "Failed to write %s/%s: %s\n", x->dest, path, strerror(errno));
+    return ret;
+}
+
+/* 首次需要时创建 io_uring 写入器（strict 模式逐个 fsync，不使用） */
+static int uring_ready(Extractor *x)
+{
+    if (!x->uring_tried && !x->strict) {
+        x->uring_tried = 1;
+        x->uring = uring_writer_new(x->dest_fd, rewrite_file, x);
+    }
+    return x->uring != NULL;
+}
+
+/**
+ * @brief 小文件整个读入内存后交给 io_uring 写入器，权限与时间在最后统一设置
+ * @return 0 成功，-1 失败
+ */
+static int write_file_async(Extractor *x, struct archive_entry *entry, const char *path, size_t size)
+{
+    mode_t mode = archive_entry_perm(entry);
+    char *buf = malloc(size ? size : 1);
+    if (!buf)
+        return -1;
+    const void *block;
+    size_t n, filled = 0;  // 之前的数据都已填入
+    la_int64_t offset;
     int r;
+    while ((r = archive_read_data_block(x->a, &block, &n, &offset)) == ARCHIVE_OK) {
+        if (offset < 0 || (uint64_t)offset + n > size) {
+            cpk_printf(ERROR, "Entry data exceeds its size: %s\n", path);
+            free(buf);
+            return -1;
+        }
+        if ((size_t)offset > filled)
+            memset(buf + filled, 0, (size_t)offset - filled);
+        memcpy(buf + offset, block, n);
+        if ((size_t)offset + n > filled)
+            filled = (size_t)offset + n;
+    }
+    if (filled < size)
+        memset(buf + filled, 0, size - filled);
+    if (r != ARCHIVE_EOF) {
+        cpk_printf(ERROR, "archive_read_data_block failed: %s\n", archive_error_string(x->a));
+        free(buf);
+        return -1;
+    }
+    if (add_fixup(x, path, mode, needs_chmod(mode), entry, 0) != 0) {
+        cpk_printf(ERROR, "Failed to create %s/%s: %s\n", x->dest, path, strerror(errno));
+        free(buf);
+        return -1;
+    }
+    timing_add(TIMING_FILES_CREATED, 1);
+    int queued = uring_writer_file(x->uring, path, mode, buf, size);
+    if (queued == 0)
+        return 0;
+    int ret = queued > 0 ? rewrite_file(x, path, mode, buf, size) : -1;
+    free(buf);
+    return ret;
+}
 
-    // 设置解压选项：保留权限、时间等
-    archive_write_disk_set_options(ext,
-        ARCHIVE_EXTRACT_TIME | ARCHIVE_EXTRACT_PERM |
-        ARCHIVE_EXTRACT_ACL | ARCHIVE_EXTRACT_FFLAGS);
-    // 支持所有压缩和格式
-    archive_read_support_filter_all(a);
-    archive_read_support_format_all(a);
+/**
+ * @brief 快速路径写入普通文件
+ * @return 0 成功，1 目标已存在或路径经过符号链接（尚未读取数据，改走 archive_write_disk），-1 失败
+ */
+static int write_file(Extractor *x, struct archive_entry *entry, const char *path)
+{
+    // 父目录在此创建：内核中的 openat2 只创建文件本身
+    const char *base;
+    int dir_fd = parent_fd(x, path, &base);
+    if (dir_fd < 0) {
+        if (diverted(errno))
+            return 1;
+        cpk_printf(ERROR, "Failed to create %s/%s: %s\n", x->dest, path, strerror(errno));
+        return -1;
+    }
+    int64_t size = archive_entry_size_is_set(entry) ? archive_entry_size(entry) : -1;
+    if (size >= 0 && size <= URING_MAX_FILE && archive_entry_sparse_count(entry) == 0 && uring_ready(x))
+        return write_file_async(x, entry, path, (size_t)size);
 
-    // 从 FILE* 打开（从当前位置开始读）
-    if (archive_read_open_FILE(a, fp) != ARCHIVE_OK) {
-        archive_read_free(a);
-        archive_write_free(ext);
+    mode_t mode = archive_entry_perm(entry);
+    int fd = openat(dir_fd, base, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, mode);
+    if (fd < 0) {
+        if (errno == EEXIST || diverted(errno))
+            return 1;
+        cpk_printf(ERROR, "Failed to create %s/%s: %s\n", x->dest, path, strerror(errno));
         return -1;
     }
+    timing_add(TIMING_FILES_CREATED, 1);
 
-    struct archive_entry *entry;
-    while ((r = archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
-        const char *entry_name = archive_entry_pathname(entry);
-        // 拼接目标完整路径
-        char full_path[MAX_PATH_LEN];
-        snprintf(full_path, sizeof(full_path), "%s/%s", dest, entry_name);
-        archive_entry_set_pathname(entry, full_path);
+    int ret = 0;
+    // 稀疏文件不预分配，保留空洞
+    int preallocated = size >= EXTRACT_FALLOCATE_MIN && archive_entry_sparse_count(entry) == 0 &&
+                       posix_fallocate(fd, 0, size) == 0;
+    int64_t end = copy_data(x, fd);
+    if (end < 0)
+        ret = -1;
+    else if (size > end && !preallocated && ftruncate(fd, size) != 0)  // 结尾的空洞
+        ret = -1;
+    if (ret == 0 && needs_chmod(mode) && fchmod(fd, mode) != 0)
+        ret = -1;
+    if (ret == 0 && archive_entry_mtime_is_set(entry)) {
+        struct timespec ts[2];
+        entry_times(entry, ts);
+        if (futimens(fd, ts) != 0)
+            ret = -1;
+    }
+    if (x->strict ? sync_pool_submit(x->pool, fd) != 0 : close(fd) != 0)
+        ret = -1;
+    if (ret != 0 && end >= 0)
+        cpk_printf(ERROR, "Failed to write %s/%s: %s\n", x->dest, path, strerror(errno));
+    return ret;
+}
 
-        // 写入头部（创建文件/目录）
-        r = archive_write_header(ext, entry);
-        if (r != ARCHIVE_OK) {
-            fprintf(stderr, "archive_write_header failed: %s\n", archive_error_string(ext));
-            break;
+/* 快速路径创建硬链接，目标与新条目的父目录都不经过符号链接 */
+static int write_link(Extractor *x, const char *path, const char *target)
+{
+    if (uring_writer_drain(x->uring) != 0)  // 目标可能还在写入
+        return -1;
+    char target_dir[MAX_PATH_LEN];
+    const char *target_base = split_path(target, target_dir, sizeof(target_dir));
+    int target_fd = target_dir[0] ? open_dir(x, target_dir, 0) : x->dest_fd;
+    const char *base;
+    int dir_fd = target_fd >= 0 ? parent_fd(x, path, &base) : -1;
+    int r = dir_fd >= 0 ? linkat(target_fd, target_base, dir_fd, base, 0) : -1;
+    int saved = errno;
+    if (target_fd >= 0 && target_fd != x->dest_fd)
+        close(target_fd);
+    if (r == 0)
+        return 0;
+    if (saved == EEXIST || diverted(saved))
+        return 1;
+    cpk_printf(ERROR, "Failed to link %s/%s: %s\n", x->dest, path, strerror(saved));
+    return -1;
+}
+
+/**
+ * @brief 快速路径处理一个条目
+ * @param path 相对目标目录的路径（不以 / 结尾）
+ * @return 0 成功，1 需要改走 archive_write_disk，-1 失败
+ */
+static int write_fast(Extractor *x, struct archive_entry *entry, const char *path)
+{
+    // ACL 与文件标志只在条目确实带有时才处理
+    unsigned long fflags_set, fflags_clear;
+    archive_entry_fflags(entry, &fflags_set, &fflags_clear);
+    if (archive_entry_acl_types(entry) != 0 || fflags_set || fflags_clear)
+        return 1;
+    // 同名条目可能还在异步写入，先等它完成，否则它可能覆盖本条目
+    if (uring_writer_wait_path(x->uring, path) != 0)
+        return -1;
+
+    const char *hardlink = archive_entry_hardlink(entry);
+    if (hardlink) {
+        if (archive_entry_size(entry) > 0 || !safe_path(hardlink))
+            return 1;  // 带数据的硬链接与不安全的目标交给慢速路径
+        return write_link(x, path, hardlink);
+    }
+
+    int type = archive_entry_filetype(entry);
+    if (type == AE_IFREG)
+        return write_file(x, entry, path);
+    if (type != AE_IFDIR && type != AE_IFLNK)
+        return 1;
+    const char *target = type == AE_IFLNK ? archive_entry_symlink(entry) : NULL;
+    if (type == AE_IFLNK && !target)
+        return 1;
+    const char *base;
+    int dir_fd = parent_fd(x, path, &base);
+    if (dir_fd < 0) {
+        if (diverted(errno))
+            return 1;
+        cpk_printf(ERROR, "Failed to create %s/%s: %s\n", x->dest, path, strerror(errno));
+        return -1;
+    }
+
+    mode_t mode = archive_entry_perm(entry);
+    if (type == AE_IFDIR) {
+        // 先保证自己可写可进入，最终权限在最后设置
+        if (mkdirat(dir_fd, base, mode | S_IRWXU) != 0) {
+            struct stat st;
+            if (errno != EEXIST) {
+                cpk_printf(ERROR, "Failed to create %s/%s: %s\n", x->dest, path, strerror(errno));
+                return -1;
+            }
+            if (fstatat(dir_fd, base, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISDIR(st.st_mode))
+                return 1;
         }
+        return add_fixup(x, path, mode, needs_chmod(mode) || (mode & S_IRWXU) != S_IRWXU, entry, 0);
+    }
+    if (symlinkat(target, dir_fd, base) != 0) {
+        if (errno == EEXIST)
+            return 1;
+        cpk_printf(ERROR, "Failed to create %s/%s: %s\n", x->dest, path, strerror(errno));
+        return -1;
+    }
+    return add_fixup(x, path, 0, 0, entry, 1);
+}
 
-        // 如果是普通文件，复制数据
-        if (archive_entry_size(entry) > 0) {
-            char buff[8192];
-            ssize_t size;
-            while ((size = archive_read_data(a, buff, sizeof(buff))) > 0) {
-                ssize_t written = archive_write_data(ext, buff, size);
-                if (written != size) {
-                    fprintf(stderr, "archive_write_data failed: %s\n", archive_error_string(ext));
-                    r = ARCHIVE_FATAL;
-                    break;
-                }
+/**
+ * 从已打开的 FILE* 流中解压剩余数据到目标目录
+ * @param fp     已打开的文件流（当前位置为压缩数据开始处）
+ * @param dest   目标目录（必须存在）
+ * @return 0 成功，-1 失败
+ */
+int extract_archive(FILE *fp, const char *dest) {
+    uint64_t t_extract = timing_begin();
+    Extractor x = { 0 };
+    x.dest = dest;
+    x.parent_fd = -1;
+    x.dest_fd = open(dest, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    x.buf = malloc(EXTRACT_BUFFER_SIZE);
+    x.a = archive_read_new();
+    if (x.dest_fd < 0 || !x.buf || !x.a) {
+        cpk_printf(ERROR, "Cannot prepare extraction into %s: %s\n", dest, strerror(errno));
+        if (x.dest_fd >= 0)
+            close(x.dest_fd);
+        free(x.buf);
+        archive_read_free(x.a);
+        timing_end(TIMING_EXTRACT, t_extract);
+        return -1;
+    }
+    x.strict = durability_mode() == DURABILITY_STRICT;
+    if (x.strict)
+        x.pool = sync_pool_new(DURABILITY_SYNC_THREADS);
+    // 支持所有压缩和格式
+    archive_read_support_filter_all(x.a);
+    archive_read_support_format_all(x.a);
+
+    int r = ARCHIVE_FATAL;
+    // 从 FILE* 打开（从当前位置开始读）
+    if (archive_read_open_FILE(x.a, fp) == ARCHIVE_OK) {
+        struct archive_entry *entry;
+        uint64_t files_done = 0;
+        while ((r = archive_read_next_header(x.a, &entry)) == ARCHIVE_OK) {
+            const char *entry_name = archive_entry_pathname(entry);
+            if (!safe_path(entry_name)) {
+                cpk_printf(ERROR, "Refusing to extract unsafe path: %s\n", entry_name ? entry_name : "(null)");
+                r = ARCHIVE_FATAL;
+                break;
             }
-            if (size < 0) { // 读取错误
-                fprintf(stderr, "archive_read_data failed: %s\n", archive_error_string(a));
+            if (archive_entry_filetype(entry) == AE_IFLNK &&
+                !safe_link_target(entry_name, archive_entry_symlink(entry))) {
+                cpk_printf(ERROR, "Refusing to extract symlink pointing outside the package: %s -> %s\n",
+                           entry_name, archive_entry_symlink(entry) ? archive_entry_symlink(entry) : "(null)");
                 r = ARCHIVE_FATAL;
                 break;
             }
-        }
+            // 去掉目录条目结尾的 /，快速路径在父目录中按最后一个分量创建
+            char path[MAX_PATH_LEN];
+            size_t len = strlen(entry_name);
+            while (len > 1 && entry_name[len - 1] == '/')
+                len--;
+            if (len >= sizeof(path)) {
+                cpk_printf(ERROR, "Path too long: %s\n", entry_name);
+                r = ARCHIVE_FATAL;
+                break;
+            }
+            memcpy(path, entry_name, len);
+            path[len] = '\0';
+            // 拼接目标完整路径
+            char full_path[INSTALL_PATH_LEN];
+            snprintf(full_path, sizeof(full_path), "%s/%s", dest, path);
 
-        // 完成当前条目的写入
-        r = archive_write_finish_entry(ext);
-        if (r != ARCHIVE_OK) {
-            fprintf(stderr, "archive_write_finish_entry failed: %s\n", archive_error_string(ext));
-            break;
+            trace_begin(TRACE_FILE, full_path);
+            int w = write_fast(&x, entry, path);
+            if (w > 0)  // 慢速路径可能替换或链接到尚在写入的文件
+                w = uring_writer_drain(x.uring) == 0 ? write_slow(&x, entry, path) : -1;
+            trace_end(TRACE_FILE);
+            if (w != 0) {
+                r = ARCHIVE_FATAL;
+                break;
+            }
+            if (archive_entry_filetype(entry) == AE_IFREG)
+                cpk_progress("extract", full_path + strlen(dest) + 1, ++files_done, 0);
         }
+        if (r != ARCHIVE_EOF && r != ARCHIVE_FATAL)
+            cpk_printf(ERROR, "archive_read_next_header failed: %s\n", archive_error_string(x.a));
     }
 
-    // 清理
-    archive_read_close(a);
-    archive_read_free(a);
-    archive_write_close(ext);
-    archive_write_free(ext);
+    // 清理：文件写完后才能设置时间
+    if (uring_writer_drain(x.uring) != 0)
+        r = ARCHIVE_FATAL;
+    if (apply_fixups(&x) != 0 && r == ARCHIVE_EOF) {
+        cpk_printf(ERROR, "Failed to set permissions or times under %s: %s\n", dest, strerror(errno));
+        r = ARCHIVE_FATAL;
+    }
+    free(x.fixups);
+    // 等待所有 fsync 完成：数据落盘前不算解压成功
+    if (sync_pool_finish(x.pool) != 0 && r == ARCHIVE_EOF) {
+        cpk_printf(ERROR, "Failed to sync files under %s: %s\n", dest, strerror(errno));
+        r = ARCHIVE_FATAL;
+    }
+    uring_writer_free(x.uring);
+    forget_parent(&x);
+    archive_read_close(x.a);
+    archive_read_free(x.a);
+    if (x.ext) {
+        archive_write_close(x.ext);
+        archive_write_free(x.ext);
+    }
+    free(x.slow_root);
+    close(x.dest_fd);
+    free(x.buf);
+    timing_end(TIMING_EXTRACT, t_extract);
 
     // 如果正常结束（读到文件尾），返回 0
     return (r == ARCHIVE_EOF) ? 0 : -1;
-}
\ No newline at end of file
+}
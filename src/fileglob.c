@@ -0,0 +1,470 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "../include/fileglob.h"
+
+#define GETDENTS_BUF_SIZE (32 * 1024)   // 每次 getdents64 读取的字节数
+
+/* getdents64 返回的目录项 */
+typedef struct {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} Dirent64;
+
+typedef struct {
+    char *text;         // 模式（已去掉 '!'）
+    char *prefix;       // 不含通配符的目录前缀（"" 表示当前目录）
+    char **comps;       // 前缀之后的各分量（指向 buf）
+    int ncomps;
+    char *buf;
+    int group;
+    int negate;
+    int literal;        // 整个模式不含通配符
+} Glob_Pattern;
+
+typedef struct {
+    char **items;
+    size_t count, capacity;
+} Path_List;
+
+struct File_Glob {
+    Glob_Pattern *pats;
+    size_t npats, capacity;
+    Path_List res[FILEGLOB_MAX_GROUPS];
+};
+
+static int is_wild(const char *s)
+{
+    return strpbrk(s, "*?[") != NULL;
+}
+
+int fileglob_is_pattern(const char *pattern)
+{
+    return pattern[0] == '!' || is_wild(pattern);
+}
+
+File_Glob *fileglob_new(void)
+{
+    return calloc(1, sizeof(File_Glob));
+}
+
+/* 正向的字面模式不参与遍历，直接作为结果 */
+static int walked(const Glob_Pattern *p)
+{
+    return !p->literal || p->negate;
+}
+
+/**
+ * @brief 展开开头的 "~" 或 "~user"（与 glob 的 GLOB_TILDE 相同）
+ * @return malloc 的新模式，主目录未知或内存不足时返回 NULL
+ */
+static char *expand_tilde(const char *pattern)
+{
+    const char *rest = pattern + 1 + strcspn(pattern + 1, "/");
+    size_t ulen = (size_t)(rest - pattern - 1);
+    const char *home = ulen == 0 ? getenv("HOME") : NULL;
+    struct passwd pw, *found = NULL;
+    char buf[4096];
+    if (!home || !home[0]) {
+        char user[LOGIN_NAME_MAX + 1];
+        if (ulen >= sizeof(user))
+            return NULL;
+        memcpy(user, pattern + 1, ulen);
+        user[ulen] = '\0';
+        int r = ulen == 0 ? getpwuid_r(getuid(), &pw, buf, sizeof(buf), &found)
+                          : getpwnam_r(user, &pw, buf, sizeof(buf), &found);
+        if (r != 0 || !found)
+            return NULL;
+        home = found->pw_dir;
+    }
+    size_t len = strlen(home) + strlen(rest) + 1;
+    char *out = malloc(len);
+    if (out)
+        snprintf(out, len, "%s%s", home, rest);
+    return out;
+}
+
+static int add_pattern(File_Glob *g, int group, const char *pattern, int negate);
+
+int fileglob_add(File_Glob *g, int group, const char *pattern)
+{
+    if (!g || !pattern || group < 0 || group >= FILEGLOB_MAX_GROUPS)
+        return -1;
+    int negate = pattern[0] == '!';
+    if (negate)
+        pattern++;
+    if (pattern[0] != '~')
+        return add_pattern(g, group, pattern, negate);
+    char *expanded = expand_tilde(pattern);
+    int ret = expanded ? add_pattern(g, group, expanded, negate) : -1;
+    free(expanded);
+    return ret;
+}
+
+static int add_pattern(File_Glob *g, int group, const char *pattern, int negate)
+{
+    if (g->npats == g->capacity) {
+        size_t ncap = g->capacity ? g->capacity * 2 : 16;
+        Glob_Pattern *t = realloc(g->pats, ncap * sizeof(Glob_Pattern));
+        if (!t)
+            return -1;
+        g->pats = t;
+        g->capacity = ncap;
+    }
+    Glob_Pattern *p = &g->pats[g->npats];
+    memset(p, 0, sizeof(*p));
+    p->group = group;
+    p->negate = negate;
+
+    // 按 '/' 切分（忽略空分量），前面不含通配符的分量构成目录前缀，最后一个分量总是留给匹配
+    size_t len = strlen(pattern);
+    int n = 0;
+    for (size_t i = 0; i < len; i++)
+        if (pattern[i] != '/' && (i == 0 || pattern[i - 1] == '/'))
+            n++;
+    p->text = strdup(pattern);
+    p->buf = strdup(pattern);
+    p->prefix = malloc(len + 2);
+    char **comps = malloc(((size_t)n + 1) * sizeof(char *));
+    if (n == 0 || !p->text || !p->buf || !p->prefix || !comps) {
+        free(p->text);
+        free(p->buf);
+        free(p->prefix);
+        free(comps);
+        return -1;
+    }
+    int k = 0;
+    char *save = NULL;
+    for (char *c = strtok_r(p->buf, "/", &save); c; c = strtok_r(NULL, "/", &save))
+        comps[k++] = c;
+    int lit = 0;
+    while (lit < n - 1 && !is_wild(comps[lit]))
+        lit++;
+    p->literal = lit == n - 1 && !is_wild(comps[n - 1]);
+
+    size_t off = 0;
+    if (pattern[0] == '/')
+        p->prefix[off++] = '/';
+    for (int i = 0; i < lit; i++) {
+        size_t cl = strlen(comps[i]);
+        if (i > 0)
+            p->prefix[off++] = '/';
+        memcpy(p->prefix + off, comps[i], cl);
+        off += cl;
+    }
+    p->prefix[off] = '\0';
+    memmove(comps, comps + lit, (size_t)(n - lit) * sizeof(char *));
+    p->comps = comps;
+    p->ncomps = n - lit;
+    if (p->ncomps > FILEGLOB_MAX_DEPTH) {
+        free(p->text);
+        free(p->buf);
+        free(p->prefix);
+        free(comps);
+        return -1;
+    }
+    g->npats++;
+    return 0;
+}
+
+/* 若 path 位于 root 之下（或等于 root），返回 root 之后的部分，否则返回 NULL */
+static const char *strip_root(const char *root, const char *path)
+{
+    size_t n = strlen(root);
+    if (n == 0)
+        return path[0] == '/' ? NULL : path;
+    if (strncmp(path, root, n) != 0)
+        return NULL;
+    if (path[n] == '\0' || root[n - 1] == '/')
+        return path + n;
+    return path[n] == '/' ? path + n + 1 : NULL;
+}
+
+/* 从 root 开始遍历能否到达目录 path（遍历得到的路径不含 "." 与 ".." 分量） */
+static int reachable(const char *root, const char *path)
+{
+    const char *c = strip_root(root, path);
+    while (c && *c) {
+        size_t len = strcspn(c, "/");
+        if ((len == 1 && c[0] == '.') || (len == 2 && c[0] == '.' && c[1] == '.'))
+            return 0;
+        c += len;
+        if (*c)
+            c++;
+    }
+    return c != NULL;
+}
+
+/*
+ * 匹配状态：第 i 位表示下一个要匹配的是 comps[i]，第 ncomps 位表示已匹配完整个模式。
+ * "**" 可以匹配零个分量，所以置位时同时置下一位。
+ */
+static uint64_t closure(const Glob_Pattern *p, uint64_t s)
+{
+    for (int i = 0; i < p->ncomps; i++)
+        if ((s >> i & 1) && strcmp(p->comps[i], "**") == 0)
+            s |= 1ULL << (i + 1);
+    return s;
+}
+
+static uint64_t step(const Glob_Pattern *p, uint64_t s, const char *name)
+{
+    uint64_t ns = 0;
+    for (int i = 0; i < p->ncomps; i++) {
+        if (!(s >> i & 1))
+            continue;
+        if (strcmp(p->comps[i], "**") == 0) {
+            if (name[0] != '.')
+                ns |= 1ULL << i;
+        } else if (fnmatch(p->comps[i], name, FNM_PERIOD) == 0) {
+            ns |= 1ULL << (i + 1);
+        }
+    }
+    return closure(p, ns);
+}
+
+static int matched(const Glob_Pattern *p, uint64_t s)
+{
+    return (int)(s >> p->ncomps & 1);
+}
+
+/* 检查一个路径是否匹配模式（用于字面模式与其后的排除模式） */
+static int match_path(const Glob_Pattern *p, const char *path)
+{
+    const char *rest = strip_root(p->prefix, path);
+    if (!rest)
+        return 0;
+    uint64_t s = closure(p, 1);
+    char name[NAME_MAX + 1];
+    while (*rest && s) {
+        size_t len = strcspn(rest, "/");
+        if (len > NAME_MAX)
+            return 0;
+        if (len > 0) {
+            memcpy(name, rest, len);
+            name[len] = '\0';
+            s = step(p, s, name);
+        }
+        rest += len;
+        if (*rest)
+            rest++;
+    }
+    return matched(p, s);
+}
+
+static int list_add(Path_List *l, const char *path)
+{
+    if (l->count == l->capacity) {
+        size_t ncap = l->capacity ? l->capacity * 2 : 64;
+        char **t = realloc(l->items, ncap * sizeof(char *));
+        if (!t)
+            return -1;
+        l->items = t;
+        l->capacity = ncap;
+    }
+    if ((l->items[l->count] = strdup(path)) == NULL)
+        return -1;
+    l->count++;
+    return 0;
+}
+
+/**
+ * @brief 遍历一个目录并同时匹配所有模式
+ * @param fd 目录（由本函数关闭）
+ * @param path 目录路径（缓冲区长度 PATH_MAX，子目录名临时追加在后面）
+ * @param state 进入目录时各模式的匹配状态
+ */
+static int walk(File_Glob *g, int fd, char *path, const uint64_t *state)
+{
+    size_t npats = g->npats;
+    char *buf = malloc(GETDENTS_BUF_SIZE + 2 * npats * sizeof(uint64_t));
+    if (!buf) {
+        close(fd);
+        return -1;
+    }
+    uint64_t *cur = (uint64_t *)(buf + GETDENTS_BUF_SIZE);
+    uint64_t *child = cur + npats;
+    for (size_t i = 0; i < npats; i++) {
+        const Glob_Pattern *p = &g->pats[i];
+        cur[i] = state[i];
+        if (walked(p) && strcmp(p->prefix, path) == 0)
+            cur[i] |= closure(p, 1);
+    }
+
+    size_t plen = strlen(path);
+    int ret = 0;
+    long n;
+    while (ret == 0 && (n = syscall(SYS_getdents64, fd, buf, GETDENTS_BUF_SIZE)) > 0) {
+        for (long off = 0; ret == 0 && off < n; ) {
+            const Dirent64 *d = (const Dirent64 *)(buf + off);
+            off += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            // 确定类型；指向目录的符号链接既不匹配也不进入
+            int is_dir = d->d_type == DT_DIR;
+            if (d->d_type == DT_UNKNOWN || d->d_type == DT_LNK) {
+                struct stat st;
+                if (fstatat(fd, name, &st, 0) != 0)
+                    continue;
+                if (S_ISDIR(st.st_mode)) {
+                    struct stat lst;
+                    if (fstatat(fd, name, &lst, AT_SYMLINK_NOFOLLOW) != 0 || S_ISLNK(lst.st_mode))
+                        continue;
+                    is_dir = 1;
+                }
+            }
+
+            size_t nlen = strlen(name);
+            int sep = plen > 0 && path[plen - 1] != '/';
+            if (plen + (size_t)sep + nlen >= PATH_MAX)
+                continue;
+            if (sep)
+                path[plen] = '/';
+            memcpy(path + plen + sep, name, nlen + 1);
+
+            if (!is_dir) {
+                // 同一组内最后一个匹配的模式决定取舍
+                int last[FILEGLOB_MAX_GROUPS];
+                for (int k = 0; k < FILEGLOB_MAX_GROUPS; k++)
+                    last[k] = -1;
+                for (size_t i = 0; i < npats; i++)
+                    if (cur[i] && matched(&g->pats[i], step(&g->pats[i], cur[i], name)))
+                        last[g->pats[i].group] = (int)i;
+                for (int k = 0; ret == 0 && k < FILEGLOB_MAX_GROUPS; k++)
+                    if (last[k] >= 0 && !g->pats[last[k]].negate)
+                        ret = list_add(&g->res[k], path);
+            } else {
+                int any = 0;
+                for (size_t i = 0; i < npats; i++) {
+                    child[i] = cur[i] ? step(&g->pats[i], cur[i], name) : 0;
+                    any |= child[i] != 0;
+                }
+                for (size_t i = 0; !any && i < npats; i++)
+                    any = walked(&g->pats[i]) && reachable(path, g->pats[i].prefix);
+                if (any) {
+                    int cfd = openat(fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+                    if (cfd >= 0)
+                        ret = walk(g, cfd, path, child);
+                }
+            }
+            path[plen] = '\0';
+        }
+    }
+    free(buf);
+    close(fd);
+    return ret;
+}
+
+static int cmp_path(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int fileglob_run(File_Glob *g)
+{
+    if (!g)
+        return -1;
+    uint64_t *zero = calloc(g->npats ? g->npats : 1, sizeof(uint64_t));
+    if (!zero)
+        return -1;
+    int ret = 0;
+
+    // 每个不被其他前缀覆盖的前缀作为一个遍历起点
+    for (size_t i = 0; ret == 0 && i < g->npats; i++) {
+        const Glob_Pattern *p = &g->pats[i];
+        if (!walked(p))
+            continue;
+        int covered = 0;
+        for (size_t j = 0; !covered && j < g->npats; j++) {
+            const Glob_Pattern *q = &g->pats[j];
+            if (j == i || !walked(q))
+                continue;
+            if (strcmp(q->prefix, p->prefix) == 0)
+                covered = j < i;
+            else
+                covered = reachable(q->prefix, p->prefix);
+        }
+        if (covered)
+            continue;
+        char path[PATH_MAX];
+        if (strlen(p->prefix) >= sizeof(path))
+            continue;
+        strcpy(path, p->prefix);
+        int fd = open(path[0] ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0)
+            ret = walk(g, fd, path, zero);
+    }
+    free(zero);
+
+    // 正向的字面模式直接加入（除非被同组中其后的排除模式排除）
+    for (size_t i = 0; ret == 0 && i < g->npats; i++) {
+        const Glob_Pattern *p = &g->pats[i];
+        if (walked(p))
+            continue;
+        int excluded = 0;
+        for (size_t j = i + 1; !excluded && j < g->npats; j++)
+            excluded = g->pats[j].negate && g->pats[j].group == p->group &&
+                       match_path(&g->pats[j], p->text);
+        if (!excluded)
+            ret = list_add(&g->res[p->group], p->text);
+    }
+
+    for (int k = 0; ret == 0 && k < FILEGLOB_MAX_GROUPS; k++) {
+        Path_List *l = &g->res[k];
+        if (l->count == 0)
+            continue;
+        qsort(l->items, l->count, sizeof(char *), cmp_path);
+        size_t w = 1;
+        for (size_t i = 1; i < l->count; i++) {
+            if (strcmp(l->items[i], l->items[w - 1]) == 0)
+                free(l->items[i]);
+            else
+                l->items[w++] = l->items[i];
+        }
+        l->count = w;
+    }
+    return ret;
+}
+
+const char *const *fileglob_results(const File_Glob *g, int group, size_t *count)
+{
+    if (!g || group < 0 || group >= FILEGLOB_MAX_GROUPS) {
+        *count = 0;
+        return NULL;
+    }
+    *count = g->res[group].count;
+    return (const char *const *)g->res[group].items;
+}
+
+void fileglob_free(File_Glob *g)
+{
+    if (!g)
+        return;
+    for (size_t i = 0; i < g->npats; i++) {
+        free(g->pats[i].text);
+        free(g->pats[i].buf);
+        free(g->pats[i].prefix);
+        free(g->pats[i].comps);
+    }
+    free(g->pats);
+    for (int k = 0; k < FILEGLOB_MAX_GROUPS; k++) {
+        for (size_t i = 0; i < g->res[k].count; i++)
+            free(g->res[k].items[i]);
+        free(g->res[k].items);
+    }
+    free(g);
+}
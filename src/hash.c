@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include "../include/hash.h"
+
+static const EVP_MD *sha256_md;
+static pthread_once_t sha256_once = PTHREAD_ONCE_INIT;
+
+/* 显式获取一次算法对象，避免每次初始化都在提供者中查找 */
+static void sha256_fetch(void)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    sha256_md = EVP_MD_fetch(NULL, "SHA256", NULL);
+#endif
+    if (!sha256_md)
+        sha256_md = EVP_sha256();
+}
+
+Hash_Ctx *hash_new(void)
+{
+    Hash_Ctx *h = EVP_MD_CTX_new();
+    if (h && hash_reset(h) != 0) {
+        EVP_MD_CTX_free(h);
+        return NULL;
+    }
+    return h;
+}
+
+int hash_reset(Hash_Ctx *h)
+{
+    pthread_once(&sha256_once, sha256_fetch);
+    return EVP_DigestInit_ex(h, sha256_md, NULL) == 1 ? 0 : -1;
+}
+
+int hash_update(Hash_Ctx *h, const void *data, size_t len)
+{
+    return EVP_DigestUpdate(h, data, len) == 1 ? 0 : -1;
+}
+
+int hash_final(Hash_Ctx *h, unsigned char *out)
+{
+    unsigned int len = 0;
+    return (EVP_DigestFinal_ex(h, out, &len) == 1 && len == HASH_DIGEST_LEN) ? 0 : -1;
+}
+
+int hash_final_hex(Hash_Ctx *h, char *out)
+{
+    unsigned char digest[HASH_DIGEST_LEN];
+    if (hash_final(h, digest) != 0) {
+        out[0] = '\0';
+        return -1;
+    }
+    hex_encode(digest, HASH_DIGEST_LEN, out);
+    return 0;
+}
+
+void hash_free(Hash_Ctx *h)
+{
+    EVP_MD_CTX_free(h);
+}
+
+int hash_mem(const void *data, size_t len, unsigned char *out)
+{
+    pthread_once(&sha256_once, sha256_fetch);
+    unsigned int dlen = 0;
+    return (EVP_Digest(data, len, out, &dlen, sha256_md, NULL) == 1 && dlen == HASH_DIGEST_LEN) ? 0 : -1;
+}
+
+int hash_mem_hex(const void *data, size_t len, char *out)
+{
+    unsigned char digest[HASH_DIGEST_LEN];
+    if (hash_mem(data, len, digest) != 0) {
+        out[0] = '\0';
+        return -1;
+    }
+    hex_encode(digest, HASH_DIGEST_LEN, out);
+    return 0;
+}
+
+int hash_fd_update(Hash_Ctx *h, int fd, off_t offset)
+{
+    unsigned char *buf = malloc(HASH_IO_BLOCK);
+    int ret = buf ? 0 : -1;
+    posix_fadvise(fd, offset, 0, POSIX_FADV_SEQUENTIAL);
+    ssize_t n = 0;
+    while (ret == 0 && (n = pread(fd, buf, HASH_IO_BLOCK, offset)) > 0) {
+        ret = hash_update(h, buf, (size_t)n);
+        offset += n;
+    }
+    if (n < 0)
+        ret = -1;
+    free(buf);
+    return ret;
+}
+
+int hash_fd_hex(int fd, off_t offset, char *out)
+{
+    Hash_Ctx *h = hash_new();
+    int ret = h ? hash_fd_update(h, fd, offset) : -1;
+    if (ret == 0)
+        ret = hash_final_hex(h, out);
+    hash_free(h);
+    return ret;
+}
+
+/* 每个字节值对应的两个十六进制字符 */
+static const char hex_pairs[513] =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+/* 字符 -> 数值 + 1（0 表示不是十六进制字符） */
+static const unsigned char hex_values[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+void hex_encode(const unsigned char *in, size_t len, char *out)
+{
+    for (size_t i = 0; i < len; i++)
+        memcpy(out + i * 2, hex_pairs + in[i] * 2, 2);
+    out[len * 2] = '\0';
+}
+
+int hex_decode(const char *in, unsigned char *out, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        unsigned hi = hex_values[(unsigned char)in[i * 2]];
+        unsigned lo = hi ? hex_values[(unsigned char)in[i * 2 + 1]] : 0;
+        if (!hi || !lo)
+            return -1;
+        out[i] = (unsigned char)(((hi - 1) << 4) | (lo - 1));
+    }
+    return 0;
+}
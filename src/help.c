@@ -29,6 +29,8 @@ const char *help_message =
 "  -r|--remove        <package>       ... | -a|--pending\n"
 "  -P|--purge         <package>       ... | -a|--pending\n"
 "  -V|--verify <package> ...          Verify package integrity.\n"
+"  --batch=<file>                     Run install/remove/fetch lines from <file> ('-' for stdin);\n"
+"                                     stops at the first failed phase, no rollback.\n"
 "  --get-selections [<pattern> ...]   Print list of selected packages to stdout.\n"
 "  --set-selections                   Read selections from stdin.\n"
 "  --clear-selections                 Deselect all non-essential packages.\n"
@@ -0,0 +1,582 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <zstd.h>
+#include "../include/index.h"
+#include "../include/mirror.h"
+#include "../include/network.h"
+#include "../include/cpkg.h"
+#include "../include/help.h"
+
+
+/* 解析时使用的临时记录：pos 用于在排序后保留重复包名中的第一条 */
+typedef struct {
+    Index_Entry entry;
+    size_t pos;
+} Parsed_Entry;
+
+/**
+ * @brief 解析一行索引记录
+ * @param s 行起始位置（不含换行）
+ * @param n 行长度
+ * @param out 输出记录
+ * @return 0 成功，1 空行或注释，-1 内存不足
+ */
+static int parse_entry(const char *s, size_t n, Index_Entry *out)
+{
+    // 去除首尾空白（包括 '\r'）
+    while (n > 0 && isspace((unsigned char)*s)) { s++; n--; }
+    while (n > 0 && isspace((unsigned char)s[n - 1])) n--;
+    if (n == 0 || *s == '#')
+        return 1;
+
+    char *line = malloc(n + 1);
+    if (!line)
+        return -1;
+    memcpy(line, s, n);
+    line[n] = '\0';
+
+    char *fields[INDEX_FIELDS] = { line };
+    for (int i = 1; i < INDEX_FIELDS; i++)
+        fields[i] = "";
+    char *p = line;
+    for (int i = 1; i < INDEX_FIELDS; i++) {
+        p = strchr(p, '|');
+        if (!p)
+            break;
+        *p++ = '\0';
+        fields[i] = p;
+    }
+    // 多余字段保留给后续格式扩展，这里截断
+    char *extra = strchr(fields[INDEX_FIELDS - 1], '|');
+    if (extra)
+        *extra = '\0';
+
+    out->line = line;
+    out->name = fields[0];
+    out->version = fields[1];
+    out->url = fields[2];
+    out->sha256 = fields[3];
+    out->depends = fields[4];
+    out->size = fields[5];
+    out->tree = fields[6];
+    return 0;
+}
+
+static int cmp_parsed(const void *a, const void *b)
+{
+    const Parsed_Entry *x = a, *y = b;
+    int c = strcmp(x->entry.name, y->entry.name);
+    if (c != 0)
+        return c;
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+int index_parse(const char *data, size_t len, Repo_Index *out)
+{
+    if (!data || !out)
+        return 1;
+    memset(out, 0, sizeof(*out));
+
+    Parsed_Entry *tmp = NULL;
+    size_t count = 0, cap = 0;
+    const char *p = data, *end = data + len;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        size_t n = nl ? (size_t)(nl - p) : (size_t)(end - p);
+        Index_Entry e;
+        int r = parse_entry(p, n, &e);
+        if (r < 0)
+            goto error;
+        if (r == 0) {
+            if (count == cap) {
+                size_t new_cap = cap ? cap * 2 : 256;
+                Parsed_Entry *t = realloc(tmp, new_cap * sizeof(*t));
+                if (!t) {
+                    free(e.line);
+                    goto error;
+                }
+                tmp = t;
+                cap = new_cap;
+            }
+            tmp[count].entry = e;
+            tmp[count].pos = count;
+            count++;
+        }
+        p += n + 1;
+    }
+
+    qsort(tmp, count, sizeof(*tmp), cmp_parsed);
+
+    out->entries = malloc((count ? count : 1) * sizeof(Index_Entry));
+    if (!out->entries)
+        goto error;
+    out->capacity = count ? count : 1;
+    for (size_t i = 0; i < count; i++) {
+        if (out->count > 0 &&
+            strcmp(out->entries[out->count - 1].name, tmp[i].entry.name) == 0) {
+            free(tmp[i].entry.line);  // 重复包名，保留第一条
+            continue;
+        }
+        out->entries[out->count++] = tmp[i].entry;
+    }
+    free(tmp);
+    return 0;
+
+error:
+    for (size_t i = 0; i < count; i++)
+        free(tmp[i].entry.line);
+    free(tmp);
+    index_free(out);
+    return 2;
+}
+
+void index_free(Repo_Index *idx)
+{
+    if (!idx)
+        return;
+    for (size_t i = 0; i < idx->count; i++)
+        free(idx->entries[i].line);
+    free(idx->entries);
+    memset(idx, 0, sizeof(*idx));
+}
+
+/* 二分查找 name 的插入位置；found 表示是否已存在 */
+static size_t index_lower_bound(const Repo_Index *idx, const char *name, int *found)
+{
+    size_t lo = 0, hi = idx->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(idx->entries[mid].name, name) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *found = (lo < idx->count && strcmp(idx->entries[lo].name, name) == 0);
+    return lo;
+}
+
+const Index_Entry *index_find(const Repo_Index *idx, const char *name)
+{
+    if (!idx || !name)
+        return NULL;
+    int found = 0;
+    size_t pos = index_lower_bound(idx, name, &found);
+    return found ? &idx->entries[pos] : NULL;
+}
+
+int index_apply_diff(Repo_Index *idx, const char *diff, size_t len)
+{
+    if (!idx || !diff)
+        return 1;
+    const char *p = diff, *end = diff + len;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        size_t n = nl ? (size_t)(nl - p) : (size_t)(end - p);
+        const char *line = p;
+        p += n + 1;
+
+        while (n > 0 && isspace((unsigned char)line[n - 1])) n--;
+        if (n == 0 || line[0] == '#')
+            continue;
+
+        if (line[0] == '+') {
+            Index_Entry e;
+            int r = parse_entry(line + 1, n - 1, &e);
+            if (r < 0)
+                return 2;
+            if (r > 0)
+                continue;
+            int found = 0;
+            size_t pos = index_lower_bound(idx, e.name, &found);
+            if (found) {
+                free(idx->entries[pos].line);
+                idx->entries[pos] = e;
+                continue;
+            }
+            if (idx->count == idx->capacity) {
+                size_t new_cap = idx->capacity ? idx->capacity * 2 : 256;
+                Index_Entry *t = realloc(idx->entries, new_cap * sizeof(*t));
+                if (!t) {
+                    free(e.line);
+                    return 2;
+                }
+                idx->entries = t;
+                idx->capacity = new_cap;
+            }
+            memmove(&idx->entries[pos + 1], &idx->entries[pos],
+                    (idx->count - pos) * sizeof(Index_Entry));
+            idx->entries[pos] = e;
+            idx->count++;
+        } else if (line[0] == '-') {
+            char name[MAX_PATH_LEN];
+            size_t nlen = n - 1;
+            const char *s = line + 1;
+            while (nlen > 0 && isspace((unsigned char)*s)) { s++; nlen--; }
+            if (nlen == 0 || nlen >= sizeof(name))
+                return 3;
+            memcpy(name, s, nlen);
+            name[nlen] = '\0';
+            int found = 0;
+            size_t pos = index_lower_bound(idx, name, &found);
+            if (found) {
+                free(idx->entries[pos].line);
+                memmove(&idx->entries[pos], &idx->entries[pos + 1],
+                        (idx->count - pos - 1) * sizeof(Index_Entry));
+                idx->count--;
+            }
+        } else {
+            return 3;  // 无法识别的增量行
+        }
+    }
+    return 0;
+}
+
+char *index_serialize(const Repo_Index *idx, size_t *out_len)
+{
+    if (!idx || !out_len)
+        return NULL;
+    size_t total = 1;
+    for (size_t i = 0; i < idx->count; i++) {
+        const Index_Entry *e = &idx->entries[i];
+        total += strlen(e->name) + strlen(e->version) + strlen(e->url) + strlen(e->sha256) +
+                 strlen(e->depends) + strlen(e->size) + strlen(e->tree) + INDEX_FIELDS;
+    }
+    char *buf = malloc(total);
+    if (!buf)
+        return NULL;
+    size_t off = 0;
+    for (size_t i = 0; i < idx->count; i++) {
+        const Index_Entry *e = &idx->entries[i];
+        off += snprintf(buf + off, total - off, "%s|%s|%s|%s",
+                        e->name, e->version, e->url, e->sha256);
+        // 可选字段只写到最后一个非空字段为止，保持与旧格式一致
+        const char *opt[] = { e->depends, e->size, e->tree };
+        int last = -1;
+        for (int k = 0; k < (int)(sizeof(opt) / sizeof(opt[0])); k++)
+            if (opt[k][0])
+                last = k;
+        for (int k = 0; k <= last; k++)
+            off += snprintf(buf + off, total - off, "|%s", opt[k]);
+        buf[off++] = '\n';
+    }
+    buf[off] = '\0';
+    *out_len = off;
+    return buf;
+}
+
+/**
+ * @brief 若数据为 gzip 或 zstd 压缩格式则就地解压
+ * @note 按魔数识别，未压缩的数据原样保留；成功时 *data 被替换为新缓冲区
+ * @return 0 成功，非0 解压失败
+ */
+static int index_decompress(char **data, size_t *len)
+{
+    const unsigned char *in = (const unsigned char *)*data;
+    size_t in_len = *len;
+
+    if (in_len >= 4 && in[0] == 0x28 && in[1] == 0xb5 && in[2] == 0x2f && in[3] == 0xfd) {
+        ZSTD_DStream *ds = ZSTD_createDStream();
+        if (!ds)
+            return 1;
+        size_t cap = in_len * 4 + ZSTD_DStreamOutSize(), size = 0;
+        char *out = malloc(cap + 1);
+        ZSTD_inBuffer ib = { in, in_len, 0 };
+        size_t ret = 1;
+        while (out && (ret != 0 || ib.pos < ib.size)) {
+            if (size == cap) {
+                char *t = realloc(out, cap * 2 + 1);
+                if (!t) { free(out); out = NULL; break; }
+                out = t;
+                cap *= 2;
+            }
+            ZSTD_outBuffer ob = { out, cap, size };
+            ret = ZSTD_decompressStream(ds, &ob, &ib);
+            size = ob.pos;
+            if (ZSTD_isError(ret) || (ret != 0 && ib.pos == ib.size && ob.pos < ob.size)) {
+                free(out);
+                out = NULL;
+            }
+        }
+        ZSTD_freeDStream(ds);
+        if (!out)
+            return 2;
+        out[size] = '\0';
+        free(*data);
+        *data = out;
+        *len = size;
+        return 0;
+    }
+
+    if (in_len >= 2 && in[0] == 0x1f && in[1] == 0x8b) {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (inflateInit2(&zs, 15 + 32) != Z_OK)
+            return 1;
+        size_t cap = in_len * 4 + FILE_BUFFER_SIZE, size = 0;
+        char *out = malloc(cap + 1);
+        zs.next_in = (Bytef *)in;
+        zs.avail_in = in_len;
+        int zr = Z_OK;
+        while (out && zr != Z_STREAM_END) {
+            if (size == cap) {
+                char *t = realloc(out, cap * 2 + 1);
+                if (!t) { free(out); out = NULL; break; }
+                out = t;
+                cap *= 2;
+            }
+            zs.next_out = (Bytef *)out + size;
+            zs.avail_out = cap - size;
+            zr = inflate(&zs, Z_NO_FLUSH);
+            size = cap - zs.avail_out;
+            if (zr != Z_OK && zr != Z_STREAM_END) {
+                free(out);
+                out = NULL;
+            }
+        }
+        inflateEnd(&zs);
+        if (!out)
+            return 2;
+        out[size] = '\0';
+        free(*data);
+        *data = out;
+        *len = size;
+        return 0;
+    }
+    return 0;
+}
+
+/* 原子写文件：先写临时文件再 rename */
+static int write_file_atomic(const char *path, const char *data, size_t len)
+{
+    char tmp[MAX_PATH_LEN + 32];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp)
+        return 1;
+    if (len > 0 && fwrite(data, 1, len, fp) != len) {
+        fclose(fp);
+        unlink(tmp);
+        return 2;
+    }
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return 3;
+    }
+    return 0;
+}
+
+static char *read_file_all(const char *path, size_t *out_len)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return NULL;
+    char *buf = NULL;
+    size_t size = 0, cap = 0, n;
+    do {
+        if (cap - size < FILE_BUFFER_SIZE) {
+            cap = cap ? cap * 2 : FILE_BUFFER_SIZE * 4;
+            char *t = realloc(buf, cap + 1);
+            if (!t) {
+                free(buf);
+                fclose(fp);
+                return NULL;
+            }
+            buf = t;
+        }
+        n = fread(buf + size, 1, cap - size, fp);
+        size += n;
+    } while (n > 0);
+    fclose(fp);
+    buf[size] = '\0';
+    *out_len = size;
+    return buf;
+}
+
+/* 下载序列号文件，失败返回 -1 */
+static long fetch_remote_seq(const char *base)
+{
+    char url[NET_URL_MAX + 8];
+    snprintf(url, sizeof(url), "%s.seq", base);
+    char *data = NULL;
+    size_t len = 0;
+    if (net_download_to_memory(net_default(), url, &data, &len) != 0)
+        return -1;
+    char *endp = NULL;
+    long seq = strtol(data, &endp, 10);
+    if (endp == data || seq < 0)
+        seq = -1;
+    free(data);
+    return seq;
+}
+
+/* 保存缓存（索引文本 + 序列号 + 来源） */
+static void save_index_cache(const Repo_Index *idx, long seq, const char *url)
+{
+    char dir[MAX_PATH_LEN], path[MAX_PATH_LEN];
+    snprintf(dir, sizeof(dir), "%s/%s", cpk_work_dir(), INDEX_CACHE_DIR);
+    if (mkdir_p(dir, 0755) != 0 && errno != EEXIST)
+        return;
+
+    size_t len = 0;
+    char *text = index_serialize(idx, &len);
+    if (!text)
+        return;
+    snprintf(path, sizeof(path), "%s/%s/%s", cpk_work_dir(), INDEX_CACHE_DIR, INDEX_CACHE_FILE);
+    int r = write_file_atomic(path, text, len);
+    free(text);
+    if (r != 0)
+        return;
+
+    char seq_line[NET_URL_MAX + 32];
+    int n = snprintf(seq_line, sizeof(seq_line), "%ld %s\n", seq, url);
+    snprintf(path, sizeof(path), "%s/%s/%s", cpk_work_dir(), INDEX_CACHE_DIR, INDEX_CACHE_SEQ);
+    write_file_atomic(path, seq_line, (size_t)n);
+}
+
+/* 读取缓存；来源不一致或不存在时返回非0 */
+static int load_index_cache(const char *url, Repo_Index *out, long *out_seq)
+{
+    char path[MAX_PATH_LEN];
+    size_t len = 0;
+    snprintf(path, sizeof(path), "%s/%s/%s", cpk_work_dir(), INDEX_CACHE_DIR, INDEX_CACHE_SEQ);
+    char *seq_data = read_file_all(path, &len);
+    if (!seq_data)
+        return 1;
+    char *endp = NULL;
+    long seq = strtol(seq_data, &endp, 10);
+    while (endp && *endp == ' ') endp++;
+    size_t ulen = endp ? strcspn(endp, "\r\n") : 0;
+    int same = (endp && ulen == strlen(url) && strncmp(endp, url, ulen) == 0);
+    free(seq_data);
+    if (!same)
+        return 2;
+
+    snprintf(path, sizeof(path), "%s/%s/%s", cpk_work_dir(), INDEX_CACHE_DIR, INDEX_CACHE_FILE);
+    char *data = read_file_all(path, &len);
+    if (!data)
+        return 3;
+    int r = index_parse(data, len, out);
+    free(data);
+    if (r != 0)
+        return 4;
+    *out_seq = seq;
+    return 0;
+}
+
+/* 依次下载并应用 (from, to] 之间的增量文件，任何一个缺失都视为缺口 */
+static int apply_remote_diffs(Repo_Index *idx, const char *base, long from, long to)
+{
+    for (long n = from + 1; n <= to; n++) {
+        char url[NET_URL_MAX + 32];
+        snprintf(url, sizeof(url), "%s.diff.%ld", base, n);
+        char *diff = NULL;
+        size_t len = 0;
+        if (net_download_to_memory(net_default(), url, &diff, &len) != 0) {
+            cpk_printf(WARNING, "Index diff %ld is missing, falling back to full fetch\n", n);
+            return 1;
+        }
+        int r = index_decompress(&diff, &len);
+        if (r == 0)
+            r = index_apply_diff(idx, diff, len);
+        free(diff);
+        if (r != 0) {
+            cpk_printf(WARNING, "Index diff %ld is invalid, falling back to full fetch\n", n);
+            return 2;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 从一个镜像获取索引（缓存 + 增量，出现缺口时全量）
+ * @param key 仓库标识，所有镜像共用同一份缓存
+ * @return 0 成功，2 网络失败（可换下一个镜像），其他为内容错误
+ */
+static int load_index_from(const char *url, const char *key, Repo_Index *out)
+{
+    // BASE：去掉压缩后缀后的地址，用于 .seq/.diff 文件
+    char base[NET_URL_MAX];
+    snprintf(base, sizeof(base), "%s", url);
+    size_t blen = strlen(base);
+    if (blen > 3 && strcasecmp(base + blen - 3, ".gz") == 0)
+        base[blen - 3] = '\0';
+    else if (blen > 4 && strcasecmp(base + blen - 4, ".zst") == 0)
+        base[blen - 4] = '\0';
+
+    long remote_seq = fetch_remote_seq(base);
+    long cached_seq = -1;
+    Repo_Index cached;
+    if (remote_seq >= 0 && load_index_cache(key, &cached, &cached_seq) == 0) {
+        if (cached_seq == remote_seq) {
+            *out = cached;
+            return 0;
+        }
+        if (cached_seq >= 0 && cached_seq < remote_seq && remote_seq - cached_seq <= INDEX_MAX_DIFFS &&
+            apply_remote_diffs(&cached, base, cached_seq, remote_seq) == 0) {
+            cpk_printf(INFO, "Index updated incrementally (%ld -> %ld)\n", cached_seq, remote_seq);
+            save_index_cache(&cached, remote_seq, key);
+            *out = cached;
+            return 0;
+        }
+        // 增量失败后 cached 可能已部分修改，丢弃并重新全量获取
+        index_free(&cached);
+    }
+
+    char *data = NULL;
+    size_t len = 0;
+    if (net_download_to_memory(net_default(), url, &data, &len) != 0)
+        return 2;
+    if (index_decompress(&data, &len) != 0) {
+        cpk_printf(ERROR, "Failed to decompress index from %s\n", url);
+        free(data);
+        return 3;
+    }
+    int r = index_parse(data, len, out);
+    free(data);
+    if (r != 0) {
+        cpk_printf(ERROR, "Failed to parse index from %s\n", url);
+        return 4;
+    }
+    // 服务器未提供序列号时不缓存，下次仍全量获取
+    if (remote_seq >= 0)
+        save_index_cache(out, remote_seq, key);
+    return 0;
+}
+
+int repo_load_index(Repo_Index *out)
+{
+    const Mirror_List *mirrors = mirror_default();
+    if (!out || !mirrors)
+        return 1;
+
+    // 按评分依次尝试各镜像，网络失败时切换到下一个
+    for (size_t i = 0; i < mirrors->count; i++) {
+        char url[NET_URL_MAX];
+        mirror_index_url(mirrors, i, url, sizeof(url));
+        int r = load_index_from(url, mirrors->key, out);
+        if (r == 0)
+            return 0;
+        if (r != 2)
+            return r;
+        mirror_mark_failed(mirrors->mirrors[i].base);
+        if (i + 1 < mirrors->count)
+            cpk_printf(WARNING, "Failed to download index from %s, trying next mirror\n", url);
+        else
+            cpk_printf(WARNING, "Failed to download index from %s\n", url);
+    }
+
+    // 所有镜像都不可用时使用本地缓存
+    long seq;
+    if (load_index_cache(mirrors->key, out, &seq) == 0) {
+        cpk_printf(WARNING, "Using cached index\n");
+        return 0;
+    }
+    cpk_printf(ERROR, "Failed to download index\n");
+    return 2;
+}
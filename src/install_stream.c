@@ -0,0 +1,403 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "../include/cpkg.h"
+#include "../include/help.h"
+#include "../include/status.h"
+#include "../include/hash.h"
+#include "../include/merkle.h"
+#include "../include/manifest.h"
+#include "../include/timing.h"
+#include "../include/trace.h"
+#include "../include/lock.h"
+#include "../include/durability.h"
+
+/**
+ * 流式安装：数据按到达顺序写入（来自网络或本地文件），单次遍历内完成
+ *   1. 对整个文件计算 SHA256（与索引中的哈希比较，没有索引哈希时跳过）；
+ *      提供了叶子列表时改为逐叶校验，出错的块到达时立即失败
+ *   2. 解析 CPK_Header
+ *   3. 对头部之后的数据计算 SHA256（与 CPK_Header.hash 比较）
+ *   4. 通过管道交给解压线程，解压到 staging 目录
+ * 只有两个哈希都匹配且解压成功时才把 staging 中的内容提交到安装目录。
+ * 按持久化策略（durability.h），提交前数据已落盘，输出安装成功前提交已落盘。
+ */
+struct Install_Stream {
+    Hash_Ctx *file_sha;         // 整个文件的哈希（不需要校验时为 NULL）
+    Hash_Ctx *payload_sha;      // 头部之后数据的哈希
+    char expected[SHA256_HEX_LEN + 1]; // 索引中的哈希（空串表示不校验）
+    Merkle_Builder tree;        // 逐叶校验（use_tree 为 1 时有效）
+    Merkle_Digest *tree_leaves; // 期望的叶子列表
+    int use_tree;
+    CPK_Header header;
+    size_t header_size;         // 头部大小（收到魔数后确定，0 表示未知）
+    size_t header_got;          // 已收到的头部字节数
+    int pipe_w;                 // 写入端（-1 表示尚未开始解压）
+    FILE *pipe_r;               // 解压线程读取端
+    pthread_t thread;
+    int extract_result;
+    char staging[MAX_PATH_LEN];
+    int failed;
+    int verified;               // install_stream_verify 是否通过
+    const Cpk_Context *context; // 创建者的上下文，解压线程继承
+};
+
+/* 解压线程：从管道读取并解压；失败后继续读空管道，避免写入端阻塞 */
+static void *extract_thread(void *arg)
+{
+    Install_Stream *s = (Install_Stream *)arg;
+    cpk_context_set(s->context);
+    trace_begin(TRACE_PACKAGE, s->header.name);
+    s->extract_result = extract_archive(s->pipe_r, s->staging);
+    trace_end(TRACE_PACKAGE);
+    char drain[FILE_BUFFER_SIZE];
+    while (fread(drain, 1, sizeof(drain), s->pipe_r) > 0)
+        ;
+    return NULL;
+}
+
+static void stream_free(Install_Stream *s)
+{
+    hash_free(s->file_sha);
+    hash_free(s->payload_sha);
+    if (s->use_tree)
+        merkle_free(&s->tree);
+    free(s->tree_leaves);
+    free(s);
+}
+
+Install_Stream *install_stream_begin(const char *expected_sha256)
+{
+    Install_Stream *s = calloc(1, sizeof(Install_Stream));
+    if (!s)
+        return NULL;
+    s->pipe_w = -1;
+    s->context = cpk_context();
+    if (expected_sha256 && strlen(expected_sha256) >= SHA256_HEX_LEN) {
+        memcpy(s->expected, expected_sha256, SHA256_HEX_LEN);
+        s->expected[SHA256_HEX_LEN] = '\0';
+    }
+    // 没有期望值时不计算整个文件的哈希，每个字节只哈希一次
+    s->payload_sha = hash_new();
+    s->file_sha = s->expected[0] ? hash_new() : NULL;
+    if (!s->payload_sha || (s->expected[0] && !s->file_sha)) {
+        stream_free(s);
+        return NULL;
+    }
+
+    char staging_root[MAX_PATH_LEN];
+    snprintf(staging_root, sizeof(staging_root), "%s/%s", cpk_work_dir(), STAGING_DIR);
+    if (mkdir_p(staging_root, 0755) != 0 && errno != EEXIST) {
+        cpk_printf(ERROR, "Failed to create directory: %s\n", staging_root);
+        stream_free(s);
+        return NULL;
+    }
+    snprintf(s->staging, sizeof(s->staging), "%s/%s/install-XXXXXX", cpk_work_dir(), STAGING_DIR);
+    if (!mkdtemp(s->staging)) {
+        cpk_printf(ERROR, "Failed to create staging directory: %s\n", strerror(errno));
+        stream_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+/* 头部接收完整后打印信息并启动解压线程 */
+static int start_extract(Install_Stream *s)
+{
+    CPK_Header *header = &s->header;
+    header->hash[SHA256_HEX_LEN] = '\0';
+    header->depends[CPKG_DEPENDS_LEN - 1] = '\0';
+    cpk_printf(INFO, "CPK_Header size: %zu bytes\n", s->header_size);
+    cpk_printf(INFO, "Package name: %s\n", header->name);
+    cpk_printf(INFO, "Package version: %s\n", header->version);
+    cpk_printf(INFO, "Package description: %s\n", header->description);
+    cpk_printf(INFO, "Package author: %s\n", header->author);
+    if (header->depends[0])
+        cpk_printf(INFO, "Package depends: %s\n", header->depends);
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        cpk_printf(ERROR, "Failed to create pipe: %s\n", strerror(errno));
+        return -1;
+    }
+    s->pipe_r = fdopen(fds[0], "rb");
+    if (!s->pipe_r) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    s->pipe_w = fds[1];
+    if (pthread_create(&s->thread, NULL, extract_thread, s) != 0) {
+        fclose(s->pipe_r);
+        close(s->pipe_w);
+        s->pipe_r = NULL;
+        s->pipe_w = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int install_stream_expect_tree(Install_Stream *s, const unsigned char *leaves, size_t count)
+{
+    if (!s || s->header_got > 0 || count == 0)
+        return -1;
+    s->tree_leaves = malloc(count * sizeof(Merkle_Digest));
+    if (!s->tree_leaves)
+        return -1;
+    memcpy(s->tree_leaves, leaves, count * sizeof(Merkle_Digest));
+    if (merkle_init(&s->tree, s->tree_leaves, count) != 0) {
+        free(s->tree_leaves);
+        s->tree_leaves = NULL;
+        return -1;
+    }
+    // 叶子列表已与索引中的根比对过，逐叶校验可以代替整个文件的哈希
+    hash_free(s->file_sha);
+    s->file_sha = NULL;
+    s->use_tree = 1;
+    return 0;
+}
+
+int install_stream_write(Install_Stream *s, const void *data, size_t len)
+{
+    if (!s || s->failed)
+        return -1;
+    const unsigned char *p = data;
+    uint64_t t_hash = timing_begin();
+    if (s->use_tree && merkle_update(&s->tree, p, len) != 0) {
+        if (s->tree.bad_leaf >= 0)
+            cpk_printf(ERROR, "Hash mismatch in block %ld (offset %lld)\n", s->tree.bad_leaf,
+                       (long long)s->tree.bad_leaf * MERKLE_LEAF_SIZE);
+        s->failed = 1;
+        return -1;
+    }
+    if (s->file_sha)
+        hash_update(s->file_sha, p, len);
+    timing_end(TIMING_HASH, t_hash);
+
+    // 先收魔数以确定头部版本，再收剩余头部
+    while (len > 0 && (s->header_size == 0 || s->header_got < s->header_size)) {
+        size_t target = s->header_size ? s->header_size : CPKG_MAGIC_LEN;
+        size_t need = target - s->header_got;
+        size_t n = len < need ? len : need;
+        memcpy((char *)&s->header + s->header_got, p, n);
+        s->header_got += n;
+        p += n;
+        len -= n;
+        if (s->header_size == 0 && s->header_got == CPKG_MAGIC_LEN) {
+            s->header_size = cpk_header_size(s->header.magic);
+            if (s->header_size == 0) {
+                cpk_printf(ERROR, "Invalid package file (bad magic)\n");
+                s->failed = 1;
+                return -1;
+            }
+        } else if (s->header_size && s->header_got == s->header_size && start_extract(s) != 0) {
+            s->failed = 1;
+            return -1;
+        }
+    }
+
+    if (len > 0) {
+        t_hash = timing_begin();
+        hash_update(s->payload_sha, p, len);
+        timing_end(TIMING_HASH, t_hash);
+        while (len > 0) {
+            ssize_t w = write(s->pipe_w, p, len);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0) {
+                s->failed = 1;
+                return -1;
+            }
+            p += w;
+            len -= w;
+        }
+    }
+    return 0;
+}
+
+/* 把 staging 中的顶层条目移动到安装目录（已存在的同名条目先删除） */
+static int commit_staging(const char *staging, const char *install_dir)
+{
+    DIR *dir = opendir(staging);
+    if (!dir)
+        return -1;
+    int ret = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        char src[INSTALL_PATH_LEN], dst[INSTALL_PATH_LEN];
+        snprintf(src, sizeof(src), "%s/%s", staging, entry->d_name);
+        snprintf(dst, sizeof(dst), "%s/%s", install_dir, entry->d_name);
+        if (rm_rf(dst) != 0 || rename(src, dst) != 0) {
+            cpk_printf(ERROR, "Failed to commit %s: %s\n", dst, strerror(errno));
+            ret = -1;
+        }
+    }
+    closedir(dir);
+    return ret;
+}
+
+int install_stream_verify(Install_Stream *s, int transfer_ok)
+{
+    if (!s)
+        return 1;
+    if (s->pipe_w >= 0) {
+        close(s->pipe_w);
+        pthread_join(s->thread, NULL);
+        fclose(s->pipe_r);
+        s->pipe_w = -1;
+        s->pipe_r = NULL;
+    }
+
+    char file_hash[SHA256_HEX_LEN + 1] = "", payload_hash[SHA256_HEX_LEN + 1] = "";
+    if (s->file_sha)
+        hash_final_hex(s->file_sha, file_hash);
+    hash_final_hex(s->payload_sha, payload_hash);
+    int tree_ok = !s->use_tree || s->failed || merkle_final(&s->tree, file_hash) == 0;
+
+    if (!transfer_ok) {
+        cpk_printf(ERROR, "Package transfer failed\n");
+    } else if (s->header_size == 0 || s->header_got < s->header_size) {
+        cpk_printf(ERROR, "Failed to read header\n");
+    } else if (s->failed) {
+        cpk_printf(ERROR, "Failed to stream package data\n");
+    } else if (!tree_ok) {
+        cpk_printf(ERROR, "Hash mismatch: package length does not match its tree\n");
+    } else if (!s->use_tree && s->expected[0] && strcmp(file_hash, s->expected) != 0) {
+        cpk_printf(ERROR, "Hash mismatch: expected %s, got %s\n", s->expected, file_hash);
+    } else if (strcmp(payload_hash, s->header.hash) != 0) {
+        cpk_printf(ERROR, "Hash mismatch: expected %s, got %s\n", s->header.hash, payload_hash);
+    } else if (s->extract_result != 0) {
+        cpk_printf(ERROR, "Failed to extract package\n");
+    } else {
+        cpk_printf(SUCCESS, "Hash verification passed: %s\n", s->header.name);
+        s->verified = 1;
+    }
+    return s->verified ? 0 : 1;
+}
+
+const CPK_Header *install_stream_header(const Install_Stream *s)
+{
+    if (!s || s->header_size == 0 || s->header_got < s->header_size)
+        return NULL;
+    return &s->header;
+}
+
+void install_stream_abort(Install_Stream *s)
+{
+    if (!s)
+        return;
+    if (s->pipe_w >= 0)
+        install_stream_verify(s, 0);
+    rm_rf(s->staging);
+    stream_free(s);
+}
+
+int install_stream_commit(Install_Stream *s)
+{
+    if (!s)
+        return 1;
+    if (!s->verified) {
+        install_stream_abort(s);
+        return 1;
+    }
+    int ret = 0;
+    uint64_t t_commit = timing_begin();
+    trace_begin(TRACE_PACKAGE, s->header.name);
+    char install_dir[MAX_PATH_LEN];
+    snprintf(install_dir, sizeof(install_dir), "%s/%s", cpk_work_dir(), INSTALL_DIR);
+    cpk_printf(INFO, "Extracting package to: %s\n", install_dir);
+    // 提交前记录各文件的摘要（rename 不改变内容与修改时间），供 --verify 使用
+    Manifest manifest;
+    int have_manifest = manifest_build(s->staging, 0, &manifest) == 0;
+    // batch：数据先落盘，文件才以最终名称出现（在加锁之前，不阻塞其他进程的查询）
+    Durability_Mode durability = durability_mode();
+    if (durability == DURABILITY_BATCH && durability_syncfs(s->staging) != 0) {
+        cpk_printf(ERROR, "Failed to sync %s: %s\n", s->staging, strerror(errno));
+        ret = 1;
+    }
+    // 提交期间持有状态排他锁，查询不会看到提交到一半的目录与记录
+    int lock = ret == 0 ? lock_state(1) : LOCK_NONE;
+    if (ret != 0 || lock < 0 || (mkdir_p(install_dir, 0755) != 0 && errno != EEXIST) ||
+        commit_staging(s->staging, install_dir) != 0)
+        ret = 1;
+    if (ret == 0 && durability_sync_dir(install_dir) != 0)
+        cpk_printf(WARNING, "Failed to sync %s: %s\n", install_dir, strerror(errno));
+    if (ret == 0 && status_write(&s->header) != 0)
+        cpk_printf(WARNING, "Failed to record install status for %s\n", s->header.name);
+    if (ret == 0 && (!have_manifest || manifest_write(s->header.name, &manifest) != 0)) {
+        cpk_printf(WARNING, "Failed to record file manifest for %s\n", s->header.name);
+        manifest_remove(s->header.name);  // 不保留旧版本的清单
+    }
+    lock_release(lock);
+    if (have_manifest)
+        manifest_free(&manifest);
+    rm_rf(s->staging);
+    // batch：安装目录与记录的更新落盘后才输出安装完成
+    if (ret == 0 && durability == DURABILITY_BATCH && durability_syncfs(install_dir) != 0)
+        cpk_printf(WARNING, "Failed to sync %s: %s\n", install_dir, strerror(errno));
+    trace_end(TRACE_PACKAGE);
+    timing_end(TIMING_COMMIT, t_commit);
+
+    if (ret == 0) {
+        cpk_printf(SUCCESS, "Package installed successfully: %s %s\n", s->header.name, s->header.version);
+        cpk_progress("install", s->header.name, 1, 1);
+        // 列出安装目录内容（简单遍历）
+        cpk_printf(INFO, "Package contents:\n");
+        DIR *dir = opendir(install_dir);
+        if (dir) {
+            struct dirent *entry;
+            while ((entry = readdir(dir)) != NULL) {
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                    continue;
+                cpk_text("  ├─ %s\n", entry->d_name);
+            }
+            closedir(dir);
+        } else {
+            cpk_printf(WARNING, "Cannot list contents of %s\n", install_dir);
+        }
+    }
+    stream_free(s);
+    return ret;
+}
+
+int install_stream_finish(Install_Stream *s, int transfer_ok)
+{
+    if (!s)
+        return 1;
+    if (install_stream_verify(s, transfer_ok) != 0) {
+        install_stream_abort(s);
+        return 1;
+    }
+    return install_stream_commit(s);
+}
+
+int install_stream_load_file(Install_Stream *s, const char *pkg_path)
+{
+    FILE *fp = fopen(pkg_path, "rb");
+    if (!fp) {
+        cpk_printf(ERROR, "Failed to open package file: %s\n", pkg_path);
+        return 0;
+    }
+    char *buffer = malloc(HASH_IO_BLOCK);
+    int read_ok = (buffer != NULL);
+    size_t n;
+    while (read_ok && (n = fread(buffer, 1, HASH_IO_BLOCK, fp)) > 0) {
+        timing_add(TIMING_BYTES_READ, n);
+        if (install_stream_write(s, buffer, n) != 0)
+            break;
+    }
+    if (read_ok && ferror(fp)) {
+        cpk_printf(ERROR, "Failed to read package content: %s\n", pkg_path);
+        read_ok = 0;
+    }
+    free(buffer);
+    fclose(fp);
+    return read_ok;
+}
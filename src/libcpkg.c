@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/libcpkg.h"
+#include "../include/context.h"
+#include "../include/cpkg.h"
+#include "../include/help.h"
+#include "../include/index.h"
+#include "../include/network.h"
+#include "../include/repo.h"
+#include "../include/durability.h"
+#include "../include/mirror.h"
+
+#define LAST_ERROR_LEN 1024
+
+struct cpkg_handle {
+    Cpk_Context context;            // 调用期间设为当前线程的上下文
+    char *work_dir;
+    int jobs;
+    pthread_mutex_t lock;           // 串行化回调、回调的设置与 last_error（工作线程共用同一句柄）
+    cpkg_log_fn log;
+    void *log_user;
+    cpkg_progress_fn progress;
+    void *progress_user;
+    char last_error[LAST_ERROR_LEN];
+};
+
+/* 把 help.h 中的级别字符串转换为日志级别 */
+static cpkg_log_level log_level(const char *level)
+{
+    if (!level)
+        return CPKG_LOG_TEXT;
+    if (strcmp(level, ERROR) == 0)
+        return CPKG_LOG_ERROR;
+    if (strcmp(level, WARNING) == 0)
+        return CPKG_LOG_WARNING;
+    if (strcmp(level, SUCCESS) == 0)
+        return CPKG_LOG_SUCCESS;
+    if (strcmp(level, DEBUG) == 0)
+        return CPKG_LOG_DEBUG;
+    return CPKG_LOG_INFO;
+}
+
+static void handle_output(void *user, const char *level, const char *text)
+{
+    cpkg_handle *h = (cpkg_handle *)user;
+    cpkg_log_level l = log_level(level);
+    pthread_mutex_lock(&h->lock);
+    if (l == CPKG_LOG_ERROR) {
+        // 记录最后一条错误，去掉结尾的换行
+        snprintf(h->last_error, sizeof(h->last_error), "%s", text);
+        size_t n = strlen(h->last_error);
+        while (n > 0 && h->last_error[n - 1] == '\n')
+            h->last_error[--n] = '\0';
+    }
+    if (h->log)
+        h->log(h->log_user, l, text);
+    pthread_mutex_unlock(&h->lock);
+}
+
+static void handle_progress(void *user, const char *phase, const char *name, uint64_t done, uint64_t total)
+{
+    cpkg_handle *h = (cpkg_handle *)user;
+    pthread_mutex_lock(&h->lock);
+    if (h->progress)
+        h->progress(h->progress_user, phase, name, done, total);
+    pthread_mutex_unlock(&h->lock);
+}
+
+/* 开始一次调用：设置当前线程的上下文，返回之前的上下文 */
+static const Cpk_Context *enter(cpkg_handle *h)
+{
+    const Cpk_Context *prev = cpk_context();
+    h->last_error[0] = '\0';
+    pthread_mutex_lock(&h->lock);
+    h->context.progress = h->progress ? handle_progress : NULL;
+    pthread_mutex_unlock(&h->lock);
+    cpk_context_set(&h->context);
+    return prev;
+}
+
+static cpkg_status leave(cpkg_handle *h, const Cpk_Context *prev, cpkg_status status)
+{
+    cpk_context_set(prev);
+    if (status == CPKG_OK)
+        h->last_error[0] = '\0';   // 重试过程中的错误不算失败
+    else if (h->last_error[0] == '\0')
+        snprintf(h->last_error, sizeof(h->last_error), "%s", cpkg_strerror(status));
+    return status;
+}
+
+cpkg_handle *cpkg_open(const char *root)
+{
+    cpkg_handle *h = calloc(1, sizeof(cpkg_handle));
+    if (!h)
+        return NULL;
+    if (asprintf(&h->work_dir, "%s/%s", root ? root : ".", WORK_DIR_NAME) == -1) {
+        free(h);
+        return NULL;
+    }
+    h->context.net = net_ctx_new();
+    h->context.mirrors = mirror_state_new();
+    if (!h->context.net || !h->context.mirrors) {
+        net_ctx_free(h->context.net);
+        mirror_state_free(h->context.mirrors);
+        free(h->work_dir);
+        free(h);
+        return NULL;
+    }
+    pthread_mutex_init(&h->lock, NULL);
+    h->context.work_dir = h->work_dir;
+    h->context.output = handle_output;
+    h->context.output_user = h;
+    h->context.progress_user = h;
+    h->context.assume_yes = 1;
+    return h;
+}
+
+void cpkg_close(cpkg_handle *h)
+{
+    if (!h)
+        return;
+    net_ctx_free(h->context.net);
+    mirror_state_free(h->context.mirrors);
+    pthread_mutex_destroy(&h->lock);
+    free(h->work_dir);
+    free(h);
+}
+
+void cpkg_set_log(cpkg_handle *h, cpkg_log_fn fn, void *user)
+{
+    pthread_mutex_lock(&h->lock);
+    h->log = fn;
+    h->log_user = user;
+    pthread_mutex_unlock(&h->lock);
+}
+
+void cpkg_set_progress(cpkg_handle *h, cpkg_progress_fn fn, void *user)
+{
+    pthread_mutex_lock(&h->lock);
+    h->progress = fn;
+    h->progress_user = user;
+    pthread_mutex_unlock(&h->lock);
+}
+
+void cpkg_set_jobs(cpkg_handle *h, int jobs)
+{
+    h->jobs = jobs > 0 ? jobs : 0;
+}
+
+void cpkg_set_durability(cpkg_handle *h, cpkg_durability mode)
+{
+    switch (mode) {
+    case CPKG_DURABILITY_NONE:   h->context.durability = DURABILITY_NONE; break;
+    case CPKG_DURABILITY_BATCH:  h->context.durability = DURABILITY_BATCH; break;
+    case CPKG_DURABILITY_STRICT: h->context.durability = DURABILITY_STRICT; break;
+    default:                     h->context.durability = DURABILITY_DEFAULT; break;
+    }
+}
+
+cpkg_status cpkg_install_file(cpkg_handle *h, const char *path)
+{
+    if (!h || !path)
+        return CPKG_E_INVALID;
+    const Cpk_Context *prev = enter(h);
+    int r = install_package_file(path, NULL);
+    return leave(h, prev, r == 0 ? CPKG_OK : CPKG_E_FAILED);
+}
+
+cpkg_status cpkg_install(cpkg_handle *h, const char **names, size_t count)
+{
+    if (!h || (!names && count > 0))
+        return CPKG_E_INVALID;
+    if (count == 0)
+        return CPKG_OK;
+    const Cpk_Context *prev = enter(h);
+    Repo_Index index;
+    if (repo_load_index(&index) != 0)
+        return leave(h, prev, CPKG_E_INDEX);
+    int r = repo_install_from_index(&index, names, count, h->jobs);
+    index_free(&index);
+    // 4 为部分包下载、校验或提交失败，其余非 0 值来自依赖解析
+    cpkg_status status = r == 0 ? CPKG_OK : r == 4 ? CPKG_E_FAILED : CPKG_E_DEPENDS;
+    return leave(h, prev, status);
+}
+
+cpkg_status cpkg_remove(cpkg_handle *h, const char *name)
+{
+    if (!h || !name)
+        return CPKG_E_INVALID;
+    const Cpk_Context *prev = enter(h);
+    int r = remove_package(name);
+    return leave(h, prev, r == 0 ? CPKG_OK : CPKG_E_FAILED);
+}
+
+cpkg_status cpkg_build(cpkg_handle *h, const char *package_dir)
+{
+    if (!h || !package_dir)
+        return CPKG_E_INVALID;
+    const Cpk_Context *prev = enter(h);
+    int r = make_build_package(package_dir);
+    return leave(h, prev, r == 0 ? CPKG_OK : CPKG_E_FAILED);
+}
+
+cpkg_status cpkg_fetch(cpkg_handle *h, const char **names, const char **dests, size_t count)
+{
+    if (!h || (count > 0 && (!names || !dests)))
+        return CPKG_E_INVALID;
+    if (count == 0)
+        return CPKG_OK;
+    const Cpk_Context *prev = enter(h);
+    Repo_Index index;
+    if (repo_load_index(&index) != 0)
+        return leave(h, prev, CPKG_E_INDEX);
+    int r = repo_fetch_from_index(&index, names, dests, count, h->jobs);
+    index_free(&index);
+    cpkg_status status;
+    switch (r) {
+    case 0: status = CPKG_OK; break;
+    case 2: status = CPKG_E_NOMEM; break;
+    case 3: status = CPKG_E_NOT_FOUND; break;
+    default: status = CPKG_E_DOWNLOAD; break;
+    }
+    return leave(h, prev, status);
+}
+
+cpkg_status cpkg_search(cpkg_handle *h, const char *query, cpkg_search_fn fn, void *user)
+{
+    if (!h || !query || !fn)
+        return CPKG_E_INVALID;
+    const Cpk_Context *prev = enter(h);
+    Repo_Index index;
+    if (repo_load_index(&index) != 0)
+        return leave(h, prev, CPKG_E_INDEX);
+    // 与 repo_search 相同的匹配规则
+    for (size_t i = 0; i < index.count; i++) {
+        const Index_Entry *e = &index.entries[i];
+        if (strstr(e->name, query) || strstr(e->version, query) ||
+            strstr(e->url, query) || strstr(e->sha256, query))
+            fn(user, e->name, e->version, e->url);
+    }
+    index_free(&index);
+    return leave(h, prev, CPKG_OK);
+}
+
+const char *cpkg_last_error(const cpkg_handle *h)
+{
+    return h ? h->last_error : "";
+}
+
+const char *cpkg_strerror(cpkg_status status)
+{
+    switch (status) {
+    case CPKG_OK:          return "success";
+    case CPKG_E_INVALID:   return "invalid argument";
+    case CPKG_E_NOMEM:     return "out of memory";
+    case CPKG_E_INDEX:     return "failed to load repository index";
+    case CPKG_E_NOT_FOUND: return "package not found in index";
+    case CPKG_E_DOWNLOAD:  return "download or verification failed";
+    case CPKG_E_DEPENDS:   return "dependency resolution failed";
+    case CPKG_E_FAILED:    return "operation failed";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include "../include/lock.h"
+#include "../include/cpkg.h"
+#include "../include/help.h"
+
+#define HOLDERS_LEN 512
+
+static long timeout_ms(void)
+{
+    const char *env = getenv(LOCK_TIMEOUT_ENV);
+    if (env && *env) {
+        char *end;
+        double sec = strtod(env, &end);
+        if (*end == '\0' && sec >= 0)
+            return (long)(sec * 1000);
+    }
+    return LOCK_DEFAULT_TIMEOUT * 1000L;
+}
+
+static long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/* 进程的命令行（参数以空格分隔，过长时截断） */
+static void process_cmdline(int pid, char *out, size_t len)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
+    out[0] = '\0';
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return;
+    size_t n = fread(out, 1, len - 1, fp);
+    fclose(fp);
+    while (n > 0 && out[n - 1] == '\0')
+        n--;
+    for (size_t i = 0; i < n; i++)
+        if (out[i] == '\0')
+            out[i] = ' ';
+    out[n] = '\0';
+}
+
+/**
+ * @brief 从 /proc/locks 找出锁文件的持有者
+ * @note flock 锁在 /proc/locks 中记录加锁的进程；等待者（"->" 行）不计入
+ */
+static void describe_holders(int fd, char *out, size_t len)
+{
+    struct stat st;
+    FILE *fp = fstat(fd, &st) == 0 ? fopen("/proc/locks", "r") : NULL;
+    size_t used = 0;
+    out[0] = '\0';
+    if (fp) {
+        char line[256];
+        while (fgets(line, sizeof(line), fp)) {
+            char kind[16], mode[16];
+            unsigned int maj, min;
+            unsigned long ino;
+            int pid;
+            if (sscanf(line, "%*[^:]: %15s %*s %15s %d %x:%x:%lu", kind, mode, &pid, &maj, &min, &ino) != 6 ||
+                strcmp(kind, "FLOCK") != 0 || ino != (unsigned long)st.st_ino ||
+                maj != major(st.st_dev) || min != minor(st.st_dev))
+                continue;
+            char cmd[96];
+            process_cmdline(pid, cmd, sizeof(cmd));
+            int w = snprintf(out + used, len - used, "%spid %d (%s, %s)", used ? ", " : "", pid,
+                             cmd[0] ? cmd : "?", strcmp(mode, "WRITE") == 0 ? "exclusive" : "shared");
+            if (w < 0 || (size_t)w >= len - used)
+                break;
+            used += (size_t)w;
+        }
+        fclose(fp);
+    }
+    if (used == 0)
+        snprintf(out, len, "an unknown process");
+}
+
+/**
+ * @brief 获取 cpkg-work/lock/file 上的锁，等待有上限
+ * @param what 用于提示的锁名
+ */
+static int acquire(const char *file, int exclusive, const char *what)
+{
+    char dir[MAX_PATH_LEN], path[MAX_PATH_LEN + 272];
+    snprintf(dir, sizeof(dir), "%s/%s", cpk_work_dir(), LOCK_DIR);
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    int fd = -1;
+    if (mkdir_p(dir, 0755) == 0 || errno == EEXIST)
+        fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        fd = open(path, O_RDONLY | O_CLOEXEC);  // 只读的工作目录中仍可对已有的锁文件加锁
+    if (fd < 0) {
+        if (!exclusive)
+            return LOCK_NONE;
+        cpk_printf(ERROR, "Cannot open lock file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    const char *mode = exclusive ? "exclusive" : "shared";
+    long limit = timeout_ms(), start = now_ms(), step = 1;
+    int noticed = 0;
+    char holders[HOLDERS_LEN];
+    for (;;) {
+        if (flock(fd, (exclusive ? LOCK_EX : LOCK_SH) | LOCK_NB) == 0)
+            return fd;
+        if (errno == EINTR)
+            continue;
+        if (errno != EWOULDBLOCK) {
+            cpk_printf(ERROR, "Failed to lock %s: %s\n", path, strerror(errno));
+            break;
+        }
+        long waited = now_ms() - start;
+        if (waited >= limit) {
+            describe_holders(fd, holders, sizeof(holders));
+            cpk_printf(ERROR, "Timed out after %.1fs waiting for %s lock on %s, held by %s\n",
+                       waited / 1000.0, mode, what, holders);
+            break;
+        }
+        if (!noticed && waited >= LOCK_NOTICE_MS) {
+            describe_holders(fd, holders, sizeof(holders));
+            cpk_printf(INFO, "Waiting for %s lock on %s, held by %s\n", mode, what, holders);
+            noticed = 1;
+        }
+        // 指数退避，最多 100ms 检查一次
+        long sleep_ms = step < limit - waited ? step : limit - waited;
+        struct timespec ts = { sleep_ms / 1000, (sleep_ms % 1000) * 1000000L };
+        nanosleep(&ts, NULL);
+        if (step < 100)
+            step *= 2;
+    }
+    close(fd);
+    return -1;
+}
+
+int lock_state(int exclusive)
+{
+    return acquire(LOCK_STATE, exclusive, "package state");
+}
+
+typedef struct {
+    const char *name;
+    size_t index;
+} Lock_Item;
+
+static int cmp_item(const void *a, const void *b)
+{
+    return strcmp(((const Lock_Item *)a)->name, ((const Lock_Item *)b)->name);
+}
+
+int lock_packages(const char **names, size_t count, int *fds)
+{
+    for (size_t i = 0; i < count; i++)
+        fds[i] = -1;
+    if (count == 0)
+        return 0;
+    Lock_Item *items = malloc(count * sizeof(Lock_Item));
+    if (!items)
+        return -1;
+    for (size_t i = 0; i < count; i++) {
+        items[i].name = names[i];
+        items[i].index = i;
+    }
+    // 统一按包名顺序加锁，同时安装重叠包集合的进程不会互相等待成环
+    qsort(items, count, sizeof(Lock_Item), cmp_item);
+    int ret = 0;
+    for (size_t i = 0; i < count && ret == 0; i++) {
+        const char *name = items[i].name;
+        if (i > 0 && strcmp(name, items[i - 1].name) == 0)
+            continue;
+        char file[272], what[300];
+        if (!name[0] || strchr(name, '/') || snprintf(file, sizeof(file), "%s.lock", name) >= (int)sizeof(file)) {
+            cpk_printf(ERROR, "Invalid package name for locking: %s\n", name);
+            ret = -1;
+            break;
+        }
+        snprintf(what, sizeof(what), "package %s", name);
+        fds[items[i].index] = acquire(file, 1, what);
+        if (fds[items[i].index] < 0)
+            ret = -1;
+    }
+    free(items);
+    if (ret != 0)
+        lock_release_all(fds, count);
+    return ret;
+}
+
+void lock_release(int fd)
+{
+    if (fd >= 0)
+        close(fd);  // 关闭最后一个引用即释放 flock 锁
+}
+
+void lock_release_all(int *fds, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        lock_release(fds[i]);
+        fds[i] = -1;
+    }
+}
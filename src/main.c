@@ -17,11 +17,146 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <getopt.h>
 #include "../include/cpkg.h"
 #include "../include/param.h"
 #include "../include/help.h"
 #include "../include/repo.h"
+#include "../include/cache.h"
+#include "../include/verify.h"
+#include "../include/timing.h"
+#include "../include/trace.h"
+#include "../include/daemon.h"
+#include "../include/batch.h"
+#include "../include/context.h"
+#include "../include/durability.h"
+#include "../include/lock.h"
+
+#ifdef __GLIBC__
+/* --timings 的分配计数：仅在可执行文件中替换 malloc/calloc/realloc，转发给 glibc */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    timing_add(TIMING_ALLOCATIONS, 1);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    timing_add(TIMING_ALLOCATIONS, 1);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    timing_add(TIMING_ALLOCATIONS, 1);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+/**
+ * @brief 预先扫描 --timings 与 --trace：安装等操作在解析参数时即执行，统计须在此之前启用
+ * @return 0 成功，1 参数无效（已打印错误）
+ */
+static int scan_profiling(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--") == 0)
+            break;
+        const char *trace = NULL;
+        if (strcmp(argv[i], "--timings") == 0 || strncmp(argv[i], "--timings=", 10) == 0) {
+            const char *format = argv[i][9] ? argv[i] + 10 : NULL;
+            if (timing_enable(format) != 0) {
+                cpk_printf(ERROR, "--timings accepts 'json' or 'text'\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace = argv[i] + 8;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace = argv[++i];
+        }
+        if (trace && trace_open(trace) != 0) {
+            cpk_printf(ERROR, "Cannot create trace file: %s\n", trace);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int durability_given; // 指定了 --durability：在本地执行，cpkgd 按自己的设置安装
+
+/**
+ * @brief 预先扫描 --durability：本地安装在解析参数时即执行，须在此之前生效
+ * @param context 命令行的上下文，模式写入其中
+ * @return 0 成功，1 参数无效（已打印错误）
+ */
+static int scan_durability(int argc, char *argv[], Cpk_Context *context)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--") == 0)
+            break;
+        const char *value = NULL;
+        if (strncmp(argv[i], "--durability=", 13) == 0)
+            value = argv[i] + 13;
+        else if (strcmp(argv[i], "--durability") == 0 && i + 1 < argc)
+            value = argv[++i];
+        if (!value)
+            continue;
+        int mode = durability_parse(value);
+        if (mode < 0) {
+            cpk_printf(ERROR, "--durability accepts 'none', 'batch' or 'strict'\n");
+            return 1;
+        }
+        context->durability = mode;
+        durability_given = 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 是否设置了影响索引、下载或锁的环境变量
+ *
+ * cpkgd 按自己启动时的环境执行请求，客户端的这些设置不会传过去；
+ * 设置了其中任何一个时在本地执行，与 --timings/--trace/--durability 相同。
+ */
+static int client_env_set(void)
+{
+    static const char *const vars[] = {
+        "CPKG_INDEX_URL", "CPKG_MIRRORS", "CPKG_CACHE_MAX", "CPKG_SEGMENTS", LOCK_TIMEOUT_ENV,
+    };
+    for (size_t i = 0; i < sizeof(vars) / sizeof(vars[0]); i++)
+        if (getenv(vars[i]))
+            return 1;
+    return 0;
+}
+
+/**
+ * @brief 把 --fetch/--repo-install 交给 cpkgd，在当前目录中执行
+ * @return -1 表示没有可用的 cpkgd（或启用了 --timings/--trace/--durability、
+ *         设置了 client_env_set 中的环境变量），需要在本地执行
+ */
+static int daemon_queue(uint8_t op, const char **names, size_t count, int jobs)
+{
+    char cwd[MAX_PATH_LEN], jobs_str[16];
+    if (timing_enabled || trace_enabled || durability_given || client_env_set() ||
+        count + 2 > UINT16_MAX || !getcwd(cwd, sizeof(cwd)))
+        return -1;
+    const char **args = calloc(count + 2, sizeof(char *));
+    if (!args)
+        return -1;
+    snprintf(jobs_str, sizeof(jobs_str), "%d", jobs);
+    args[0] = cwd;
+    args[1] = jobs_str;
+    memcpy(args + 2, names, count * sizeof(char *));
+    int r = daemon_request(op, args, (uint16_t)(count + 2));
+    free(args);
+    return r;
+}
 
 /**
  * @brief cpkg 一个优秀的c包管底层
@@ -30,6 +165,7 @@ int main(int argc, char *argv[])
 {
     int opt; // 选项
     int option_index = 0; // 选项索引
+    int jobs = 0; // 并行下载数（0 表示默认值）
 
     // 处理命令行参数
     if(argc < 2)
@@ -38,26 +174,60 @@ int main(int argc, char *argv[])
         less_info_cpkg();
         return 1;
     }
+    // 命令行的设置放在上下文中（静态存储：退出时的统计输出仍会用到它）
+    static Cpk_Context context;
+    context = *cpk_context();
+    if (scan_profiling(argc, argv) != 0 || scan_durability(argc, argv, &context) != 0)
+        return 1;
+    cpk_context_set(&context);
+
+    // 远程下载/安装的包名列表（最多 argc 个）
+    const char **fetch_names = calloc(argc, sizeof(char *));
+    const char **install_names = calloc(argc, sizeof(char *));
+    const char **upgrade_names = calloc(argc, sizeof(char *));
+    const char **verify_names = calloc(argc, sizeof(char *));
+    size_t fetch_count = 0, install_count = 0, upgrade_count = 0, verify_count = 0;
+    int upgrade = 0;
+    int verify = 0, verify_all = 0, verify_fast = 0; // --verify [包名...|--all] [--fast]
+    const char *verify_dir = NULL; // --verify-packages 的目录
+    const char *batch_file = NULL; // --batch 的操作列表
+    const char **list = NULL; // 当前接受包名列表的选项的列表，其后的非选项参数归入其中
+    size_t *list_count = NULL;
+    int ret = 0;
+    if (!fetch_names || !install_names || !upgrade_names || !verify_names) {
+        cpk_printf(ERROR, "Memory allocation failed.\n");
+        ret = 1;
+        goto out;
+    }
 
     // 解析命令行参数
     // 将选项字符串修改为 "hvi:r:m:"，表示 i, r, m 需要参数
-while((opt = getopt_long(argc, argv, "hvi:r:m:s:f:I:", long_options, &option_index)) != -1)
+    // 开头的 "-" 使非选项参数按原顺序以 1 返回，归入它之前最近的列表选项
+while((opt = getopt_long(argc, argv, "-hvi:r:m:s:f:I:j:V", long_options, &option_index)) != -1)
 {
     switch(opt)
     {
+        case 1:
+            if (list)
+                list[(*list_count)++] = optarg;
+            else
+                cpk_printf(INFO, "Non-option argument: %s\n", optarg);
+            break;
+
         case 'h':
             full_info_cpkg();
-            return 0;
+            goto out;
 
         case 'v':
             cpkg_version();
-            return 0;
+            goto out;
 
         case 'i':
             if (!getenv("CPKG_ALLOW_USER_INSTALL") || strcmp(getenv("CPKG_ALLOW_USER_INSTALL"), "1") != 0) {
                 if(check_sudo_privileges() != 0) {
                     cpk_printf(ERROR, "This operation requires sudo privileges.\n");
-                    return 1;
+                    ret = 1;
+                    goto out;
                 }
             }
             if (optarg) {
@@ -65,21 +235,26 @@ while((opt = getopt_long(argc, argv, "hvi:r:m:s:f:I:", long_options, &option_ind
             } else {
                 cpk_printf(ERROR, "--install requires at least one package file as an argument\n");
                 less_info_cpkg();
-                return 1;
+                ret = 1;
+                goto out;
             }
             break;
 
         case 'r':
-            if(check_sudo_privileges() != 0) {
-                cpk_printf(ERROR, "This operation requires sudo privileges.\n");
-                return 1;
+            if (!getenv("CPKG_ALLOW_USER_INSTALL") || strcmp(getenv("CPKG_ALLOW_USER_INSTALL"), "1") != 0) {
+                if(check_sudo_privileges() != 0) {
+                    cpk_printf(ERROR, "This operation requires sudo privileges.\n");
+                    ret = 1;
+                    goto out;
+                }
             }
             if (optarg) {
                 remove_package(optarg);
             } else {
                 cpk_printf(ERROR, "--remove needs at least one package name argument\n");
                 less_info_cpkg();
-                return 1;
+                ret = 1;
+                goto out;
             }
             break;
 
@@ -89,32 +264,35 @@ while((opt = getopt_long(argc, argv, "hvi:r:m:s:f:I:", long_options, &option_ind
             } else {
                 cpk_printf(ERROR, "--make-build requires at least one directory name argument\n");
                 less_info_cpkg();
-                return 1;
+                ret = 1;
+                goto out;
             }
             break;
         case 's':
             if (optarg) {
-                repo_search(optarg);
+                // 本地统计或使用客户端自己的索引设置时不经过 cpkgd
+                if (timing_enabled || trace_enabled || client_env_set() ||
+                    daemon_request(DAEMON_SEARCH, (const char *[]){ optarg }, 1) < 0)
+                    repo_search(optarg);
             } else {
                 cpk_printf(ERROR, "--search requires a query string\n");
                 less_info_cpkg();
-                return 1;
+                ret = 1;
+                goto out;
             }
             break;
 
         case 'f':
             if (optarg) {
-                char dest[MAX_PATH_LEN];
-                snprintf(dest, MAX_PATH_LEN, "%s.cpk", optarg);
-                if (repo_fetch_package_by_name(optarg, dest) == 0) {
-                    cpk_printf(SUCCESS, "Fetched package to %s\n", dest);
-                } else {
-                    cpk_printf(ERROR, "Failed to fetch package %s\n", optarg);
-                }
+                // 其后的包名在解析完成后收集，统一并行下载
+                fetch_names[fetch_count++] = optarg;
+                list = fetch_names;
+                list_count = &fetch_count;
             } else {
                 cpk_printf(ERROR, "--fetch requires a package name\n");
                 less_info_cpkg();
-                return 1;
+                ret = 1;
+                goto out;
             }
             break;
 
@@ -122,31 +300,154 @@ while((opt = getopt_long(argc, argv, "hvi:r:m:s:f:I:", long_options, &option_ind
             if (!getenv("CPKG_ALLOW_USER_INSTALL") || strcmp(getenv("CPKG_ALLOW_USER_INSTALL"), "1") != 0) {
                 if(check_sudo_privileges() != 0) {
                     cpk_printf(ERROR, "This operation requires sudo privileges.\n");
-                    return 1;
+                    ret = 1;
+                    goto out;
                 }
             }
             if (optarg) {
-                if (repo_install_by_name(optarg) != 0) {
-                    cpk_printf(ERROR, "Remote install failed for %s\n", optarg);
-                }
+                // 其后的包名在解析完成后收集，统一并行下载并安装
+                install_names[install_count++] = optarg;
+                list = install_names;
+                list_count = &install_count;
             } else {
                 cpk_printf(ERROR, "--repo-install requires a package name\n");
                 less_info_cpkg();
-                return 1;
+                ret = 1;
+                goto out;
+            }
+            break;
+
+        case 'j':
+            jobs = atoi(optarg);
+            if (jobs <= 0) {
+                cpk_printf(ERROR, "--jobs requires a positive number\n");
+                ret = 1;
+                goto out;
+            }
+            break;
+
+        case OPT_CACHE_STATS:
+            ret = cache_print_stats();
+            goto out;
+
+        case OPT_UPGRADE:
+            if (!getenv("CPKG_ALLOW_USER_INSTALL") || strcmp(getenv("CPKG_ALLOW_USER_INSTALL"), "1") != 0) {
+                if(check_sudo_privileges() != 0) {
+                    cpk_printf(ERROR, "This operation requires sudo privileges.\n");
+                    ret = 1;
+                    goto out;
+                }
+            }
+            // 可选的包名列表，未指定时升级全部已安装的包
+            upgrade = 1;
+            list = upgrade_names;
+            list_count = &upgrade_count;
+            break;
+
+        case OPT_VERIFY_PACKAGES:
+            verify_dir = optarg;  // 解析完成后执行，以便使用 --jobs
+            break;
+
+        case 'V':
+            verify = 1;
+            list = verify_names;
+            list_count = &verify_count;
+            break;
+
+        case OPT_ALL:
+            verify_all = 1;
+            break;
+
+        case OPT_FAST:
+            verify_fast = 1;
+            break;
+
+        case OPT_BATCH:
+            if (!getenv("CPKG_ALLOW_USER_INSTALL") || strcmp(getenv("CPKG_ALLOW_USER_INSTALL"), "1") != 0) {
+                if(check_sudo_privileges() != 0) {
+                    cpk_printf(ERROR, "This operation requires sudo privileges.\n");
+                    ret = 1;
+                    goto out;
+                }
             }
+            batch_file = optarg;  // 解析完成后执行，以便使用 --jobs
             break;
+
+        case OPT_TIMINGS:
+        case OPT_TRACE:
+        case OPT_DURABILITY:
+            break;  // 已在 scan_profiling/scan_durability 中处理
             
         default:
             cpk_printf(ERROR, "Invalid option: -%c\n", opt);
             less_info_cpkg();
-            return 1;
+            ret = 1;
+            goto out;
     }
 }
 
-// 处理非选项参数（备用方案）
-if (optind < argc) {
-    // 如果有非选项参数，可以作为命令处理
-    cpk_printf(INFO, "Non-option argument: %s\n", argv[optind]);
-}
-    return 0;
+    // "--" 之后的参数同样归入最后一个列表选项
+    for (; optind < argc; optind++) {
+        if (list)
+            list[(*list_count)++] = argv[optind];
+        else
+            cpk_printf(INFO, "Non-option argument: %s\n", argv[optind]);
+    }
+
+    if (fetch_count > 0) {
+        char (*dests)[MAX_PATH_LEN] = calloc(fetch_count, sizeof(*dests));
+        const char **dest_ptrs = calloc(fetch_count, sizeof(char *));
+        if (!dests || !dest_ptrs) {
+            cpk_printf(ERROR, "Memory allocation failed.\n");
+            ret = 1;
+        } else {
+            for (size_t i = 0; i < fetch_count; i++) {
+                snprintf(dests[i], MAX_PATH_LEN, "%s.cpk", fetch_names[i]);
+                dest_ptrs[i] = dests[i];
+            }
+            int r = daemon_queue(DAEMON_FETCH, fetch_names, fetch_count, jobs);
+            if (r < 0)
+                r = repo_fetch_packages(fetch_names, dest_ptrs, fetch_count, jobs);
+            if (r == 0) {
+                for (size_t i = 0; i < fetch_count; i++)
+                    cpk_printf(SUCCESS, "Fetched package to %s\n", dests[i]);
+            } else {
+                cpk_printf(ERROR, "Failed to fetch package(s)\n");
+                ret = 1;
+            }
+        }
+        free(dests);
+        free(dest_ptrs);
+    }
+    if (install_count > 0) {
+        int r = daemon_queue(DAEMON_INSTALL, install_names, install_count, jobs);
+        if (r < 0)
+            r = repo_install_packages(install_names, install_count, jobs);
+        if (r != 0) {
+            cpk_printf(ERROR, "Remote install failed\n");
+            ret = 1;
+        }
+    }
+    if (batch_file && batch_run(batch_file, jobs) != 0)
+        ret = 1;
+    if (verify_dir && verify_packages_dir(verify_dir, jobs) != 0)
+        ret = 1;
+    if (verify) {
+        if (verify_count == 0 && !verify_all) {
+            cpk_printf(ERROR, "--verify requires package names or --all\n");
+            ret = 1;
+        } else if (verify_installed(verify_names, verify_all ? 0 : verify_count, verify_fast, jobs) != 0) {
+            ret = 1;
+        }
+    }
+    if (upgrade && repo_upgrade_packages(upgrade_names, upgrade_count, jobs) != 0) {
+        cpk_printf(ERROR, "Upgrade failed\n");
+        ret = 1;
+    }
+out:
+    free(fetch_names);
+    free(install_names);
+    free(upgrade_names);
+    free(verify_names);
+    return ret;
 }
\ No newline at end of file
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../include/manifest.h"
+#include "../include/workers.h"
+#include "../include/cpkg.h"
+#include "../include/help.h"
+#include "../include/durability.h"
+
+/* 包名不能包含路径分隔符，避免清单写到清单目录之外 */
+static int valid_name(const char *name)
+{
+    return name && name[0] && strchr(name, '/') == NULL &&
+           strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+static void manifest_path(const char *name, char *out, size_t len)
+{
+    snprintf(out, len, "%s/%s/%.255s", cpk_work_dir(), MANIFEST_DIR, name);
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+    return strcmp(((const Manifest_Entry *)a)->path, ((const Manifest_Entry *)b)->path);
+}
+
+int manifest_hash_file(const char *path, char type, char *out)
+{
+    if (type == 'l') {
+        char target[MAX_PATH_LEN];
+        ssize_t n = readlink(path, target, sizeof(target));
+        if (n < 0 || (size_t)n == sizeof(target))
+            return -1;
+        return hash_mem_hex(target, (size_t)n, out);
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0)
+        return -1;
+    // 绝大多数文件很小：读到栈上一次哈希完，不为每个文件分配 1 MiB 缓冲区
+    unsigned char small[MANIFEST_SMALL_FILE];
+    size_t got = 0;
+    ssize_t n = 1;
+    while (got < sizeof(small) && (n = read(fd, small + got, sizeof(small) - got)) > 0)
+        got += (size_t)n;
+    int ret;
+    if (n < 0)
+        ret = -1;
+    else if (got < sizeof(small))
+        ret = hash_mem_hex(small, got, out);
+    else
+        ret = hash_fd_hex(fd, 0, out);
+    close(fd);
+    return ret;
+}
+
+/* 遍历过程中收集的条目（path 单独分配，完成后合并到 Manifest.data） */
+typedef struct {
+    Manifest_Entry *entries;
+    size_t count, capacity;
+    char root[MAX_PATH_LEN];
+} Walker;
+
+static int walk_dir(Walker *w, const char *rel)
+{
+    char dir_path[INSTALL_PATH_LEN];
+    snprintf(dir_path, sizeof(dir_path), "%s%s%s", w->root, rel[0] ? "/" : "", rel);
+    DIR *dir = opendir(dir_path);
+    if (!dir)
+        return -1;
+    int ret = 0;
+    struct dirent *de;
+    while (ret == 0 && (de = readdir(dir)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+        char child[MAX_PATH_LEN];
+        int len = snprintf(child, sizeof(child), "%s%s%s", rel, rel[0] ? "/" : "", de->d_name);
+        struct stat st;
+        if (len < 0 || (size_t)len >= sizeof(child) || strchr(de->d_name, '\n') ||
+            fstatat(dirfd(dir), de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            cpk_printf(WARNING, "Cannot record %s/%s\n", dir_path, de->d_name);
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            ret = walk_dir(w, child);
+            continue;
+        }
+        if (!S_ISREG(st.st_mode) && !S_ISLNK(st.st_mode))
+            continue;
+        if (w->count == w->capacity) {
+            size_t ncap = w->capacity ? w->capacity * 2 : 256;
+            Manifest_Entry *t = realloc(w->entries, ncap * sizeof(Manifest_Entry));
+            if (!t) {
+                ret = -1;
+                break;
+            }
+            w->entries = t;
+            w->capacity = ncap;
+        }
+        Manifest_Entry *e = &w->entries[w->count];
+        memset(e, 0, sizeof(*e));
+        if ((e->path = strdup(child)) == NULL) {
+            ret = -1;
+            break;
+        }
+        e->type = S_ISLNK(st.st_mode) ? 'l' : 'f';
+        e->size = (long long)st.st_size;
+        e->mtime_sec = (long long)st.st_mtim.tv_sec;
+        e->mtime_nsec = st.st_mtim.tv_nsec;
+        w->count++;
+    }
+    closedir(dir);
+    return ret;
+}
+
+int manifest_list(const char *root, Manifest *out)
+{
+    memset(out, 0, sizeof(*out));
+    Walker w;
+    memset(&w, 0, sizeof(w));
+    snprintf(w.root, sizeof(w.root), "%s", root);
+    int ret = walk_dir(&w, "");
+
+    // 把各条路径合并到一块存储中，与 manifest_read 的结果形式一致
+    size_t total = 1;
+    for (size_t i = 0; i < w.count; i++)
+        total += strlen(w.entries[i].path) + 1;
+    char *data = ret == 0 ? malloc(total) : NULL;
+    size_t off = 0;
+    for (size_t i = 0; i < w.count; i++) {
+        char *p = (char *)w.entries[i].path;
+        if (data) {
+            size_t len = strlen(p) + 1;
+            memcpy(data + off, p, len);
+            w.entries[i].path = data + off;
+            off += len;
+        }
+        free(p);
+    }
+    if (!data) {
+        free(w.entries);
+        return -1;
+    }
+    qsort(w.entries, w.count, sizeof(Manifest_Entry), cmp_entry);
+    out->entries = w.entries;
+    out->count = w.count;
+    out->data = data;
+    return 0;
+}
+
+/* 并行哈希时的共享状态 */
+typedef struct {
+    const char *root;
+    Manifest *m;
+    int failed;
+} Hash_Job;
+
+static void hash_entry(void *ctx, size_t i)
+{
+    Hash_Job *job = (Hash_Job *)ctx;
+    Manifest_Entry *e = &job->m->entries[i];
+    char path[INSTALL_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s", job->root, e->path);
+    if (manifest_hash_file(path, e->type, e->sha256) != 0)
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+}
+
+int manifest_build(const char *root, int threads, Manifest *out)
+{
+    if (manifest_list(root, out) != 0)
+        return -1;
+    Hash_Job job = { root, out, 0 };
+    run_parallel(out->count, threads, hash_entry, &job);
+    if (job.failed) {
+        manifest_free(out);
+        return -1;
+    }
+    return 0;
+}
+
+int manifest_write(const char *name, const Manifest *m)
+{
+    if (!valid_name(name) || !m)
+        return 1;
+    char dir[MAX_PATH_LEN];
+    snprintf(dir, sizeof(dir), "%s/%s", cpk_work_dir(), MANIFEST_DIR);
+    if (mkdir_p(dir, 0755) != 0 && errno != EEXIST)
+        return 1;
+    char path[MAX_PATH_LEN], tmp[MAX_PATH_LEN + 16];
+    manifest_path(name, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp)
+        return 1;
+    for (size_t i = 0; i < m->count; i++) {
+        const Manifest_Entry *e = &m->entries[i];
+        fprintf(fp, "%c %s %lld %lld.%09ld %s\n", e->type, e->sha256, e->size,
+                e->mtime_sec, e->mtime_nsec, e->path);
+    }
+    int synced = durability_sync_file(fp) == 0;
+    if (fclose(fp) != 0 || !synced || rename(tmp, path) != 0) {
+        remove(tmp);
+        return 1;
+    }
+    return durability_sync_dir(dir) == 0 ? 0 : 1;
+}
+
+/* 解析一行，path 指向行内（就地把换行改为 '\0'） */
+static int parse_line(char *line, Manifest_Entry *e)
+{
+    int pos = 0;
+    memset(e, 0, sizeof(*e));
+    if (sscanf(line, "%c %64s %lld %lld.%ld %n", &e->type, e->sha256, &e->size,
+               &e->mtime_sec, &e->mtime_nsec, &pos) != 5 || pos == 0 || !line[pos])
+        return -1;
+    if ((e->type != 'f' && e->type != 'l') || strlen(e->sha256) != HASH_HEX_LEN)
+        return -1;
+    e->path = line + pos;
+    return 0;
+}
+
+int manifest_read(const char *name, Manifest *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!valid_name(name))
+        return 1;
+    char path[MAX_PATH_LEN];
+    manifest_path(name, path, sizeof(path));
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return 1;
+    struct stat st;
+    char *data = NULL;
+    if (fstat(fileno(fp), &st) == 0)
+        data = malloc((size_t)st.st_size + 1);
+    size_t len = data ? fread(data, 1, (size_t)st.st_size, fp) : 0;
+    fclose(fp);
+    if (!data)
+        return -1;
+    data[len] = '\0';
+
+    size_t lines = 0;
+    for (size_t i = 0; i < len; i++)
+        if (data[i] == '\n')
+            lines++;
+    Manifest_Entry *entries = malloc((lines + 1) * sizeof(Manifest_Entry));
+    if (!entries) {
+        free(data);
+        return -1;
+    }
+    size_t count = 0;
+    char *p = data;
+    while (*p) {
+        char *nl = strchr(p, '\n');
+        if (nl)
+            *nl = '\0';
+        if (*p && parse_line(p, &entries[count]) != 0) {
+            free(entries);
+            free(data);
+            return -1;
+        }
+        if (*p)
+            count++;
+        if (!nl)
+            break;
+        p = nl + 1;
+    }
+    qsort(entries, count, sizeof(Manifest_Entry), cmp_entry);
+    out->entries = entries;
+    out->count = count;
+    out->data = data;
+    return 0;
+}
+
+int manifest_remove(const char *name)
+{
+    if (!valid_name(name))
+        return 1;
+    char path[MAX_PATH_LEN];
+    manifest_path(name, path, sizeof(path));
+    return (unlink(path) == 0 || errno == ENOENT) ? 0 : 1;
+}
+
+void manifest_free(Manifest *m)
+{
+    if (!m)
+        return;
+    free(m->entries);
+    free(m->data);
+    memset(m, 0, sizeof(*m));
+}
+
+const Manifest_Entry *manifest_find(const Manifest *m, const char *path)
+{
+    Manifest_Entry key;
+    key.path = path;
+    return bsearch(&key, m->entries, m->count, sizeof(Manifest_Entry), cmp_entry);
+}
@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "../include/merkle.h"
+#include "../include/workers.h"
+
+static const unsigned char leaf_prefix = 0x00;
+
+/* 开始一个新叶子 */
+static int leaf_begin(Merkle_Builder *b)
+{
+    b->leaf_fill = 0;
+    if (hash_reset(b->leaf) != 0)
+        return -1;
+    return hash_update(b->leaf, &leaf_prefix, 1);
+}
+
+/* 结束当前叶子并与期望值比较 */
+static int leaf_end(Merkle_Builder *b)
+{
+    if (b->count == b->capacity) {
+        size_t ncap = b->capacity ? b->capacity * 2 : 64;
+        Merkle_Digest *t = realloc(b->leaves, ncap * sizeof(Merkle_Digest));
+        if (!t)
+            return -1;
+        b->leaves = t;
+        b->capacity = ncap;
+    }
+    if (hash_final(b->leaf, b->leaves[b->count]) != 0)
+        return -1;
+    if (b->expected && b->bad_leaf < 0 &&
+        (b->count >= b->expected_count ||
+         memcmp(b->leaves[b->count], b->expected[b->count], HASH_DIGEST_LEN) != 0))
+        b->bad_leaf = (long)b->count;
+    b->count++;
+    return b->bad_leaf < 0 ? 0 : -1;
+}
+
+int merkle_init(Merkle_Builder *b, const Merkle_Digest *expected, size_t expected_count)
+{
+    memset(b, 0, sizeof(*b));
+    b->expected = expected;
+    b->expected_count = expected_count;
+    b->bad_leaf = -1;
+    b->leaf = hash_new();
+    if (!b->leaf || leaf_begin(b) != 0) {
+        merkle_free(b);
+        return -1;
+    }
+    return 0;
+}
+
+int merkle_update(Merkle_Builder *b, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    while (len > 0) {
+        size_t n = MERKLE_LEAF_SIZE - b->leaf_fill;
+        if (n > len)
+            n = len;
+        if (hash_update(b->leaf, p, n) != 0)
+            return -1;
+        b->leaf_fill += n;
+        p += n;
+        len -= n;
+        if (b->leaf_fill == MERKLE_LEAF_SIZE && (leaf_end(b) != 0 || leaf_begin(b) != 0))
+            return -1;
+    }
+    return 0;
+}
+
+int merkle_final(Merkle_Builder *b, char *root_hex)
+{
+    root_hex[0] = '\0';
+    // 未写满的最后一个叶子（空数据也算一个叶子）
+    if ((b->leaf_fill > 0 || b->count == 0) && leaf_end(b) != 0)
+        return -1;
+    if (b->expected && b->count != b->expected_count)
+        return -1;
+    Merkle_Digest root;
+    if (merkle_root(b->leaves, b->count, root) != 0)
+        return -1;
+    hex_encode(root, HASH_DIGEST_LEN, root_hex);
+    return 0;
+}
+
+int merkle_restore(Merkle_Builder *b, const Merkle_Digest *leaves, size_t count)
+{
+    if (b->count != 0 || b->leaf_fill != 0)
+        return -1;
+    if (count > b->capacity) {
+        Merkle_Digest *t = realloc(b->leaves, count * sizeof(Merkle_Digest));
+        if (!t)
+            return -1;
+        b->leaves = t;
+        b->capacity = count;
+    }
+    for (size_t i = 0; i < count; i++) {
+        memcpy(b->leaves[b->count], leaves[i], HASH_DIGEST_LEN);
+        if (b->expected && b->bad_leaf < 0 &&
+            (b->count >= b->expected_count || memcmp(leaves[i], b->expected[b->count], HASH_DIGEST_LEN) != 0))
+            b->bad_leaf = (long)b->count;
+        b->count++;
+    }
+    return b->bad_leaf < 0 ? 0 : -1;
+}
+
+void merkle_free(Merkle_Builder *b)
+{
+    hash_free(b->leaf);
+    free(b->leaves);
+    b->leaf = NULL;
+    b->leaves = NULL;
+    b->count = b->capacity = 0;
+}
+
+int merkle_root(const Merkle_Digest *leaves, size_t count, Merkle_Digest root)
+{
+    if (count == 0)
+        return -1;
+    Merkle_Digest *level = malloc(count * sizeof(Merkle_Digest));
+    if (!level)
+        return -1;
+    memcpy(level, leaves, count * sizeof(Merkle_Digest));
+    unsigned char node[1 + 2 * HASH_DIGEST_LEN];
+    node[0] = 0x01;
+    int ret = 0;
+    while (count > 1 && ret == 0) {
+        size_t next = 0;
+        for (size_t i = 0; i + 1 < count && ret == 0; i += 2) {
+            memcpy(node + 1, level[i], HASH_DIGEST_LEN);
+            memcpy(node + 1 + HASH_DIGEST_LEN, level[i + 1], HASH_DIGEST_LEN);
+            ret = hash_mem(node, sizeof(node), level[next++]);
+        }
+        if (count % 2)
+            memmove(level[next++], level[count - 1], HASH_DIGEST_LEN);
+        count = next;
+    }
+    if (ret == 0)
+        memcpy(root, level[0], HASH_DIGEST_LEN);
+    free(level);
+    return ret;
+}
+
+size_t merkle_leaf_count(off_t length)
+{
+    if (length <= 0)
+        return 1;
+    return (size_t)((length + MERKLE_LEAF_SIZE - 1) / MERKLE_LEAF_SIZE);
+}
+
+int merkle_hash_leaves(int fd, off_t offset, off_t length, size_t first, size_t count, Merkle_Digest *out)
+{
+    unsigned char *buf = malloc(MERKLE_LEAF_SIZE);
+    Hash_Ctx *h = hash_new();
+    int ret = (buf && h) ? 0 : -1;
+    for (size_t i = 0; i < count && ret == 0; i++) {
+        off_t start = (off_t)(first + i) * MERKLE_LEAF_SIZE;
+        size_t want = (length - start) < MERKLE_LEAF_SIZE ? (size_t)(length - start) : MERKLE_LEAF_SIZE;
+        size_t got = 0;
+        while (got < want) {
+            ssize_t n = pread(fd, buf + got, want - got, offset + start + (off_t)got);
+            if (n <= 0) {
+                ret = -1;
+                break;
+            }
+            got += (size_t)n;
+        }
+        if (ret == 0 && (hash_reset(h) != 0 || hash_update(h, &leaf_prefix, 1) != 0 ||
+                         hash_update(h, buf, want) != 0 || hash_final(h, out[i]) != 0))
+            ret = -1;
+    }
+    hash_free(h);
+    free(buf);
+    return ret;
+}
+
+/* 并行计算时的共享状态 */
+typedef struct {
+    int fd;
+    off_t offset, length;
+    Merkle_Digest *leaves;
+    size_t count;
+    int failed;
+} Leaf_Job;
+
+static void hash_unit(void *ctx, size_t unit)
+{
+    Leaf_Job *job = (Leaf_Job *)ctx;
+    size_t first = unit * MERKLE_UNIT_LEAVES;
+    size_t n = job->count - first < MERKLE_UNIT_LEAVES ? job->count - first : MERKLE_UNIT_LEAVES;
+    if (merkle_hash_leaves(job->fd, job->offset, job->length, first, n, job->leaves + first) != 0)
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+}
+
+int merkle_root_fd(int fd, off_t offset, int threads, char *root_hex)
+{
+    root_hex[0] = '\0';
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < offset)
+        return -1;
+    Leaf_Job job = { fd, offset, st.st_size - offset, NULL, 0, 0 };
+    job.count = merkle_leaf_count(job.length);
+    job.leaves = malloc(job.count * sizeof(Merkle_Digest));
+    if (!job.leaves)
+        return -1;
+    size_t units = (job.count + MERKLE_UNIT_LEAVES - 1) / MERKLE_UNIT_LEAVES;
+    run_parallel(units, threads, hash_unit, &job);
+    Merkle_Digest root;
+    int ret = (!job.failed && merkle_root(job.leaves, job.count, root) == 0) ? 0 : -1;
+    if (ret == 0)
+        hex_encode(root, HASH_DIGEST_LEN, root_hex);
+    free(job.leaves);
+    return ret;
+}
+
+int merkle_parse_leaves(const char *text, size_t len, Merkle_Digest **out, size_t *count)
+{
+    *out = NULL;
+    *count = 0;
+    size_t cap = len / (HASH_HEX_LEN + 1) + 1;
+    Merkle_Digest *leaves = malloc(cap * sizeof(Merkle_Digest));
+    if (!leaves)
+        return -1;
+    size_t n = 0;
+    const char *p = text, *end = text + len;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        size_t line_len = (eol ? eol : end) - p;
+        if (line_len > 0 && p[line_len - 1] == '\r')
+            line_len--;
+        if (line_len > 0) {
+            if (line_len != HASH_HEX_LEN || n == cap || hex_decode(p, leaves[n], HASH_DIGEST_LEN) != 0) {
+                free(leaves);
+                return -1;
+            }
+            n++;
+        }
+        p = eol ? eol + 1 : end;
+    }
+    if (n == 0) {
+        free(leaves);
+        return -1;
+    }
+    *out = leaves;
+    *count = n;
+    return 0;
+}
+
+int merkle_write_leaves(const char *path, const Merkle_Digest *leaves, size_t count)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+    char hex[HASH_HEX_LEN + 1];
+    for (size_t i = 0; i < count; i++) {
+        hex_encode(leaves[i], HASH_DIGEST_LEN, hex);
+        fprintf(fp, "%s\n", hex);
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "../include/mirror.h"
+#include "../include/cpkg.h"
+#include "../include/context.h"
+#include "../include/help.h"
+
+static const char *default_index_url = "https://example.com/cpkg/index.txt";
+
+struct Mirror_State {
+    pthread_mutex_t lock;
+    int loaded;                 // 已读取配置（并在需要时测速）
+    int ok;                     // 至少有一个镜像
+    Mirror_List list;
+};
+
+// 没有自己镜像状态的上下文（cpkg 与 cpkgd）共用
+static Mirror_State default_state = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* 截断复制字符串（保证以 '\0' 结尾） */
+static void copy_str(char *dst, size_t size, const char *src)
+{
+    size_t n = strnlen(src, size - 1);
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+/* 拼接 "a/b"，超出 size 时返回 -1 */
+static int join_url(char *out, size_t size, const char *a, const char *b)
+{
+    size_t la = strlen(a), lb = strlen(b);
+    if (la + 1 + lb >= size)
+        return -1;
+    memcpy(out, a, la);
+    out[la] = '/';
+    memcpy(out + la + 1, b, lb + 1);
+    return 0;
+}
+
+static void add_mirror(Mirror_List *list, const char *base, size_t len)
+{
+    while (len > 0 && base[len - 1] == '/')
+        len--;
+    if (len == 0 || len >= NET_URL_MAX || list->count >= MIRROR_MAX)
+        return;
+    Mirror *m = &list->mirrors[list->count++];
+    memset(m, 0, sizeof(*m));
+    memcpy(m->base, base, len);
+    m->base[len] = '\0';
+}
+
+/* 读取 CPKG_MIRRORS / CPKG_INDEX_URL */
+static void parse_config(Mirror_List *list)
+{
+    const char *url = getenv("CPKG_INDEX_URL");
+    if (!url) url = default_index_url;
+    const char *slash = strrchr(url, '/');
+    const char *mirrors = getenv("CPKG_MIRRORS");
+
+    if (mirrors && *mirrors) {
+        copy_str(list->index_name, sizeof(list->index_name),
+                 getenv("CPKG_INDEX_URL") && slash ? slash + 1 : MIRROR_DEFAULT_INDEX);
+        const char *p = mirrors;
+        while (*p) {
+            p += strspn(p, ", \t\n");
+            size_t n = strcspn(p, ", \t\n");
+            add_mirror(list, p, n);
+            p += n;
+        }
+    }
+    if (list->count == 0) {
+        // 单一镜像：索引地址所在目录
+        copy_str(list->index_name, sizeof(list->index_name), slash ? slash + 1 : url);
+        add_mirror(list, url, slash ? (size_t)(slash - url) : strlen(url));
+    }
+    if (list->count > 0)
+        mirror_index_url(list, 0, list->key, sizeof(list->key));
+}
+
+int mirror_index_url(const Mirror_List *list, size_t i, char *out, size_t len)
+{
+    return join_url(out, len, list->mirrors[i].base, list->index_name);
+}
+
+static void state_path(char *out, size_t len)
+{
+    snprintf(out, len, "%s/%s", cpk_work_dir(), MIRROR_STATE_FILE);
+}
+
+/* 读取持久化的评分（每行：score latency speed failures probed_at base） */
+static void load_state(Mirror_List *list)
+{
+    char path[MAX_PATH_LEN];
+    state_path(path, sizeof(path));
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return;
+    char line[NET_URL_MAX + 128];
+    while (fgets(line, sizeof(line), fp)) {
+        Mirror m;
+        int consumed = 0;
+        if (sscanf(line, "%lf %lf %lf %d %ld %n", &m.score_ms, &m.latency_ms,
+                   &m.bytes_per_sec, &m.failures, &m.probed_at, &consumed) != 5)
+            continue;
+        char *base = line + consumed;
+        base[strcspn(base, "\r\n")] = '\0';
+        for (size_t i = 0; i < list->count; i++) {
+            Mirror *cur = &list->mirrors[i];
+            if (strcmp(cur->base, base) == 0) {
+                cur->score_ms = m.score_ms;
+                cur->latency_ms = m.latency_ms;
+                cur->bytes_per_sec = m.bytes_per_sec;
+                cur->failures = m.failures;
+                cur->probed_at = m.probed_at;
+            }
+        }
+    }
+    fclose(fp);
+}
+
+/* 写入评分（临时文件 + rename），保留文件中其他仓库的镜像记录 */
+static void save_state(const Mirror *mirrors, size_t count)
+{
+    char path[MAX_PATH_LEN], tmp[MAX_PATH_LEN + 16];
+    state_path(path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (mkdir_p(cpk_work_dir(), 0755) != 0 && errno != EEXIST)
+        return;
+    FILE *out = fopen(tmp, "w");
+    if (!out)
+        return;
+    for (size_t i = 0; i < count; i++)
+        fprintf(out, "%.3f %.3f %.0f %d %ld %s\n", mirrors[i].score_ms, mirrors[i].latency_ms,
+                mirrors[i].bytes_per_sec, mirrors[i].failures, mirrors[i].probed_at, mirrors[i].base);
+    FILE *in = fopen(path, "r");
+    if (in) {
+        char line[NET_URL_MAX + 128];
+        while (fgets(line, sizeof(line), in)) {
+            int consumed = 0;
+            double d;
+            int f;
+            long t;
+            if (sscanf(line, "%lf %lf %lf %d %ld %n", &d, &d, &d, &f, &t, &consumed) != 5)
+                continue;
+            char base[NET_URL_MAX];
+            copy_str(base, sizeof(base), line + consumed);
+            base[strcspn(base, "\r\n")] = '\0';
+            int ours = 0;
+            for (size_t i = 0; i < count && !ours; i++)
+                ours = (strcmp(mirrors[i].base, base) == 0);
+            if (!ours)
+                fputs(line, out);
+        }
+        fclose(in);
+    }
+    if (fclose(out) != 0 || rename(tmp, path) != 0)
+        remove(tmp);
+}
+
+/* 并行测速并更新评分（与上次评分做平滑，避免一次抖动改变排序） */
+static void probe_mirrors(Mirror_List *list)
+{
+    net_probe probes[MIRROR_MAX];
+    char urls[MIRROR_MAX][NET_URL_MAX];
+    for (size_t i = 0; i < list->count; i++) {
+        mirror_index_url(list, i, urls[i], sizeof(urls[i]));
+        probes[i].url = urls[i];
+    }
+    cpk_printf(INFO, "Probing %zu mirrors...\n", list->count);
+    net_probe_many(net_default(), probes, list->count, MIRROR_PROBE_BYTES, MIRROR_PROBE_TIMEOUT_MS);
+
+    long now = (long)time(NULL);
+    for (size_t i = 0; i < list->count; i++) {
+        Mirror *m = &list->mirrors[i];
+        m->probed_at = now;
+        if (!probes[i].ok) {
+            m->failures++;
+            m->score_ms = MIRROR_DEAD_SCORE;
+            continue;
+        }
+        double speed = probes[i].bytes_per_sec > 1 ? probes[i].bytes_per_sec : 1;
+        double score = probes[i].latency_ms + MIRROR_SCORE_BYTES / speed * 1000.0;
+        if (m->score_ms > 0 && m->score_ms < MIRROR_DEAD_SCORE && m->failures == 0)
+            score = (m->score_ms + score) / 2;
+        m->latency_ms = probes[i].latency_ms;
+        m->bytes_per_sec = probes[i].bytes_per_sec;
+        m->score_ms = score;
+        m->failures = 0;
+    }
+    save_state(list->mirrors, list->count);
+}
+
+static int cmp_score(const void *a, const void *b)
+{
+    const Mirror *x = a, *y = b;
+    return (x->score_ms > y->score_ms) - (x->score_ms < y->score_ms);
+}
+
+/* 读取配置，必要时测速，并按评分排序 */
+static void load_list(Mirror_State *state)
+{
+    Mirror_List *list = &state->list;
+    parse_config(list);
+    if (list->count == 0)
+        return;
+    state->ok = 1;
+    if (list->count == 1)
+        return;  // 只有一个镜像时无需排序
+
+    load_state(list);
+    long now = (long)time(NULL);
+    const char *force = getenv("CPKG_MIRROR_PROBE");
+    int need_probe = (force && strcmp(force, "1") == 0);
+    for (size_t i = 0; i < list->count && !need_probe; i++) {
+        const Mirror *m = &list->mirrors[i];
+        // 测速时不可用的镜像等评分过期再测；测速后使用中失败的镜像下次立即重测
+        need_probe = (m->probed_at == 0 || now - m->probed_at > MIRROR_PROBE_TTL ||
+                      (m->failures > 0 && m->score_ms < MIRROR_DEAD_SCORE));
+    }
+    if (need_probe)
+        probe_mirrors(list);
+
+    // 稳定排序：评分相同时保持配置顺序
+    Mirror sorted[MIRROR_MAX];
+    memcpy(sorted, list->mirrors, list->count * sizeof(Mirror));
+    for (size_t i = 1; i < list->count; i++) {
+        Mirror cur = sorted[i];
+        size_t j = i;
+        while (j > 0 && cmp_score(&sorted[j - 1], &cur) > 0) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = cur;
+    }
+    memcpy(list->mirrors, sorted, list->count * sizeof(Mirror));
+    for (size_t i = 0; i < list->count; i++) {
+        const Mirror *m = &list->mirrors[i];
+        if (m->score_ms >= MIRROR_DEAD_SCORE)
+            cpk_printf(DEBUG, "Mirror %zu: %s (unreachable)\n", i + 1, m->base);
+        else
+            cpk_printf(DEBUG, "Mirror %zu: %s (%.1f ms, %.1f KiB/s)\n", i + 1, m->base,
+                       m->latency_ms, m->bytes_per_sec / 1024.0);
+    }
+}
+
+Mirror_State *mirror_state_new(void)
+{
+    Mirror_State *state = calloc(1, sizeof(Mirror_State));
+    if (state)
+        pthread_mutex_init(&state->lock, NULL);
+    return state;
+}
+
+void mirror_state_free(Mirror_State *state)
+{
+    if (!state)
+        return;
+    pthread_mutex_destroy(&state->lock);
+    free(state);
+}
+
+/* 当前上下文的镜像状态 */
+static Mirror_State *current_state(void)
+{
+    Mirror_State *state = cpk_context()->mirrors;
+    return state ? state : &default_state;
+}
+
+const Mirror_List *mirror_default(void)
+{
+    Mirror_State *state = current_state();
+    pthread_mutex_lock(&state->lock);
+    if (!state->loaded) {
+        load_list(state);
+        state->loaded = 1;
+    }
+    pthread_mutex_unlock(&state->lock);
+    return state->ok ? &state->list : NULL;
+}
+
+size_t mirror_candidates(const Mirror_List *list, const char *url, char (*out)[NET_URL_MAX], size_t max)
+{
+    if (!url || max == 0)
+        return 0;
+    const char *rel = NULL;
+    if (list && !strstr(url, "://")) {
+        rel = url;  // 相对镜像根地址
+    } else if (list) {
+        for (size_t i = 0; i < list->count && !rel; i++) {
+            size_t n = strlen(list->mirrors[i].base);
+            if (strncmp(url, list->mirrors[i].base, n) == 0 && url[n] == '/')
+                rel = url + n + 1;
+        }
+    }
+    if (!rel) {
+        copy_str(out[0], NET_URL_MAX, url);
+        return 1;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < list->count && count < max; i++) {
+        if (join_url(out[count], NET_URL_MAX, list->mirrors[i].base, rel) == 0)
+            count++;
+    }
+    if (count == 0)
+        copy_str(out[count++], NET_URL_MAX, url);
+    return count;
+}
+
+void mirror_mark_failed(const char *base)
+{
+    Mirror_State *state = current_state();
+    pthread_mutex_lock(&state->lock);
+    for (size_t i = 0; state->ok && i < state->list.count; i++) {
+        Mirror *m = &state->list.mirrors[i];
+        if (strcmp(m->base, base) == 0 && state->list.count > 1) {
+            m->failures++;
+            save_state(m, 1);
+        }
+    }
+    pthread_mutex_unlock(&state->lock);
+}
@@ -1,18 +1,188 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <curl/curl.h>
 #include "../include/network.h"
+#include "../include/hash.h"
+#include "../include/merkle.h"
+#include "../include/timing.h"
+#include "../include/trace.h"
+#include "../include/context.h"
+
+struct net_ctx {
+    CURLSH *share;                           // 共享 DNS / TLS 会话 / 连接缓存
+    pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST]; // 共享数据的锁（供多线程使用）
+    pthread_mutex_t pool_lock;               // 保护空闲句柄池
+    CURL *idle[NET_MAX_IDLE_HANDLES];        // 空闲的 easy 句柄
+    int idle_count;
+    long connect_timeout;                    // 连接超时（秒）
+    long low_speed_time;                     // 停滞判定时间（秒）
+};
 
 struct mem_buffer {
     char *data;
     size_t size;
 };
 
+static pthread_once_t global_once = PTHREAD_ONCE_INIT;
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+static net_ctx *default_ctx = NULL;
+
+static void net_global_init(void)
+{
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+    (void)handle;
+    (void)access;
+    net_ctx *ctx = (net_ctx *)userptr;
+    pthread_mutex_lock(&ctx->share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr)
+{
+    (void)handle;
+    net_ctx *ctx = (net_ctx *)userptr;
+    pthread_mutex_unlock(&ctx->share_locks[data]);
+}
+
+net_ctx *net_ctx_new(void)
+{
+    pthread_once(&global_once, net_global_init);
+
+    net_ctx *ctx = calloc(1, sizeof(net_ctx));
+    if (!ctx) return NULL;
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_init(&ctx->share_locks[i], NULL);
+    pthread_mutex_init(&ctx->pool_lock, NULL);
+    // 死掉或停滞的镜像要尽快失败，才能及时切换到下一个镜像
+    const char *env = getenv("CPKG_CONNECT_TIMEOUT");
+    ctx->connect_timeout = (env && atol(env) > 0) ? atol(env) : NET_CONNECT_TIMEOUT;
+    env = getenv("CPKG_LOW_SPEED_TIME");
+    ctx->low_speed_time = (env && atol(env) > 0) ? atol(env) : NET_LOW_SPEED_TIME;
+
+    ctx->share = curl_share_init();
+    if (!ctx->share) {
+        net_ctx_free(ctx);
+        return NULL;
+    }
+    curl_share_setopt(ctx->share, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(ctx->share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(ctx->share, CURLSHOPT_USERDATA, ctx);
+    curl_share_setopt(ctx->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(ctx->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(ctx->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    return ctx;
+}
+
+void net_ctx_free(net_ctx *ctx)
+{
+    if (!ctx) return;
+    // 必须先释放所有使用共享对象的句柄
+    for (int i = 0; i < ctx->idle_count; i++)
+        curl_easy_cleanup(ctx->idle[i]);
+    ctx->idle_count = 0;
+    if (ctx->share)
+        curl_share_cleanup(ctx->share);
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_destroy(&ctx->share_locks[i]);
+    pthread_mutex_destroy(&ctx->pool_lock);
+    free(ctx);
+}
+
+static void net_default_free(void)
+{
+    net_ctx_free(default_ctx);
+    default_ctx = NULL;
+}
+
+static void net_default_init(void)
+{
+    default_ctx = net_ctx_new();
+    if (default_ctx)
+        atexit(net_default_free);
+}
+
+net_ctx *net_default(void)
+{
+    const Cpk_Context *context = cpk_context();
+    if (context->net)
+        return context->net;
+    pthread_once(&default_once, net_default_init);
+    return default_ctx;
+}
+
+/**
+ * @brief 从上下文中取出一个 easy 句柄（优先复用空闲句柄）
+ * @note 复用的句柄保留了与服务器之间的连接；所有请求共用的选项只在创建时设置一次
+ */
+static CURL *net_acquire(net_ctx *ctx)
+{
+    CURL *curl = NULL;
+    pthread_mutex_lock(&ctx->pool_lock);
+    if (ctx->idle_count > 0)
+        curl = ctx->idle[--ctx->idle_count];
+    pthread_mutex_unlock(&ctx->pool_lock);
+    if (curl)
+        return curl;
+
+    curl = curl_easy_init();
+    if (!curl) return NULL;
+    curl_easy_setopt(curl, CURLOPT_SHARE, ctx->share);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "cpkg/0.1");
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);      // HTTP 错误码视为失败（用于检测增量缺口）
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);         // 多线程环境下不使用信号
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, ctx->connect_timeout);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, (long)NET_LOW_SPEED_LIMIT);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, ctx->low_speed_time);
+    return curl;
+}
+
+/* 归还句柄；池满时直接释放 */
+static void net_release(net_ctx *ctx, CURL *curl)
+{
+    if (!curl) return;
+    // 清除本次请求设置的回调数据，避免悬空指针
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, NULL);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, NULL);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
+    curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)0);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 0L);
+    curl_easy_setopt(curl, CURLOPT_RANGE, NULL);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, NULL);
+    pthread_mutex_lock(&ctx->pool_lock);
+    if (ctx->idle_count < NET_MAX_IDLE_HANDLES) {
+        ctx->idle[ctx->idle_count++] = curl;
+        curl = NULL;
+    }
+    pthread_mutex_unlock(&ctx->pool_lock);
+    if (curl)
+        curl_easy_cleanup(curl);
+}
+
 static size_t write_to_mem(void *ptr, size_t size, size_t nmemb, void *userdata)
 {
     size_t realsize = size * nmemb;
     struct mem_buffer *mem = (struct mem_buffer *)userdata;
+    timing_add(TIMING_NET_BYTES, realsize);
     char *tmp = realloc(mem->data, mem->size + realsize + 1);
     if (!tmp) return 0;
     mem->data = tmp;
@@ -25,41 +195,48 @@ static size_t write_to_mem(void *ptr, size_t size, size_t nmemb, void *userdata)
 static size_t write_to_file(void *ptr, size_t size, size_t nmemb, void *userdata)
 {
     FILE *fp = (FILE *)userdata;
+    timing_add(TIMING_NET_BYTES, size * nmemb);
     return fwrite(ptr, size, nmemb, fp);
 }
 
-int repo_download_to_memory(const char *url, char **out_data, size_t *out_len)
+int net_download_to_memory(net_ctx *ctx, const char *url, char **out_data, size_t *out_len)
 {
-    if (!url || !out_data || !out_len) return 1;
+    if (!ctx || !url || !out_data || !out_len) return 1;
     CURL *curl = NULL;
     CURLcode res;
     struct mem_buffer mem = {0};
 
-    curl = curl_easy_init();
+    curl = net_acquire(ctx);
     if (!curl) return 2;
 
     curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_to_mem);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&mem);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "cpkg/0.1");
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");  // 协商 gzip/zstd 等传输压缩
 
+    uint64_t t_net = timing_begin();
+    trace_begin(TRACE_DOWNLOAD, url);
     res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
+    trace_end(TRACE_DOWNLOAD);
+    timing_end(TIMING_NETWORK, t_net);
+    net_release(ctx, curl);
 
     if (res != CURLE_OK) {
         if (mem.data) free(mem.data);
         return 3;
     }
 
+    // 空响应也返回可 free 的缓冲区
+    if (!mem.data && !(mem.data = calloc(1, 1)))
+        return 2;
     *out_data = mem.data;
     *out_len = mem.size;
     return 0;
 }
 
-int repo_download_to_file(const char *url, const char *dest_path)
+int net_download_to_file(net_ctx *ctx, const char *url, const char *dest_path)
 {
-    if (!url || !dest_path) return 1;
+    if (!ctx || !url || !dest_path) return 1;
     CURL *curl = NULL;
     CURLcode res;
     FILE *fp = NULL;
@@ -67,21 +244,898 @@ int repo_download_to_file(const char *url, const char *dest_path)
     fp = fopen(dest_path, "wb");
     if (!fp) return 2;
 
-    curl = curl_easy_init();
+    curl = net_acquire(ctx);
     if (!curl) { fclose(fp); return 3; }
 
     curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_to_file);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "cpkg/0.1");
 
+    uint64_t t_net = timing_begin();
+    trace_begin(TRACE_DOWNLOAD, url);
     res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-    fclose(fp);
+    trace_end(TRACE_DOWNLOAD);
+    timing_end(TIMING_NETWORK, t_net);
+    net_release(ctx, curl);
+    if (fclose(fp) != 0 && res == CURLE_OK)
+        return 4;
 
     if (res != CURLE_OK) {
         return 4;
     }
     return 0;
 }
+
+/* 断点续传元数据（保存在 <dest>.part.meta，key: value 文本格式）；
+ * 按 Merkle 根校验的顺序下载另有若干 "leaf:" 行，依次为已完成叶子的哈希 */
+struct part_meta {
+    char url[NET_URL_MAX];
+    char etag[256];             // ETag 校验器
+    char last_modified[128];    // Last-Modified 校验器
+    curl_off_t offset;          // .part 中已写入的字节数（顺序下载）
+    curl_off_t length;          // 文件总长度（分段下载）
+    int nseg;                   // 分段数（0 表示顺序下载）
+    curl_off_t seg_start[NET_MAX_SEGMENTS];
+    curl_off_t seg_end[NET_MAX_SEGMENTS];   // 包含
+    curl_off_t seg_done[NET_MAX_SEGMENTS];
+};
+
+/* 截断复制字符串（保证以 '\0' 结尾） */
+static void copy_str(char *dst, size_t size, const char *src)
+{
+    size_t n = strnlen(src, size - 1);
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+/* 原子写入元数据（先写临时文件再 rename），leaves 为已完成的叶子（可为 NULL） */
+static int save_part_meta(const char *meta_path, const struct part_meta *m,
+                          const Merkle_Digest *leaves, size_t leaf_count)
+{
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", meta_path);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return -1;
+    fprintf(fp, "url: %s\n", m->url);
+    if (m->etag[0]) fprintf(fp, "etag: %s\n", m->etag);
+    if (m->last_modified[0]) fprintf(fp, "last-modified: %s\n", m->last_modified);
+    fprintf(fp, "offset: %" CURL_FORMAT_CURL_OFF_T "\n", m->offset);
+    if (m->nseg > 0) {
+        fprintf(fp, "length: %" CURL_FORMAT_CURL_OFF_T "\n", m->length);
+        for (int i = 0; i < m->nseg; i++)
+            fprintf(fp, "segment: %" CURL_FORMAT_CURL_OFF_T " %" CURL_FORMAT_CURL_OFF_T
+                    " %" CURL_FORMAT_CURL_OFF_T "\n", m->seg_start[i], m->seg_end[i], m->seg_done[i]);
+    }
+    for (size_t i = 0; i < leaf_count; i++) {
+        char hex[HASH_HEX_LEN + 1];
+        hex_encode(leaves[i], HASH_DIGEST_LEN, hex);
+        fprintf(fp, "leaf: %s\n", hex);
+    }
+    if (fclose(fp) != 0 || rename(tmp, meta_path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/* 读取元数据；文件不存在或格式错误返回非0 */
+static int load_part_meta(const char *meta_path, struct part_meta *m)
+{
+    memset(m, 0, sizeof(*m));
+    FILE *fp = fopen(meta_path, "r");
+    if (!fp) return -1;
+    char line[NET_URL_MAX + 64];
+    int ok = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *value = strstr(line, ": ");
+        if (!value) { ok = -1; break; }
+        *value = '\0';
+        value += 2;
+        if (strcmp(line, "url") == 0) {
+            copy_str(m->url, sizeof(m->url), value);
+        } else if (strcmp(line, "etag") == 0) {
+            copy_str(m->etag, sizeof(m->etag), value);
+        } else if (strcmp(line, "last-modified") == 0) {
+            copy_str(m->last_modified, sizeof(m->last_modified), value);
+        } else if (strcmp(line, "offset") == 0) {
+            m->offset = strtoll(value, NULL, 10);
+        } else if (strcmp(line, "length") == 0) {
+            m->length = strtoll(value, NULL, 10);
+        } else if (strcmp(line, "segment") == 0 && m->nseg < NET_MAX_SEGMENTS) {
+            long long s = 0, e = 0, d = 0;
+            if (sscanf(value, "%lld %lld %lld", &s, &e, &d) != 3) { ok = -1; break; }
+            m->seg_start[m->nseg] = s;
+            m->seg_end[m->nseg] = e;
+            m->seg_done[m->nseg] = d;
+            m->nseg++;
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+/* 读取元数据中保存的叶子哈希，*out 由调用方 free；没有或格式错误时 *count 为 0 */
+static void load_part_leaves(const char *meta_path, Merkle_Digest **out, size_t *count)
+{
+    *out = NULL;
+    *count = 0;
+    FILE *fp = fopen(meta_path, "r");
+    if (!fp) return;
+    char line[NET_URL_MAX + 64];
+    size_t cap = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "leaf: ", 6) != 0)
+            continue;
+        if (*count == cap) {
+            size_t ncap = cap ? cap * 2 : 64;
+            Merkle_Digest *t = realloc(*out, ncap * sizeof(Merkle_Digest));
+            if (!t) break;
+            *out = t;
+            cap = ncap;
+        }
+        if (strlen(line + 6) < HASH_HEX_LEN || hex_decode(line + 6, (*out)[*count], HASH_DIGEST_LEN) != 0) {
+            *count = 0;
+            break;
+        }
+        (*count)++;
+    }
+    fclose(fp);
+}
+
+/* 解析响应头中的 ETag / Last-Modified / Accept-Ranges */
+struct resp_headers {
+    char etag[256];
+    char last_modified[128];
+    int accept_ranges;
+};
+
+static size_t header_cb(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    struct resp_headers *h = (struct resp_headers *)userdata;
+    size_t len = size * nitems;
+    char line[512];
+    size_t n = len < sizeof(line) - 1 ? len : sizeof(line) - 1;
+    memcpy(line, buffer, n);
+    line[n] = '\0';
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if (strncmp(line, "HTTP/", 5) == 0) {
+        // 新的响应（如重定向后），清空上一响应的头
+        memset(h, 0, sizeof(*h));
+    } else if (strncasecmp(line, "ETag:", 5) == 0) {
+        const char *v = line + 5;
+        while (*v == ' ') v++;
+        if (strncmp(v, "W/", 2) != 0)  // 弱校验器不能用于 If-Range
+            copy_str(h->etag, sizeof(h->etag), v);
+    } else if (strncasecmp(line, "Last-Modified:", 14) == 0) {
+        const char *v = line + 14;
+        while (*v == ' ') v++;
+        copy_str(h->last_modified, sizeof(h->last_modified), v);
+    } else if (strncasecmp(line, "Accept-Ranges:", 14) == 0) {
+        h->accept_ranges = (strstr(line + 14, "bytes") != NULL);
+    }
+    return len;
+}
+
+/* 并行下载中单个传输的状态 */
+struct multi_xfer {
+    net_job *job;
+    CURL *curl;
+    FILE *fp;                    // .part 文件
+    Hash_Ctx *sha;               // 随数据到达增量计算哈希（按 tree_root 校验时不用）
+    Merkle_Builder tree;         // 按 tree_root 校验时增量计算叶子，完成的叶子随续传点保存
+    int tree_ready;              // tree 已初始化
+    curl_off_t hashed;           // 已计入哈希的字节数；重试时与续传点相同则沿用当前状态
+    char host[256];              // 用于每主机并发计数
+    char part_path[PATH_MAX];
+    char meta_path[PATH_MAX];
+    struct part_meta meta;       // 当前续传状态
+    struct resp_headers resp;    // 本次响应头
+    struct curl_slist *headers;  // If-Range 请求头
+    curl_off_t saved_at;         // 上次保存元数据时的 offset
+    int checked;                 // 已检查本次响应的状态码
+    int attempts;                // 已尝试次数
+    size_t url_index;            // 当前地址（0 为 job->url，其余为 alt_urls[i-1]）
+    int host_valid;              // host 是否对应当前地址
+    size_t delivered;            // 流式任务已交给 sink 的字节数
+    curl_off_t progress_base;    // 本次尝试开始时已有的字节数（续传点）
+};
+
+/* 当前尝试使用的地址 */
+static const char *xfer_url(const struct multi_xfer *x)
+{
+    return x->url_index == 0 ? x->job->url : x->job->alt_urls[x->url_index - 1];
+}
+
+/* 续传点是否来自本任务的某个地址（不同镜像上的同一文件） */
+static int job_has_url(const net_job *job, const char *url)
+{
+    if (strcmp(job->url, url) == 0)
+        return 1;
+    for (size_t i = 0; i < job->alt_count; i++)
+        if (strcmp(job->alt_urls[i], url) == 0)
+            return 1;
+    return 0;
+}
+
+/* 保存当前续传点（先刷新 .part，保证文件内容不少于 offset） */
+static void xfer_checkpoint(struct multi_xfer *x)
+{
+    if (!x->fp || fflush(x->fp) != 0)
+        return;
+    int tree = x->job->tree_root && x->tree_ready;
+    if (save_part_meta(x->meta_path, &x->meta, tree ? x->tree.leaves : NULL, tree ? x->tree.count : 0) == 0)
+        x->saved_at = x->meta.offset;
+}
+
+/* 从头开始计算哈希 */
+static int xfer_hash_reset(struct multi_xfer *x)
+{
+    x->hashed = 0;
+    if (x->job->tree_root) {
+        if (x->tree_ready)
+            merkle_free(&x->tree);
+        x->tree_ready = (merkle_init(&x->tree, NULL, 0) == 0);
+        return x->tree_ready ? 0 : -1;
+    }
+    if (!x->sha && !(x->sha = hash_new()))
+        return -1;
+    return hash_reset(x->sha);
+}
+
+static int xfer_hash_update(struct multi_xfer *x, const void *data, size_t len)
+{
+    int r = x->job->tree_root ? merkle_update(&x->tree, data, len) : hash_update(x->sha, data, len);
+    if (r == 0)
+        x->hashed += (curl_off_t)len;
+    return r;
+}
+
+/**
+ * @brief 使哈希状态与续传点 offset（.part 已截断到该长度）一致
+ * @note 同一进程中重试时哈希状态通常已经与续传点一致，直接沿用；否则从 .part 重新计算：
+ *       按 tree_root 校验时元数据中保存了已完成的叶子，只读取最后一个未满的叶子；
+ *       按 sha256 校验时 EVP 上下文无法保存，读取整个 .part（读本地文件远比重新下载快）
+ * @return 0 成功，-1 失败（调用方从头下载）
+ */
+static int xfer_hash_resume(struct multi_xfer *x, curl_off_t offset)
+{
+    if (x->hashed == offset && (x->job->tree_root ? x->tree_ready : x->sha != NULL))
+        return 0;
+    if (xfer_hash_reset(x) != 0)
+        return -1;
+    int fd = fileno(x->fp);
+    if (!x->job->tree_root) {
+        if (hash_fd_update(x->sha, fd, 0) != 0)
+            return -1;
+        x->hashed = offset;
+        return 0;
+    }
+    Merkle_Digest *leaves;
+    size_t count;
+    load_part_leaves(x->meta_path, &leaves, &count);
+    if (count > (size_t)(offset / MERKLE_LEAF_SIZE))
+        count = (size_t)(offset / MERKLE_LEAF_SIZE);
+    int ret = merkle_restore(&x->tree, leaves, count);
+    free(leaves);
+    curl_off_t pos = (curl_off_t)count * MERKLE_LEAF_SIZE;
+    x->hashed = pos;
+    char *buf = ret == 0 && pos < offset ? malloc(MERKLE_LEAF_SIZE) : NULL;
+    if (ret == 0 && pos < offset && !buf)
+        ret = -1;
+    while (ret == 0 && pos < offset) {
+        size_t want = offset - pos < MERKLE_LEAF_SIZE ? (size_t)(offset - pos) : MERKLE_LEAF_SIZE;
+        ssize_t n = pread(fd, buf, want, (off_t)pos);
+        if (n <= 0 || xfer_hash_update(x, buf, (size_t)n) != 0)
+            ret = -1;
+        else
+            pos += n;
+    }
+    free(buf);
+    return ret;
+}
+
+static size_t write_to_xfer(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    struct multi_xfer *x = (struct multi_xfer *)userdata;
+    size_t realsize = size * nmemb;
+    timing_add(TIMING_NET_BYTES, realsize);
+
+    if (x->job->sink) {
+        // 数据直接交给调用方的流水线，由其负责校验
+        x->delivered += realsize;
+        return x->job->sink(x->job->sink_user, ptr, realsize) == 0 ? realsize : 0;
+    }
+
+    if (!x->checked) {
+        // 续传请求收到完整内容（200）：校验器不匹配或服务器不支持 Range，从头开始
+        long code = 0;
+        curl_easy_getinfo(x->curl, CURLINFO_RESPONSE_CODE, &code);
+        if (x->meta.offset > 0 && code == 200) {
+            if (ftruncate(fileno(x->fp), 0) != 0 || fseek(x->fp, 0, SEEK_SET) != 0)
+                return 0;
+            if (xfer_hash_reset(x) != 0)
+                return 0;
+            x->meta.offset = 0;
+            x->saved_at = 0;
+        }
+        copy_str(x->meta.etag, sizeof(x->meta.etag), x->resp.etag);
+        copy_str(x->meta.last_modified, sizeof(x->meta.last_modified), x->resp.last_modified);
+        x->checked = 1;
+    }
+
+    if (fwrite(ptr, 1, realsize, x->fp) != realsize || xfer_hash_update(x, ptr, realsize) != 0)
+        return 0;
+    x->meta.offset += realsize;
+    if (x->meta.offset - x->saved_at >= NET_CHECKPOINT_BYTES)
+        xfer_checkpoint(x);
+    return realsize;
+}
+
+/* 提取 URL 的主机名（file:// 等无主机的 URL 返回空串） */
+static void url_host(const char *url, char *host, size_t size)
+{
+    host[0] = '\0';
+    CURLU *u = curl_url();
+    if (!u) return;
+    char *h = NULL;
+    if (curl_url_set(u, CURLUPART_URL, url, 0) == CURLUE_OK &&
+        curl_url_get(u, CURLUPART_HOST, &h, 0) == CURLUE_OK) {
+        snprintf(host, size, "%s", h);
+        curl_free(h);
+    }
+    curl_url_cleanup(u);
+}
+
+/**
+ * @brief 打开 .part 文件并根据元数据确定续传位置
+ * @note 只有存在校验器时才续传，否则从头下载；续传时的哈希状态见 xfer_hash_resume
+ * @return 0 成功，-1 无法打开文件或创建哈希上下文
+ */
+static int xfer_open(struct multi_xfer *x)
+{
+    if (x->job->sink) {
+        memset(&x->meta, 0, sizeof(x->meta));
+        return 0;
+    }
+    struct part_meta m;
+    int resume = (load_part_meta(x->meta_path, &m) == 0 && m.nseg == 0 &&
+                  m.offset > 0 && job_has_url(x->job, m.url) &&
+                  (m.etag[0] || m.last_modified[0]));
+    if (resume) {
+        x->fp = fopen(x->part_path, "r+b");
+        // .part 可能比元数据记录的更长（未及时保存检查点），截断到记录位置
+        if (!x->fp || ftruncate(fileno(x->fp), m.offset) != 0 || fseek(x->fp, 0, SEEK_END) != 0 ||
+            ftell(x->fp) != (long)m.offset || xfer_hash_resume(x, m.offset) != 0) {
+            if (x->fp) fclose(x->fp);
+            x->fp = NULL;
+            resume = 0;
+        }
+    }
+    if (!resume) {
+        if (xfer_hash_reset(x) != 0)
+            return -1;
+        x->fp = fopen(x->part_path, "wb");
+        if (!x->fp) return -1;
+        memset(&m, 0, sizeof(m));
+    }
+    // 换到其他镜像时沿用续传点，校验器不一致时服务器会返回完整内容
+    copy_str(m.url, sizeof(m.url), xfer_url(x));
+    x->meta = m;
+    x->saved_at = m.offset;
+    x->checked = 0;
+    return 0;
+}
+
+/* 把传输进度交给当前上下文（在 net_download_many 的线程中调用） */
+static int xfer_progress(void *userdata, curl_off_t dltotal, curl_off_t dlnow,
+                         curl_off_t ultotal, curl_off_t ulnow)
+{
+    (void)ultotal;
+    (void)ulnow;
+    struct multi_xfer *x = (struct multi_xfer *)userdata;
+    const char *url = xfer_url(x);
+    const char *name = strrchr(url, '/');
+    cpk_progress("download", name ? name + 1 : url, (uint64_t)(x->progress_base + dlnow),
+                 dltotal > 0 ? (uint64_t)(x->progress_base + dltotal) : 0);
+    return 0;
+}
+
+static void xfer_setup(struct multi_xfer *x)
+{
+    curl_easy_setopt(x->curl, CURLOPT_URL, xfer_url(x));
+    curl_easy_setopt(x->curl, CURLOPT_WRITEFUNCTION, write_to_xfer);
+    curl_easy_setopt(x->curl, CURLOPT_WRITEDATA, x);
+    curl_easy_setopt(x->curl, CURLOPT_HEADERFUNCTION, header_cb);
+    curl_easy_setopt(x->curl, CURLOPT_HEADERDATA, &x->resp);
+    curl_easy_setopt(x->curl, CURLOPT_PRIVATE, x);
+    curl_easy_setopt(x->curl, CURLOPT_PIPEWAIT, 1L);  // 优先复用已有 HTTP/2 连接
+    x->progress_base = x->job->sink ? (curl_off_t)x->delivered : x->meta.offset;
+    if (cpk_progress_wanted()) {
+        curl_easy_setopt(x->curl, CURLOPT_XFERINFOFUNCTION, xfer_progress);
+        curl_easy_setopt(x->curl, CURLOPT_XFERINFODATA, x);
+        curl_easy_setopt(x->curl, CURLOPT_NOPROGRESS, 0L);
+    }
+    memset(&x->resp, 0, sizeof(x->resp));
+    if (x->meta.offset > 0) {
+        char hdr[300];
+        snprintf(hdr, sizeof(hdr), "If-Range: %s",
+                 x->meta.etag[0] ? x->meta.etag : x->meta.last_modified);
+        x->headers = curl_slist_append(NULL, hdr);
+        curl_easy_setopt(x->curl, CURLOPT_HTTPHEADER, x->headers);
+        curl_easy_setopt(x->curl, CURLOPT_RESUME_FROM_LARGE, x->meta.offset);
+    }
+}
+
+/**
+ * @brief 完成一次传输尝试
+ * @note 成功时校验哈希并把 .part 重命名为目标文件；
+ *       网络失败时保存续传点，未超过重试次数则重新排队（status 保持 -1）
+ */
+static void finish_xfer(struct multi_xfer *x, CURLcode res)
+{
+    net_job *job = x->job;
+    curl_slist_free_all(x->headers);
+    x->headers = NULL;
+
+    if (job->sink) {
+        // 流式任务无法续传；只有尚未交付任何数据时才能换到下一个镜像重试
+        job->status = (res == CURLE_OK) ? 0 : 2;
+        if (res != CURLE_OK && x->delivered == 0 && x->url_index < job->alt_count) {
+            x->url_index++;
+            x->host_valid = 0;
+            job->status = -1;
+        }
+        return;
+    }
+
+    if (res != CURLE_OK) {
+        long code = 0;
+        curl_easy_getinfo(x->curl, CURLINFO_RESPONSE_CODE, &code);
+        if (code == 416) {
+            // 续传范围无效，丢弃 .part 从头开始
+            fclose(x->fp);
+            remove(x->part_path);
+            remove(x->meta_path);
+        } else {
+            xfer_checkpoint(x);
+            fclose(x->fp);
+        }
+        x->fp = NULL;
+        // 有备用地址时每次失败都换到下一个镜像（轮转），每个镜像至少尝试一次
+        if (job->alt_count > 0) {
+            x->url_index = (x->url_index + 1) % (job->alt_count + 1);
+            x->host_valid = 0;
+        }
+        job->status = (++x->attempts < NET_MAX_ATTEMPTS + (int)job->alt_count) ? -1 : 2;
+        return;
+    }
+
+    int close_failed = (fclose(x->fp) != 0);
+    x->fp = NULL;
+    const char *expected = job->tree_root ? job->tree_root : job->sha256;
+    int hash_failed = job->tree_root ? merkle_final(&x->tree, job->actual_sha256)
+                                     : hash_final_hex(x->sha, job->actual_sha256);
+    x->hashed = -1;  // 哈希状态已结束
+    if (hash_failed || close_failed)
+        job->status = 2;
+    else if (expected && strncmp(expected, job->actual_sha256, HASH_HEX_LEN) != 0)
+        job->status = 3;
+    else if (rename(x->part_path, job->dest_path) != 0)
+        job->status = 1;
+    else
+        job->status = 0;
+    if (job->status != 0)
+        remove(x->part_path);  // 不保留损坏的文件
+    remove(x->meta_path);
+}
+
+int net_download_many(net_ctx *ctx, net_job *jobs, size_t count, int max_parallel, int max_per_host)
+{
+    if (!ctx || (!jobs && count > 0)) return -1;
+    if (max_parallel <= 0) max_parallel = NET_DEFAULT_PARALLEL;
+    if (max_per_host <= 0) max_per_host = NET_DEFAULT_PER_HOST;
+
+    struct multi_xfer *xfers = calloc(count ? count : 1, sizeof(*xfers));
+    CURLM *multi = curl_multi_init();
+    if (!xfers || !multi) {
+        free(xfers);
+        if (multi) curl_multi_cleanup(multi);
+        return -1;
+    }
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)max_per_host);
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)max_parallel);
+
+    for (size_t i = 0; i < count; i++) {
+        xfers[i].job = &jobs[i];
+        jobs[i].status = -1;  // 未开始
+        jobs[i].actual_sha256[0] = '\0';
+        if (jobs[i].dest_path) {
+            snprintf(xfers[i].part_path, PATH_MAX, "%s%s", jobs[i].dest_path, NET_PART_SUFFIX);
+            snprintf(xfers[i].meta_path, PATH_MAX, "%s%s", jobs[i].dest_path, NET_META_SUFFIX);
+        }
+    }
+
+    size_t done = 0, next = 0;
+    int active = 0, failed = 0;
+    uint64_t t_net = timing_begin();
+    while (done < count) {
+        // 按顺序启动任务，受总并发和每主机并发限制
+        for (size_t i = next; i < count && active < max_parallel; i++) {
+            struct multi_xfer *x = &xfers[i];
+            if (x->job->status != -1 || x->curl)
+                continue;
+            if (!x->host_valid) {
+                url_host(xfer_url(x), x->host, sizeof(x->host));
+                x->host_valid = 1;
+            }
+            int host_active = 0;
+            for (size_t k = 0; k < count; k++)
+                if (xfers[k].curl && strcmp(xfers[k].host, x->host) == 0)
+                    host_active++;
+            if (host_active >= max_per_host)
+                continue;
+
+            x->curl = (xfer_open(x) == 0) ? net_acquire(ctx) : NULL;
+            if (!x->curl) {
+                if (x->fp) { fclose(x->fp); x->fp = NULL; }
+                x->job->status = 1;
+                if (x->job->on_done)
+                    x->job->on_done(x->job);
+                failed++;
+                done++;
+                continue;
+            }
+            xfer_setup(x);
+            // 同一线程上的多个传输互相重叠，用按 id 配对的异步事件
+            trace_async_begin(TRACE_DOWNLOAD, xfer_url(x), (uintptr_t)x);
+            curl_multi_add_handle(multi, x->curl);
+            active++;
+        }
+        while (next < count && (xfers[next].curl || xfers[next].job->status != -1))
+            next++;
+
+        int running = 0;
+        curl_multi_perform(multi, &running);
+
+        CURLMsg *msg;
+        int queued = 0;
+        while ((msg = curl_multi_info_read(multi, &queued)) != NULL) {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            struct multi_xfer *x = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&x);
+            CURLcode res = msg->data.result;
+            curl_multi_remove_handle(multi, x->curl);
+            trace_async_end(TRACE_DOWNLOAD, xfer_url(x), (uintptr_t)x);
+            finish_xfer(x, res);
+            net_release(ctx, x->curl);
+            x->curl = NULL;
+            active--;
+            if (x->job->status == -1) {
+                // 重新排队续传
+                if ((size_t)(x - xfers) < next)
+                    next = x - xfers;
+                continue;
+            }
+            if (x->job->on_done)
+                x->job->on_done(x->job);
+            if (x->job->status != 0)
+                failed++;
+            done++;
+        }
+
+        if (done < count && active > 0)
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+    }
+
+    timing_end(TIMING_NETWORK, t_net);
+    curl_multi_cleanup(multi);
+    for (size_t i = 0; i < count; i++) {
+        hash_free(xfers[i].sha);
+        if (xfers[i].tree_ready)
+            merkle_free(&xfers[i].tree);
+    }
+    free(xfers);
+    return failed;
+}
+
+/* 探测传输的状态 */
+struct probe_xfer {
+    net_probe *probe;
+    CURL *curl;
+    long max_bytes;
+    long got;
+};
+
+static size_t write_to_probe(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    (void)ptr;
+    struct probe_xfer *p = (struct probe_xfer *)userdata;
+    size_t realsize = size * nmemb;
+    p->got += (long)realsize;
+    // 服务器忽略 Range 时收够探测量即中止
+    return p->got > p->max_bytes ? 0 : realsize;
+}
+
+/* 根据传输计时填写探测结果 */
+static void probe_result(struct probe_xfer *p, CURLcode res)
+{
+    net_probe *probe = p->probe;
+    probe->ok = (res == CURLE_OK || (res == CURLE_WRITE_ERROR && p->got > p->max_bytes));
+    if (!probe->ok)
+        return;
+    curl_off_t start = 0, total = 0, bytes = 0, speed = 0;
+    curl_easy_getinfo(p->curl, CURLINFO_STARTTRANSFER_TIME_T, &start);
+    curl_easy_getinfo(p->curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(p->curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+    curl_easy_getinfo(p->curl, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+    probe->latency_ms = start / 1000.0;
+    // 吞吐只统计首字节之后的时间，避免把延迟算进去
+    if (total > start && bytes > 0)
+        probe->bytes_per_sec = bytes * 1e6 / (double)(total - start);
+    else
+        probe->bytes_per_sec = (double)speed;
+}
+
+int net_probe_many(net_ctx *ctx, net_probe *probes, size_t count, long max_bytes, long timeout_ms)
+{
+    if (!ctx || !probes || count == 0) return 0;
+    struct probe_xfer *xfers = calloc(count, sizeof(*xfers));
+    CURLM *multi = curl_multi_init();
+    if (!xfers || !multi) {
+        free(xfers);
+        if (multi) curl_multi_cleanup(multi);
+        return 0;
+    }
+    char range[64];
+    snprintf(range, sizeof(range), "0-%ld", max_bytes - 1);
+
+    int active = 0;
+    for (size_t i = 0; i < count; i++) {
+        struct probe_xfer *p = &xfers[i];
+        p->probe = &probes[i];
+        p->max_bytes = max_bytes;
+        probes[i].ok = 0;
+        probes[i].latency_ms = 0;
+        probes[i].bytes_per_sec = 0;
+        p->curl = net_acquire(ctx);
+        if (!p->curl)
+            continue;
+        curl_easy_setopt(p->curl, CURLOPT_URL, probes[i].url);
+        curl_easy_setopt(p->curl, CURLOPT_WRITEFUNCTION, write_to_probe);
+        curl_easy_setopt(p->curl, CURLOPT_WRITEDATA, p);
+        curl_easy_setopt(p->curl, CURLOPT_RANGE, range);
+        curl_easy_setopt(p->curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+        curl_easy_setopt(p->curl, CURLOPT_PRIVATE, p);
+        curl_multi_add_handle(multi, p->curl);
+        active++;
+    }
+
+    int ok = 0;
+    while (active > 0) {
+        int running = 0;
+        curl_multi_perform(multi, &running);
+        CURLMsg *msg;
+        int queued = 0;
+        while ((msg = curl_multi_info_read(multi, &queued)) != NULL) {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            struct probe_xfer *p = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&p);
+            CURLcode res = msg->data.result;
+            probe_result(p, res);
+            ok += p->probe->ok;
+            curl_multi_remove_handle(multi, p->curl);
+            net_release(ctx, p->curl);
+            p->curl = NULL;
+            active--;
+        }
+        if (active > 0)
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+    }
+    curl_multi_cleanup(multi);
+    free(xfers);
+    return ok;
+}
+
+/* 分段下载中单个分段的状态 */
+struct seg_xfer {
+    CURL *curl;
+    int fd;                      // .part 文件描述符（pwrite 写入）
+    int index;
+    struct part_meta *meta;
+    int attempts;
+};
+
+static size_t write_to_segment(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    struct seg_xfer *s = (struct seg_xfer *)userdata;
+    size_t realsize = size * nmemb;
+    struct part_meta *m = s->meta;
+    timing_add(TIMING_NET_BYTES, realsize);
+    curl_off_t pos = m->seg_start[s->index] + m->seg_done[s->index];
+    if (pos + (curl_off_t)realsize > m->seg_end[s->index] + 1)
+        return 0;  // 服务器返回的数据超出请求范围
+    const char *p = ptr;
+    size_t left = realsize;
+    while (left > 0) {
+        ssize_t w = pwrite(s->fd, p, left, pos);
+        if (w <= 0) return 0;
+        p += w;
+        pos += w;
+        left -= w;
+    }
+    m->seg_done[s->index] += realsize;
+    return realsize;
+}
+
+/* 退回普通（可续传）下载 */
+static int download_whole(net_ctx *ctx, net_job *job)
+{
+    return net_download_many(ctx, job, 1, 1, 1);
+}
+
+int net_download_segmented(net_ctx *ctx, net_job *job, int segments)
+{
+    if (!ctx || !job) return -1;
+    if (segments > NET_MAX_SEGMENTS) segments = NET_MAX_SEGMENTS;
+    if (segments <= 1)
+        return download_whole(ctx, job);
+
+    // HEAD 请求获取长度与校验器
+    CURL *curl = net_acquire(ctx);
+    if (!curl) { job->status = 2; return 1; }
+    struct resp_headers h;
+    memset(&h, 0, sizeof(h));
+    curl_easy_setopt(curl, CURLOPT_URL, job->url);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_cb);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &h);
+    CURLcode res = curl_easy_perform(curl);
+    curl_off_t length = -1;
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    net_release(ctx, curl);
+
+    // 不支持 Range 或文件较小时退回普通（可续传）下载
+    if (res != CURLE_OK || !h.accept_ranges || length < NET_SEGMENT_MIN_SIZE)
+        return download_whole(ctx, job);
+
+    char part_path[PATH_MAX], meta_path[PATH_MAX];
+    snprintf(part_path, sizeof(part_path), "%s%s", job->dest_path, NET_PART_SUFFIX);
+    snprintf(meta_path, sizeof(meta_path), "%s%s", job->dest_path, NET_META_SUFFIX);
+
+    // 元数据与服务器当前实体一致时沿用各分段进度
+    struct part_meta m;
+    int resume = (load_part_meta(meta_path, &m) == 0 && m.nseg > 0 && m.length == length &&
+                  strcmp(m.url, job->url) == 0 &&
+                  (h.etag[0] ? strcmp(m.etag, h.etag) == 0 :
+                   (h.last_modified[0] && strcmp(m.last_modified, h.last_modified) == 0)));
+    int fd = open(part_path, O_RDWR | O_CREAT | (resume ? 0 : O_TRUNC), 0644);
+    if (fd < 0) { job->status = 1; return 1; }
+    if (ftruncate(fd, length) != 0) {
+        close(fd);
+        job->status = 1;
+        return 1;
+    }
+    if (!resume) {
+        memset(&m, 0, sizeof(m));
+        copy_str(m.url, sizeof(m.url), job->url);
+        copy_str(m.etag, sizeof(m.etag), h.etag);
+        copy_str(m.last_modified, sizeof(m.last_modified), h.last_modified);
+        m.length = length;
+        m.nseg = segments;
+        curl_off_t chunk = length / segments;
+        for (int i = 0; i < segments; i++) {
+            m.seg_start[i] = i * chunk;
+            m.seg_end[i] = (i == segments - 1) ? length - 1 : (i + 1) * chunk - 1;
+        }
+    }
+
+    CURLM *multi = curl_multi_init();
+    struct seg_xfer segs[NET_MAX_SEGMENTS];
+    memset(segs, 0, sizeof(segs));
+    int active = 0, failed = 0;
+    for (int i = 0; multi && i < m.nseg; i++) {
+        segs[i].fd = fd;
+        segs[i].index = i;
+        segs[i].meta = &m;
+    }
+
+    time_t last_save = time(NULL);
+    while (multi) {
+        // 启动所有未完成且未在传输中的分段
+        for (int i = 0; i < m.nseg; i++) {
+            struct seg_xfer *s = &segs[i];
+            if (s->curl || s->attempts >= NET_MAX_ATTEMPTS ||
+                m.seg_start[i] + m.seg_done[i] > m.seg_end[i])
+                continue;
+            s->curl = net_acquire(ctx);
+            if (!s->curl) { s->attempts = NET_MAX_ATTEMPTS; continue; }
+            char range[64];
+            snprintf(range, sizeof(range), "%" CURL_FORMAT_CURL_OFF_T "-%" CURL_FORMAT_CURL_OFF_T,
+                     m.seg_start[i] + m.seg_done[i], m.seg_end[i]);
+            curl_easy_setopt(s->curl, CURLOPT_URL, job->url);
+            curl_easy_setopt(s->curl, CURLOPT_RANGE, range);
+            curl_easy_setopt(s->curl, CURLOPT_WRITEFUNCTION, write_to_segment);
+            curl_easy_setopt(s->curl, CURLOPT_WRITEDATA, s);
+            curl_easy_setopt(s->curl, CURLOPT_PRIVATE, s);
+            curl_multi_add_handle(multi, s->curl);
+            active++;
+        }
+        if (active == 0)
+            break;
+
+        int running = 0;
+        curl_multi_perform(multi, &running);
+        CURLMsg *msg;
+        int queued = 0;
+        while ((msg = curl_multi_info_read(multi, &queued)) != NULL) {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            struct seg_xfer *s = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&s);
+            long code = 0;
+            curl_easy_getinfo(s->curl, CURLINFO_RESPONSE_CODE, &code);
+            if (msg->data.result != CURLE_OK || (code != 206 && code != 0))
+                s->attempts++;
+            curl_multi_remove_handle(multi, s->curl);
+            curl_easy_setopt(s->curl, CURLOPT_RANGE, NULL);
+            net_release(ctx, s->curl);
+            s->curl = NULL;
+            active--;
+        }
+        if (time(NULL) != last_save) {
+            // 每秒保存一次各分段进度
+            if (fdatasync(fd) == 0)
+                save_part_meta(meta_path, &m, NULL, 0);
+            last_save = time(NULL);
+        }
+        if (active > 0)
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+    }
+    if (multi) curl_multi_cleanup(multi);
+
+    for (int i = 0; i < m.nseg; i++)
+        if (m.seg_start[i] + m.seg_done[i] <= m.seg_end[i])
+            failed = 1;
+    if (!multi || failed) {
+        if (fdatasync(fd) == 0)
+            save_part_meta(meta_path, &m, NULL, 0);  // 保留进度，下次继续
+        close(fd);
+        job->status = 2;
+        return 1;
+    }
+
+    // 整个文件已在磁盘上：有 Merkle 根时各叶子可在所有核上并行计算
+    const char *expected = job->tree_root ? job->tree_root : job->sha256;
+    int hash_failed = job->tree_root ? merkle_root_fd(fd, 0, 0, job->actual_sha256)
+                                     : hash_fd_hex(fd, 0, job->actual_sha256);
+    close(fd);
+    if (hash_failed)
+        job->status = 2;
+    else if (expected && strncmp(expected, job->actual_sha256, HASH_HEX_LEN) != 0)
+        job->status = 3;
+    else if (rename(part_path, job->dest_path) != 0)
+        job->status = 1;
+    else
+        job->status = 0;
+    if (job->status != 0)
+        remove(part_path);
+    remove(meta_path);
+    return job->status == 0 ? 0 : 1;
+}
+
+int repo_download_to_memory(const char *url, char **out_data, size_t *out_len)
+{
+    return net_download_to_memory(net_default(), url, out_data, out_len);
+}
+
+int repo_download_to_file(const char *url, const char *dest_path)
+{
+    return net_download_to_file(net_default(), url, dest_path);
+}
@@ -26,5 +26,16 @@ struct option long_options[] = {
     {"search", required_argument, 0, 's'},
     {"fetch", required_argument, 0, 'f'},
     {"repo-install", required_argument, 0, 'I'},
+    {"jobs", required_argument, 0, 'j'},
+    {"cache-stats", no_argument, 0, OPT_CACHE_STATS},
+    {"upgrade", no_argument, 0, OPT_UPGRADE},
+    {"verify-packages", required_argument, 0, OPT_VERIFY_PACKAGES},
+    {"verify", no_argument, 0, 'V'},
+    {"all", no_argument, 0, OPT_ALL},
+    {"fast", no_argument, 0, OPT_FAST},
+    {"timings", optional_argument, 0, OPT_TIMINGS},
+    {"trace", required_argument, 0, OPT_TRACE},
+    {"batch", required_argument, 0, OPT_BATCH},
+    {"durability", required_argument, 0, OPT_DURABILITY},
     {0, 0, 0, 0}
 };
\ No newline at end of file
@@ -1,458 +1,586 @@
-#define _GNU_SOURCE   // 启用 GNU 扩展，包括 glob_t
-
 #include <ctype.h>
-#include <glob.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "../include/cpkg.h"
+#include "../include/depends.h"
+#include "../include/fileglob.h"
+#include "../include/help.h"
+
+/*
+ * 控制文件语法（逐字节单遍扫描，不限制行长）：
+ *   key: value            值可用双引号括起来（路径类字段必须加引号）
+ *   key: { "a", "b" }     列表，可以跨行，项必须用双引号括起来
+ *   # ...                 注释（引号之外的 '#' 到行尾）
+ * 没有冒号的行与未知的键忽略（前者给出警告）。
+ * include 与 lib 的各项可以是模式（*、?、[...]、**、!排除，见 fileglob.h），
+ * 整个文件解析完后一起展开，只遍历一次目录。
+ */
+
+/* 键的取值形式 */
+enum {
+    KEY_TEXT,       // 文本，复制到定长字段
+    KEY_FILES,      // 文件列表，各项可以是模式，解析完后统一展开
+    KEY_DEPENDS,    // 依赖列表，单个字符串值按逗号分隔
+};
+
+/* 文本字段：X(键名, 字段, 是否必须加引号) */
+#define CONTROL_TEXT_KEYS(X) \
+    X("packet",       name,                 0) \
+    X("version",      version,              0) \
+    X("description",  description,          0) \
+    X("author",       author,               0) \
+    X("homepage",     homepage,             0) \
+    X("license",      license,              0) \
+    X("include_path", include_install_path, 1) \
+    X("lib_path",     lib_install_path,     1)
+
+/* 列表字段：X(键名, 数组字段, 计数字段, 取值形式, 单值是否必须加引号) */
+#define CONTROL_LIST_KEYS(X) \
+    X("include",      include_files,        include_file_count, KEY_FILES,   1) \
+    X("lib",          lib_files,            lib_file_count,     KEY_FILES,   1) \
+    X("depends",      depends,              depends_count,      KEY_DEPENDS, 0)
+
+typedef struct {
+    const char *key;
+    unsigned char len;
+    unsigned char kind;
+    unsigned char quoted;
+    size_t field;           // 字段在 Control_Info 中的偏移
+    size_t count;           // 列表字段：计数字段的偏移
+} Key_Def;
+
+static const Key_Def key_table[] = {
+#define TEXT_KEY(k, f, q) { k, sizeof(k) - 1, KEY_TEXT, q, offsetof(Control_Info, f), 0 },
+    CONTROL_TEXT_KEYS(TEXT_KEY)
+#undef TEXT_KEY
+#define LIST_KEY(k, f, c, kind, q) { k, sizeof(k) - 1, kind, q, offsetof(Control_Info, f), offsetof(Control_Info, c) },
+    CONTROL_LIST_KEYS(LIST_KEY)
+#undef LIST_KEY
+};
+
+static const Key_Def *find_key(const char *s, size_t len)
+{
+    for (size_t i = 0; i < sizeof(key_table) / sizeof(key_table[0]); i++)
+        if (key_table[i].len == len && memcmp(key_table[i].key, s, len) == 0)
+            return &key_table[i];
+    return NULL;
+}
+
+/*
+ * 控制信息的内存：结构体本身位于第一块的开头，字符串与列表依次分配在其后，
+ * 用完的块挂到链表上，control_info_free 逐块释放，不需要逐个字段释放。
+ */
+#define CONTROL_CHUNK_SIZE 4096
+
+struct Control_Chunk {
+    Control_Chunk *next;
+    size_t used, size;
+    _Alignas(max_align_t) unsigned char data[];
+};
+
+static Control_Chunk *chunk_new(size_t size, Control_Chunk *next)
+{
+    Control_Chunk *c = malloc(sizeof(Control_Chunk) + size);
+    if (c) {
+        c->next = next;
+        c->used = 0;
+        c->size = size;
+    }
+    return c;
+}
+
+static void *arena_alloc(Control_Info *info, size_t len, size_t align)
+{
+    Control_Chunk *c = info->arena;
+    size_t off = (c->used + align - 1) & ~(align - 1);
+    if (off + len > c->size) {
+        // 超过一块大小的分配单独占一块
+        c = chunk_new(len > CONTROL_CHUNK_SIZE ? len : CONTROL_CHUNK_SIZE, c);
+        if (!c)
+            return NULL;
+        info->arena = c;
+        off = 0;
+    }
+    c->used = off + len;
+    return c->data + off;
+}
+
+static const char *arena_strndup(Control_Info *info, const char *s, size_t len)
+{
+    char *d = arena_alloc(info, len + 1, 1);
+    if (d) {
+        memcpy(d, s, len);
+        d[len] = '\0';
+    }
+    return d;
+}
+
+static Control_Info *control_info_new(void)
+{
+    Control_Chunk *c = chunk_new(CONTROL_CHUNK_SIZE, NULL);
+    if (!c)
+        return NULL;
+    Control_Info *info = (Control_Info *)c->data;
+    memset(info, 0, sizeof(*info));
+    c->used = sizeof(*info);
+    info->arena = c;
+    // 未出现的文本字段为空串
+    for (size_t i = 0; i < sizeof(key_table) / sizeof(key_table[0]); i++)
+        if (key_table[i].kind == KEY_TEXT)
+            *(const char **)((char *)info + key_table[i].field) = "";
+    return info;
+}
 
 /**
- * @brief 解析花括号内的列表字符串（逗号分隔），每个项必须用双引号括起来
- * @param list_str 花括号内的内容（已去除首尾空白）
- * @param count 输出参数：列表项个数
- * @param err 输出参数：解析是否出错（非0表示出错）
- * @return 成功返回动态分配的字符串数组，失败返回NULL
+ * @brief 释放控制信息
+ * @note 结构体、字符串与列表都在同一组内存块中，一次全部释放
+ * @param info 控制信息（可为 NULL）
  */
-static char **parse_list(const char *list_str, int *count, int *err)
+void control_info_free(Control_Info *info)
 {
-    char *list_buf, *token;
-    char **items = NULL;
-    int cnt = 0;
+    if (!info)
+        return;
+    Control_Chunk *c = info->arena;   // info 本身位于最后一块中
+    while (c) {
+        Control_Chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+}
+
+/* 扫描状态 */
+typedef struct {
+    const char *p, *end;
+    const char *line_start;
+    int line;
+    const char *source;     // 出错时显示的文件名
+} Scanner;
+
+/* 一段未复制的文本 */
+typedef struct {
+    const char *s;
     size_t len;
+} Span;
 
-    *err = 0;
-    len = strlen(list_str);
-    list_buf = (char *)malloc(len + 1);
-    if (list_buf == NULL)
-    {
-        *err = 1;
-        return NULL;
+static void scan_error(const Scanner *sc, const char *at, const char *msg)
+{
+    cpk_printf(ERROR, "%s:%d:%d: %s\n", sc->source, sc->line, (int)(at - sc->line_start) + 1, msg);
+}
+
+static void skip_blank(Scanner *sc)
+{
+    while (sc->p < sc->end && (*sc->p == ' ' || *sc->p == '\t' || *sc->p == '\r'))
+        sc->p++;
+}
+
+static void skip_line(Scanner *sc)
+{
+    const char *nl = memchr(sc->p, '\n', (size_t)(sc->end - sc->p));
+    sc->p = nl ? nl : sc->end;
+}
+
+static void next_line(Scanner *sc)
+{
+    if (sc->p < sc->end && *sc->p == '\n') {
+        sc->p++;
+        sc->line++;
+        sc->line_start = sc->p;
     }
-    strcpy(list_buf, list_str);
-
-    token = strtok(list_buf, ",");
-    while (token != NULL)
-    {
-        char *item = token;
-        // 去除项的首尾空白
-        while (isspace((unsigned char)*item))
-            item++;
-        if (*item == '\0')
-        {
-            token = strtok(NULL, ",");
-            continue;
-        }
-        char *end = item + strlen(item) - 1;
-        while (end > item && isspace((unsigned char)*end))
-        {
-            *end = '\0';
-            end--;
-        }
+}
 
-        // 【修复】去除尾部空白后再次检查是否为空
-        if (*item == '\0')
-        {
-            token = strtok(NULL, ",");
-            continue;
-        }
+/* 当前位置之后（到行尾）只允许空白与注释 */
+static int expect_line_end(Scanner *sc, const char *msg)
+{
+    skip_blank(sc);
+    if (sc->p < sc->end && *sc->p != '\n' && *sc->p != '#') {
+        scan_error(sc, sc->p, msg);
+        return -1;
+    }
+    skip_line(sc);
+    return 0;
+}
 
-        // 检查是否用双引号括起来
-        if (item[0] != '"' || item[strlen(item)-1] != '"')
-        {
-            *err = 1;
-            goto error;
-        }
-        // 去除引号
-        item[strlen(item)-1] = '\0';
-        item++;
+/* 读取双引号括起来的字符串（不能跨行），sc->p 指向开头的引号 */
+static int scan_quoted(Scanner *sc, Span *out)
+{
+    const char *open = sc->p++;
+    const char *q = sc->p;
+    while (q < sc->end && *q != '"' && *q != '\n')
+        q++;
+    if (q == sc->end || *q != '"') {
+        scan_error(sc, open, "unterminated string");
+        return -1;
+    }
+    out->s = sc->p;
+    out->len = (size_t)(q - sc->p);
+    sc->p = q + 1;
+    return 0;
+}
 
-        if (*item == '\0')
-        {
-            token = strtok(NULL, ",");
-            continue;
-        }
+/* 解析过程中收集列表项的临时数组（各条目之间复用，项本身已复制到 arena） */
+typedef struct {
+    const char **items;
+    int count, capacity;
+    Control_Info *info;
+} Item_List;
 
-        cnt++;
-        items = (char **)realloc(items, cnt * sizeof(char *));
-        if (items == NULL)
-        {
-            *err = 1;
-            goto error;
+static int list_add(Item_List *l, const char *s, size_t len)
+{
+    if (l->count == l->capacity) {
+        int ncap = l->capacity ? l->capacity * 2 : 16;
+        const char **t = realloc(l->items, (size_t)ncap * sizeof(char *));
+        if (!t)
+            return -1;
+        l->items = t;
+        l->capacity = ncap;
+    }
+    if ((l->items[l->count] = arena_strndup(l->info, s, len)) == NULL)
+        return -1;
+    l->count++;
+    return 0;
+}
+
+/**
+ * @brief 解析花括号列表 { "a", "b", ... }，可以跨行，项之间可以有注释
+ * @note sc->p 指向 '{'；空项（""）忽略
+ */
+static int scan_list(Scanner *sc, Item_List *out)
+{
+    const char *open = sc->p++;
+    int open_line = sc->line;
+    const char *open_line_start = sc->line_start;
+    int need_item = 1;      // 下一个记号应为列表项（或 '}'）
+    for (;;) {
+        skip_blank(sc);
+        if (sc->p == sc->end) {
+            Scanner at = *sc;
+            at.line = open_line;
+            at.line_start = open_line_start;
+            scan_error(&at, open, "missing '}'");
+            return -1;
         }
-        items[cnt-1] = strdup(item);
-        if (items[cnt-1] == NULL)
-        {
-            *err = 1;
-            goto error;
+        char c = *sc->p;
+        if (c == '\n') {
+            next_line(sc);
+        } else if (c == '#') {
+            skip_line(sc);
+        } else if (c == '}') {
+            sc->p++;
+            return 0;
+        } else if (c == ',' && !need_item) {
+            sc->p++;
+            need_item = 1;
+        } else if (c == '"' && need_item) {
+            Span item;
+            if (scan_quoted(sc, &item) != 0)
+                return -1;
+            if (item.len > 0 && list_add(out, item.s, item.len) != 0) {
+                scan_error(sc, item.s, "out of memory");
+                return -1;
+            }
+            need_item = 0;
+        } else if (c == ',') {
+            sc->p++;    // 连续的逗号视为空项
+        } else {
+            scan_error(sc, sc->p, need_item ? "expected a quoted string" : "expected ',' or '}'");
+            return -1;
         }
-
-        token = strtok(NULL, ",");
     }
+}
 
-    free(list_buf);
-    *count = cnt;
-    return items;
-
-error:
-    for (int i = 0; i < cnt; i++)
-        free(items[i]);
-    free(items);
-    free(list_buf);
-    return NULL;
+/**
+ * @brief 读取到行尾的单个值（去除首尾空白与成对的双引号）
+ * @param quoted 是否必须加引号
+ */
+static int scan_value(Scanner *sc, int quoted, Span *out)
+{
+    skip_blank(sc);
+    if (quoted) {
+        if (sc->p == sc->end || *sc->p != '"') {
+            scan_error(sc, sc->p, "expected a quoted string");
+            return -1;
+        }
+        return scan_quoted(sc, out) == 0 ? expect_line_end(sc, "unexpected text after string") : -1;
+    }
+    const char *s = sc->p;
+    const char *nl = memchr(s, '\n', (size_t)(sc->end - s));
+    const char *eol = nl ? nl : sc->end;
+    if (s < eol && *s == '"') {
+        // 引号内的 '#' 不是注释；引号后还有其他内容时按原样取整个值
+        const char *q = memchr(s + 1, '"', (size_t)(eol - s - 1));
+        const char *t = q ? q + 1 : eol;
+        while (t < eol && (*t == ' ' || *t == '\t' || *t == '\r'))
+            t++;
+        if (q && (t == eol || *t == '#')) {
+            out->s = s + 1;
+            out->len = (size_t)(q - s - 1);
+            sc->p = eol;
+            return 0;
+        }
+    }
+    const char *e = memchr(s, '#', (size_t)(eol - s));
+    if (!e)
+        e = eol;
+    while (e > s && isspace((unsigned char)e[-1]))
+        e--;
+    out->s = s;
+    out->len = (size_t)(e - s);
+    sc->p = eol;
+    return 0;
 }
 
 /**
- * @brief 对包含通配符的模式进行 glob 展开
- * @param pattern 模式字符串（已去除引号）
- * @param count 输出参数：匹配的文件个数
- * @param err 输出参数：解析是否出错（非0表示出错）
- * @return 成功返回动态分配的字符串数组，失败返回NULL
+ * @brief 检查依赖列表中每一项的语法（见 depends.h）
+ * @return 0 全部正确，非0 有错误
  */
-static char **expand_wildcard(const char *pattern, int *count, int *err)
+static int check_depends(const Item_List *l)
 {
-    glob_t globbuf;
-    char **files = NULL;
-    int ret;
-
-    *err = 0;
-    ret = glob(pattern, GLOB_TILDE, NULL, &globbuf);
-    if (ret != 0 && ret != GLOB_NOMATCH)
-    {
-        *err = 1;
-        return NULL;
+    for (int i = 0; i < l->count; i++) {
+        Dep_Spec *spec = NULL;
+        size_t n = 0;
+        int bad = dep_parse_list(l->items[i], &spec, &n) != 0 || n != 1;
+        free(spec);
+        if (bad)
+            return 1;
     }
-    if (ret == GLOB_NOMATCH || globbuf.gl_pathc == 0)
-    {
-        globfree(&globbuf);
-        *count = 0;
-        return NULL;
+    return 0;
+}
+
+/* 把单个字符串值转换为列表：依赖按逗号分隔，文件名（或模式）作为单项 */
+static int split_value(const Key_Def *def, Span v, Item_List *out)
+{
+    if (def->kind == KEY_DEPENDS) {
+        const char *p = v.s, *end = v.s + v.len;
+        while (p < end) {
+            const char *comma = memchr(p, ',', (size_t)(end - p));
+            const char *e = comma ? comma : end;
+            const char *s = p;
+            while (s < e && isspace((unsigned char)*s)) s++;
+            while (e > s && isspace((unsigned char)e[-1])) e--;
+            if (e > s && list_add(out, s, (size_t)(e - s)) != 0)
+                return -1;
+            p = comma ? comma + 1 : end;
+        }
+        return 0;
     }
+    return list_add(out, v.s, v.len);
+}
 
-    *count = globbuf.gl_pathc;
-    files = (char **)malloc(*count * sizeof(char *));
-    if (files == NULL)
-    {
-        *err = 1;
-        globfree(&globbuf);
-        return NULL;
+/* 检查列表并把它复制为 info 中连续的数组（替换已有内容） */
+static int assign_list(Scanner *sc, const char *at, const Key_Def *def, Item_List *list)
+{
+    if (def->kind == KEY_DEPENDS && check_depends(list) != 0) {
+        scan_error(sc, at, "invalid dependency");   // 具体的项已由 dep_parse_list 报告
+        return -1;
+    }
+    Control_Info *info = list->info;
+    const char **items = NULL;
+    if (list->count > 0) {
+        items = arena_alloc(info, (size_t)list->count * sizeof(char *), _Alignof(char *));
+        if (!items) {
+            scan_error(sc, at, "out of memory");
+            return -1;
+        }
+        memcpy(items, list->items, (size_t)list->count * sizeof(char *));
+    }
+    *(const char ***)((char *)info + def->field) = items;
+    *(int *)((char *)info + def->count) = list->count;
+    return 0;
+}
+
+/* 解析一行 "key: value"（或跨行的列表），sc->p 指向键的第一个字符 */
+static int parse_entry(Scanner *sc, Item_List *list)
+{
+    const char *key = sc->p;
+    while (sc->p < sc->end && *sc->p != ':' && *sc->p != '\n' && *sc->p != '#')
+        sc->p++;
+    if (sc->p == sc->end || *sc->p != ':') {
+        cpk_printf(WARNING, "%s:%d:%d: expected ':', line ignored\n", sc->source, sc->line,
+                   (int)(sc->p - sc->line_start) + 1);
+        skip_line(sc);
+        return 0;
+    }
+    const char *key_end = sc->p++;
+    while (key_end > key && isspace((unsigned char)key_end[-1]))
+        key_end--;
+    const Key_Def *def = find_key(key, (size_t)(key_end - key));
+    skip_blank(sc);
+    list->count = 0;
+
+    if (sc->p < sc->end && *sc->p == '{') {
+        Scanner open = *sc;     // 错误位置指向 '{'
+        if (scan_list(sc, list) != 0 || expect_line_end(sc, "unexpected text after list") != 0)
+            return -1;
+        // 未知键（或文本键写成了列表）忽略
+        return (!def || def->kind == KEY_TEXT) ? 0 : assign_list(&open, open.p, def, list);
     }
 
-    for (int i = 0; i < *count; i++)
-    {
-        files[i] = strdup(globbuf.gl_pathv[i]);
-        if (files[i] == NULL)
-        {
-            for (int j = 0; j < i; j++)
-                free(files[j]);
-            free(files);
-            *err = 1;
-            globfree(&globbuf);
-            return NULL;
+    const char *at = sc->p;
+    Span v;
+    if (scan_value(sc, def ? def->quoted : 0, &v) != 0)
+        return -1;
+    if (!def)
+        return 0;
+    if (def->kind == KEY_TEXT) {
+        const char *text = arena_strndup(list->info, v.s, v.len);
+        if (!text) {
+            scan_error(sc, at, "out of memory");
+            return -1;
         }
+        *(const char **)((char *)list->info + def->field) = text;
+        return 0;
     }
+    if (split_value(def, v, list) != 0) {
+        scan_error(sc, at, "out of memory");
+        return -1;
+    }
+    return assign_list(sc, at, def, list);
+}
 
-    globfree(&globbuf);
-    return files;
+/**
+ * @brief 展开 include 与 lib 中的模式
+ * @note 两个列表的所有模式一起编译，一次遍历完成匹配；不含模式的列表保持原样
+ * @return 0 成功，非0 失败
+ */
+static int expand_files(Control_Info *info)
+{
+    const char ***lists[] = { &info->include_files, &info->lib_files };
+    int *counts[] = { &info->include_file_count, &info->lib_file_count };
+    int has_pattern[2] = { 0, 0 };
+    for (int k = 0; k < 2; k++)
+        for (int i = 0; i < *counts[k]; i++)
+            has_pattern[k] |= fileglob_is_pattern((*lists[k])[i]);
+    if (!has_pattern[0] && !has_pattern[1])
+        return 0;
+
+    File_Glob *g = fileglob_new();
+    int ret = g ? 0 : -1;
+    for (int k = 0; ret == 0 && k < 2; k++)
+        for (int i = 0; ret == 0 && has_pattern[k] && i < *counts[k]; i++)
+            if ((ret = fileglob_add(g, k, (*lists[k])[i])) != 0)
+                cpk_printf(ERROR, "Invalid file pattern (or unknown home directory for ~): %s\n",
+                           (*lists[k])[i]);
+    if (ret == 0)
+        ret = fileglob_run(g);
+    for (int k = 0; ret == 0 && k < 2; k++) {
+        if (!has_pattern[k])
+            continue;
+        size_t n;
+        const char *const *files = fileglob_results(g, k, &n);
+        const char **items = n ? arena_alloc(info, n * sizeof(char *), _Alignof(char *)) : NULL;
+        for (size_t i = 0; items && i < n; i++)
+            if ((items[i] = arena_strndup(info, files[i], strlen(files[i]))) == NULL)
+                items = NULL;
+        if (n && !items) {
+            ret = -1;
+            break;
+        }
+        *lists[k] = items;
+        *counts[k] = (int)n;
+    }
+    fileglob_free(g);
+    return ret;
 }
 
 /**
- * @brief 读取控制信息
- * @note 读取控制信息文件，并解析其中的键值对，填充 Control_Info 结构体
- *       支持行内注释（# 后的内容忽略），支持键值对中的列表（花括号包围），
- *       支持 include 和 lib 字段中的通配符展开（使用 glob）
- * @param fp 控制信息文件指针
+ * @brief 解析内存中的控制文件内容
+ * @note 单遍扫描，键按编译期生成的键表匹配，不复制整行；
+ *       出错时以 "source:行:列" 的形式报告位置；结果用 control_info_free 释放
+ * @param data 文件内容（不要求以 '\0' 结尾）
+ * @param len 内容长度
+ * @param source 报告错误时使用的文件名
  * @return 成功时返回 Control_Info 结构体指针，失败时返回 NULL
  */
-Control_Info *read_control_info(FILE *fp)
+Control_Info *parse_control_info(const char *data, size_t len, const char *source)
 {
-    Control_Info *info;
-    char line[4096];
-
-    info = (Control_Info *)malloc(sizeof(Control_Info));
+    Control_Info *info = control_info_new();
     if (info == NULL)
         return NULL;
-    memset(info, 0, sizeof(Control_Info));
-
-    while (fgets(line, sizeof(line), fp) != NULL)
-    {
-        char *p, *colon, *key, *value, *comment;
-        size_t len;
-
-        // 去除行尾换行符
-        len = strlen(line);
-        if (len > 0 && line[len-1] == '\n')
-            line[len-1] = '\0';
-
-        // 去除行内注释（第一个 '#' 之后的内容）
-        comment = strchr(line, '#');
-        if (comment != NULL)
-            *comment = '\0';
-
-        // 跳过空行
-        p = line;
-        while (isspace((unsigned char)*p))
-            p++;
-        if (*p == '\0')
-            continue;
-
-        // 查找第一个冒号
-        colon = strchr(line, ':');
-        if (colon == NULL)
+    Item_List list = { NULL, 0, 0, info };
+    Scanner sc = { data, data + len, data, 1, source ? source : "control" };
+    while (sc.p < sc.end) {
+        skip_blank(&sc);
+        if (sc.p == sc.end)
+            break;
+        if (*sc.p == '\n') {
+            next_line(&sc);
             continue;
-
-        // 分割键和值
-        *colon = '\0';
-        key = line;
-        value = colon + 1;
-
-        // 去除键的首尾空白
-        while (isspace((unsigned char)*key))
-            key++;
-        p = key + strlen(key) - 1;
-        while (p > key && isspace((unsigned char)*p))
-        {
-            *p = '\0';
-            p--;
         }
-
-        // 去除值的前导空白
-        while (isspace((unsigned char)*value))
-            value++;
-        // 去除值的尾部空白
-        char *end_val = value + strlen(value) - 1;
-        while (end_val >= value && isspace((unsigned char)*end_val))
-            *end_val-- = '\0';
-
-        // 处理值：可能是列表（以 '{' 开头）或简单字符串
-        if (value[0] == '{')
-        {
-            // 列表格式：{ item1, item2, ... }
-            char *brace_end, *list_start, *list_end_trim;
-            char **items = NULL;
-            int count = 0;
-            int err = 0;
-
-            brace_end = strchr(value, '}');
-            if (brace_end == NULL)
-                continue;   // 缺少右花括号，忽略此行
-
-            // 提取花括号内的内容，去除首尾空白
-            list_start = value + 1;
-            while (isspace((unsigned char)*list_start) && list_start < brace_end)
-                list_start++;
-            list_end_trim = brace_end - 1;
-            while (list_end_trim >= list_start && isspace((unsigned char)*list_end_trim))
-                list_end_trim--;
-
-            if (list_start > list_end_trim)
-            {
-                // 空列表，清空对应字段
-                if (strcmp(key, "include") == 0)
-                {
-                    if (info->include_files != NULL)
-                    {
-                        for (int i = 0; i < info->include_file_count; i++)
-                            free(info->include_files[i]);
-                        free(info->include_files);
-                        info->include_files = NULL;
-                        info->include_file_count = 0;
-                    }
-                }
-                else if (strcmp(key, "lib") == 0)
-                {
-                    if (info->lib_files != NULL)
-                    {
-                        for (int i = 0; i < info->lib_file_count; i++)
-                            free(info->lib_files[i]);
-                        free(info->lib_files);
-                        info->lib_files = NULL;
-                        info->lib_file_count = 0;
-                    }
-                }
-                continue;
-            }
-
-            // 解析列表内容
-            len = list_end_trim - list_start + 1;
-            char *list_buf = (char *)malloc(len + 1);
-            if (list_buf == NULL)
-                goto error;
-            strncpy(list_buf, list_start, len);
-            list_buf[len] = '\0';
-
-            items = parse_list(list_buf, &count, &err);
-            free(list_buf);
-            if (err)
-                goto error;
-
-            // 根据键名赋值
-            if (strcmp(key, "include") == 0)
-            {
-                if (info->include_files != NULL)
-                {
-                    for (int i = 0; i < info->include_file_count; i++)
-                        free(info->include_files[i]);
-                    free(info->include_files);
-                }
-                info->include_files = items;
-                info->include_file_count = count;
-            }
-            else if (strcmp(key, "lib") == 0)
-            {
-                if (info->lib_files != NULL)
-                {
-                    for (int i = 0; i < info->lib_file_count; i++)
-                        free(info->lib_files[i]);
-                    free(info->lib_files);
-                }
-                info->lib_files = items;
-                info->lib_file_count = count;
-            }
-            else
-            {
-                // 未知键，释放列表
-                for (int i = 0; i < count; i++)
-                    free(items[i]);
-                free(items);
-            }
+        if (*sc.p == '#') {
+            skip_line(&sc);
+            continue;
         }
-        else
-        {
-            // 简单字符串值
-            // 对于路径相关字段，检查是否用双引号括起来
-            int need_quote = (strcmp(key, "include") == 0 || strcmp(key, "lib") == 0 ||
-                              strcmp(key, "include_path") == 0 || strcmp(key, "lib_path") == 0);
-
-            if (need_quote)
-            {
-                // 检查引号（此时 value 已去除尾部空白，确保最后一个字符正确）
-                if (value[0] != '"' || value[strlen(value)-1] != '"')
-                    goto error;
-                // 去除引号
-                value[strlen(value)-1] = '\0';
-                value++;
-            }
-            else
-            {
-                // 其他字段可选引号，如果有则去除
-                if (value[0] == '"' && value[strlen(value)-1] == '"')
-                {
-                    value[strlen(value)-1] = '\0';
-                    value++;
-                }
-            }
-
-            // 根据键名填充对应的字段
-            if (strcmp(key, "packet") == 0)
-            {
-                strncpy(info->name, value, MAX_PATH_LEN - 1);
-                info->name[MAX_PATH_LEN - 1] = '\0';
-            }
-            else if (strcmp(key, "version") == 0)
-            {
-                strncpy(info->version, value, MAX_PATH_LEN - 1);
-                info->version[MAX_PATH_LEN - 1] = '\0';
-            }
-            else if (strcmp(key, "description") == 0)
-            {
-                strncpy(info->description, value, MAX_PATH_LEN - 1);
-                info->description[MAX_PATH_LEN - 1] = '\0';
-            }
-            else if (strcmp(key, "author") == 0)
-            {
-                strncpy(info->author, value, MAX_PATH_LEN - 1);
-                info->author[MAX_PATH_LEN - 1] = '\0';
-            }
-            else if (strcmp(key, "homepage") == 0)
-            {
-                strncpy(info->homepage, value, MAX_PATH_LEN - 1);
-                info->homepage[MAX_PATH_LEN - 1] = '\0';
-            }
-            else if (strcmp(key, "license") == 0)
-            {
-                strncpy(info->license, value, MAX_PATH_LEN - 1);
-                info->license[MAX_PATH_LEN - 1] = '\0';
-            }
-            else if (strcmp(key, "include_path") == 0)
-            {
-                strncpy(info->include_install_path, value, MAX_PATH_LEN - 1);
-                info->include_install_path[MAX_PATH_LEN - 1] = '\0';
-            }
-            else if (strcmp(key, "lib_path") == 0)
-            {
-                strncpy(info->lib_install_path, value, MAX_PATH_LEN - 1);
-                info->lib_install_path[MAX_PATH_LEN - 1] = '\0';
-            }
-            else if (strcmp(key, "include") == 0 || strcmp(key, "lib") == 0)
-            {
-                char **files = NULL;
-                int count = 0;
-                int err = 0;
-
-                // 检查是否包含通配符
-                if (strpbrk(value, "*?[") != NULL)
-                {
-                    files = expand_wildcard(value, &count, &err);
-                    if (err)
-                        goto error;
-                }
-                else
-                {
-                    // 无通配符，作为单个文件
-                    count = 1;
-                    files = (char **)malloc(count * sizeof(char *));
-                    if (files == NULL)
-                        goto error;
-                    files[0] = strdup(value);
-                    if (files[0] == NULL)
-                    {
-                        free(files);
-                        goto error;
-                    }
-                }
-
-                // 赋值
-                if (strcmp(key, "include") == 0)
-                {
-                    if (info->include_files != NULL)
-                    {
-                        for (int i = 0; i < info->include_file_count; i++)
-                            free(info->include_files[i]);
-                        free(info->include_files);
-                    }
-                    info->include_files = files;
-                    info->include_file_count = count;
-                }
-                else // lib
-                {
-                    if (info->lib_files != NULL)
-                    {
-                        for (int i = 0; i < info->lib_file_count; i++)
-                            free(info->lib_files[i]);
-                        free(info->lib_files);
-                    }
-                    info->lib_files = files;
-                    info->lib_file_count = count;
-                }
-            }
-            // 其他未知键忽略
+        if (parse_entry(&sc, &list) != 0) {
+            free(list.items);
+            control_info_free(info);
+            return NULL;
         }
+        next_line(&sc);
+    }
+    free(list.items);
+    if (expand_files(info) != 0) {
+        cpk_printf(ERROR, "%s: failed to expand file patterns\n", sc.source);
+        control_info_free(info);
+        return NULL;
     }
-
     return info;
+}
 
-error:
-    // 发生错误时，释放已分配的所有资源
-    if (info->include_files != NULL)
-    {
-        for (int i = 0; i < info->include_file_count; i++)
-            free(info->include_files[i]);
-        free(info->include_files);
+/**
+ * @brief 读取控制文件（mmap 映射后直接解析，不逐行复制）
+ * @param path 控制文件路径
+ * @return 成功时返回 Control_Info 结构体指针，失败时返回 NULL
+ */
+Control_Info *read_control_file(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
     }
-    if (info->lib_files != NULL)
-    {
-        for (int i = 0; i < info->lib_file_count; i++)
-            free(info->lib_files[i]);
-        free(info->lib_files);
+    if (st.st_size == 0) {
+        close(fd);
+        return parse_control_info("", 0, path);
     }
-    free(info);
-    return NULL;
-}
\ No newline at end of file
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+    Control_Info *info = parse_control_info(data, (size_t)st.st_size, path);
+    munmap(data, (size_t)st.st_size);
+    return info;
+}
+
+/**
+ * @brief 读取控制信息
+ * @note 读入整个文件后交给 parse_control_info 解析
+ * @param fp 控制信息文件指针
+ * @return 成功时返回 Control_Info 结构体指针，失败时返回 NULL
+ */
+Control_Info *read_control_info(FILE *fp)
+{
+    char *data = NULL;
+    size_t len = 0, cap = 0, n;
+    do {
+        if (cap - len < FILE_BUFFER_SIZE) {
+            cap = cap ? cap * 2 : FILE_BUFFER_SIZE;
+            char *t = realloc(data, cap);
+            if (!t) {
+                free(data);
+                return NULL;
+            }
+            data = t;
+        }
+        n = fread(data + len, 1, cap - len, fp);
+        len += n;
+    } while (n > 0);
+    Control_Info *info = ferror(fp) ? NULL : parse_control_info(data, len, "control");
+    free(data);
+    return info;
+}
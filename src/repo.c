@@ -5,192 +5,555 @@
 #include <errno.h>
 #include "../include/repo.h"
 #include "../include/network.h"
+#include "../include/index.h"
+#include "../include/cache.h"
+#include "../include/mirror.h"
+#include "../include/depends.h"
+#include "../include/workers.h"
+#include "../include/merkle.h"
 #include "../include/cpkg.h"
 #include "../include/help.h"
-#define OPENSSL_SUPPRESS_DEPRECATED
-#include <openssl/sha.h>
+#include "../include/timing.h"
+#include "../include/trace.h"
+#include "../include/lock.h"
 #include <sys/stat.h>
-#include <unistd.h>
-#include <ctype.h>
 
-/* 简单的索引格式（每行一条记录）:
- * name|version|url|sha256
- */
+/* 索引格式及获取方式见 index.h */
 
-static const char *default_index_url = "https://example.com/cpkg/index.txt";
-
-/* 从索引数据中查找第一个匹配 name 的记录，返回动态分配的 url（需要 free）和 hash（需要 free） */
-static int find_from_index(const char *index_data, const char *name, char **out_url, char **out_hash)
-{
-    if (!index_data || !name) return 1;
-    char *data = strdup(index_data);
-    if (!data) return 2;
-    char *line = NULL;
-    char *saveptr = NULL;
-    line = strtok_r(data, "\n", &saveptr);
-    while (line) {
-        char *p = strdup(line);
-        if (!p) { free(data); return 2; }
-        char *tok = NULL;
-        char *save = NULL;
-        tok = strtok_r(p, "|", &save); // name
-        if (tok && strcmp(tok, name) == 0) {
-            // match
-            (void)strtok_r(NULL, "|", &save); /* skip version field */
-            char *url = strtok_r(NULL, "|", &save);
-            char *hash = strtok_r(NULL, "|", &save);
-            if (url) *out_url = strdup(url);
-            if (hash) *out_hash = strdup(hash);
-            free(p);
-            free(data);
-            return 0;
+int repo_search(const char *query)
+{
+    Repo_Index index;
+    if (repo_load_index(&index) != 0)
+        return 1;
+    // 简单字符串匹配，打印任一字段包含 query 的记录
+    for (size_t i = 0; i < index.count; i++) {
+        const Index_Entry *e = &index.entries[i];
+        if (strstr(e->name, query) || strstr(e->version, query) ||
+            strstr(e->url, query) || strstr(e->sha256, query)) {
+            cpk_text("%s\t%s\t%s\n", e->name, e->version, e->url);
         }
-        free(p);
-        line = strtok_r(NULL, "\n", &saveptr);
     }
-    free(data);
-    return 3; // not found
+    index_free(&index);
+    return 0;
 }
 
-int repo_search(const char *query)
+/* 返回索引记录中可用于校验的哈希（至少 64 个字符），否则返回 NULL */
+static const char *entry_hash(const Index_Entry *entry)
 {
-    char *index = NULL;
-    size_t len = 0;
-    const char *url = getenv("CPKG_INDEX_URL");
-    if (!url) url = default_index_url;
-    if (repo_download_to_memory(url, &index, &len) != 0) {
-        cpk_printf(ERROR, "Failed to download index from %s\n", url);
-        return 1;
+    return strlen(entry->sha256) >= SHA256_HEX_LEN ? entry->sha256 : NULL;
+}
+
+/* 返回索引记录中的 Merkle 根（64 个字符），否则返回 NULL */
+static const char *entry_tree(const Index_Entry *entry)
+{
+    return strlen(entry->tree) >= SHA256_HEX_LEN ? entry->tree : NULL;
+}
+
+/* 一个下载地址在各镜像上的候选地址（按镜像评分排序） */
+typedef struct {
+    char urls[MIRROR_MAX][NET_URL_MAX];
+    const char *ptrs[MIRROR_MAX];
+} Url_Set;
+
+/* 设置任务的主地址与备用地址，失败时由网络层依次切换 */
+static void job_set_urls(net_job *job, Url_Set *set, const char *url)
+{
+    size_t n = mirror_candidates(mirror_default(), url, set->urls, MIRROR_MAX);
+    for (size_t i = 0; i < n; i++)
+        set->ptrs[i] = set->urls[i];
+    job->url = set->ptrs[0];
+    job->alt_urls = set->ptrs + 1;
+    job->alt_count = n - 1;
+}
+
+static int fetch_packages(const Repo_Index *index, const char **names, const char **dest_paths, size_t count, int jobs)
+{
+    net_job *list = calloc(count, sizeof(net_job));
+    const char **job_names = calloc(count, sizeof(char *));
+    Url_Set *urls = calloc(count, sizeof(Url_Set));
+    if (!list || !job_names || !urls) {
+        free(list);
+        free(job_names);
+        free(urls);
+        return 2;
     }
-    // 简单字符串匹配，打印包含 query 的行
-    char *line = NULL;
-    char *saveptr = NULL;
-    line = strtok_r(index, "\n", &saveptr);
-    while (line) {
-        if (strstr(line, query)) {
-            // 输出解析后的字段
-            char *copy = strdup(line);
-            char *tok = NULL;
-            char *s = NULL;
-            tok = strtok_r(copy, "|", &s); // name
-            char *name = tok ? tok : "";
-            tok = strtok_r(NULL, "|", &s); // version
-            char *ver = tok ? tok : "";
-            tok = strtok_r(NULL, "|", &s); // url
-            char *pkgurl = tok ? tok : "";
-            printf("%s\t%s\t%s\n", name, ver, pkgurl);
-            free(copy);
+    size_t job_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        const Index_Entry *entry = index_find(index, names[i]);
+        if (!entry) {
+            cpk_printf(ERROR, "Package not found in index: %s\n", names[i]);
+            free(list);
+            free(job_names);
+            free(urls);
+            return 3;
         }
-        line = strtok_r(NULL, "\n", &saveptr);
+        cpk_printf(DEBUG, "Index returned url='%s' hash='%s' (len=%zu)\n", entry->url, entry->sha256, strlen(entry->sha256));
+        // 缓存以索引中的哈希为键，命中时直接复制（复制过程中重新校验）
+        if (cache_fetch(entry_hash(entry), dest_paths[i]) == 0) {
+            cpk_printf(SUCCESS, "Using cached %s (%.12s)\n", names[i], entry->sha256);
+            continue;
+        }
+        job_set_urls(&list[job_count], &urls[job_count], entry->url);
+        cpk_printf(INFO, "Downloading %s from %s\n", names[i], list[job_count].url);
+        job_names[job_count] = names[i];
+        list[job_count].dest_path = dest_paths[i];
+        list[job_count].sha256 = entry_hash(entry);
+        // 有 Merkle 根时按根校验：中断后续传只需重新读取最后一个未完成的叶子
+        list[job_count].tree_root = entry_tree(entry);
+        job_count++;
     }
-    free(index);
-    return 0;
+
+    // 并行下载，哈希在数据到达时同步计算；单个包时可按 CPKG_SEGMENTS 拆分为并行 Range 分段
+    int failed = 0;
+    const char *seg_env = getenv("CPKG_SEGMENTS");
+    int segments = seg_env ? atoi(seg_env) : 1;
+    if (job_count == 1 && segments > 1) {
+        // 完整文件落盘后按 Merkle 根校验，各叶子在所有核上并行计算
+        failed = net_download_segmented(net_default(), &list[0], segments) != 0;
+    }
+    else if (job_count > 0)
+        failed = net_download_many(net_default(), list, job_count, jobs, NET_DEFAULT_PER_HOST);
+    for (size_t i = 0; i < job_count; i++) {
+        switch (list[i].status) {
+        case 0:
+            if (list[i].sha256) {
+                cpk_printf(SUCCESS, "Hash verification passed for %s\n", job_names[i]);
+                cache_store_file(list[i].sha256, list[i].dest_path);
+            }
+            break;
+        case 1:
+            cpk_printf(ERROR, "Failed to open %s for writing\n", list[i].dest_path);
+            break;
+        case 3:
+            cpk_printf(ERROR, "Hash mismatch for %s: expected %.64s, got %s\n", job_names[i],
+                       list[i].tree_root ? list[i].tree_root : list[i].sha256, list[i].actual_sha256);
+            break;
+        default:
+            cpk_printf(ERROR, "Download failed for %s\n", job_names[i]);
+            break;
+        }
+    }
+    cache_evict();
+    free(list);
+    free(job_names);
+    free(urls);
+    return failed ? 4 : 0;
+}
+
+int repo_fetch_from_index(const Repo_Index *index, const char **names, const char **dest_paths, size_t count, int jobs)
+{
+    if (!index || !names || !dest_paths) return 1;
+    if (count == 0) return 0;
+    uint64_t t_fetch = timing_begin();
+    int ret = fetch_packages(index, names, dest_paths, count, jobs);
+    timing_end(TIMING_FETCH, t_fetch);
+    return ret;
+}
+
+int repo_fetch_packages(const char **names, const char **dest_paths, size_t count, int jobs)
+{
+    if (!names || !dest_paths) return 1;
+    if (count == 0) return 0;
+    Repo_Index index;
+    if (repo_load_index(&index) != 0)
+        return 2;
+    int ret = repo_fetch_from_index(&index, names, dest_paths, count, jobs);
+    index_free(&index);
+    return ret;
 }
 
 int repo_fetch_package_by_name(const char *name, const char *dest_path)
 {
     if (!name || !dest_path) return 1;
-    char *index = NULL;
-    size_t len = 0;
-    const char *url = getenv("CPKG_INDEX_URL");
-    if (!url) url = default_index_url;
-    if (repo_download_to_memory(url, &index, &len) != 0) {
-        cpk_printf(ERROR, "Failed to download index from %s\n", url);
-        return 2;
+    return repo_fetch_packages(&name, &dest_path, 1, 1);
+}
+
+/* 安装计划中每个包的执行状态 */
+enum {
+    TASK_PENDING = 0,   // 尚未获得数据
+    TASK_STAGED,        // 已校验并解压到 staging，等待提交
+    TASK_RETRY,         // 流式传输中断，改用可续传下载
+    TASK_FAILED,
+    TASK_DONE,          // 已提交
+};
+
+typedef struct {
+    const Plan_Item *item;
+    const char *hash;           // 索引中的哈希（可能为 NULL）
+    Merkle_Digest *leaves;      // 已按索引中的根校验过的叶子列表（可能为 NULL）
+    size_t leaf_count;
+    Install_Stream *stream;
+    Cache_Writer *cache;
+    char path[MAX_PATH_LEN + 128]; // 本地包文件（缓存条目或下载结果）
+    int state;
+    int sink_failed;            // 安装流拒绝了数据（校验失败等），换用其他下载方式也无济于事
+} Install_Task;
+
+/* 从本地文件解压并校验（在工作线程中执行） */
+static void stage_from_file(void *ctx, size_t i)
+{
+    Install_Task *t = ((Install_Task **)ctx)[i];
+    trace_begin(TRACE_PACKAGE, t->item->entry->name);
+    t->stream = install_stream_begin(t->hash);
+    if (t->stream && install_stream_verify(t->stream, install_stream_load_file(t->stream, t->path)) == 0) {
+        t->state = TASK_STAGED;
+    } else {
+        install_stream_abort(t->stream);
+        t->stream = NULL;
+        t->state = TASK_FAILED;
     }
-    char *pkg_url = NULL;
-    char *pkg_hash = NULL;
-    int r = find_from_index(index, name, &pkg_url, &pkg_hash);
-    free(index);
-    if (r != 0) {
-        cpk_printf(ERROR, "Package not found in index: %s\n", name);
-        return 3;
-    }
-    cpk_printf(DEBUG, "Index returned url='%s' hash='%s' (len=%zu)\n", pkg_url ? pkg_url : "", pkg_hash ? pkg_hash : "", pkg_hash ? strlen(pkg_hash) : 0);
-    cpk_printf(INFO, "Downloading %s from %s\n", name, pkg_url);
-    int dl = repo_download_to_file(pkg_url, dest_path);
-    if (dl != 0) {
-        cpk_printf(ERROR, "Download failed (code %d)\n", dl);
-        free(pkg_url);
-        free(pkg_hash);
-        return 4;
+    trace_end(TRACE_PACKAGE);
+}
+
+/* 下载数据同时交给安装流水线和缓存写入 */
+static int stream_sink(void *user, const void *data, size_t len)
+{
+    Install_Task *t = (Install_Task *)user;
+    cache_writer_write(t->cache, data, len);
+    if (install_stream_write(t->stream, data, len) != 0) {
+        t->sink_failed = 1;
+        return -1;
     }
-    /* 验证文件哈希（如果索引中提供了哈希） */
-    if (pkg_hash) {
-        /* 修剪前后空白（包括换行） */
-        char *start = pkg_hash;
-        while (*start && isspace((unsigned char)*start)) start++;
-        char *end = pkg_hash + strlen(pkg_hash) - 1;
-        while (end > start && isspace((unsigned char)*end)) { *end = '\0'; end--; }
-        size_t phlen = strlen(start);
-        if (phlen >= 64) {
-            /* 使用前 64 字符作为期望哈希 */
-            char expected[65];
-            memcpy(expected, start, 64);
-            expected[64] = '\0';
-            /* 计算文件哈希 */
-            FILE *fp = fopen(dest_path, "rb");
-            if (!fp) {
-                cpk_printf(ERROR, "Failed to open downloaded file for hashing: %s\n", dest_path);
-                free(pkg_url);
-                free(pkg_hash);
-                return 5;
-            }
-            SHA256_CTX ctx;
-            unsigned char buf[FILE_BUFFER_SIZE];
-            unsigned char hashbin[SHA256_DIGEST_LENGTH];
-            if (!SHA256_Init(&ctx)) {
-                fclose(fp);
-                free(pkg_url);
-                free(pkg_hash);
-                return 6;
-            }
-            size_t n = 0;
-            while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
-                SHA256_Update(&ctx, buf, n);
-            }
-            SHA256_Final(hashbin, &ctx);
-            fclose(fp);
-
-            char actual_hash[SHA256_DIGEST_LENGTH * 2 + 1];
-            for (int i = 0; i < SHA256_DIGEST_LENGTH; i++)
-                sprintf(actual_hash + i * 2, "%02x", hashbin[i]);
-            actual_hash[SHA256_DIGEST_LENGTH * 2] = '\0';
-
-            if (strcmp(actual_hash, expected) != 0) {
-                cpk_printf(ERROR, "Hash mismatch: expected %s, got %s\n", expected, actual_hash);
-                /* 删除损坏的下载文件 */
-                unlink(dest_path);
-                free(pkg_url);
-                free(pkg_hash);
-                return 7;
-            }
-            cpk_printf(SUCCESS, "Hash verification passed for %s\n", name);
-        }
+    return 0;
+}
+
+/* 传输结束后立即完成校验，解压线程不必等到全部下载结束 */
+static void stream_done(net_job *job)
+{
+    Install_Task *t = (Install_Task *)job->sink_user;
+    int transfer_failed = (job->status == 2 && !t->sink_failed);
+    int ok = install_stream_verify(t->stream, !transfer_failed) == 0;
+    // 只有整个文件的哈希与索引一致时才发布到缓存
+    cache_writer_commit(t->cache, ok);
+    t->cache = NULL;
+    if (ok) {
+        t->state = TASK_STAGED;
+        return;
     }
+    install_stream_abort(t->stream);
+    t->stream = NULL;
+    t->state = transfer_failed ? TASK_RETRY : TASK_FAILED;
+}
 
-    free(pkg_url);
-    free(pkg_hash);
+/* 下载到内存的叶子列表 */
+typedef struct {
+    char *data;
+    size_t len, cap;
+} Tree_Buf;
+
+static int tree_sink(void *user, const void *data, size_t len)
+{
+    Tree_Buf *b = (Tree_Buf *)user;
+    if (b->len + len > b->cap) {
+        size_t ncap = b->cap ? b->cap * 2 : 4096;
+        while (ncap < b->len + len)
+            ncap *= 2;
+        char *t = realloc(b->data, ncap);
+        if (!t)
+            return -1;
+        b->data = t;
+        b->cap = ncap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
     return 0;
 }
 
-int repo_install_by_name(const char *name)
+/* 叶子列表可用时返回 0：格式正确且根与索引一致 */
+static int accept_tree(Install_Task *t, const Tree_Buf *b)
 {
-    if (!name) return 1;
-    char tmpfile[] = "/tmp/cpkg_download_XXXXXX.cpk";
-    int fd = mkstemps(tmpfile, 4); // 保留 .cpk 后缀
-    if (fd == -1) {
-        cpk_printf(ERROR, "Failed to create temp file: %s\n", strerror(errno));
+    Merkle_Digest *leaves, root;
+    size_t count;
+    if (merkle_parse_leaves(b->data, b->len, &leaves, &count) != 0)
+        return -1;
+    char hex[HASH_HEX_LEN + 1] = "";
+    if (merkle_root(leaves, count, root) == 0)
+        hex_encode(root, HASH_DIGEST_LEN, hex);
+    if (strncmp(hex, t->item->entry->tree, HASH_HEX_LEN) != 0) {
+        free(leaves);
+        return -1;
+    }
+    t->leaves = leaves;
+    t->leaf_count = count;
+    return 0;
+}
+
+/**
+ * @brief 为索引中带 tree 字段的包并行获取叶子列表（url + MERKLE_SUFFIX）
+ * @note 获取失败或根与索引不一致时回退为整个文件的哈希校验
+ */
+static void fetch_trees(Install_Task *tasks, size_t count, int jobs)
+{
+    net_job *list = calloc(count, sizeof(net_job));
+    Url_Set *urls = calloc(count, sizeof(Url_Set));
+    Tree_Buf *bufs = calloc(count, sizeof(Tree_Buf));
+    Install_Task **owners = calloc(count, sizeof(Install_Task *));
+    size_t n = 0;
+    for (size_t i = 0; list && urls && bufs && owners && i < count; i++) {
+        Install_Task *t = &tasks[i];
+        if (t->state != TASK_PENDING || !entry_tree(t->item->entry))
+            continue;
+        char url[NET_URL_MAX];
+        snprintf(url, sizeof(url), "%s%s", t->item->entry->url, MERKLE_SUFFIX);
+        job_set_urls(&list[n], &urls[n], url);
+        list[n].sink = tree_sink;
+        list[n].sink_user = &bufs[n];
+        owners[n++] = t;
+    }
+    if (n > 0)
+        net_download_many(net_default(), list, n, jobs, NET_DEFAULT_PER_HOST);
+    for (size_t k = 0; k < n; k++) {
+        if (list[k].status != 0 || accept_tree(owners[k], &bufs[k]) != 0)
+            cpk_printf(WARNING, "Tree file for %s is unusable, verifying the whole file instead\n",
+                       owners[k]->item->entry->name);
+        free(bufs[k].data);
+    }
+    free(list);
+    free(urls);
+    free(bufs);
+    free(owners);
+}
+
+/* 打印安装计划 */
+static void print_plan(const Install_Plan *plan)
+{
+    cpk_printf(INFO, "Install plan: %zu package(s) in %d level(s)\n", plan->count, plan->levels);
+    for (size_t i = 0; i < plan->count; i++) {
+        const Plan_Item *item = &plan->items[i];
+        cpk_text("  [%d] %s %s%s\n", item->level, item->entry->name, item->entry->version,
+               item->requested ? "" : " (dependency)");
+    }
+}
+
+/**
+ * @brief 对 tasks 中状态为 TASK_RETRY 的包改用可续传下载（cpkg-work/downloads），再从文件解压
+ * @note 下载中断后再次安装时可从 .part 断点续传
+ */
+static void stage_via_download(Install_Task *tasks, size_t count, int jobs)
+{
+    char download_dir[MAX_PATH_LEN];
+    snprintf(download_dir, sizeof(download_dir), "%s/%s", cpk_work_dir(), DOWNLOAD_DIR);
+    if (mkdir_p(download_dir, 0755) != 0 && errno != EEXIST) {
+        cpk_printf(ERROR, "Failed to create directory: %s\n", download_dir);
+        return;
+    }
+    const char **names = calloc(count, sizeof(char *));
+    const char **dests = calloc(count, sizeof(char *));
+    Install_Task **list = calloc(count, sizeof(Install_Task *));
+    if (!names || !dests || !list) {
+        free(names);
+        free(dests);
+        free(list);
+        return;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        Install_Task *t = &tasks[i];
+        if (t->state != TASK_RETRY)
+            continue;
+        t->state = TASK_FAILED;
+        snprintf(t->path, sizeof(t->path), "%s/%s/%.256s.cpk", cpk_work_dir(), DOWNLOAD_DIR, t->item->entry->name);
+        names[n] = t->item->entry->name;
+        dests[n] = t->path;
+        list[n++] = t;
+    }
+    if (n > 0) {
+        repo_fetch_packages(names, dests, n, jobs);
+        // 只有下载并校验成功的文件会出现在目标位置
+        size_t ready = 0;
+        for (size_t i = 0; i < n; i++)
+            if (access(list[i]->path, F_OK) == 0)
+                list[ready++] = list[i];
+        run_parallel(ready, jobs, stage_from_file, list);
+        for (size_t i = 0; i < n; i++)
+            unlink(dests[i]);
+    }
+    free(names);
+    free(dests);
+    free(list);
+}
+
+int repo_install_packages(const char **names, size_t count, int jobs)
+{
+    if (!names) return 1;
+    if (count == 0) return 0;
+
+    Repo_Index index;
+    if (repo_load_index(&index) != 0)
+        return 2;
+    int r = repo_install_from_index(&index, names, count, jobs);
+    index_free(&index);
+    return r;
+}
+
+static int contains(const char **names, size_t count, const char *name)
+{
+    for (size_t i = 0; i < count; i++)
+        if (strcmp(names[i], name) == 0)
+            return 1;
+    return 0;
+}
+
+/* 安装 names 及其依赖，held 中的包锁已由调用方持有 */
+static int install_from_index(const Repo_Index *index, const char **names, size_t count, int jobs,
+                              const char **held, size_t held_count)
+{
+    Install_Plan plan;
+    int r = dep_resolve(index, names, count, &plan);
+    if (r != 0)
+        return r;
+    print_plan(&plan);
+
+    Install_Task *tasks = calloc(plan.count, sizeof(Install_Task));
+    Install_Task **cached = calloc(plan.count, sizeof(Install_Task *));
+    net_job *list = calloc(plan.count, sizeof(net_job));
+    Url_Set *urls = calloc(plan.count, sizeof(Url_Set));
+    const char **lock_names = calloc(plan.count, sizeof(char *));
+    int *locks = calloc(plan.count, sizeof(int));
+    if (!tasks || !cached || !list || !urls || !lock_names || !locks) {
+        free(tasks);
+        free(cached);
+        free(list);
+        free(urls);
+        free(lock_names);
+        free(locks);
+        dep_plan_free(&plan);
         return 2;
     }
-    close(fd);
-    int r = repo_fetch_package_by_name(name, tmpfile);
-    if (r != 0) {
-        unlink(tmpfile);
-        return 3;
+    // 计划中的包从下载到提交都持有包锁，其他进程可以同时安装不相关的包
+    size_t lock_count = 0;
+    for (size_t i = 0; i < plan.count; i++)
+        if (!contains(held, held_count, plan.items[i].entry->name))
+            lock_names[lock_count++] = plan.items[i].entry->name;
+    if (lock_packages(lock_names, lock_count, locks) != 0) {
+        free(tasks);
+        free(cached);
+        free(list);
+        free(urls);
+        free(lock_names);
+        free(locks);
+        dep_plan_free(&plan);
+        return 4;
+    }
+
+    // 1. 缓存命中的包在线程池中并行解压校验（离线安装）
+    size_t cached_count = 0;
+    for (size_t i = 0; i < plan.count; i++) {
+        Install_Task *t = &tasks[i];
+        t->item = &plan.items[i];
+        t->hash = entry_hash(t->item->entry);
+        if (cache_lookup(t->hash, t->path, sizeof(t->path)) == 0) {
+            cpk_printf(SUCCESS, "Using cached %s (%.12s)\n", t->item->entry->name, t->hash);
+            cached[cached_count++] = t;
+        }
+    }
+    run_parallel(cached_count, jobs, stage_from_file, cached);
+    for (size_t i = 0; i < cached_count; i++) {
+        if (cached[i]->state == TASK_STAGED)
+            continue;
+        // 条目损坏（哈希不符）则删除并改为下载
+        cpk_printf(WARNING, "Cached package for %s is unusable, downloading again\n", cached[i]->item->entry->name);
+        cache_remove(cached[i]->hash);
+        cached[i]->state = TASK_PENDING;
+    }
+
+    // 2. 其余的包并行下载，数据直接流入校验与解压流水线，不落临时文件；
+    //    分段下载需要完整文件，走可续传下载的路径
+    //    索引提供了 Merkle 根时先取叶子列表，下载中每个块到达即校验
+    const char *seg_env = getenv("CPKG_SEGMENTS");
+    int segmented = seg_env && atoi(seg_env) > 1;
+    if (!segmented)
+        fetch_trees(tasks, plan.count, jobs);
+    size_t job_count = 0;
+    for (size_t i = 0; i < plan.count; i++) {
+        Install_Task *t = &tasks[i];
+        if (t->state != TASK_PENDING)
+            continue;
+        if (segmented) {
+            t->state = TASK_RETRY;
+            continue;
+        }
+        t->stream = install_stream_begin(t->hash);
+        if (t->stream && t->leaves &&
+            install_stream_expect_tree(t->stream, (const unsigned char *)t->leaves, t->leaf_count) != 0) {
+            install_stream_abort(t->stream);
+            t->stream = NULL;
+        }
+        if (!t->stream) {
+            t->state = TASK_FAILED;
+            continue;
+        }
+        t->cache = cache_writer_begin(t->hash);
+        job_set_urls(&list[job_count], &urls[job_count], t->item->entry->url);
+        cpk_printf(INFO, "Downloading %s from %s\n", t->item->entry->name, list[job_count].url);
+        list[job_count].sink = stream_sink;
+        list[job_count].sink_user = t;
+        list[job_count].on_done = stream_done;
+        job_count++;
+    }
+    if (job_count > 0)
+        net_download_many(net_default(), list, job_count, jobs, NET_DEFAULT_PER_HOST);
+
+    // 3. 流式传输中断的包改用可续传下载
+    size_t retry_count = 0;
+    for (size_t i = 0; i < plan.count; i++)
+        if (tasks[i].state == TASK_RETRY)
+            retry_count++;
+    if (retry_count > 0) {
+        if (!segmented)
+            cpk_printf(WARNING, "Streaming transfer failed for %zu package(s), retrying with resumable download\n", retry_count);
+        stage_via_download(tasks, plan.count, jobs);
+    }
+
+    // 4. 按层提交：依赖都已提交的包才提交（提交只是目录重命名）
+    for (size_t i = 0; i < plan.count; i++) {
+        Install_Task *t = &tasks[i];
+        const char *name = t->item->entry->name;
+        const char *missing = NULL;
+        for (size_t k = 0; k < t->item->dep_count && !missing; k++)
+            if (tasks[t->item->deps[k]].state != TASK_DONE)
+                missing = plan.items[t->item->deps[k]].entry->name;
+        if (t->state == TASK_STAGED && missing) {
+            cpk_printf(ERROR, "Skipping %s: dependency %s was not installed\n", name, missing);
+            install_stream_abort(t->stream);
+            t->state = TASK_FAILED;
+        } else if (t->state == TASK_STAGED) {
+            t->state = install_stream_commit(t->stream) == 0 ? TASK_DONE : TASK_FAILED;
+        }
+        t->stream = NULL;
+        if (t->state != TASK_DONE) {
+            cpk_printf(ERROR, "Remote install failed for %s\n", name);
+            r = 4;
+        }
     }
-    // 调用已有安装逻辑
-    r = install_package(tmpfile);
-    unlink(tmpfile);
+
+    lock_release_all(locks, lock_count);
+    cache_evict();
+    for (size_t i = 0; i < plan.count; i++)
+        free(tasks[i].leaves);
+    free(tasks);
+    free(cached);
+    free(list);
+    free(urls);
+    free(lock_names);
+    free(locks);
+    dep_plan_free(&plan);
     return r;
 }
+
+int repo_install_from_index(const Repo_Index *index, const char **names, size_t count, int jobs)
+{
+    return install_from_index(index, names, count, jobs, NULL, 0);
+}
+
+int repo_install_held(const Repo_Index *index, const char **names, size_t count, int jobs,
+                      const char **held, size_t held_count)
+{
+    return install_from_index(index, names, count, jobs, held, held_count);
+}
+
+int repo_install_by_name(const char *name)
+{
+    if (!name) return 1;
+    return repo_install_packages(&name, 1, 1);
+}
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "../include/status.h"
+#include "../include/cpkg.h"
+#include "../include/help.h"
+#include "../include/durability.h"
+
+/* 包名不能包含路径分隔符，避免记录写到状态目录之外 */
+static int valid_name(const char *name)
+{
+    return name && name[0] && strchr(name, '/') == NULL &&
+           strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+static void record_path(const char *name, char *out, size_t len)
+{
+    snprintf(out, len, "%s/%s/%.255s", cpk_work_dir(), STATUS_DIR, name);
+}
+
+int status_write(const CPK_Header *header)
+{
+    if (!header || !valid_name(header->name))
+        return 1;
+    char dir[MAX_PATH_LEN];
+    snprintf(dir, sizeof(dir), "%s/%s", cpk_work_dir(), STATUS_DIR);
+    if (mkdir_p(dir, 0755) != 0 && errno != EEXIST) {
+        cpk_printf(WARNING, "Failed to create directory: %s\n", dir);
+        return 1;
+    }
+    char path[MAX_PATH_LEN], tmp[MAX_PATH_LEN + 16];
+    record_path(header->name, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp)
+        return 1;
+    fprintf(fp, "package: %.255s\n", header->name);
+    fprintf(fp, "version: %.63s\n", header->version);
+    fprintf(fp, "depends: %.*s\n", CPKG_DEPENDS_LEN - 1, header->depends);
+    fprintf(fp, "installed: %ld\n", (long)time(NULL));
+    int synced = durability_sync_file(fp) == 0;
+    if (fclose(fp) != 0 || !synced || rename(tmp, path) != 0) {
+        remove(tmp);
+        return 1;
+    }
+    return durability_sync_dir(dir) == 0 ? 0 : 1;
+}
+
+int status_read(const char *name, Installed_Pkg *out)
+{
+    if (!valid_name(name) || !out)
+        return 1;
+    char path[MAX_PATH_LEN];
+    record_path(name, path, sizeof(path));
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return 1;
+    memset(out, 0, sizeof(*out));
+    char line[CPKG_DEPENDS_LEN + 32];
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *value = strstr(line, ": ");
+        if (!value)
+            continue;
+        *value = '\0';
+        value += 2;
+        if (strcmp(line, "package") == 0)
+            snprintf(out->name, sizeof(out->name), "%s", value);
+        else if (strcmp(line, "version") == 0)
+            snprintf(out->version, sizeof(out->version), "%s", value);
+        else if (strcmp(line, "depends") == 0)
+            snprintf(out->depends, sizeof(out->depends), "%s", value);
+        else if (strcmp(line, "installed") == 0)
+            out->installed_at = strtol(value, NULL, 10);
+    }
+    fclose(fp);
+    return out->name[0] ? 0 : 1;
+}
+
+int status_remove(const char *name)
+{
+    if (!valid_name(name))
+        return 1;
+    char path[MAX_PATH_LEN];
+    record_path(name, path, sizeof(path));
+    return (unlink(path) == 0 || errno == ENOENT) ? 0 : 1;
+}
+
+static int cmp_name(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int status_list(Installed_Pkg **out, size_t *count)
+{
+    *out = NULL;
+    *count = 0;
+    char dir_path[MAX_PATH_LEN];
+    snprintf(dir_path, sizeof(dir_path), "%s/%s", cpk_work_dir(), STATUS_DIR);
+    DIR *dir = opendir(dir_path);
+    if (!dir)
+        return errno == ENOENT ? 0 : 1;
+
+    // 先收集文件名并排序，再逐个读取，结果即按包名有序
+    char **names = NULL;
+    size_t n = 0, cap = 0;
+    int ret = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        size_t len = strlen(name);
+        if (!valid_name(name) || name[0] == '.' || (len > 4 && strcmp(name + len - 4, ".tmp") == 0))
+            continue;
+        if (n == cap) {
+            size_t ncap = cap ? cap * 2 : 64;
+            char **t = realloc(names, ncap * sizeof(char *));
+            if (!t) {
+                ret = 1;
+                break;
+            }
+            names = t;
+            cap = ncap;
+        }
+        if ((names[n] = strdup(name)) == NULL) {
+            ret = 1;
+            break;
+        }
+        n++;
+    }
+    closedir(dir);
+
+    Installed_Pkg *pkgs = NULL;
+    if (ret == 0 && n > 0) {
+        qsort(names, n, sizeof(char *), cmp_name);
+        pkgs = malloc(n * sizeof(Installed_Pkg));
+        if (!pkgs)
+            ret = 1;
+        for (size_t i = 0; pkgs && i < n; i++)
+            if (status_read(names[i], &pkgs[*count]) == 0)
+                (*count)++;
+    }
+    for (size_t i = 0; i < n; i++)
+        free(names[i]);
+    free(names);
+    if (ret != 0) {
+        free(pkgs);
+        *count = 0;
+        return ret;
+    }
+    *out = pkgs;
+    return 0;
+}
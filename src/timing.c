@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "../include/timing.h"
+
+int timing_enabled = 0;
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} Timing_Span;
+
+static Timing_Span spans[TIMING_PHASE_COUNT];
+static uint64_t counters[TIMING_COUNTER_COUNT];
+static uint64_t start_ns;
+static int json_output;
+
+static const char *const phase_names[] = {
+#define TIMING_NAME(id, name) name,
+    TIMING_PHASES(TIMING_NAME)
+};
+
+static const char *const counter_names[] = {
+    TIMING_COUNTERS(TIMING_NAME)
+#undef TIMING_NAME
+};
+
+uint64_t timing_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void timing_record(Timing_Phase phase, uint64_t start)
+{
+    uint64_t d = timing_now_ns() - start;
+    Timing_Span *s = &spans[phase];
+    __atomic_add_fetch(&s->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->total_ns, d, __ATOMIC_RELAXED);
+    uint64_t m = __atomic_load_n(&s->max_ns, __ATOMIC_RELAXED);
+    while (d > m && !__atomic_compare_exchange_n(&s->max_ns, &m, d, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void timing_count(Timing_Counter counter, uint64_t n)
+{
+    __atomic_add_fetch(&counters[counter], n, __ATOMIC_RELAXED);
+}
+
+static void report(void)
+{
+    timing_enabled = 0;   // 输出本身不计入统计
+    double wall_ms = (timing_now_ns() - start_ns) / 1e6;
+    struct rusage ru;
+    long peak_rss_kb = getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : 0;
+    FILE *out = stderr;
+    fflush(stdout);
+
+    if (json_output) {
+        fprintf(out, "{\"wall_ms\": %.3f, \"peak_rss_kb\": %ld, \"phases\": {", wall_ms, peak_rss_kb);
+        int first = 1;
+        for (int i = 0; i < TIMING_PHASE_COUNT; i++) {
+            if (spans[i].count == 0)
+                continue;
+            fprintf(out, "%s\"%s\": {\"count\": %llu, \"total_ms\": %.3f, \"max_ms\": %.3f}",
+                    first ? "" : ", ", phase_names[i], (unsigned long long)spans[i].count,
+                    spans[i].total_ns / 1e6, spans[i].max_ns / 1e6);
+            first = 0;
+        }
+        fprintf(out, "}, \"counters\": {");
+        for (int i = 0; i < TIMING_COUNTER_COUNT; i++)
+            fprintf(out, "%s\"%s\": %llu", i ? ", " : "", counter_names[i],
+                    (unsigned long long)counters[i]);
+        fprintf(out, "}}\n");
+        return;
+    }
+
+    fprintf(out, "\n%-12s %8s %12s %12s\n", "phase", "count", "total(ms)", "max(ms)");
+    for (int i = 0; i < TIMING_PHASE_COUNT; i++)
+        if (spans[i].count > 0)
+            fprintf(out, "%-12s %8llu %12.3f %12.3f\n", phase_names[i],
+                    (unsigned long long)spans[i].count, spans[i].total_ns / 1e6, spans[i].max_ns / 1e6);
+    for (int i = 0; i < TIMING_COUNTER_COUNT; i++)
+        fprintf(out, "%-14s %llu\n", counter_names[i], (unsigned long long)counters[i]);
+    fprintf(out, "%-14s %.3f ms\n%-14s %ld KiB\n", "wall", wall_ms, "peak_rss", peak_rss_kb);
+}
+
+int timing_enable(const char *format)
+{
+    if (format && strcmp(format, "json") != 0 && strcmp(format, "text") != 0)
+        return -1;
+    json_output = format && strcmp(format, "json") == 0;
+    if (!timing_enabled) {
+        start_ns = timing_now_ns();
+        timing_enabled = 1;
+        atexit(report);
+    }
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "../include/trace.h"
+#include "../include/timing.h"
+#include "../include/help.h"
+
+#define TRACE_NAME_LEN 42
+#define TRACE_RING_SIZE (1u << 15)   // 每个缓冲区的事件数（2 的幂）
+
+int trace_enabled = 0;
+
+typedef struct {
+    uint64_t ts;
+    uint64_t id;                // 异步事件的配对 id
+    int32_t tid;
+    char ph;
+    uint8_t cat;
+    char name[TRACE_NAME_LEN];
+} Trace_Event;
+
+/**
+ * 单个线程的环形缓冲区。缓冲区只加入全局链表、从不删除：线程退出后
+ * 标记为空闲，由之后创建的线程接着使用（事件里记录了各自的 tid）。
+ */
+typedef struct Trace_Ring {
+    struct Trace_Ring *next;
+    int owned;                  // 是否有线程正在写入
+    uint64_t head;              // 已写入的事件总数（release 发布）
+    Trace_Event events[TRACE_RING_SIZE];
+} Trace_Ring;
+
+static Trace_Ring *rings;
+static __thread Trace_Ring *my_ring;
+static __thread int32_t my_tid;
+static pthread_key_t ring_key;
+static FILE *trace_file;
+static char trace_path[4096];
+static uint64_t trace_start;
+static int32_t main_tid;
+
+static const char *const category_names[] = {
+#define TRACE_NAME(id, name) name,
+    TRACE_CATEGORIES(TRACE_NAME)
+#undef TRACE_NAME
+};
+
+/* 线程退出时归还缓冲区 */
+static void release_ring(void *arg)
+{
+    Trace_Ring *r = (Trace_Ring *)arg;
+    __atomic_store_n(&r->owned, 0, __ATOMIC_RELEASE);
+}
+
+static Trace_Ring *acquire_ring(void)
+{
+    Trace_Ring *r;
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&r->owned, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+    if (!r) {
+        r = calloc(1, sizeof(Trace_Ring));
+        if (!r)
+            return NULL;
+        r->owned = 1;
+        r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+    pthread_setspecific(ring_key, r);
+    my_tid = (int32_t)syscall(SYS_gettid);
+    my_ring = r;
+    return r;
+}
+
+void trace_record(char ph, Trace_Category cat, const char *name, uint64_t id)
+{
+    Trace_Ring *r = my_ring ? my_ring : acquire_ring();
+    if (!r)
+        return;
+    uint64_t h = r->head;
+    Trace_Event *e = &r->events[h & (TRACE_RING_SIZE - 1)];
+    e->ts = timing_now_ns();
+    e->id = id;
+    e->tid = my_tid;
+    e->ph = ph;
+    e->cat = (uint8_t)cat;
+    size_t len = name ? strlen(name) : 0;
+    if (len >= TRACE_NAME_LEN) {
+        // 路径的结尾更有辨识度；不从 UTF-8 字符中间截断
+        name += len - (TRACE_NAME_LEN - 1);
+        len = TRACE_NAME_LEN - 1;
+        while (len > 0 && ((unsigned char)*name & 0xC0) == 0x80) {
+            name++;
+            len--;
+        }
+    }
+    memcpy(e->name, name ? name : "", len);
+    e->name[len] = '\0';
+    __atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+}
+
+static void write_string(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static void write_trace(void)
+{
+    trace_enabled = 0;
+    FILE *out = trace_file;
+    int pid = (int)getpid();
+    uint64_t dropped = 0;
+
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"cpkg\"}}",
+            pid, main_tid);
+    for (Trace_Ring *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        dropped += first;
+        for (uint64_t i = first; i < head; i++) {
+            const Trace_Event *e = &r->events[i & (TRACE_RING_SIZE - 1)];
+            fprintf(out, ",\n{\"name\": ");
+            write_string(out, e->name);
+            fprintf(out, ", \"cat\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d",
+                    category_names[e->cat], e->ph, (e->ts - trace_start) / 1e3, pid, e->tid);
+            if (e->ph == 'b' || e->ph == 'e')
+                fprintf(out, ", \"id\": \"0x%llx\"", (unsigned long long)e->id);
+            fputc('}', out);
+        }
+    }
+    fprintf(out, "\n], \"otherData\": {\"dropped_events\": %llu}}\n", (unsigned long long)dropped);
+    if (fclose(out) != 0)
+        cpk_printf(WARNING, "Failed to write trace file %s\n", trace_path);
+    else if (dropped > 0)
+        cpk_printf(WARNING, "Trace buffer overflowed, %llu oldest event(s) dropped\n", (unsigned long long)dropped);
+}
+
+int trace_open(const char *path)
+{
+    if (trace_enabled)
+        return 0;
+    trace_file = fopen(path, "w");
+    if (!trace_file)
+        return -1;
+    snprintf(trace_path, sizeof(trace_path), "%s", path);
+    if (pthread_key_create(&ring_key, release_ring) != 0) {
+        fclose(trace_file);
+        return -1;
+    }
+    main_tid = (int32_t)syscall(SYS_gettid);
+    trace_start = timing_now_ns();
+    trace_enabled = 1;
+    atexit(write_trace);
+    return 0;
+}
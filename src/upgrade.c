@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/repo.h"
+#include "../include/index.h"
+#include "../include/status.h"
+#include "../include/version.h"
+#include "../include/cpkg.h"
+#include "../include/help.h"
+
+/* 升级计划中的一项 */
+typedef struct {
+    const Index_Entry *entry;
+    const Installed_Pkg *installed;
+} Upgrade_Item;
+
+static void format_size(unsigned long long bytes, char *out, size_t len)
+{
+    if (bytes >= 1024ULL * 1024 * 1024)
+        snprintf(out, len, "%.1f GiB", bytes / (1024.0 * 1024.0 * 1024.0));
+    else if (bytes >= 1024ULL * 1024)
+        snprintf(out, len, "%.1f MiB", bytes / (1024.0 * 1024.0));
+    else if (bytes >= 1024)
+        snprintf(out, len, "%.1f KiB", bytes / 1024.0);
+    else
+        snprintf(out, len, "%llu B", bytes);
+}
+
+/* 解析索引中的大小字段，未知时返回 0 */
+static int entry_size(const Index_Entry *entry, unsigned long long *out)
+{
+    char *end;
+    if (!entry->size[0])
+        return 0;
+    *out = strtoull(entry->size, &end, 10);
+    return *end == '\0';
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static int cmp_installed(const void *key, const void *elem)
+{
+    return strcmp((const char *)key, ((const Installed_Pkg *)elem)->name);
+}
+
+static double elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/**
+ * @brief 合并遍历已安装列表与索引（两者都按包名排序），找出可升级的包
+ * @param wanted 已排序的指定包名（count 为 0 表示全部）
+ * @return 可升级的包数
+ */
+static size_t plan_upgrades(const Installed_Pkg *pkgs, size_t pkg_count, const Repo_Index *index,
+                            const char **wanted, size_t wanted_count, Upgrade_Item *out)
+{
+    size_t i = 0, j = 0, w = 0, n = 0;
+    while (i < pkg_count && j < index->count) {
+        int c = strcmp(pkgs[i].name, index->entries[j].name);
+        if (c < 0) {
+            i++;
+            continue;
+        }
+        if (c > 0) {
+            j++;
+            continue;
+        }
+        // 指定包名时同样按序推进，整体仍为一次线性遍历
+        int selected = 1;
+        if (wanted_count > 0) {
+            while (w < wanted_count && strcmp(wanted[w], pkgs[i].name) < 0)
+                w++;
+            selected = (w < wanted_count && strcmp(wanted[w], pkgs[i].name) == 0);
+        }
+        if (selected && version_compare(index->entries[j].version, pkgs[i].version) > 0) {
+            out[n].entry = &index->entries[j];
+            out[n].installed = &pkgs[i];
+            n++;
+        }
+        i++;
+        j++;
+    }
+    return n;
+}
+
+static void print_upgrade_plan(const Upgrade_Item *items, size_t n)
+{
+    unsigned long long total = 0;
+    size_t unknown = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned long long size;
+        if (entry_size(items[i].entry, &size))
+            total += size;
+        else
+            unknown++;
+    }
+    char buf[32];
+    format_size(total, buf, sizeof(buf));
+    if (unknown > 0)
+        cpk_printf(INFO, "Upgrade plan: %zu package(s), %s to download (+%zu of unknown size)\n", n, buf, unknown);
+    else
+        cpk_printf(INFO, "Upgrade plan: %zu package(s), %s to download\n", n, buf);
+    for (size_t i = 0; i < n; i++) {
+        unsigned long long size;
+        if (entry_size(items[i].entry, &size))
+            format_size(size, buf, sizeof(buf));
+        else
+            snprintf(buf, sizeof(buf), "size unknown");
+        cpk_text("  %-24s %s -> %s  (%s)\n", items[i].entry->name, items[i].installed->version,
+               items[i].entry->version, buf);
+    }
+}
+
+int repo_upgrade_packages(const char **names, size_t count, int jobs)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Installed_Pkg *pkgs;
+    size_t pkg_count;
+    if (status_list(&pkgs, &pkg_count) != 0) {
+        cpk_printf(ERROR, "Failed to read installed package records\n");
+        return 2;
+    }
+
+    const char **wanted = NULL;
+    if (count > 0) {
+        wanted = malloc(count * sizeof(char *));
+        if (!wanted) {
+            free(pkgs);
+            return 2;
+        }
+        memcpy(wanted, names, count * sizeof(char *));
+        qsort(wanted, count, sizeof(char *), cmp_str);
+        for (size_t i = 0; i < count; i++) {
+            if (!bsearch(wanted[i], pkgs, pkg_count, sizeof(Installed_Pkg), cmp_installed)) {
+                cpk_printf(ERROR, "Package '%s' is not installed.\n", wanted[i]);
+                free(wanted);
+                free(pkgs);
+                return 3;
+            }
+        }
+    }
+
+    Repo_Index index;
+    if (repo_load_index(&index) != 0) {
+        free(wanted);
+        free(pkgs);
+        return 2;
+    }
+
+    int r = 0;
+    Upgrade_Item *items = malloc((pkg_count ? pkg_count : 1) * sizeof(Upgrade_Item));
+    const char **upgrade_names = malloc((pkg_count ? pkg_count : 1) * sizeof(char *));
+    if (!items || !upgrade_names) {
+        r = 2;
+        goto out;
+    }
+    size_t n = plan_upgrades(pkgs, pkg_count, &index, wanted, count, items);
+    cpk_printf(DEBUG, "Planned %zu installed against %zu index entries in %.2f ms\n",
+               pkg_count, index.count, elapsed_ms(&start));
+    for (size_t i = 0; i < count; i++)
+        if (!index_find(&index, wanted[i]))
+            cpk_printf(WARNING, "%s is not available in the index\n", wanted[i]);
+    if (n == 0) {
+        cpk_printf(SUCCESS, "All packages are up to date\n");
+        goto out;
+    }
+    print_upgrade_plan(items, n);
+
+    // 执行与安装相同：解析新增依赖，并行下载解压，按依赖层次提交
+    for (size_t i = 0; i < n; i++)
+        upgrade_names[i] = items[i].entry->name;
+    r = repo_install_from_index(&index, upgrade_names, n, jobs);
+
+out:
+    free(items);
+    free(upgrade_names);
+    free(wanted);
+    free(pkgs);
+    index_free(&index);
+    return r;
+}
@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/openat2.h>
+#include "../include/uring_writer.h"
+#include "../include/timing.h"
+#include "../include/workers.h"
+
+#define URING_ENTRIES 256   // SQ 大小（每个文件最多 3 个 SQE）
+
+enum { OP_OPEN, OP_WRITE, OP_CLOSE };
+
+typedef struct {
+    char *path;
+    struct open_how how;    // openat2 的参数（提交时由内核复制）
+    char *buf;
+    size_t len;
+    mode_t mode;
+    int pending;            // 尚未收到的 CQE 数（0 表示槽空闲）
+    int open_res;
+    int write_res;
+    int close_res;
+} Uring_File;
+
+struct Uring_Writer {
+    int ring_fd;
+    int dir_fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;          // 与 sq_ring 相同时只映射一次
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_array;
+    unsigned sq_mask, sq_entries;
+    unsigned *cq_head, *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned to_submit;     // 已放入 SQ 尚未提交的 SQE 数
+    unsigned in_flight;     // 在途文件数
+    size_t in_flight_bytes;
+    int broken;             // 不再提交（内核不支持直接打开到固定槽或提交失败），改为同步写入
+    int error;              // 有文件最终写入失败
+    Uring_Redo_Fn redo;
+    void *redo_ctx;
+    Uring_File files[URING_SLOTS];
+};
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned opcode, void *arg, unsigned nr)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr);
+}
+
+/* 内核是否支持所需的操作 */
+static int probe_ops(int ring_fd)
+{
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if (!probe)
+        return -1;
+    int ok = sys_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    const int ops[] = { IORING_OP_OPENAT2, IORING_OP_WRITE, IORING_OP_CLOSE };
+    for (size_t i = 0; ok && i < sizeof(ops) / sizeof(ops[0]); i++)
+        ok = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok ? 0 : -1;
+}
+
+static void unmap(Uring_Writer *w)
+{
+    if (w->sqes)
+        munmap(w->sqes, w->sqes_size);
+    if (w->cq_ring && w->cq_ring != w->sq_ring)
+        munmap(w->cq_ring, w->cq_ring_size);
+    if (w->sq_ring)
+        munmap(w->sq_ring, w->sq_ring_size);
+}
+
+Uring_Writer *uring_writer_new(int dir_fd, Uring_Redo_Fn redo, void *redo_ctx)
+{
+    const char *env = getenv(URING_ENV);
+    if (env && *env ? strcmp(env, "0") == 0 : worker_cpu_count() < 2)
+        return NULL;
+    Uring_Writer *w = calloc(1, sizeof(Uring_Writer));
+    if (!w)
+        return NULL;
+    w->dir_fd = dir_fd;
+    w->redo = redo;
+    w->redo_ctx = redo_ctx;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    w->ring_fd = sys_setup(URING_ENTRIES, &p);
+    if (w->ring_fd < 0) {
+        free(w);
+        return NULL;
+    }
+    // 映射 SQ/CQ 环与 SQE 数组
+    w->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    w->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (w->cq_ring_size > w->sq_ring_size)
+            w->sq_ring_size = w->cq_ring_size;
+        w->cq_ring_size = w->sq_ring_size;
+    }
+    w->sq_ring = mmap(NULL, w->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      w->ring_fd, IORING_OFF_SQ_RING);
+    if (w->sq_ring == MAP_FAILED)
+        w->sq_ring = NULL;
+    if (w->sq_ring && (p.features & IORING_FEAT_SINGLE_MMAP)) {
+        w->cq_ring = w->sq_ring;
+    } else if (w->sq_ring) {
+        w->cq_ring = mmap(NULL, w->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          w->ring_fd, IORING_OFF_CQ_RING);
+        if (w->cq_ring == MAP_FAILED)
+            w->cq_ring = NULL;
+    }
+    w->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    if (w->cq_ring) {
+        w->sqes = mmap(NULL, w->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       w->ring_fd, IORING_OFF_SQES);
+        if (w->sqes == MAP_FAILED)
+            w->sqes = NULL;
+    }
+    // 空的固定文件槽（-1），openat2 直接打开到槽中，不占用进程的描述符
+    int slots[URING_SLOTS];
+    for (int i = 0; i < URING_SLOTS; i++)
+        slots[i] = -1;
+    if (!w->sqes || probe_ops(w->ring_fd) != 0 ||
+        sys_register(w->ring_fd, IORING_REGISTER_FILES, slots, URING_SLOTS) != 0) {
+        unmap(w);
+        close(w->ring_fd);
+        free(w);
+        return NULL;
+    }
+    char *sq = w->sq_ring, *cq = w->cq_ring;
+    w->sq_head = (unsigned *)(sq + p.sq_off.head);
+    w->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    w->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    w->sq_entries = *(unsigned *)(sq + p.sq_off.ring_entries);
+    w->sq_array = (unsigned *)(sq + p.sq_off.array);
+    w->cq_head = (unsigned *)(cq + p.cq_off.head);
+    w->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    w->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    w->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return w;
+}
+
+static struct io_uring_sqe *next_sqe(Uring_Writer *w, unsigned *tail)
+{
+    unsigned index = *tail & w->sq_mask;
+    struct io_uring_sqe *sqe = &w->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    w->sq_array[index] = index;
+    (*tail)++;
+    return sqe;
+}
+
+static int submit(Uring_Writer *w, unsigned wait)
+{
+    for (;;) {
+        int r = sys_enter(w->ring_fd, w->to_submit, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+        if (r >= 0) {
+            w->to_submit -= (unsigned)r < w->to_submit ? (unsigned)r : w->to_submit;
+            if (w->to_submit == 0 || wait)
+                return 0;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        return -1;
+    }
+}
+
+/* 一个文件的所有 CQE 都已收到：成功时释放，否则同步重写 */
+static void finish_file(Uring_Writer *w, Uring_File *f)
+{
+    int ok = f->open_res >= 0 && (f->len == 0 || f->write_res == (int)f->len) && f->close_res >= 0;
+    if (ok) {
+        timing_add(TIMING_BYTES_WRITTEN, f->len);
+    } else {
+        if (f->open_res == -EINVAL)
+            w->broken = 1;  // 内核不支持 file_index，之后不再提交
+        if (!w->redo || w->redo(w->redo_ctx, f->path, f->mode, f->buf, f->len) != 0)
+            w->error = 1;
+    }
+    w->in_flight--;
+    w->in_flight_bytes -= f->len;
+    free(f->path);
+    free(f->buf);
+    f->path = f->buf = NULL;
+}
+
+/* 处理已完成的 CQE（不进入内核） */
+static void reap(Uring_Writer *w)
+{
+    unsigned head = *w->cq_head;
+    unsigned tail = __atomic_load_n(w->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        const struct io_uring_cqe *cqe = &w->cqes[head & w->cq_mask];
+        Uring_File *f = &w->files[cqe->user_data >> 2];
+        switch (cqe->user_data & 3) {
+        case OP_OPEN:  f->open_res = cqe->res; break;
+        case OP_WRITE: f->write_res = cqe->res; break;
+        default:       f->close_res = cqe->res; break;
+        }
+        head++;
+        if (--f->pending == 0) {
+            __atomic_store_n(w->cq_head, head, __ATOMIC_RELEASE);
+            finish_file(w, f);  // 可能同步重写，先归还 CQ 空间
+        }
+    }
+    __atomic_store_n(w->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* 提交已放入的 SQE 并至少等待一个完成 */
+static int wait_one(Uring_Writer *w)
+{
+    if (submit(w, 1) != 0) {
+        w->broken = 1;
+        w->error = 1;
+        return -1;
+    }
+    reap(w);
+    return 0;
+}
+
+/* 同一路径是否有尚未完成的文件（path 在 finish_file 中释放） */
+static int path_in_flight(const Uring_Writer *w, const char *path)
+{
+    for (int i = 0; i < URING_SLOTS; i++)
+        if (w->files[i].path && strcmp(w->files[i].path, path) == 0)
+            return 1;
+    return 0;
+}
+
+int uring_writer_wait_path(Uring_Writer *w, const char *path)
+{
+    if (!w || w->in_flight == 0)
+        return 0;
+    reap(w);
+    while (path_in_flight(w, path))
+        if (wait_one(w) != 0)
+            return -1;
+    return 0;
+}
+
+int uring_writer_file(Uring_Writer *w, const char *path, mode_t mode, char *buf, size_t len)
+{
+    if (w->broken)
+        return 1;
+    // 不同的链之间没有先后顺序：同一路径的旧文件完成（包括重写）之后才提交新的
+    if (uring_writer_wait_path(w, path) != 0)
+        return w->broken ? 1 : -1;
+    // 等待空闲的槽、SQ 空间与在途字节额度
+    int slot = -1;
+    for (;;) {
+        reap(w);
+        for (int i = 0; slot < 0 && i < URING_SLOTS; i++)
+            if (w->files[i].pending == 0 && !w->files[i].path)
+                slot = i;
+        unsigned used = *w->sq_tail - __atomic_load_n(w->sq_head, __ATOMIC_ACQUIRE);
+        int room = slot >= 0 && w->sq_entries - used >= 3 &&
+                   (w->in_flight == 0 || w->in_flight_bytes + len <= URING_MAX_BYTES);
+        if (room)
+            break;
+        if (w->broken || wait_one(w) != 0)
+            return w->broken ? 1 : -1;
+        slot = -1;
+    }
+    if (w->broken)
+        return 1;
+    Uring_File *f = &w->files[slot];
+    if (!(f->path = strdup(path)))
+        return -1;
+    f->buf = buf;
+    f->len = len;
+    f->mode = mode;
+    f->open_res = f->write_res = f->close_res = 0;
+    f->pending = len > 0 ? 3 : 2;
+
+    // openat2 -> write -> close 链接执行；write 使用硬链接，写失败时仍会关闭槽
+    // 路径中不允许符号链接，也不能离开目录；固定槽不接受 O_CLOEXEC
+    memset(&f->how, 0, sizeof(f->how));
+    f->how.flags = O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW;
+    f->how.mode = mode;
+    f->how.resolve = RESOLVE_BENEATH | RESOLVE_NO_SYMLINKS;
+    unsigned tail = *w->sq_tail;
+    struct io_uring_sqe *sqe = next_sqe(w, &tail);
+    sqe->opcode = IORING_OP_OPENAT2;
+    sqe->fd = w->dir_fd;
+    sqe->addr = (uint64_t)(uintptr_t)f->path;
+    sqe->len = sizeof(f->how);
+    sqe->addr2 = (uint64_t)(uintptr_t)&f->how;
+    sqe->file_index = (unsigned)slot + 1;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = ((uint64_t)slot << 2) | OP_OPEN;
+    if (len > 0) {
+        sqe = next_sqe(w, &tail);
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = slot;
+        sqe->addr = (uint64_t)(uintptr_t)buf;
+        sqe->len = (unsigned)len;
+        sqe->off = 0;
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+        sqe->user_data = ((uint64_t)slot << 2) | OP_WRITE;
+    }
+    sqe = next_sqe(w, &tail);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = (unsigned)slot + 1;
+    sqe->user_data = ((uint64_t)slot << 2) | OP_CLOSE;
+    __atomic_store_n(w->sq_tail, tail, __ATOMIC_RELEASE);
+    w->to_submit += f->pending;
+    w->in_flight++;
+    w->in_flight_bytes += len;
+
+    // 攒够一批再进入内核，减少系统调用
+    if (w->to_submit >= URING_SUBMIT_BATCH && submit(w, 0) != 0) {
+        w->broken = 1;
+        w->error = 1;
+    }
+    return 0;
+}
+
+int uring_writer_drain(Uring_Writer *w)
+{
+    if (!w)
+        return 0;
+    while (w->in_flight > 0)
+        if (wait_one(w) != 0)
+            break;
+    // 无法再与内核通信时，未完成的文件无从得知结果
+    if (w->in_flight > 0)
+        w->error = 1;
+    int ret = w->error ? -1 : 0;
+    w->error = 0;
+    return ret;
+}
+
+void uring_writer_free(Uring_Writer *w)
+{
+    if (!w)
+        return;
+    uring_writer_drain(w);
+    unmap(w);
+    close(w->ring_fd);
+    // 与内核通信失败时仍在途的请求可能还在使用缓冲区，宁可不释放
+    for (int i = 0; i < URING_SLOTS; i++)
+        if (w->files[i].pending > 0)
+            return;
+    free(w);
+}
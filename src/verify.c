@@ -0,0 +1,630 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../include/verify.h"
+#include "../include/hash.h"
+#include "../include/merkle.h"
+#include "../include/manifest.h"
+#include "../include/status.h"
+#include "../include/workers.h"
+#include "../include/cpkg.h"
+#include "../include/help.h"
+#include "../include/lock.h"
+
+/* 单个包文件的校验结果 */
+typedef struct {
+    char path[MAX_PATH_LEN];
+    off_t size;
+    int ok;
+    const char *reason;     // 失败原因
+    CPK_Header header;
+    size_t header_size;     // 0 表示头部无效
+    Merkle_Digest *leaves;  // 头部带 Merkle 根时按叶子分块并行计算
+    size_t leaf_count;
+    int read_failed;
+} Pkg_Check;
+
+/* 一个校验任务：整个包（unit < 0）或带 Merkle 根的包中的一组叶子 */
+typedef struct {
+    size_t pkg;
+    long unit;
+} Check_Unit;
+
+typedef struct {
+    Pkg_Check *checks;
+    const Check_Unit *units;
+} Check_Ctx;
+
+/* 读取并检查头部，带 Merkle 根的包分配叶子数组 */
+static void read_header(void *ctx, size_t i)
+{
+    Pkg_Check *c = &((Pkg_Check *)ctx)[i];
+    c->reason = "cannot open";
+    int fd = open(c->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    struct stat st;
+    CPK_Header *header = &c->header;
+    memset(header, 0, sizeof(*header));
+    size_t header_size = 0;
+    if (fstat(fd, &st) == 0)
+        c->size = st.st_size;
+    if (pread(fd, header->magic, CPKG_MAGIC_LEN, 0) != CPKG_MAGIC_LEN ||
+        (header_size = cpk_header_size(header->magic)) == 0) {
+        c->reason = "bad magic";
+    } else if (pread(fd, header, header_size, 0) != (ssize_t)header_size) {
+        c->reason = "truncated header";
+    } else {
+        header->hash[SHA256_HEX_LEN] = '\0';
+        header->tree_hash[SHA256_HEX_LEN] = '\0';
+        c->header_size = header_size;
+        c->reason = NULL;
+        if (header->tree_hash[0]) {
+            c->leaf_count = merkle_leaf_count(c->size - (off_t)header_size);
+            c->leaves = malloc(c->leaf_count * sizeof(Merkle_Digest));
+            if (!c->leaves)
+                c->reason = "out of memory";
+        }
+    }
+    close(fd);
+}
+
+static void check_unit(void *ctx, size_t i)
+{
+    Check_Ctx *cc = (Check_Ctx *)ctx;
+    const Check_Unit *u = &cc->units[i];
+    Pkg_Check *c = &cc->checks[u->pkg];
+    int fd = open(c->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        c->read_failed = 1;
+        return;
+    }
+    if (u->unit < 0) {
+        char hex[HASH_HEX_LEN + 1];
+        if (hash_fd_hex(fd, (off_t)c->header_size, hex) != 0)
+            c->read_failed = 1;
+        else if (strcmp(hex, c->header.hash) != 0)
+            c->reason = "hash mismatch";
+        else
+            c->ok = 1;
+    } else {
+        size_t first = (size_t)u->unit * MERKLE_UNIT_LEAVES;
+        size_t n = c->leaf_count - first < MERKLE_UNIT_LEAVES ? c->leaf_count - first : MERKLE_UNIT_LEAVES;
+        // 同一个包的各组叶子写入不重叠的位置，只有失败标志可能被多个线程同时写
+        if (merkle_hash_leaves(fd, (off_t)c->header_size, c->size - (off_t)c->header_size,
+                               first, n, c->leaves + first) != 0)
+            __atomic_store_n(&c->read_failed, 1, __ATOMIC_RELAXED);
+    }
+    close(fd);
+}
+
+/* 汇总带 Merkle 根的包 */
+static void finish_tree(Pkg_Check *c)
+{
+    Merkle_Digest root;
+    char hex[HASH_HEX_LEN + 1];
+    if (merkle_root(c->leaves, c->leaf_count, root) != 0) {
+        c->reason = "read error";
+        return;
+    }
+    hex_encode(root, HASH_DIGEST_LEN, hex);
+    if (strcmp(hex, c->header.tree_hash) != 0)
+        c->reason = "tree hash mismatch";
+    else
+        c->ok = 1;
+}
+
+static int cmp_path(const void *a, const void *b)
+{
+    return strcmp(((const Pkg_Check *)a)->path, ((const Pkg_Check *)b)->path);
+}
+
+int verify_packages_dir(const char *dir, int jobs)
+{
+    DIR *d = opendir(dir);
+    if (!d) {
+        cpk_printf(ERROR, "Cannot open directory %s: %s\n", dir, strerror(errno));
+        return 2;
+    }
+    Pkg_Check *checks = NULL;
+    size_t count = 0, cap = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        size_t len = strlen(de->d_name);
+        if (len <= 4 || strcmp(de->d_name + len - 4, ".cpk") != 0)
+            continue;
+        if (count == cap) {
+            size_t ncap = cap ? cap * 2 : 64;
+            Pkg_Check *t = realloc(checks, ncap * sizeof(Pkg_Check));
+            if (!t)
+                break;
+            checks = t;
+            cap = ncap;
+        }
+        memset(&checks[count], 0, sizeof(Pkg_Check));
+        int n = snprintf(checks[count].path, sizeof(checks[count].path), "%s/%s", dir, de->d_name);
+        if (n > 0 && (size_t)n < sizeof(checks[count].path))
+            count++;
+    }
+    closedir(d);
+    if (count == 0) {
+        cpk_printf(WARNING, "No .cpk files in %s\n", dir);
+        free(checks);
+        return 0;
+    }
+    qsort(checks, count, sizeof(Pkg_Check), cmp_path);
+
+    int threads = jobs > 0 ? jobs : worker_cpu_count();
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    run_parallel(count, threads, read_header, checks);
+
+    // 带 Merkle 根的包按 MERKLE_UNIT_LEAVES 个叶子拆分，单个大包也能用上所有核
+    size_t unit_count = 0;
+    for (size_t i = 0; i < count; i++)
+        if (!checks[i].reason)
+            unit_count += checks[i].leaves ? (checks[i].leaf_count + MERKLE_UNIT_LEAVES - 1) / MERKLE_UNIT_LEAVES : 1;
+    Check_Unit *units = malloc((unit_count ? unit_count : 1) * sizeof(Check_Unit));
+    if (!units) {
+        for (size_t i = 0; i < count; i++)
+            free(checks[i].leaves);
+        free(checks);
+        return 2;
+    }
+    size_t u = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (checks[i].reason)
+            continue;
+        if (!checks[i].leaves) {
+            units[u++] = (Check_Unit){ i, -1 };
+            continue;
+        }
+        for (size_t first = 0; first < checks[i].leaf_count; first += MERKLE_UNIT_LEAVES)
+            units[u++] = (Check_Unit){ i, (long)(first / MERKLE_UNIT_LEAVES) };
+    }
+    Check_Ctx ctx = { checks, units };
+    run_parallel(unit_count, threads, check_unit, &ctx);
+    for (size_t i = 0; i < count; i++) {
+        if (checks[i].reason)
+            continue;
+        if (checks[i].read_failed)
+            checks[i].reason = "read error";
+        else if (checks[i].leaves)
+            finish_tree(&checks[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    size_t failed = 0;
+    unsigned long long bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        bytes += (unsigned long long)checks[i].size;
+        if (checks[i].ok) {
+            cpk_text("  OK    %s\n", checks[i].path);
+        } else {
+            cpk_text("  FAIL  %s (%s)\n", checks[i].path, checks[i].reason);
+            failed++;
+        }
+        free(checks[i].leaves);
+    }
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    if (secs <= 0)
+        secs = 1e-9;
+    cpk_printf(failed ? ERROR : SUCCESS, "Verified %zu package(s), %zu failed\n", count, failed);
+    cpk_printf(INFO, "%.1f MiB in %.3f s with %d thread(s): %.2f GB/s\n",
+               bytes / (1024.0 * 1024.0), secs, threads < (int)unit_count ? threads : (int)unit_count,
+               bytes / secs / 1e9);
+    free(units);
+    free(checks);
+    return failed ? 1 : 0;
+}
+
+/* 已安装文件的检查结果 */
+enum {
+    FILE_OK = 0,
+    FILE_MODIFIED,
+    FILE_MISSING,
+    FILE_UNREADABLE,
+};
+
+/* 一个已安装包的检查状态 */
+typedef struct {
+    const char *name;
+    Manifest manifest;
+    int has_manifest;
+    unsigned char *result;      // 每个清单条目的检查结果
+    char **extra;               // 清单之外的文件（相对安装目录）
+    size_t extra_count, extra_cap;
+    int scan_failed;
+} Pkg_Files;
+
+typedef struct {
+    Pkg_Files *pkg;
+    size_t entry;
+} File_Ref;
+
+/* 某个选中的包占用的顶层目录 */
+typedef struct {
+    const char *root;           // 指向清单条目路径，长度为 len
+    size_t len;
+    Pkg_Files *pkg;
+    size_t order;               // 包在选中列表中的位置（同一目录的包按此排序）
+} Root_Ref;
+
+/* 一个顶层目录的扫描结果：多个包共用的目录只遍历一次 */
+typedef struct {
+    char root[MAX_PATH_LEN];
+    const Root_Ref *refs;       // 占用该目录的包
+    size_t ref_count;
+    Manifest found;             // 目录中的文件（相对该目录）
+    unsigned char *extra;       // found 中不属于任何清单的条目
+    int listed;
+    int scan_failed;
+} Root_Scan;
+
+typedef struct {
+    const char **owned;         // 所有已安装包清单中的路径（有序）
+    size_t owned_count;
+    Root_Scan *roots;           // 选中的包占用的各个顶层目录
+    const File_Ref *files;
+    int fast;
+    unsigned long long bytes;   // 实际读取并哈希的字节数
+} Files_Ctx;
+
+static void check_file(void *ctx, size_t i)
+{
+    Files_Ctx *fc = (Files_Ctx *)ctx;
+    const File_Ref *ref = &fc->files[i];
+    const Manifest_Entry *e = &ref->pkg->manifest.entries[ref->entry];
+    unsigned char *result = &ref->pkg->result[ref->entry];
+    char path[INSTALL_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s/%s", cpk_work_dir(), INSTALL_DIR, e->path);
+
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+        *result = errno == ENOENT ? FILE_MISSING : FILE_UNREADABLE;
+        return;
+    }
+    if ((e->type == 'l') != (S_ISLNK(st.st_mode) != 0) || (e->type == 'f' && !S_ISREG(st.st_mode)) ||
+        (long long)st.st_size != e->size) {
+        *result = FILE_MODIFIED;
+        return;
+    }
+    if (fc->fast) {
+        // 快速模式只比较大小与修改时间
+        *result = ((long long)st.st_mtim.tv_sec != e->mtime_sec || st.st_mtim.tv_nsec != e->mtime_nsec)
+                  ? FILE_MODIFIED : FILE_OK;
+        return;
+    }
+    char hex[HASH_HEX_LEN + 1];
+    if (manifest_hash_file(path, e->type, hex) != 0) {
+        *result = FILE_UNREADABLE;
+        return;
+    }
+    __atomic_add_fetch(&fc->bytes, (unsigned long long)st.st_size, __ATOMIC_RELAXED);
+    *result = strcmp(hex, e->sha256) == 0 ? FILE_OK : FILE_MODIFIED;
+}
+
+static int add_extra(Pkg_Files *p, const char *path)
+{
+    if (p->extra_count == p->extra_cap) {
+        size_t ncap = p->extra_cap ? p->extra_cap * 2 : 16;
+        char **t = realloc(p->extra, ncap * sizeof(char *));
+        if (!t)
+            return -1;
+        p->extra = t;
+        p->extra_cap = ncap;
+    }
+    if ((p->extra[p->extra_count] = strdup(path)) == NULL)
+        return -1;
+    p->extra_count++;
+    return 0;
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static int cmp_root(const void *a, const void *b)
+{
+    const Root_Ref *x = a, *y = b;
+    int r = memcmp(x->root, y->root, x->len < y->len ? x->len : y->len);
+    if (r == 0)
+        r = (x->len > y->len) - (x->len < y->len);
+    return r ? r : (x->order > y->order) - (x->order < y->order);
+}
+
+/**
+ * @brief 在一个顶层目录中查找不属于任何清单的文件
+ * @note 清单路径有序，"<root>/" 开头的是其中连续的一段，与同样有序的遍历结果归并比较
+ */
+static void scan_root(void *ctx, size_t i)
+{
+    Files_Ctx *fc = (Files_Ctx *)ctx;
+    Root_Scan *r = &fc->roots[i];
+    char dir[INSTALL_PATH_LEN];
+    snprintf(dir, sizeof(dir), "%s/%s/%s", cpk_work_dir(), INSTALL_DIR, r->root);
+    if (manifest_list(dir, &r->found) != 0) {
+        // 整个目录都不存在时各条目已报告为缺失
+        if (access(dir, F_OK) == 0)
+            r->scan_failed = 1;
+        return;
+    }
+    r->listed = 1;
+    if ((r->extra = calloc(r->found.count + 1, 1)) == NULL) {
+        r->scan_failed = 1;
+        return;
+    }
+    size_t len = strlen(r->root);
+    size_t lo = 0, hi = fc->owned_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = strncmp(fc->owned[mid], r->root, len);
+        if (c < 0 || (c == 0 && (unsigned char)fc->owned[mid][len] < '/'))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    size_t k = lo;
+    for (size_t j = 0; j < r->found.count; j++) {
+        const char *path = r->found.entries[j].path;
+        int c = 1;
+        while (k < fc->owned_count && strncmp(fc->owned[k], r->root, len) == 0 && fc->owned[k][len] == '/' &&
+               (c = strcmp(fc->owned[k] + len + 1, path)) < 0)
+            k++;
+        r->extra[j] = !(k < fc->owned_count && strncmp(fc->owned[k], r->root, len) == 0 &&
+                        fc->owned[k][len] == '/' && c == 0);
+    }
+}
+
+/**
+ * @brief 查找选中的包所占用的顶层目录中清单之外的文件
+ *
+ * 所有清单的路径合并为一张有序表，每个不同的顶层目录只遍历一次，最后依次把
+ * 多余的文件归到占用该目录的包。其他包清单中的文件不算多余（多个包可以共用
+ * 同一个顶层目录）。
+ * @return 0 成功，-1 内存不足
+ */
+static int find_extras(Files_Ctx *fc, Pkg_Files *pkgs, size_t pkg_count,
+                       Pkg_Files **selected, size_t selected_count, int threads)
+{
+    size_t owned_count = 0, ref_count = 0;
+    for (size_t i = 0; i < pkg_count; i++)
+        if (pkgs[i].has_manifest)
+            owned_count += pkgs[i].manifest.count;
+    for (size_t i = 0; i < selected_count; i++)
+        if (selected[i]->has_manifest)
+            ref_count += selected[i]->manifest.count;
+    const char **owned = malloc((owned_count ? owned_count : 1) * sizeof(char *));
+    Root_Ref *refs = malloc((ref_count ? ref_count : 1) * sizeof(Root_Ref));
+    Root_Scan *roots = NULL;
+    int ret = -1;
+    if (!owned || !refs)
+        goto out;
+
+    size_t n = 0;
+    for (size_t i = 0; i < pkg_count; i++)
+        for (size_t k = 0; pkgs[i].has_manifest && k < pkgs[i].manifest.count; k++)
+            owned[n++] = pkgs[i].manifest.entries[k].path;
+    qsort(owned, owned_count, sizeof(char *), cmp_str);
+
+    // 选中的包占用的顶层目录（顶层文件本身就是清单条目）
+    n = 0;
+    for (size_t i = 0; i < selected_count; i++) {
+        const Manifest *m = &selected[i]->manifest;
+        for (size_t k = 0; selected[i]->has_manifest && k < m->count; k++) {
+            const char *slash = strchr(m->entries[k].path, '/');
+            if (!slash)
+                continue;
+            size_t len = (size_t)(slash - m->entries[k].path);
+            // 清单按路径排序，同一顶层目录的条目相邻
+            if (n > 0 && refs[n - 1].pkg == selected[i] && refs[n - 1].len == len &&
+                memcmp(refs[n - 1].root, m->entries[k].path, len) == 0)
+                continue;
+            refs[n++] = (Root_Ref){ m->entries[k].path, len, selected[i], i };
+        }
+    }
+    ref_count = n;
+    qsort(refs, ref_count, sizeof(Root_Ref), cmp_root);
+    if ((roots = calloc(ref_count ? ref_count : 1, sizeof(Root_Scan))) == NULL)
+        goto out;
+    size_t root_count = 0;
+    for (size_t i = 0; i < ref_count; i++) {
+        Root_Scan *r = root_count > 0 ? &roots[root_count - 1] : NULL;
+        if (r && r->refs[0].len == refs[i].len && memcmp(r->root, refs[i].root, refs[i].len) == 0) {
+            r->ref_count++;  // 同一目录的包排在一起
+            continue;
+        }
+        r = &roots[root_count++];
+        snprintf(r->root, sizeof(r->root), "%.*s", (int)refs[i].len, refs[i].root);
+        r->refs = &refs[i];
+        r->ref_count = 1;
+    }
+
+    fc->owned = owned;
+    fc->owned_count = owned_count;
+    fc->roots = roots;
+    run_parallel(root_count, threads, scan_root, fc);
+
+    ret = 0;
+    for (size_t i = 0; i < root_count; i++) {
+        Root_Scan *r = &roots[i];
+        for (size_t k = 0; k < r->ref_count; k++) {
+            Pkg_Files *p = r->refs[k].pkg;
+            if (r->scan_failed)
+                p->scan_failed = 1;
+            for (size_t j = 0; r->extra && j < r->found.count; j++) {
+                char path[INSTALL_PATH_LEN];
+                snprintf(path, sizeof(path), "%s/%s", r->root, r->found.entries[j].path);
+                if (r->extra[j] && add_extra(p, path) != 0)
+                    p->scan_failed = 1;
+            }
+        }
+        free(r->extra);
+        if (r->listed)
+            manifest_free(&r->found);
+    }
+
+out:
+    free(roots);
+    free(refs);
+    free(owned);
+    fc->owned = NULL;
+    fc->roots = NULL;
+    return ret;
+}
+
+static int verify_locked(const char **names, size_t count, int fast, int jobs);
+
+int verify_installed(const char **names, size_t count, int fast, int jobs)
+{
+    // 检查期间持有状态共享锁：其他查询可以同时进行，提交与卸载等待检查结束
+    int lock = lock_state(0);
+    if (lock == -1)
+        return 2;
+    int ret = verify_locked(names, count, fast, jobs);
+    lock_release(lock);
+    return ret;
+}
+
+static int verify_locked(const char **names, size_t count, int fast, int jobs)
+{
+    Installed_Pkg *installed = NULL;
+    size_t installed_count = 0;
+    if (status_list(&installed, &installed_count) != 0) {
+        cpk_printf(ERROR, "Failed to read installed package records\n");
+        return 2;
+    }
+    for (size_t i = 0; i < count; i++) {
+        Installed_Pkg tmp;
+        if (status_read(names[i], &tmp) != 0) {
+            cpk_printf(ERROR, "Package '%s' is not installed.\n", names[i]);
+            free(installed);
+            return 2;
+        }
+    }
+    if (count == 0 && installed_count == 0) {
+        cpk_printf(WARNING, "No packages are installed\n");
+        free(installed);
+        return 0;
+    }
+
+    // 所有已安装包的清单都要载入：判断多余文件时需要知道文件是否属于其他包
+    Pkg_Files *pkgs = calloc(installed_count ? installed_count : 1, sizeof(Pkg_Files));
+    if (!pkgs) {
+        free(installed);
+        return 2;
+    }
+    int ret = 0;
+    size_t file_count = 0;
+    for (size_t i = 0; i < installed_count; i++) {
+        Pkg_Files *p = &pkgs[i];
+        p->name = installed[i].name;
+        int r = manifest_read(p->name, &p->manifest);
+        if (r < 0) {
+            cpk_printf(ERROR, "File manifest of %s is corrupt\n", p->name);
+            ret = 1;
+        }
+        p->has_manifest = (r == 0);
+        if (p->has_manifest && (p->result = calloc(p->manifest.count + 1, 1)) == NULL) {
+            manifest_free(&p->manifest);
+            p->has_manifest = 0;
+            ret = 2;
+        }
+    }
+
+    // 选中的包：指定包名时只检查这些包
+    Pkg_Files **selected = calloc(installed_count ? installed_count : 1, sizeof(Pkg_Files *));
+    size_t selected_count = 0;
+    for (size_t i = 0; selected && i < installed_count; i++) {
+        int wanted = (count == 0);
+        for (size_t k = 0; k < count && !wanted; k++)
+            wanted = strcmp(names[k], pkgs[i].name) == 0;
+        if (!wanted)
+            continue;
+        selected[selected_count++] = &pkgs[i];
+        if (!pkgs[i].has_manifest)
+            cpk_printf(WARNING, "%s has no file manifest (installed by an older cpkg), skipping\n", pkgs[i].name);
+        else
+            file_count += pkgs[i].manifest.count;
+    }
+    File_Ref *files = malloc((file_count ? file_count : 1) * sizeof(File_Ref));
+    if (!selected || !files) {
+        ret = 2;
+        goto out;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < selected_count; i++)
+        for (size_t k = 0; selected[i]->has_manifest && k < selected[i]->manifest.count; k++)
+            files[n++] = (File_Ref){ selected[i], k };
+
+    // 小文件以 I/O 延迟为主：线程数多于核数，让存储设备上始终有足够多的并发请求
+    int threads = jobs > 0 ? jobs : worker_cpu_count();
+    if (jobs <= 0 && threads < VERIFY_MIN_THREADS)
+        threads = VERIFY_MIN_THREADS;
+    Files_Ctx fc = { NULL, 0, NULL, files, fast, 0 };
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    run_parallel(file_count, threads, check_file, &fc);
+    if (find_extras(&fc, pkgs, installed_count, selected, selected_count, threads) != 0) {
+        ret = 2;
+        goto out;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    size_t problems = 0;
+    static const char *const labels[] = { "OK", "MODIFIED", "MISSING", "UNREADABLE" };
+    for (size_t i = 0; i < selected_count; i++) {
+        Pkg_Files *p = selected[i];
+        if (!p->has_manifest)
+            continue;
+        size_t bad = p->extra_count;
+        for (size_t k = 0; k < p->manifest.count; k++) {
+            if (p->result[k] == FILE_OK)
+                continue;
+            cpk_text("  %-10s %s\n", labels[p->result[k]], p->manifest.entries[k].path);
+            bad++;
+        }
+        for (size_t k = 0; k < p->extra_count; k++)
+            cpk_text("  %-10s %s\n", "EXTRA", p->extra[k]);
+        if (p->scan_failed)
+            cpk_printf(WARNING, "Could not scan all directories of %s for extra files\n", p->name);
+        if (bad > 0)
+            cpk_printf(ERROR, "%s: %zu problem(s) in %zu recorded file(s)\n", p->name, bad, p->manifest.count);
+        else
+            cpk_text("  %-10s %s (%zu files)\n", "OK", p->name, p->manifest.count);
+        problems += bad;
+    }
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    if (secs <= 0)
+        secs = 1e-9;
+    cpk_printf(problems ? ERROR : SUCCESS, "Verified %zu file(s) in %zu package(s), %zu problem(s)\n",
+               file_count, selected_count, problems);
+    if (fast)
+        cpk_printf(INFO, "%.3f s with %d thread(s), size and mtime only\n", secs, threads);
+    else
+        cpk_printf(INFO, "%.1f MiB in %.3f s with %d thread(s): %.0f files/s, %.2f GB/s\n",
+                   fc.bytes / (1024.0 * 1024.0), secs, threads, file_count / secs, fc.bytes / secs / 1e9);
+    if (problems && ret == 0)
+        ret = 1;
+
+out:
+    for (size_t i = 0; i < installed_count; i++) {
+        for (size_t k = 0; k < pkgs[i].extra_count; k++)
+            free(pkgs[i].extra[k]);
+        free(pkgs[i].extra);
+        free(pkgs[i].result);
+        manifest_free(&pkgs[i].manifest);
+    }
+    free(pkgs);
+    free(selected);
+    free(files);
+    free(installed);
+    return ret;
+}
@@ -0,0 +1,113 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/version.h"
+
+/* 非数字部分的字符权重：'~' 最小，其次为串结束，字母小于其他符号 */
+static int char_order(int c)
+{
+    if (isdigit(c))
+        return 0;
+    if (isalpha(c))
+        return c;
+    if (c == '~')
+        return -1;
+    if (c)
+        return c + 256;
+    return 0;
+}
+
+/* 比较 [a, a_end) 与 [b, b_end)（dpkg 的 verrevcmp） */
+static int part_compare(const char *a, const char *a_end, const char *b, const char *b_end)
+{
+    while (a < a_end || b < b_end) {
+        int first_diff = 0;
+        while ((a < a_end && !isdigit((unsigned char)*a)) || (b < b_end && !isdigit((unsigned char)*b))) {
+            int ac = a < a_end ? char_order((unsigned char)*a) : 0;
+            int bc = b < b_end ? char_order((unsigned char)*b) : 0;
+            if (ac != bc)
+                return ac - bc;
+            if (a < a_end) a++;
+            if (b < b_end) b++;
+        }
+        while (a < a_end && *a == '0')
+            a++;
+        while (b < b_end && *b == '0')
+            b++;
+        while (a < a_end && isdigit((unsigned char)*a) && b < b_end && isdigit((unsigned char)*b)) {
+            if (!first_diff)
+                first_diff = *a - *b;
+            a++;
+            b++;
+        }
+        if (a < a_end && isdigit((unsigned char)*a))
+            return 1;
+        if (b < b_end && isdigit((unsigned char)*b))
+            return -1;
+        if (first_diff)
+            return first_diff;
+    }
+    return 0;
+}
+
+/* 版本号的各组成部分（均为指向原串的区间） */
+typedef struct {
+    long epoch;
+    const char *up, *up_end;    // upstream
+    const char *pre, *pre_end;  // semver 预发布标记（空区间表示正式版）
+    const char *rev, *rev_end;  // revision
+} Version_Parts;
+
+/* 拆分版本号：epoch、upstream、预发布标记与 revision */
+static void split_version(const char *v, Version_Parts *out)
+{
+    const char *colon = strchr(v, ':');
+    out->epoch = 0;
+    if (colon) {
+        const char *p = v;
+        while (p < colon && isdigit((unsigned char)*p))
+            p++;
+        if (p == colon && colon > v) {
+            out->epoch = strtol(v, NULL, 10);
+            v = colon + 1;
+        }
+    }
+    const char *end = v + strlen(v);
+    const char *dash = strrchr(v, '-');
+    out->up = v;
+    out->up_end = end;
+    out->pre = out->pre_end = end;
+    out->rev = out->rev_end = end;
+    if (!dash)
+        return;
+    out->up_end = dash;
+    if (isalpha((unsigned char)dash[1])) {
+        // "1.0.0-rc.1"：以字母开头的后缀按 semver 视为预发布版本
+        out->pre = dash + 1;
+        out->pre_end = end;
+    } else {
+        out->rev = dash + 1;
+    }
+}
+
+int version_compare(const char *a, const char *b)
+{
+    if (!a) a = "";
+    if (!b) b = "";
+    Version_Parts va, vb;
+    split_version(a, &va);
+    split_version(b, &vb);
+    if (va.epoch != vb.epoch)
+        return va.epoch < vb.epoch ? -1 : 1;
+    int c = part_compare(va.up, va.up_end, vb.up, vb.up_end);
+    if (c != 0)
+        return c;
+    // 预发布版本排在对应的正式版之前
+    int pa = va.pre < va.pre_end, pb = vb.pre < vb.pre_end;
+    if (pa != pb)
+        return pa ? -1 : 1;
+    c = part_compare(va.pre, va.pre_end, vb.pre, vb.pre_end);
+    if (c != 0)
+        return c;
+    return part_compare(va.rev, va.rev_end, vb.rev, vb.rev_end);
+}
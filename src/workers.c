@@ -0,0 +1,52 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../include/workers.h"
+#include "../include/context.h"
+
+typedef struct {
+    size_t count;
+    size_t next;              // 下一个待领取的任务（原子访问）
+    void (*fn)(void *ctx, size_t i);
+    void *ctx;
+    const Cpk_Context *context;   // 调用线程的上下文，工作线程继承
+} Work_Queue;
+
+static void *worker_main(void *arg)
+{
+    Work_Queue *q = (Work_Queue *)arg;
+    cpk_context_set(q->context);
+    size_t i;
+    while ((i = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED)) < q->count)
+        q->fn(q->ctx, i);
+    return NULL;
+}
+
+int worker_cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+void run_parallel(size_t count, int threads, void (*fn)(void *ctx, size_t i), void *ctx)
+{
+    if (count == 0)
+        return;
+    if (threads <= 0)
+        threads = worker_cpu_count();
+    if ((size_t)threads > count)
+        threads = (int)count;
+
+    Work_Queue q = { count, 0, fn, ctx, cpk_context() };
+    pthread_t *tids = threads > 1 ? calloc(threads - 1, sizeof(pthread_t)) : NULL;
+    int started = 0;
+    for (int t = 0; tids && t < threads - 1; t++) {
+        if (pthread_create(&tids[t], NULL, worker_main, &q) != 0)
+            break;
+        started++;
+    }
+    worker_main(&q);  // 调用线程也参与执行
+    for (int t = 0; t < started; t++)
+        pthread_join(tids[t], NULL);
+    free(tids);
+}
@@ -0,0 +1,278 @@
+/* test_extract.c - 解压不能离开 staging 目录（make test）
+ *
+ * 构造带有指向外部的符号链接、随后经过该链接写入文件的包：
+ *   demo/esc -> <工作目录>/outside
+ *   demo/esc/pwned
+ * 分别以索引哈希错误的远程安装、本地安装与直接解压的方式处理，
+ * 每种方式都必须失败，且外部目录中不能出现任何文件。
+ * 另外检查同名条目的替换与包内的相对链接。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <archive.h>
+#include <archive_entry.h>
+#include "../include/cpkg.h"
+#include "../include/repo.h"
+
+#define TEST_PATH_LEN (MAX_PATH_LEN * 2)
+
+typedef struct {
+    char type;              // 'd' 目录，'f' 文件，'l' 符号链接
+    const char *path;
+    const char *data;       // 文件内容或链接目标
+} Test_Entry;
+
+static int failures;
+
+#define CHECK(cond, what) do { \
+        if (cond) { \
+            printf("ok - %s\n", what); \
+        } else { \
+            printf("FAIL - %s\n", what); \
+            failures++; \
+        } \
+    } while (0)
+
+/* 生成 tar.gz 载荷，返回 malloc 的数据 */
+static unsigned char *make_payload(const Test_Entry *entries, size_t count, size_t *len)
+{
+    size_t cap = 64 * 1024;
+    unsigned char *buf = malloc(cap);
+    struct archive *a = archive_write_new();
+    if (!buf || !a) {
+        free(buf);
+        archive_write_free(a);
+        return NULL;
+    }
+    archive_write_add_filter_gzip(a);
+    archive_write_set_format_pax_restricted(a);
+    archive_write_open_memory(a, buf, cap, len);
+    for (size_t i = 0; i < count; i++) {
+        struct archive_entry *e = archive_entry_new();
+        archive_entry_set_pathname(e, entries[i].path);
+        archive_entry_set_mtime(e, 1700000000, 0);
+        if (entries[i].type == 'd') {
+            archive_entry_set_filetype(e, AE_IFDIR);
+            archive_entry_set_perm(e, 0755);
+        } else if (entries[i].type == 'l') {
+            archive_entry_set_filetype(e, AE_IFLNK);
+            archive_entry_set_perm(e, 0777);
+            archive_entry_set_symlink(e, entries[i].data);
+        } else {
+            archive_entry_set_filetype(e, AE_IFREG);
+            archive_entry_set_perm(e, 0644);
+            archive_entry_set_size(e, (la_int64_t)strlen(entries[i].data));
+        }
+        archive_write_header(a, e);
+        if (entries[i].type == 'f')
+            archive_write_data(a, entries[i].data, strlen(entries[i].data));
+        archive_entry_free(e);
+    }
+    archive_write_close(a);
+    archive_write_free(a);
+    return buf;
+}
+
+/**
+ * @brief 写出 .cpk（第 2 版头部 + 载荷），头部中的哈希与载荷一致
+ * @param file_hash 输出整个文件的哈希（用于索引）
+ */
+static int write_package(const char *path, const char *name, const Test_Entry *entries, size_t count,
+                         char file_hash[SHA256_HEX_LEN + 1])
+{
+    size_t payload_len = 0;
+    unsigned char *payload = make_payload(entries, count, &payload_len);
+    if (!payload)
+        return -1;
+    size_t total = sizeof(CPK_Header) + payload_len;
+    unsigned char *file = calloc(1, total);
+    char *payload_hash = sha256_mem(payload, payload_len);
+    if (!file || !payload_hash) {
+        free(payload);
+        free(file);
+        free(payload_hash);
+        return -1;
+    }
+    CPK_Header *h = (CPK_Header *)file;
+    memcpy(h->magic, CPKG_MAGIC_V2, CPKG_MAGIC_LEN);
+    memcpy(h->hash, payload_hash, SHA256_HEX_LEN);
+    snprintf(h->name, sizeof(h->name), "%s", name);
+    snprintf(h->version, sizeof(h->version), "1.0");
+    memcpy(file + sizeof(CPK_Header), payload, payload_len);
+    char *hash = sha256_mem(file, total);
+    FILE *fp = fopen(path, "wb");
+    int ret = hash && fp && fwrite(file, 1, total, fp) == total ? 0 : -1;
+    if (fp && fclose(fp) != 0)
+        ret = -1;
+    if (hash)
+        memcpy(file_hash, hash, SHA256_HEX_LEN + 1);
+    free(hash);
+    free(payload_hash);
+    free(payload);
+    free(file);
+    return ret;
+}
+
+/* 目录是否为空（不存在也算空） */
+static int dir_empty(const char *path)
+{
+    DIR *dir = opendir(path);
+    if (!dir)
+        return errno == ENOENT;
+    int empty = 1;
+    struct dirent *d;
+    while (empty && (d = readdir(dir)) != NULL)
+        empty = strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0;
+    closedir(dir);
+    return empty;
+}
+
+/* 文件内容是否为 text */
+static int file_is(const char *path, const char *text)
+{
+    char buf[256];
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return 0;
+    size_t n = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    return n == strlen(text) && memcmp(buf, text, n) == 0;
+}
+
+/* 把 entries 生成的载荷解压到新建的 dest */
+static int extract_entries(const Test_Entry *entries, size_t count, const char *dest)
+{
+    size_t len = 0;
+    unsigned char *payload = make_payload(entries, count, &len);
+    FILE *fp = payload ? fmemopen(payload, len, "rb") : NULL;
+    int ret = fp && mkdir(dest, 0755) == 0 ? extract_archive(fp, dest) : -1;
+    if (fp)
+        fclose(fp);
+    free(payload);
+    return ret;
+}
+
+static int write_text(const char *path, const char *text)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+    int ret = fputs(text, fp) >= 0 ? 0 : -1;
+    if (fclose(fp) != 0)
+        ret = -1;
+    return ret;
+}
+
+int main(void)
+{
+    char work[MAX_PATH_LEN];
+    snprintf(work, sizeof(work), "/tmp/cpkg-test-XXXXXX");
+    if (!mkdtemp(work) || chdir(work) != 0) {
+        perror("test_extract: mkdtemp");
+        return 1;
+    }
+    setenv("CPKG_ALLOW_USER_INSTALL", "1", 1);
+    setenv("CPKG_NO_DAEMON", "1", 1);
+
+    char outside[TEST_PATH_LEN], staging[TEST_PATH_LEN], index_url[TEST_PATH_LEN];
+    snprintf(outside, sizeof(outside), "%s/outside", work);
+    snprintf(staging, sizeof(staging), "%s/%s/%s", work, WORK_DIR_NAME, STAGING_DIR);
+    snprintf(index_url, sizeof(index_url), "file://%s/index.txt", work);
+    setenv("CPKG_INDEX_URL", index_url, 1);
+    if (mkdir(outside, 0755) != 0) {
+        perror("test_extract: mkdir");
+        return 1;
+    }
+
+    // 经过指向外部的链接写入文件
+    const Test_Entry escape[] = {
+        { 'd', "demo/", NULL },
+        { 'l', "demo/esc", outside },
+        { 'f', "demo/esc/pwned", "pwned\n" },
+    };
+    // 相对链接先借助另一个链接回到目标目录，再用 ".." 离开
+    const Test_Entry chained[] = {
+        { 'd', "demo/", NULL },
+        { 'l', "demo/up", ".." },
+        { 'l', "demo/esc", "up/../../outside" },
+        { 'f', "demo/esc/pwned", "pwned\n" },
+    };
+    // 包内的相对链接
+    const Test_Entry normal[] = {
+        { 'd', "demo/", NULL },
+        { 'd', "demo/lib/", NULL },
+        { 'f', "demo/lib/libdemo.so.1", "elf\n" },
+        { 'l', "demo/lib/libdemo.so", "libdemo.so.1" },
+        { 'l', "demo/include", "../demo/lib" },
+    };
+    char hash[SHA256_HEX_LEN + 1], index[TEST_PATH_LEN * 2];
+    if (write_package("escape.cpk", "demo", escape, 3, hash) != 0 ||
+        write_package("chained.cpk", "demo", chained, 4, hash) != 0 ||
+        write_package("normal.cpk", "demo", normal, 5, hash) != 0) {
+        fprintf(stderr, "test_extract: failed to build test packages\n");
+        return 1;
+    }
+
+    // 1. 索引哈希错误：下载时边校验边解压，哈希检查失败之前也不能写到外部
+    snprintf(index, sizeof(index), "demo|1.0|file://%s/escape.cpk|%064d\n", work, 0);
+    if (write_text("index.txt", index) != 0)
+        return 1;
+    const char *names[] = { "demo" };
+    CHECK(repo_install_packages(names, 1, 1) != 0, "install with wrong index hash fails");
+    CHECK(dir_empty(outside), "install with wrong index hash writes nothing outside staging");
+    CHECK(dir_empty(staging), "failed install leaves staging empty");
+
+    // 2. 哈希正确的本地包同样被拒绝
+    CHECK(install_package("escape.cpk") != 0, "local install of escaping symlink fails");
+    CHECK(dir_empty(outside), "local install writes nothing outside staging");
+    CHECK(install_package("chained.cpk") != 0, "local install of chained relative symlinks fails");
+    CHECK(dir_empty(outside), "chained symlinks write nothing outside staging");
+
+    // 3. 直接解压（快速路径与 archive_write_disk 都要检查）
+    CHECK(extract_entries(escape, 3, "extract") != 0, "extract_archive refuses escaping symlink");
+    CHECK(dir_empty(outside), "extract_archive writes nothing outside its destination");
+
+    // 4. 同名条目以包中靠后的为准，io_uring 写入时也一样（先写入的链可能后完成）
+    const Test_Entry replaced[] = {
+        { 'd', "r/", NULL },
+        { 'f', "r/dup", "old\n" },
+        { 'f', "r/other", "other\n" },
+        { 'f', "r/dup", "new\n" },
+        { 'd', "r/dir/", NULL },
+        { 'f', "r/dir", "file over empty dir\n" },
+    };
+    const char *modes[] = { "0", "1" };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        char dest[32], what[96];
+        setenv("CPKG_IO_URING", modes[i], 1);
+        snprintf(dest, sizeof(dest), "replaced-%s", modes[i]);
+        snprintf(what, sizeof(what), "CPKG_IO_URING=%s: later entries replace earlier ones", modes[i]);
+        CHECK(extract_entries(replaced, 6, dest) == 0, what);
+        CHECK(chdir(dest) == 0 && file_is("r/dup", "new\n") && file_is("r/dir", "file over empty dir\n") &&
+              chdir(work) == 0, what);
+    }
+    unsetenv("CPKG_IO_URING");
+
+    // 5. 包内的相对链接不受影响
+    char link[TEST_PATH_LEN], target[MAX_PATH_LEN];
+    snprintf(link, sizeof(link), "%s/%s/%s/demo/lib/libdemo.so", work, WORK_DIR_NAME, INSTALL_DIR);
+    ssize_t n;
+    CHECK(install_package("normal.cpk") == 0, "package with internal symlinks installs");
+    n = readlink(link, target, sizeof(target) - 1);
+    CHECK(n == (ssize_t)strlen("libdemo.so.1") && memcmp(target, "libdemo.so.1", (size_t)n) == 0,
+          "internal symlink is preserved");
+
+    if (chdir("/") == 0)
+        rm_rf(work);
+    if (failures) {
+        printf("test_extract: %d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_extract: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,154 @@
+/* test_fileglob.c - 文件名模式匹配（make test）
+ *
+ * 在临时目录中建立文件树，检查 "**" 匹配零个或多个目录、隐藏文件与目录、
+ * "!" 排除（同组内后出现的模式优先）、按前缀只遍历需要的目录、结果去重与分组、
+ * 字面模式原样保留、不进入指向目录的符号链接，以及开头的 "~" 展开。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/cpkg.h"
+#include "../include/fileglob.h"
+
+typedef struct {
+    int group;
+    const char *pattern;
+} Test_Pattern;
+
+static int failures;
+
+#define CHECK(cond, what) do { \
+        if (cond) { \
+            printf("ok - %s\n", what); \
+        } else { \
+            printf("FAIL - %s\n", what); \
+            failures++; \
+        } \
+    } while (0)
+
+static const char *const tree[] = {
+    "src/x.h",
+    "src/x.c",
+    "src/.hidden.h",
+    "src/a/x.h",
+    "src/a/keep.h",
+    "src/a/b/y.h",
+    "src/.git/z.h",
+    "src/b/x.h",
+    "lib/libdemo.a",
+    "lib/libdemo.so",
+    "other/w.h",
+    "home/h.h",
+};
+
+static int make_tree(void)
+{
+    for (size_t i = 0; i < sizeof(tree) / sizeof(tree[0]); i++) {
+        char dir[256];
+        snprintf(dir, sizeof(dir), "%s", tree[i]);
+        *strrchr(dir, '/') = '\0';
+        FILE *fp = NULL;
+        if (mkdir_p(dir, 0755) != 0 || !(fp = fopen(tree[i], "w")))
+            return -1;
+        fclose(fp);
+    }
+    // 指向目录的符号链接不进入
+    return symlink("a", "src/link");
+}
+
+/**
+ * @brief 匹配一组模式，把 group 组的结果以逗号连接写入 out
+ * @return 0 成功，-1 添加或匹配失败
+ */
+static int run(const Test_Pattern *pats, size_t count, int group, char *out, size_t size)
+{
+    File_Glob *g = fileglob_new();
+    int ret = g ? 0 : -1;
+    for (size_t i = 0; ret == 0 && i < count; i++)
+        ret = fileglob_add(g, pats[i].group, pats[i].pattern);
+    if (ret == 0)
+        ret = fileglob_run(g);
+    out[0] = '\0';
+    size_t n = 0, off = 0;
+    const char *const *files = ret == 0 ? fileglob_results(g, group, &n) : NULL;
+    for (size_t i = 0; i < n && off < size; i++)
+        off += (size_t)snprintf(out + off, size - off, "%s%s", i ? "," : "", files[i]);
+    fileglob_free(g);
+    return ret;
+}
+
+/* 匹配并与期望结果比较 */
+static void expect(const Test_Pattern *pats, size_t count, int group, const char *want, const char *what)
+{
+    char got[1024];
+    int ok = run(pats, count, group, got, sizeof(got)) == 0 && strcmp(got, want) == 0;
+    CHECK(ok, what);
+    if (!ok)
+        printf("#   want: %s\n#    got: %s\n", want, got);
+}
+
+int main(void)
+{
+    char work[MAX_PATH_LEN];
+    snprintf(work, sizeof(work), "/tmp/cpkg-test-XXXXXX");
+    if (!mkdtemp(work) || chdir(work) != 0 || make_tree() != 0) {
+        perror("test_fileglob: setup");
+        return 1;
+    }
+
+    const Test_Pattern star[] = { { 0, "src/*.h" } };
+    expect(star, 1, 0, "src/x.h", "'*' stays within one directory and skips dot files");
+
+    const Test_Pattern globstar[] = { { 0, "src/**/*.h" } };
+    expect(globstar, 1, 0, "src/a/b/y.h,src/a/keep.h,src/a/x.h,src/b/x.h,src/x.h",
+           "'**' matches zero or more directories, not hidden ones or symlinked dirs");
+
+    const Test_Pattern tail[] = { { 0, "src/**" } };
+    expect(tail, 1, 0, "src/a/b/y.h,src/a/keep.h,src/a/x.h,src/b/x.h,src/x.c,src/x.h",
+           "trailing '**' matches every file below the prefix");
+
+    const Test_Pattern negate[] = { { 0, "src/**/*.h" }, { 0, "!src/a/**" }, { 0, "src/a/keep.h" } };
+    expect(negate, 3, 0, "src/a/keep.h,src/b/x.h,src/x.h", "later patterns win over earlier negations");
+
+    const Test_Pattern negate_last[] = { { 0, "src/a/keep.h" }, { 0, "src/**/*.h" }, { 0, "!src/a/*" } };
+    expect(negate_last, 3, 0, "src/a/b/y.h,src/b/x.h,src/x.h", "a trailing negation removes literal matches too");
+
+    const Test_Pattern prefix[] = { { 0, "src/a/*.h" } };
+    expect(prefix, 1, 0, "src/a/keep.h,src/a/x.h", "the literal prefix limits the walk");
+
+    const Test_Pattern dedup[] = { { 0, "src/*.h" }, { 0, "src/**/x.h" }, { 0, "src/x.h" }, { 0, "src/a/*.h" } };
+    expect(dedup, 4, 0, "src/a/keep.h,src/a/x.h,src/b/x.h,src/x.h", "overlapping patterns are deduplicated");
+
+    const Test_Pattern groups[] = { { 0, "src/*.h" }, { 1, "lib/*.a" }, { 1, "lib/*.so" }, { 0, "!lib/*" } };
+    expect(groups, 4, 0, "src/x.h", "group 0 keeps its own results");
+    expect(groups, 4, 1, "lib/libdemo.a,lib/libdemo.so", "negations only apply within their group");
+
+    const Test_Pattern literal[] = { { 0, "src/*.h" }, { 0, "missing/file.h" } };
+    expect(literal, 2, 0, "missing/file.h,src/x.h", "literal paths are kept for the caller to report");
+
+    const Test_Pattern nomatch[] = { { 0, "nowhere/*.h" } };
+    expect(nomatch, 1, 0, "", "a pattern under a missing directory matches nothing");
+
+    char want[MAX_PATH_LEN + 16];
+    setenv("HOME", work, 1);
+    snprintf(want, sizeof(want), "%s/home/h.h", work);
+    const Test_Pattern tilde[] = { { 0, "~/home/*.h" } };
+    expect(tilde, 1, 0, want, "leading '~' expands to $HOME");
+    const Test_Pattern tilde_user[] = { { 0, "~root/*" } };
+    char got[1024];
+    CHECK(run(tilde_user, 1, 0, got, sizeof(got)) == 0, "'~user' expands to the user's home directory");
+    File_Glob *g = fileglob_new();
+    CHECK(g && fileglob_add(g, 0, "~no-such-user-cpkg/*.h") != 0, "unknown '~user' is rejected");
+    fileglob_free(g);
+
+    if (chdir("/") == 0)
+        rm_rf(work);
+    if (failures) {
+        printf("test_fileglob: %d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_fileglob: all checks passed\n");
+    return 0;
+}
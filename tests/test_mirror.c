@@ -0,0 +1,291 @@
+/* test_mirror.c - 在本机回环地址上测试镜像测速排序与故障切换（make test）
+ *
+ * 启动四个镜像：
+ *   fast     立即响应，但包文件每次只发送三分之一就断开连接（续传也完成不了）
+ *   slow     每个响应前等待一段时间，内容完整，支持 Range
+ *   stalled  只监听，连接建立后从不响应（测速超时）
+ *   refused  端口已关闭（连接被拒绝）
+ * 检查排序为 fast、slow，其余两个不可用；下载从 fast 开始，
+ * 中途断开后换到 slow 并从断点续传，最终哈希正确。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../include/cpkg.h"
+#include "../include/mirror.h"
+#include "../include/repo.h"
+
+#define TEST_PKG_SIZE    (1024 * 1024)
+#define TEST_SLOW_MS     150             // slow 镜像每个响应前的等待
+#define TEST_ETAG        "\"demo-1\""    // 两个镜像上的同一文件，校验器相同才能续传
+
+typedef struct {
+    int fd;                 // 监听套接字
+    int port;
+    int delay_ms;           // 每个响应前的等待
+    size_t cut;             // 包文件只发送这么多字节后断开（0 表示完整发送）
+    int serve;              // 是否处理连接（stalled 只监听不接受）
+    int pkg_requests;       // 包文件请求数
+    long range_start;       // 最近一次包文件请求的 Range 起点（-1 表示没有 Range）
+    pthread_t thread;
+} Test_Server;
+
+static unsigned char *pkg_data;
+static char index_text[256];
+static int failures;
+
+#define CHECK(cond, what) do { \
+        if (cond) { \
+            printf("ok - %s\n", what); \
+        } else { \
+            printf("FAIL - %s\n", what); \
+            failures++; \
+        } \
+    } while (0)
+
+/* 在 127.0.0.1 的随机端口上监听，返回套接字 */
+static int listen_local(int *port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &len) != 0) {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static int send_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* 处理一个请求（每个连接一个请求，响应后关闭） */
+static void serve_one(Test_Server *s, int fd)
+{
+    char req[4096];
+    size_t got = 0;
+    while (got < sizeof(req) - 1) {
+        ssize_t n = recv(fd, req + got, sizeof(req) - 1 - got, 0);
+        if (n <= 0)
+            return;
+        got += (size_t)n;
+        req[got] = '\0';
+        if (strstr(req, "\r\n\r\n"))
+            break;
+    }
+    char path[256] = "";
+    if (sscanf(req, "GET %255s", path) != 1)
+        return;
+    long start = -1, end = -1;
+    for (const char *line = strstr(req, "\r\n"); line; line = strstr(line + 2, "\r\n"))
+        if (strncasecmp(line + 2, "Range: bytes=", 13) == 0 &&
+            sscanf(line + 15, "%ld-%ld", &start, &end) < 1)
+            start = -1;
+
+    const unsigned char *body = NULL;
+    size_t size = 0;
+    if (strcmp(path, "/index.txt") == 0) {
+        body = (const unsigned char *)index_text;
+        size = strlen(index_text);
+    } else if (strcmp(path, "/demo-1.0.cpk") == 0) {
+        body = pkg_data;
+        size = TEST_PKG_SIZE;
+        __atomic_add_fetch(&s->pkg_requests, 1, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&s->range_start, start, __ATOMIC_SEQ_CST);
+    }
+    if (s->delay_ms > 0)
+        usleep((useconds_t)s->delay_ms * 1000);
+
+    char head[512];
+    if (!body) {
+        snprintf(head, sizeof(head), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        send_all(fd, head, strlen(head));
+        return;
+    }
+    size_t from = 0, to = size;  // [from, to)
+    if (start >= 0 && (size_t)start < size) {
+        from = (size_t)start;
+        if (end >= start && (size_t)end < size)
+            to = (size_t)end + 1;
+        snprintf(head, sizeof(head),
+                 "HTTP/1.1 206 Partial Content\r\nContent-Length: %zu\r\nContent-Range: bytes %zu-%zu/%zu\r\n"
+                 "ETag: " TEST_ETAG "\r\nAccept-Ranges: bytes\r\nConnection: close\r\n\r\n",
+                 to - from, from, to - 1, size);
+    } else {
+        snprintf(head, sizeof(head),
+                 "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\nETag: " TEST_ETAG "\r\n"
+                 "Accept-Ranges: bytes\r\nConnection: close\r\n\r\n", size);
+    }
+    size_t len = to - from;
+    if (body == pkg_data && s->cut > 0 && s->cut < len)
+        len = s->cut;  // 声明完整长度，只发送一部分
+    if (send_all(fd, head, strlen(head)) == 0)
+        send_all(fd, body + from, len);
+}
+
+static void *server_main(void *arg)
+{
+    Test_Server *s = arg;
+    for (;;) {
+        int fd = accept(s->fd, NULL, NULL);
+        if (fd < 0)
+            break;  // 监听套接字已被 shutdown
+        serve_one(s, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static int server_start(Test_Server *s, int delay_ms, size_t cut, int serve)
+{
+    memset(s, 0, sizeof(*s));
+    s->delay_ms = delay_ms;
+    s->cut = cut;
+    s->serve = serve;
+    s->range_start = -1;
+    if ((s->fd = listen_local(&s->port)) < 0)
+        return -1;
+    if (serve && pthread_create(&s->thread, NULL, server_main, s) != 0) {
+        close(s->fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void server_stop(Test_Server *s)
+{
+    shutdown(s->fd, SHUT_RDWR);
+    if (s->serve)
+        pthread_join(s->thread, NULL);
+    close(s->fd);
+}
+
+/* 在排序后的镜像列表中的位置，找不到返回 -1 */
+static int mirror_rank(const Mirror_List *list, int port)
+{
+    char base[64];
+    snprintf(base, sizeof(base), "http://127.0.0.1:%d", port);
+    for (size_t i = 0; i < list->count; i++)
+        if (strcmp(list->mirrors[i].base, base) == 0)
+            return (int)i;
+    return -1;
+}
+
+/* 下载结果是否与包内容一致 */
+static int file_matches(const char *path)
+{
+    unsigned char *buf = malloc(TEST_PKG_SIZE + 1);
+    FILE *fp = fopen(path, "rb");
+    size_t n = buf && fp ? fread(buf, 1, TEST_PKG_SIZE + 1, fp) : 0;
+    int same = n == TEST_PKG_SIZE && memcmp(buf, pkg_data, TEST_PKG_SIZE) == 0;
+    if (fp)
+        fclose(fp);
+    free(buf);
+    return same;
+}
+
+int main(void)
+{
+    char work[MAX_PATH_LEN];
+    snprintf(work, sizeof(work), "/tmp/cpkg-test-XXXXXX");
+    if (!mkdtemp(work) || chdir(work) != 0) {
+        perror("test_mirror: mkdtemp");
+        return 1;
+    }
+    setenv("CPKG_ALLOW_USER_INSTALL", "1", 1);
+    setenv("CPKG_NO_DAEMON", "1", 1);
+
+    // 包内容与索引（相对地址，在各镜像上展开）
+    pkg_data = malloc(TEST_PKG_SIZE);
+    if (!pkg_data)
+        return 1;
+    unsigned seed = 12345;
+    for (size_t i = 0; i < TEST_PKG_SIZE; i++) {
+        seed = seed * 1103515245u + 12345u;
+        pkg_data[i] = (unsigned char)(seed >> 16);
+    }
+    char *hash = sha256_mem(pkg_data, TEST_PKG_SIZE);
+    if (!hash)
+        return 1;
+    snprintf(index_text, sizeof(index_text), "demo|1.0|demo-1.0.cpk|%s\n", hash);
+    free(hash);
+
+    Test_Server fast, slow, stalled, refused;
+    if (server_start(&fast, 0, TEST_PKG_SIZE / 3, 1) != 0 ||
+        server_start(&slow, TEST_SLOW_MS, 0, 1) != 0 ||
+        server_start(&stalled, 0, 0, 0) != 0 ||
+        server_start(&refused, 0, 0, 0) != 0) {
+        perror("test_mirror: listen");
+        return 1;
+    }
+    close(refused.fd);  // 端口关闭后连接被拒绝
+    refused.fd = -1;
+
+    // 配置顺序与期望的排序相反，确保排序确实来自测速
+    char mirrors[512], index_url[128];
+    snprintf(mirrors, sizeof(mirrors),
+             "http://127.0.0.1:%d,http://127.0.0.1:%d,http://127.0.0.1:%d,http://127.0.0.1:%d",
+             refused.port, stalled.port, slow.port, fast.port);
+    snprintf(index_url, sizeof(index_url), "http://127.0.0.1:%d/%s", fast.port, MIRROR_DEFAULT_INDEX);
+    setenv("CPKG_MIRRORS", mirrors, 1);
+    setenv("CPKG_INDEX_URL", index_url, 1);
+
+    // 1. 测速排序
+    const Mirror_List *list = mirror_default();
+    CHECK(list && list->count == 4, "four mirrors configured");
+    if (!list || list->count != 4)
+        return 1;
+    int r_fast = mirror_rank(list, fast.port), r_slow = mirror_rank(list, slow.port);
+    int r_stalled = mirror_rank(list, stalled.port), r_refused = mirror_rank(list, refused.port);
+    CHECK(r_fast == 0, "fast mirror ranks first");
+    CHECK(r_slow == 1, "slow mirror ranks second");
+    CHECK(r_stalled >= 2 && list->mirrors[r_stalled].score_ms >= MIRROR_DEAD_SCORE,
+          "stalled mirror is ranked unreachable");
+    CHECK(r_refused >= 2 && list->mirrors[r_refused].score_ms >= MIRROR_DEAD_SCORE,
+          "refused mirror is ranked unreachable");
+
+    // 2. 下载中途断开时换到下一个镜像并续传
+    const char *names[] = { "demo" };
+    const char *dests[] = { "demo-1.0.cpk" };
+    CHECK(repo_fetch_packages(names, dests, 1, 1) == 0, "fetch succeeds despite the fast mirror dropping");
+    CHECK(file_matches(dests[0]), "fetched file matches the package");
+    CHECK(__atomic_load_n(&fast.pkg_requests, __ATOMIC_SEQ_CST) >= 1, "download started on the fast mirror");
+    CHECK(__atomic_load_n(&slow.pkg_requests, __ATOMIC_SEQ_CST) >= 1, "download failed over to the slow mirror");
+    CHECK(__atomic_load_n(&slow.range_start, __ATOMIC_SEQ_CST) > 0,
+          "slow mirror resumed mid-transfer with a Range request");
+
+    server_stop(&fast);
+    server_stop(&slow);
+    server_stop(&stalled);
+    free(pkg_data);
+    if (chdir("/") == 0)
+        rm_rf(work);
+    if (failures) {
+        printf("test_mirror: %d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_mirror: all checks passed\n");
+    return 0;
+}